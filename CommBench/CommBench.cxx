@@ -0,0 +1,474 @@
+#include "SerialDevice.h"
+#include "SerialTransport.h"
+#include "SerialResult.h"
+#include "Messages.h"
+#include "Crc16.h"
+#include "ParserBench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*****************************************************************************/
+/*                                  DEFINES                                  */
+/*****************************************************************************/
+
+#define ITEM_COUNT(_a) (sizeof(_a) / sizeof(_a[0]))
+
+/** Baud rate used to convert resync distances (in bytes) into time */
+#define RESYNC_BAUD_RATE 115200
+/** Bits on the wire per byte (start bit + 8 data bits + stop bit) */
+#define BITS_PER_BYTE 10
+
+/** Number of frames in each corruption-injection trial */
+#define RESYNC_STREAM_FRAMES 16
+/** Index of the frame that gets corrupted in each trial */
+#define RESYNC_CORRUPT_FRAME 4
+
+/** Size of each synthetic stream in the parser benchmark */
+#define PARSER_STREAM_SIZE (1024 * 1024)
+
+/** Bytes of data run through each CRC-16 variant per length */
+#define CRC_BENCH_BYTES (64 * 1024 * 1024)
+
+/*****************************************************************************/
+/*                                  TYPEDEFS                                 */
+/*****************************************************************************/
+
+/**
+ * @class BufferDevice
+ *
+ * @brief SerialDevice backed by an in-memory buffer
+ *
+ * Everything written to the device is appended to the buffer, and reads consume the
+ * buffer from the front. Reads return at most read_chunk bytes at a time so the position
+ * of the reader is known exactly when a frame completes.
+ */
+class BufferDevice : public SerialDevice
+{
+    public:
+        vector<uint8_t> data;
+        size_t read_pos = 0;
+        uint32_t read_chunk = UINT32_MAX;
+
+        void clear()
+        {
+            this->data.clear();
+            this->read_pos = 0;
+        }
+
+        bool ser_connect(SerialBaudRate baud_rate) { return true; }
+        bool ser_set_baud_rate(SerialBaudRate baud_rate) { return true; }
+        void ser_flush() { this->read_pos = this->data.size(); }
+        uint32_t ser_available() { return (uint32_t)(this->data.size() - this->read_pos); }
+
+        bool ser_read(uint8_t *out)
+        {
+            return (this->ser_read_bulk(out, 1) == 1);
+        }
+
+        uint32_t ser_read_bulk(uint8_t *buf, uint32_t max_length)
+        {
+            uint32_t length = this->ser_available();
+            if (length > max_length) length = max_length;
+            if (length > this->read_chunk) length = this->read_chunk;
+            memcpy(buf, &this->data[this->read_pos], length);
+            this->read_pos += length;
+            return length;
+        }
+
+        bool ser_wait(uint32_t timeout_ms) { return (this->ser_available() > 0); }
+
+        bool ser_write(uint8_t *data, uint32_t length)
+        {
+            this->data.insert(this->data.end(), data, data + length);
+            return true;
+        }
+
+        bool ser_writev(const SerialIOVec *iov, uint32_t count)
+        {
+            for (uint32_t i = 0; i < count; i++) {
+                if (iov[i].length > 0) this->ser_write(iov[i].data, iov[i].length);
+            }
+            return true;
+        }
+
+        void ser_disconnect() {}
+
+        uint64_t platform_millis()
+        {
+            return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+        }
+};
+
+typedef enum {
+    CORRUPT_DROP,   //!< A byte is lost
+    CORRUPT_FLIP,   //!< A byte is received with the wrong value
+    CORRUPT_INSERT  //!< A spurious byte is received
+} CorruptionType;
+
+typedef struct {
+    uint8_t id;
+    vector<uint8_t> payload;
+    size_t start; //!< Offset of the first byte of the frame in the encoded stream
+} SentFrame;
+
+/*****************************************************************************/
+/*                                  GLOBALS                                  */
+/*****************************************************************************/
+
+const SerialFraming framings[] = { SERIAL_FRAMING_DELIMITED, SERIAL_FRAMING_COBS };
+const CorruptionType corruptions[] = { CORRUPT_DROP, CORRUPT_FLIP, CORRUPT_INSERT };
+
+mt19937 rng(1);
+
+/*****************************************************************************/
+/*                                  HELPERS                                  */
+/*****************************************************************************/
+
+const char *framing_name(SerialFraming framing)
+{
+    return (framing == SERIAL_FRAMING_COBS ? "cobs" : "delimited");
+}
+
+const char *corruption_name(CorruptionType type)
+{
+    switch (type) {
+        case CORRUPT_DROP: return "drop";
+        case CORRUPT_FLIP: return "flip";
+        default:           return "insert";
+    }
+}
+
+double seconds_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+uint8_t random_byte()
+{
+    return (uint8_t)(rng() & 0xFF);
+}
+
+/**
+ * @brief Reference CRC-16 a bit at a time (@see Crc16.h)
+ */
+uint16_t crc16_bitwise(uint16_t crc, const uint8_t *data, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)(data[i] << 8);
+        for (int bit = 0; bit < 8; bit++) crc = crc16_shift(crc);
+    }
+    return crc;
+}
+
+/**
+ * @brief CRC-16 a byte (one table lookup) at a time (@see Crc16.h)
+ */
+uint16_t crc16_bytewise(uint16_t crc, const uint8_t *data, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        crc = crc16_update(crc, data[i]);
+    }
+    return crc;
+}
+
+/**
+ * @brief CRC-16 four bytes at a time, as the protocol computes it (@see Crc16.h)
+ */
+uint16_t crc16_slice4(uint16_t crc, const uint8_t *data, uint32_t length)
+{
+    return crc16_update(crc, data, length);
+}
+
+/*****************************************************************************/
+/*                                 BENCHMARKS                                */
+/*****************************************************************************/
+
+/**
+ * @brief Measures how fast frames of a fixed size can be encoded and parsed
+ *
+ * Frames have random content, so the delimiter bytes (and zeros for COBS) appear in the
+ * payload at their natural rate.
+ */
+void bench_throughput(SerialFraming framing, uint8_t length, uint32_t frame_count)
+{
+    BufferDevice device;
+    SerialTransport tx(device);
+    SerialTransport rx(device);
+    tx.set_framing(framing);
+    rx.set_framing(framing);
+
+    uint8_t payload[MSG_DATA_LENGTH_MAX];
+    for (uint32_t i = 0; i < length; i++) payload[i] = random_byte();
+
+    Message msg = { .id = MSG_ID_ECHO, .length = length, .data = payload };
+
+    device.data.reserve((size_t)frame_count * (COBS_ENCODED_LENGTH_MAX(MSG_FRAME_LENGTH_MAX) + 1));
+    auto start = chrono::steady_clock::now();
+    for (uint32_t i = 0; i < frame_count; i++) {
+        tx.send_message(msg);
+    }
+    double encode_s = seconds_since(start);
+    size_t wire_bytes = device.data.size();
+
+    uint8_t rx_data[MSG_DATA_LENGTH_MAX];
+    Message rx_msg = { .id = 0, .length = 0, .data = rx_data };
+    uint32_t received = 0;
+
+    start = chrono::steady_clock::now();
+    while (rx.check_for_message(rx_msg) == SERIAL_OK) received++;
+    double decode_s = seconds_since(start);
+
+    double payload_mb = ((double)length * frame_count) / 1e6;
+    printf("%-10s %4u %10.1f %10.1f %12.0f %10.2f %s\n",
+           framing_name(framing), length,
+           (length > 0 ? payload_mb / encode_s : 0.0),
+           (length > 0 ? payload_mb / decode_s : 0.0),
+           received / decode_s,
+           (double)wire_bytes / frame_count - length,
+           (received == frame_count ? "" : "(frames lost!)"));
+}
+
+/**
+ * @brief Encodes a stream of random frames, corrupts one of them, and measures how long
+ *        the receiver takes to get back in sync
+ *
+ * Resync distance is the number of bytes from the corrupted byte to the start of the first
+ * later frame that is received intact. Frames are delivered to the receiver one byte at a
+ * time so the distance can be measured exactly.
+ */
+void bench_resync(SerialFraming framing, CorruptionType type, uint32_t trials)
+{
+    BufferDevice device;
+    device.read_chunk = 1;
+
+    uint64_t total_bytes = 0;
+    uint64_t total_lost = 0;
+    uint32_t false_frames = 0;
+    uint32_t never_resynced = 0;
+
+    for (uint32_t trial = 0; trial < trials; trial++) {
+        SerialTransport tx(device);
+        SerialTransport rx(device);
+        tx.set_framing(framing);
+        rx.set_framing(framing);
+        device.clear();
+
+        // Random frames, the first two payload bytes hold the frame index
+        vector<SentFrame> frames(RESYNC_STREAM_FRAMES);
+        for (uint32_t i = 0; i < frames.size(); i++) {
+            SentFrame& frame = frames[i];
+            frame.id = random_byte();
+            frame.payload.resize(2 + rng() % 63);
+            frame.payload[0] = (uint8_t)(i >> 8);
+            frame.payload[1] = (uint8_t)(i >> 0);
+            for (size_t j = 2; j < frame.payload.size(); j++) frame.payload[j] = random_byte();
+            frame.start = device.data.size();
+
+            Message msg = { .id = frame.id, .length = (uint8_t)frame.payload.size(), .data = frame.payload.data() };
+            tx.send_message(msg);
+        }
+
+        // Corrupt a random byte of one frame (including its delimiters)
+        size_t frame_end = frames[RESYNC_CORRUPT_FRAME + 1].start;
+        size_t pos = frames[RESYNC_CORRUPT_FRAME].start + rng() % (frame_end - frames[RESYNC_CORRUPT_FRAME].start);
+        switch (type) {
+            case CORRUPT_DROP:
+                device.data.erase(device.data.begin() + pos);
+                for (size_t i = RESYNC_CORRUPT_FRAME + 1; i < frames.size(); i++) frames[i].start--;
+                break;
+            case CORRUPT_FLIP:
+                device.data[pos] ^= (uint8_t)(1 + rng() % 255);
+                break;
+            case CORRUPT_INSERT:
+                device.data.insert(device.data.begin() + pos, random_byte());
+                for (size_t i = RESYNC_CORRUPT_FRAME + 1; i < frames.size(); i++) frames[i].start++;
+                break;
+        }
+
+        uint8_t rx_data[MSG_DATA_LENGTH_MAX];
+        Message rx_msg = { .id = 0, .length = 0, .data = rx_data };
+        vector<bool> received(frames.size(), false);
+        bool resynced = false;
+
+        while (device.ser_available() > 0) {
+            if (rx.check_for_message(rx_msg) != SERIAL_OK) continue;
+
+            uint32_t index = (rx_msg.length >= 2 ? ((uint32_t)rx_data[0] << 8) | rx_data[1] : UINT32_MAX);
+            if (index >= frames.size() || rx_msg.id != frames[index].id ||
+                rx_msg.length != frames[index].payload.size() ||
+                memcmp(rx_data, frames[index].payload.data(), rx_msg.length) != 0) {
+                // Passed the CRC check but is not a frame that was sent
+                false_frames++;
+                continue;
+            }
+
+            received[index] = true;
+            if (!resynced && index > RESYNC_CORRUPT_FRAME) {
+                total_bytes += frames[index].start - pos;
+                resynced = true;
+            }
+        }
+
+        if (!resynced) never_resynced++;
+        for (size_t i = 0; i < frames.size(); i++) {
+            if (!received[i]) total_lost++;
+        }
+    }
+
+    uint32_t resynced = trials - never_resynced;
+    double mean_bytes = (resynced > 0 ? (double)total_bytes / resynced : 0.0);
+    printf("%-10s %-7s %10.1f %10.3f %12.2f %8u %8u\n",
+           framing_name(framing), corruption_name(type),
+           mean_bytes, mean_bytes * BITS_PER_BYTE * 1000.0 / RESYNC_BAUD_RATE,
+           (double)total_lost / trials, false_frames, never_resynced);
+}
+
+/**
+ * @brief Times the receive state machine on its own over one of the synthetic streams
+ *
+ * The stream is encoded once and parsed passes times by a fresh receiver, so only
+ * SerialTransport::check_for_message() is timed. The same streams can be cycle counted on
+ * the Due with the firmware's parser_bench environment.
+ */
+void bench_parser(SerialFraming framing, ParserStream stream, uint32_t passes)
+{
+    static uint8_t stream_buf[PARSER_STREAM_SIZE];
+    StreamDevice device(stream_buf, sizeof(stream_buf));
+    uint32_t frames = parser_stream_build(stream, framing, device);
+
+    uint32_t received = 0;
+    auto start = chrono::steady_clock::now();
+    for (uint32_t i = 0; i < passes; i++) {
+        received = parser_stream_parse(stream, framing, device);
+    }
+    double parse_s = seconds_since(start);
+
+    double bytes = (double)device.bytes() * passes;
+    printf("%-10s %-8s %10.2f %10.1f %12.0f %10u %10u\n",
+           framing_name(framing), parser_stream_name(stream),
+           parse_s * 1e9 / bytes, bytes / 1e6 / parse_s, (double)received * passes / parse_s,
+           frames, received);
+}
+
+/**
+ * @brief Times each CRC-16 variant over buffers of one length
+ *
+ * The CRC of one buffer seeds the next, so the calls cannot overlap or be optimized away.
+ * The bitwise variant runs over a tenth of the data.
+ */
+void bench_crc(uint32_t length, uint32_t total_bytes)
+{
+    typedef uint16_t (*CrcFunction)(uint16_t crc, const uint8_t *data, uint32_t length);
+    const CrcFunction variants[] = { crc16_bitwise, crc16_bytewise, crc16_slice4 };
+
+    vector<uint8_t> data(length);
+    for (uint32_t i = 0; i < length; i++) data[i] = random_byte();
+
+    double ns_per_byte[ITEM_COUNT(variants)];
+    uint16_t results[ITEM_COUNT(variants)];
+    for (uint32_t v = 0; v < ITEM_COUNT(variants); v++) {
+        uint32_t reps = total_bytes / length / (variants[v] == crc16_bitwise ? 10 : 1);
+        if (reps == 0) reps = 1;
+
+        uint16_t crc = CRC16_INIT;
+        auto start = chrono::steady_clock::now();
+        for (uint32_t i = 0; i < reps; i++) {
+            crc = variants[v](crc, data.data(), length);
+        }
+        ns_per_byte[v] = seconds_since(start) * 1e9 / ((double)reps * length);
+        results[v] = variants[v](CRC16_INIT, data.data(), length);
+        (void)crc;
+    }
+
+    bool match = (results[0] == results[1] && results[1] == results[2]);
+    printf("%6u %10.2f %10.2f %10.2f %10.2f %s\n",
+           length, ns_per_byte[0], ns_per_byte[1], ns_per_byte[2], ns_per_byte[1] / ns_per_byte[2],
+           (match ? "" : "(mismatch!)"));
+}
+
+/*****************************************************************************/
+/*                                    MAIN                                   */
+/*****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+    string test = (argc > 1 ? argv[1] : "all");
+    uint32_t count = (argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 0) : 0);
+
+    if (test != "all" && test != "throughput" && test != "resync" && test != "parser" && test != "crc") {
+        printf("\nusage: %s [all | throughput | resync | parser | crc] [count]\n\n", argv[0]);
+        printf("    throughput : encode / parse rate for each framing (count = frames per size)\n");
+        printf("    resync     : corruption injection, mean time to resync (count = trials per case)\n");
+        printf("    parser     : receive state machine over synthetic streams (count = passes per stream)\n");
+        printf("    crc        : CRC-16 bitwise, table and slice-by-4 (count = MB per length)\n\n");
+        return 0;
+    }
+
+    if (test == "all" || test == "throughput") {
+        const uint8_t lengths[] = { 0, 16, 64, MSG_DATA_LENGTH_MAX };
+        uint32_t frame_count = (count > 0 ? count : 200000);
+
+        printf("Throughput (%u frames per size)\n", frame_count);
+        printf("%-10s %4s %10s %10s %12s %10s\n", "framing", "len", "enc MB/s", "dec MB/s", "dec frame/s", "overhead");
+        for (uint32_t f = 0; f < ITEM_COUNT(framings); f++) {
+            for (uint32_t l = 0; l < ITEM_COUNT(lengths); l++) {
+                bench_throughput(framings[f], lengths[l], frame_count);
+            }
+        }
+        printf("\n");
+    }
+
+    if (test == "all" || test == "parser") {
+        uint32_t passes = (count > 0 ? count : 20);
+
+        printf("Receive state machine (%u passes over %u byte streams)\n", passes, PARSER_STREAM_SIZE);
+        printf("%-10s %-8s %10s %10s %12s %10s %10s\n",
+               "framing", "stream", "ns/byte", "MB/s", "frames/s", "frames", "received");
+        for (uint32_t f = 0; f < ITEM_COUNT(framings); f++) {
+            for (int s = 0; s < PARSER_STREAM_COUNT; s++) {
+                bench_parser(framings[f], (ParserStream)s, passes);
+            }
+        }
+        printf("\n");
+    }
+
+    if (test == "all" || test == "crc") {
+        const uint32_t lengths[] = { 4, 16, 64, MSG_DATA_LENGTH_MAX, 4096 };
+        uint32_t total_bytes = (count > 0 ? count * 1024 * 1024 : CRC_BENCH_BYTES);
+
+        const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+        printf("CRC-16 ns/byte (%u MB per length, check value 0x%04X)\n", total_bytes / (1024 * 1024),
+               crc16_update(CRC16_INIT, check, sizeof(check)));
+        printf("%6s %10s %10s %10s %10s\n", "len", "bitwise", "table", "slice-4", "speedup");
+        for (uint32_t l = 0; l < ITEM_COUNT(lengths); l++) {
+            bench_crc(lengths[l], total_bytes);
+        }
+        printf("\n");
+    }
+
+    if (test == "all" || test == "resync") {
+        uint32_t trials = (count > 0 ? count : 20000);
+
+        printf("Resync after a single corrupted byte (%u trials per case, %u frames per trial)\n",
+               trials, RESYNC_STREAM_FRAMES);
+        printf("%-10s %-7s %10s %10s %12s %8s %8s\n",
+               "framing", "error", "bytes", "ms@115200", "frames lost", "false", "stuck");
+        for (uint32_t f = 0; f < ITEM_COUNT(framings); f++) {
+            for (uint32_t c = 0; c < ITEM_COUNT(corruptions); c++) {
+                bench_resync(framings[f], corruptions[c], trials);
+            }
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,421 @@
+#include "LinuxSerialDevice.h"
+#include "LoopbackSerialDevice.h"
+#include "FrameCapture.h"
+#include "TestStandComm.h"
+
+#include "SerialResult.h"
+#include "Messages.h"
+
+#include "shared_defs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*****************************************************************************/
+/*                                  DEFINES                                  */
+/*****************************************************************************/
+
+#define ITEM_COUNT(_a) (sizeof(_a) / sizeof(_a[0]))
+
+/** Time to wait for a reply before counting an exchange as failed (milliseconds) */
+#define BENCH_TIMEOUT_MS 1000
+
+/*****************************************************************************/
+/*                                  TYPEDEFS                                 */
+/*****************************************************************************/
+
+typedef enum {
+    FORMAT_TEXT,
+    FORMAT_CSV,
+    FORMAT_JSON
+} OutputFormat;
+
+typedef struct {
+    vector<SerialBaudRate> baud_rates;
+    uint32_t count;         //!< Exchanges per ping / link_check test
+    uint32_t sweep_count;   //!< Exchanges per payload size in the echo sweep
+    uint8_t window_size;    //!< Window size to negotiate (0 for stop-and-wait)
+    bool cobs;              //!< Negotiate COBS framing
+    OutputFormat format;
+    const char *capture_file; //!< Where to capture the frames of the host end (nullptr for none)
+    LoopbackConfig loopback;
+} BenchOptions;
+
+/**
+ * @struct BenchResult
+ *
+ * @brief Results of one test at one baud rate
+ *
+ * Frames are the data frames of an exchange (request and reply, not ACKs) and payload
+ * bytes are counted in both directions. The pipelined tests time a batch of exchanges at a
+ * time, so their latencies are those of the whole batch.
+ */
+typedef struct {
+    uint32_t baud_rate;
+    string test;
+    uint32_t payload;       //!< Payload length of the request
+    uint32_t samples;       //!< Exchanges (or batches of them) that completed
+    uint32_t failures;      //!< Exchanges (or batches of them) that returned an error
+    double p50_us;
+    double p99_us;
+    double p999_us;
+    double exchanges_per_s;
+    double frames_per_s;
+    double bytes_per_s;
+} BenchResult;
+
+/**
+ * @class BenchComm
+ *
+ * @brief Host end of the link, which can also send a PING without waiting for its ACK
+ */
+class BenchComm : public TestStandComm
+{
+    public:
+        BenchComm(SerialDevice& device) : TestStandComm(device) {}
+
+        SerialResult send_ping()
+        {
+            return this->send_basic_msg(MSG_ID_PING);
+        }
+};
+
+/*****************************************************************************/
+/*                                  GLOBALS                                  */
+/*****************************************************************************/
+
+BenchOptions options = {
+    .baud_rates = { SERIAL_BAUD_RATE },
+    .count = 1000,
+    .sweep_count = 20,
+    .window_size = SERIAL_WINDOW_MAX,
+    .cobs = true,
+    .format = FORMAT_TEXT,
+    .capture_file = nullptr,
+    .loopback = { .paced = true, .latency_us = 0, .bit_error_rate = 0.0, .seed = 1 }
+};
+
+vector<BenchResult> results;
+
+FrameCaptureWriter capture;
+
+/*****************************************************************************/
+/*                                  HELPERS                                  */
+/*****************************************************************************/
+
+double percentile(vector<double>& sorted, double p)
+{
+    if (sorted.empty()) return 0.0;
+    size_t index = (size_t)(p * sorted.size() + 0.999999);
+    if (index > 0) index--;
+    if (index >= sorted.size()) index = sorted.size() - 1;
+    return sorted[index];
+}
+
+/**
+ * @brief Times count exchanges and records the result
+ *
+ * @param batch    Exchanges done by each call of exchange
+ * @param exchange Performs one exchange (or batch of them), returns its SerialResult
+ */
+template <typename F>
+void run_test(uint32_t baud_rate, const char *test, uint32_t payload, uint32_t frames, uint32_t batch, uint32_t count, F exchange)
+{
+    vector<double> rtt_us;
+    rtt_us.reserve(count);
+    uint32_t failures = 0;
+
+    auto test_start = chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; i++) {
+        auto start = chrono::steady_clock::now();
+        SerialResult res = exchange();
+        auto end = chrono::steady_clock::now();
+        if (res != SERIAL_OK) {
+            failures++;
+            continue;
+        }
+        rtt_us.push_back(chrono::duration<double, micro>(end - start).count());
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - test_start).count();
+
+    sort(rtt_us.begin(), rtt_us.end());
+    BenchResult result = {
+        .baud_rate = baud_rate,
+        .test = test,
+        .payload = payload,
+        .samples = (uint32_t)rtt_us.size(),
+        .failures = failures,
+        .p50_us = percentile(rtt_us, 0.50),
+        .p99_us = percentile(rtt_us, 0.99),
+        .p999_us = percentile(rtt_us, 0.999),
+        .exchanges_per_s = (rtt_us.size() * batch) / elapsed,
+        .frames_per_s = (rtt_us.size() * batch * frames) / elapsed,
+        .bytes_per_s = (rtt_us.size() * batch * 2.0 * payload) / elapsed
+    };
+    results.push_back(result);
+
+    if (options.format == FORMAT_TEXT) {
+        printf("%8u %-10s %4u %7u %5u %10.1f %10.1f %10.1f %10.0f %10.0f %10.0f\n",
+               result.baud_rate, result.test.c_str(), result.payload, result.samples, result.failures,
+               result.p50_us, result.p99_us, result.p999_us, result.exchanges_per_s, result.frames_per_s,
+               result.bytes_per_s);
+        fflush(stdout);
+    }
+}
+
+void print_results()
+{
+    if (options.format == FORMAT_CSV) {
+        printf("baud_rate,test,payload,samples,failures,p50_us,p99_us,p999_us,exchanges_per_s,frames_per_s,payload_bytes_per_s\n");
+        for (const BenchResult& r : results) {
+            printf("%u,%s,%u,%u,%u,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+                   r.baud_rate, r.test.c_str(), r.payload, r.samples, r.failures,
+                   r.p50_us, r.p99_us, r.p999_us, r.exchanges_per_s, r.frames_per_s, r.bytes_per_s);
+        }
+    }
+    else if (options.format == FORMAT_JSON) {
+        printf("[\n");
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult& r = results[i];
+            printf("  {\"baud_rate\": %u, \"test\": \"%s\", \"payload\": %u, \"samples\": %u, \"failures\": %u, "
+                   "\"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, \"exchanges_per_s\": %.1f, "
+                   "\"frames_per_s\": %.1f, \"payload_bytes_per_s\": %.1f}%s\n",
+                   r.baud_rate, r.test.c_str(), r.payload, r.samples, r.failures,
+                   r.p50_us, r.p99_us, r.p999_us, r.exchanges_per_s, r.frames_per_s, r.bytes_per_s,
+                   (i + 1 < results.size() ? "," : ""));
+        }
+        printf("]\n");
+    }
+}
+
+/*****************************************************************************/
+/*                                 BENCHMARKS                                */
+/*****************************************************************************/
+
+/**
+ * @brief Runs every test at the baud rate the link is currently at
+ */
+void bench_link(BenchComm& comm)
+{
+    uint32_t baud_rate = comm.baud_rate();
+    uint8_t payload[MSG_DATA_LENGTH_MAX];
+    for (uint32_t i = 0; i < MSG_DATA_LENGTH_MAX; i++) payload[i] = (uint8_t)i;
+
+    // PING and its ACK
+    run_test(baud_rate, "ping", 0, 1, 1, options.count, [&]() {
+        SerialResult res = comm.ping();
+        if (res != SERIAL_OK) return res;
+        return comm.wait_acked();
+    });
+
+    // ECHO / ECHOED of every payload size
+    for (uint32_t length = 0; length <= MSG_DATA_LENGTH_MAX; length++) {
+        run_test(baud_rate, "echo", length, 2, 1, options.sweep_count, [&]() {
+            SerialResult res = comm.echo(payload, (uint8_t)length);
+            if (res != SERIAL_OK) return res;
+            return comm.recv_message(MSG_ID_ECHOED, (uint8_t)length, BENCH_TIMEOUT_MS);
+        });
+    }
+
+    // Full size ECHO with the data verified
+    run_test(baud_rate, "link_check", MSG_DATA_LENGTH_MAX, 2, 1, options.count, [&]() {
+        return comm.link_check(BENCH_TIMEOUT_MS);
+    });
+
+    // The same with as many exchanges in flight as the window allows (one on a stop-and-wait link)
+    uint32_t depth = (comm.window_size() > 0 ? comm.window_size() : 1);
+    uint32_t batches = (options.count + depth - 1) / depth;
+
+    run_test(baud_rate, "ping_pipe", 0, 1, depth, batches, [&]() {
+        for (uint32_t i = 0; i < depth; i++) {
+            SerialResult res = comm.send_ping();
+            if (res != SERIAL_OK) return res;
+        }
+        return comm.wait_acked();
+    });
+
+    run_test(baud_rate, "lc_pipe", MSG_DATA_LENGTH_MAX, 2, depth, batches, [&]() {
+        for (uint32_t i = 0; i < depth; i++) {
+            SerialResult res = comm.echo(payload, MSG_DATA_LENGTH_MAX);
+            if (res != SERIAL_OK) return res;
+        }
+        for (uint32_t i = 0; i < depth; i++) {
+            SerialResult res = comm.recv_message(MSG_ID_ECHOED, MSG_DATA_LENGTH_MAX, BENCH_TIMEOUT_MS);
+            if (res != SERIAL_OK) return res;
+            if (memcmp(comm.received_message().data, payload, MSG_DATA_LENGTH_MAX) != 0) return SERIAL_ERR_DATA_CORRUPT;
+        }
+        return SERIAL_OK;
+    });
+}
+
+/**
+ * @brief Switches the link to a baud rate and runs the tests at it
+ *
+ * @return false if the link could not be switched
+ */
+bool bench_baud_rate(BenchComm& comm, SerialBaudRate baud_rate)
+{
+    uint8_t features = (options.cobs ? LINK_FEATURES_SUPPORTED : LINK_FEATURES_SUPPORTED & ~LINK_FEATURE_COBS);
+
+    // Baud rate changes are only done on a stop-and-wait link
+    SerialResult res = comm.negotiate(0, 0, BENCH_TIMEOUT_MS);
+    if (res == SERIAL_OK) res = comm.change_baud_rate(baud_rate, BENCH_TIMEOUT_MS);
+    if (res == SERIAL_OK) res = comm.negotiate(features, options.window_size, BENCH_TIMEOUT_MS);
+    if (res != SERIAL_OK) {
+        fprintf(stderr, "Could not switch to %u baud: %d\n", baud_rate, res);
+        return false;
+    }
+
+    bench_link(comm);
+    return true;
+}
+
+/**
+ * @brief Answers the requests of the benchmark, standing in for the firmware
+ */
+void loopback_controller(TestStandComm& comm, atomic<bool>& stop)
+{
+    while (!stop) {
+        if (comm.check_for_message() != SERIAL_OK) {
+            // Frames already read behind an ACK are processed right away
+            comm.wait(1);
+            continue;
+        }
+
+        switch (comm.received_message().id) {
+            case MSG_ID_ECHO:           comm.recv_echo();             break;
+            case MSG_ID_NEGOTIATE:      comm.recv_negotiate();        break;
+            case MSG_ID_CHANGE_BAUD:    comm.recv_change_baud_rate(); break;
+            case MSG_ID_GET_LINK_STATS: comm.recv_get_link_stats();   break;
+            default:                                                  break;
+        }
+    }
+}
+
+/*****************************************************************************/
+/*                                    MAIN                                   */
+/*****************************************************************************/
+
+void print_usage(const char *name)
+{
+    printf("\nusage: %s [options] <loopback | serial device file>\n\n", name);
+    printf("    -b <rates>  comma separated baud rates to test (default %d)\n", SERIAL_BAUD_RATE);
+    printf("    -n <count>  exchanges per ping / link_check test (default %u)\n", options.count);
+    printf("    -s <count>  exchanges per payload size in the echo sweep (default %u)\n", options.sweep_count);
+    printf("    -w <size>   window size to negotiate, 0 for stop-and-wait (default %u)\n", options.window_size);
+    printf("    -d          use delimited framing rather than COBS\n");
+    printf("    -f <format> output format: text, csv or json (default text)\n");
+    printf("    -c <file>   capture the frames of the host end to a file (@see Replay)\n");
+    printf("\n  loopback only:\n");
+    printf("    -u          do not pace the data at the baud rate\n");
+    printf("    -l <us>     one-way latency in microseconds (default 0)\n");
+    printf("    -e <rate>   bit error rate (default 0)\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "b:n:s:w:df:c:ul:e:")) != -1) {
+        switch (opt) {
+            case 'b': {
+                options.baud_rates.clear();
+                istringstream iss(optarg);
+                string rate;
+                while (getline(iss, rate, ',')) {
+                    options.baud_rates.push_back((SerialBaudRate)strtoul(rate.c_str(), nullptr, 0));
+                }
+                break;
+            }
+            case 'n': options.count = strtoul(optarg, nullptr, 0);                         break;
+            case 's': options.sweep_count = strtoul(optarg, nullptr, 0);                   break;
+            case 'w': options.window_size = (uint8_t)strtoul(optarg, nullptr, 0);          break;
+            case 'd': options.cobs = false;                                                break;
+            case 'c': options.capture_file = optarg;                                       break;
+            case 'u': options.loopback.paced = false;                                      break;
+            case 'l': options.loopback.latency_us = strtoul(optarg, nullptr, 0);           break;
+            case 'e': options.loopback.bit_error_rate = strtod(optarg, nullptr);           break;
+            case 'f':
+                if (strcmp(optarg, "csv") == 0)       options.format = FORMAT_CSV;
+                else if (strcmp(optarg, "json") == 0) options.format = FORMAT_JSON;
+                else                                  options.format = FORMAT_TEXT;
+                break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (options.capture_file != nullptr && !capture.open(options.capture_file)) {
+        fprintf(stderr, "Could not create capture file %s\n", options.capture_file);
+        return 1;
+    }
+
+    if (options.format == FORMAT_TEXT) {
+        printf("%8s %-10s %4s %7s %5s %10s %10s %10s %10s %10s %10s\n",
+               "baud", "test", "len", "samples", "fail", "p50 us", "p99 us", "p999 us", "xchg/s", "frames/s", "bytes/s");
+    }
+
+    bool ok = true;
+    string target = argv[optind];
+    if (target == "loopback") {
+        LoopbackSerialPair pair(options.loopback);
+        BenchComm host(pair.host);
+        TestStandComm controller(pair.controller);
+        if (capture.is_open()) host.set_capture(&capture);
+        host.connect(SERIAL_BAUD_RATE);
+        controller.connect(SERIAL_BAUD_RATE);
+
+        atomic<bool> stop(false);
+        thread controller_thread(loopback_controller, ref(controller), ref(stop));
+
+        for (size_t i = 0; i < options.baud_rates.size() && ok; i++) {
+            ok = bench_baud_rate(host, options.baud_rates[i]);
+        }
+
+        stop = true;
+        controller_thread.join();
+    }
+    else {
+        LinuxSerialDevice device;
+        BenchComm comm(device);
+        if (capture.is_open()) comm.set_capture(&capture);
+        device.set_device_file(target.c_str());
+        if (!comm.connect(SERIAL_BAUD_RATE)) return 1;
+        comm.flush();
+
+        fprintf(stderr, "Waiting for Arduino...");
+        while (comm.recv_message(MSG_ID_PING, 0, comm.reply_timeout()) != SERIAL_OK);
+        comm.flush();
+        fprintf(stderr, "Connected!\n");
+
+        for (size_t i = 0; i < options.baud_rates.size() && ok; i++) {
+            ok = bench_baud_rate(comm, options.baud_rates[i]);
+        }
+
+        device.ser_disconnect();
+    }
+
+    if (capture.is_open()) {
+        fprintf(stderr, "Captured %u frames (%u dropped) to %s\n", capture.records(), capture.dropped(), options.capture_file);
+        capture.close();
+    }
+
+    print_results();
+    return (ok ? 0 : 1);
+}
@@ -7,11 +7,17 @@
 
 #include "shared_defs.h"
 #include "TestStandMessages.h"
+#include "BinaryLog.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <iostream>
 #include <sstream>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
@@ -34,6 +40,11 @@ bool _name(istringstream& iss)               \
 
 #define ITEM_COUNT(_a) (sizeof(_a) / sizeof(_a[0]))
 
+/** File in the home directory the fastest baud rate found is kept in between runs */
+#ifndef BAUD_RATE_FILE
+#define BAUD_RATE_FILE ".mpmt_baud_rate"
+#endif // BAUD_RATE_FILE
+
 /*****************************************************************************/
 /*                                  TYPEDEFS                                 */
 /*****************************************************************************/
@@ -59,8 +70,13 @@ typedef enum {
     CMD_ID_GET_POSITION,
     CMD_ID_GET_TEMP,
     CMD_ID_GET_AXIS_STATE,
+    CMD_ID_GET_SNAPSHOT,
+    CMD_ID_TELEMETRY,
+    CMD_ID_POSITIONS,
     // General commands
     CMD_ID_LINK_CHECK,
+    CMD_ID_LINK_BENCH,
+    CMD_ID_LINK_STATS,
     CMD_ID_RESET,
     CMD_ID_HELP,
     CMD_ID_EXIT
@@ -118,7 +134,7 @@ bool move(istringstream& iss)
         iss >> dist;
 
         AxisResult axis_res;
-        SerialResult res = comm.move(axis, dir, vel_hold, dist, &axis_res, MSG_RECEIVE_TIMEOUT_MS);
+        SerialResult res = comm.move(axis, dir, vel_hold, dist, &axis_res, comm.reply_timeout());
         if (res == SERIAL_OK) {
             switch (axis_res) {
                 case AXIS_OK:                 puts("AXIS_OK"); break;
@@ -144,7 +160,7 @@ bool move(istringstream& iss)
 bool get_status(istringstream& iss)
 {
     Status status;
-    SerialResult res = comm.get_status(&status, MSG_RECEIVE_TIMEOUT_MS);
+    SerialResult res = comm.get_status(&status, comm.reply_timeout());
     if (res == SERIAL_OK) {
         switch (status) {
             case STATUS_IDLE:   puts("Status: IDLE"); break;
@@ -163,7 +179,7 @@ bool get_status(istringstream& iss)
 bool get_position(istringstream& iss)
 {
     PositionMsgData position;
-    SerialResult res = comm.get_position(&position, MSG_RECEIVE_TIMEOUT_MS);
+    SerialResult res = comm.get_position(&position, comm.reply_timeout());
     if (res == SERIAL_OK) {
         printf("Position (counts): (%d, %d)\n", position.x_counts, position.y_counts);
     }
@@ -176,7 +192,7 @@ bool get_position(istringstream& iss)
 bool get_temp(istringstream& iss)
 {
     TempData temp_data;
-    SerialResult res = comm.get_temp(&temp_data, MSG_RECEIVE_TIMEOUT_MS);
+    SerialResult res = comm.get_temp(&temp_data, comm.reply_timeout());
     if (res == SERIAL_OK) {
         printf("Ambient : %12f deg C\n", temp_data.temp_ambient);
         printf("Motor X : %12f deg C\n", temp_data.temp_motor_x);
@@ -192,16 +208,42 @@ bool get_temp(istringstream& iss)
 
 bool get_axis_state(istringstream& iss)
 {
-    StateMsgData status_data;
-    SerialResult res = comm.get_axis_state(&status_data, MSG_RECEIVE_TIMEOUT_MS);
+    static const char *segment_names[] = { "ACCELERATE", "HOLD", "DECELERATE" };
+
+    AxisStateData state;
+    SerialResult res = comm.get_axis_state(&state, comm.reply_timeout());
     if (res == SERIAL_OK) {
-        printf("X axis moving : %i \n", status_data.x_motion);
-        printf("Y axis moving : %i\n", status_data.y_motion);
-        printf("X limit switch far : %i\n", status_data.x_ls_far);
-        printf("Y limit switch far : %i\n", status_data.y_ls_far);
-        printf("X limit switch home : %i\n", status_data.x_ls_home);
-        printf("Y limit switch home : %i\n", status_data.y_ls_home);
+        for (int axis = AXIS_X; axis <= AXIS_Y; axis++) {
+            uint8_t segment = state.axis[axis].velocity_segment;
+            printf("%c axis moving : %i\n", (axis == AXIS_X ? 'X' : 'Y'), state.axis[axis].moving);
+            printf("  limit switch far : %i\n", state.axis[axis].ls_far_pressed);
+            printf("  limit switch home : %i\n", state.axis[axis].ls_home_pressed);
+            printf("  velocity (steps/s) : %u (next %u)\n", state.axis[axis].velocity, state.axis[axis].next_velocity);
+            printf("  velocity segment : %s\n", (segment < 3 ? segment_names[segment] : "?"));
+            printf("  encoder target (counts) : %d\n", state.axis[axis].encoder_target);
+        }
+    }
+    else {
+        printf("ERROR: %d\n", res);
+    }
+    return true;
+}
 
+bool get_snapshot(istringstream& iss)
+{
+    Snapshot snapshot;
+    SerialResult res = comm.get_snapshot(&snapshot, comm.reply_timeout());
+    if (res == SERIAL_OK) {
+        printf("Status : %d\n", snapshot.status);
+        printf("Position (counts): (%d, %d)\n", snapshot.position.x_counts, snapshot.position.y_counts);
+        printf("Moving (x, y) : (%i, %i)\n", snapshot.axis_state.x_motion, snapshot.axis_state.y_motion);
+        printf("Limit switch far (x, y) : (%i, %i)\n", snapshot.axis_state.x_ls_far, snapshot.axis_state.y_ls_far);
+        printf("Limit switch home (x, y) : (%i, %i)\n", snapshot.axis_state.x_ls_home, snapshot.axis_state.y_ls_home);
+        printf("Ambient : %12f deg C\n", snapshot.temp.temp_ambient);
+        printf("Motor X : %12f deg C\n", snapshot.temp.temp_motor_x);
+        printf("Motor Y : %12f deg C\n", snapshot.temp.temp_motor_y);
+        printf("mPMT    : %12f deg C\n", snapshot.temp.temp_mpmt);
+        printf("Optical : %12f deg C\n", snapshot.temp.temp_optical);
     }
     else {
         printf("ERROR: %d\n", res);
@@ -209,11 +251,170 @@ bool get_axis_state(istringstream& iss)
     return true;
 }
 
+/**
+ * @class TelemetryPrinter
+ *
+ * @brief Prints every telemetry sample as it arrives
+ */
+class TelemetryPrinter : public TelemetryHandler
+{
+    public:
+        void telemetry(const TelemetryMsgData& data)
+        {
+            printf("%10.6f s  status %d  X %8d counts %6u steps/s seg %d %s%s%s  Y %8d counts %6u steps/s seg %d %s%s%s\n",
+                   data.time_us / 1e6, data.status,
+                   data.x_counts, data.x_velocity, data.x_velocity_segment,
+                   (data.flags & TELEMETRY_X_MOVING ? "M" : "-"),
+                   (data.flags & TELEMETRY_X_LS_HOME ? "H" : "-"),
+                   (data.flags & TELEMETRY_X_LS_FAR ? "F" : "-"),
+                   data.y_counts, data.y_velocity, data.y_velocity_segment,
+                   (data.flags & TELEMETRY_Y_MOVING ? "M" : "-"),
+                   (data.flags & TELEMETRY_Y_LS_HOME ? "H" : "-"),
+                   (data.flags & TELEMETRY_Y_LS_FAR ? "F" : "-"));
+        }
+};
+
+bool telemetry(istringstream& iss)
+{
+    uint32_t rate_hz = 0;
+    double seconds = 2.0;
+    iss >> rate_hz;
+    if (iss.good()) iss >> seconds;
+    if (iss.fail() || rate_hz == 0 || rate_hz > TELEMETRY_RATE_MAX || seconds <= 0) {
+        print_cmd_usage(CMD_ID_TELEMETRY);
+        return true;
+    }
+
+    TelemetryPrinter printer;
+    comm.set_telemetry_handler(&printer);
+    uint32_t received_start = comm.telemetry_received();
+
+    uint16_t rate_in_use;
+    SerialResult res = comm.subscribe_telemetry((uint16_t)rate_hz, &rate_in_use, comm.reply_timeout());
+    if (res == SERIAL_OK) {
+        auto time_start = chrono::steady_clock::now();
+        auto time_end = time_start + chrono::duration<double>(seconds);
+        while (chrono::steady_clock::now() < time_end && res == SERIAL_OK) {
+            res = comm.poll();
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        if (res == SERIAL_OK) res = comm.unsubscribe_telemetry(comm.reply_timeout());
+
+        uint32_t received = comm.telemetry_received() - received_start;
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - time_start).count();
+        printf("%u samples in %.3f s (%.1f Hz, asked for %u Hz)\n", received, elapsed, received / elapsed, rate_in_use);
+    }
+    comm.set_telemetry_handler(nullptr);
+
+    if (res == SERIAL_ERR_REJECTED) {
+        printf("ERROR: telemetry needs a windowed link\n");
+    }
+    else if (res != SERIAL_OK) {
+        printf("ERROR: %d\n", res);
+    }
+    return true;
+}
+
+/**
+ * @class PositionPrinter
+ *
+ * @brief Prints the latest position stream sample every second (at stream rates, printing
+ *        them all would hold up the link)
+ */
+class PositionPrinter : public TelemetryHandler
+{
+    private:
+        uint32_t next_print_us;
+        bool first;
+
+    public:
+        PositionPrinter() : next_print_us(0), first(true) {}
+
+        void telemetry(const TelemetryMsgData& data) {}
+
+        void position(const PositionSample& sample)
+        {
+            if (!this->first && (int32_t)(sample.time_us - this->next_print_us) < 0) return;
+            this->first = false;
+            this->next_print_us = sample.time_us + 1000000;
+            printf("%10.6f s  X %8d counts  Y %8d counts\n", sample.time_us / 1e6, sample.x_counts, sample.y_counts);
+        }
+};
+
+bool positions(istringstream& iss)
+{
+    uint32_t rate_hz = 0;
+    double seconds = 2.0;
+    iss >> rate_hz;
+    if (iss.good()) iss >> seconds;
+    if (iss.fail() || rate_hz == 0 || rate_hz > POSITION_STREAM_RATE_MAX || seconds <= 0) {
+        print_cmd_usage(CMD_ID_POSITIONS);
+        return true;
+    }
+
+    PositionPrinter printer;
+    comm.set_telemetry_handler(&printer);
+    uint32_t received_start = comm.positions_received();
+    uint32_t bytes_start = comm.position_stream_bytes();
+    uint32_t skipped_start = comm.position_frames_skipped();
+
+    uint16_t rate_in_use;
+    SerialResult res = comm.subscribe_position_stream((uint16_t)rate_hz, &rate_in_use, comm.reply_timeout());
+    if (res == SERIAL_OK) {
+        auto time_start = chrono::steady_clock::now();
+        auto time_end = time_start + chrono::duration<double>(seconds);
+        while (chrono::steady_clock::now() < time_end && res == SERIAL_OK) {
+            res = comm.poll();
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        if (res == SERIAL_OK) res = comm.unsubscribe_position_stream(comm.reply_timeout());
+
+        uint32_t received = comm.positions_received() - received_start;
+        uint32_t bytes = comm.position_stream_bytes() - bytes_start;
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - time_start).count();
+        printf("%u samples in %.3f s (%.1f Hz, asked for %u Hz), %.2f bytes per sample, %u frames skipped\n",
+               received, elapsed, received / elapsed, rate_in_use, (received > 0 ? (double)bytes / received : 0.0),
+               comm.position_frames_skipped() - skipped_start);
+    }
+    comm.set_telemetry_handler(nullptr);
+
+    if (res == SERIAL_ERR_REJECTED) {
+        printf("ERROR: the position stream needs a windowed link\n");
+    }
+    else if (res != SERIAL_OK) {
+        printf("ERROR: %d\n", res);
+    }
+    return true;
+}
+
 bool link_check(istringstream& iss)
 {
-    SerialResult res = comm.link_check(MSG_RECEIVE_TIMEOUT_MS);
+    if (!iss.good()) {
+        SerialResult res = comm.link_check(comm.reply_timeout());
+        if (res == SERIAL_OK) {
+            printf("OK\n");
+            return true;
+        }
+
+        printf("ERROR: %d\n", res);
+        return true;
+    }
+
+    // Large payload variant, echoes an extended message to measure throughput
+    uint32_t length = 0;
+    iss >> length;
+    if (iss.fail() || length == 0 || length > MSG_EXT_BUFFER_SIZE) {
+        print_cmd_usage(CMD_ID_LINK_CHECK);
+        return true;
+    }
+
+    vector<uint8_t> buf(length);
+    auto time_start = chrono::steady_clock::now();
+    SerialResult res = comm.link_check(buf.data(), (uint16_t)length, comm.reply_timeout(length, length));
+    auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - time_start).count();
     if (res == SERIAL_OK) {
-        printf("OK\n");
+        // The data crosses the link twice
+        printf("OK (%u bytes in %.3f s, %.0f bytes/s)\n", length, elapsed, (2.0 * length) / elapsed);
         return true;
     }
 
@@ -221,18 +422,197 @@ bool link_check(istringstream& iss)
     return true;
 }
 
+bool link_bench(istringstream& iss)
+{
+    uint32_t count = 100;
+    if (iss.good()) iss >> count;
+    if (iss.fail() || count == 0) {
+        print_cmd_usage(CMD_ID_LINK_BENCH);
+        return true;
+    }
+
+    SerialResult res = SERIAL_OK;
+
+    // Round trip latency: a PING and its ACK
+    double rtt_min = 1e9, rtt_max = 0, rtt_total = 0;
+    for (uint32_t i = 0; i < count && res == SERIAL_OK; i++) {
+        auto time_start = chrono::steady_clock::now();
+        res = comm.ping();
+        if (res == SERIAL_OK) res = comm.wait_acked();
+        double rtt = chrono::duration<double, milli>(chrono::steady_clock::now() - time_start).count();
+        if (rtt < rtt_min) rtt_min = rtt;
+        if (rtt > rtt_max) rtt_max = rtt;
+        rtt_total += rtt;
+    }
+    if (res != SERIAL_OK) {
+        printf("ERROR: %d\n", res);
+        return true;
+    }
+    printf("Round trip : %8.3f ms avg, %8.3f ms min, %8.3f ms max (%u pings)\n",
+           rtt_total / count, rtt_min, rtt_max, count);
+
+    // Throughput: full size ECHOs, then extended ECHOs (the data crosses the link twice)
+    auto time_start = chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count && res == SERIAL_OK; i++) {
+        res = comm.link_check(comm.reply_timeout());
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - time_start).count();
+    if (res != SERIAL_OK) {
+        printf("ERROR: %d\n", res);
+        return true;
+    }
+    printf("Throughput : %8.0f bytes/s (%u x %d byte ECHO)\n",
+           (2.0 * count * MSG_DATA_LENGTH_MAX) / elapsed, count, MSG_DATA_LENGTH_MAX);
+
+    vector<uint8_t> buf(MSG_EXT_BUFFER_SIZE);
+    uint32_t ext_count = (count + 9) / 10;
+    time_start = chrono::steady_clock::now();
+    for (uint32_t i = 0; i < ext_count && res == SERIAL_OK; i++) {
+        res = comm.link_check(buf.data(), MSG_EXT_BUFFER_SIZE, comm.reply_timeout(MSG_EXT_BUFFER_SIZE, MSG_EXT_BUFFER_SIZE));
+    }
+    elapsed = chrono::duration<double>(chrono::steady_clock::now() - time_start).count();
+    if (res != SERIAL_OK) {
+        printf("ERROR: %d\n", res);
+        return true;
+    }
+    printf("Throughput : %8.0f bytes/s (%u x %d byte extended ECHO)\n",
+           (2.0 * ext_count * MSG_EXT_BUFFER_SIZE) / elapsed, ext_count, MSG_EXT_BUFFER_SIZE);
+    return true;
+}
+
+void print_link_stats(const char *name, LinkStats& stats)
+{
+    printf("%s\n", name);
+    printf("  Frames sent / received : %10u / %10u\n", stats.transport.frames_sent, stats.transport.frames_received);
+    printf("  Bytes sent / received  : %10u / %10u\n", stats.transport.bytes_sent, stats.transport.bytes_received);
+    printf("  Bytes discarded        : %10u\n", stats.transport.bytes_discarded);
+    printf("  Bad end delimiters     : %10u\n", stats.transport.bad_end_delims);
+    printf("  CRC errors             : %10u\n", stats.transport.crc_errors);
+    printf("  ACK timeouts           : %10u\n", stats.session.ack_timeouts);
+    printf("  NACKs sent / received  : %10u / %10u\n", stats.session.nacks_sent, stats.session.nacks_received);
+    printf("  Retransmits            : %10u\n", stats.session.retransmits);
+    printf("  ACK latency (ms)       :");
+    for (int i = 0; i < LINK_ACK_HIST_BUCKETS; i++) {
+        if (i < LINK_ACK_HIST_BUCKETS - 1) printf(" <%d: %u", 1 << i, stats.session.ack_latency_hist[i]);
+        else                               printf(" >=%d: %u", 1 << (i - 1), stats.session.ack_latency_hist[i]);
+    }
+    printf("\n");
+}
+
+bool link_stats(istringstream& iss)
+{
+    string word;
+    iss >> word;
+    if (word == "reset") {
+        comm.reset_link_stats();
+        return true;
+    }
+    if (!word.empty()) {
+        print_cmd_usage(CMD_ID_LINK_STATS);
+        return true;
+    }
+
+    LinkStats stats_arduino, stats_host;
+    SerialResult res = comm.get_link_stats(&stats_arduino, comm.reply_timeout());
+    comm.link_stats(&stats_host);
+
+    print_link_stats("Host", stats_host);
+    if (res == SERIAL_OK) {
+        print_link_stats("Arduino", stats_arduino);
+    }
+    else {
+        printf("ERROR: %d\n", res);
+    }
+    return true;
+}
+
+/**
+ * @class LogPrinter
+ *
+ * @brief Prints the entries the Arduino logs as they arrive
+ */
+class LogPrinter : public LogHandler
+{
+    public:
+        void log(const LogEntry& entry)
+        {
+            char text[MSG_DATA_LENGTH_MAX];
+            log_entry_format(entry, text, sizeof(text));
+            printf("[%s] %10.3f s  %s\n", log_level_name(log_entry_level(entry)), entry.time_ms / 1e3, text);
+        }
+};
+
+LogPrinter log_printer;
+
+/**
+ * @brief Builds the path of BAUD_RATE_FILE (in the home directory, or else the working directory)
+ */
+string baud_rate_file_path()
+{
+    const char *home = getenv("HOME");
+    return (home != nullptr) ? string(home) + "/" + BAUD_RATE_FILE : string(BAUD_RATE_FILE);
+}
+
+/**
+ * @brief Has negotiate_baud_rate() try the baud rate saved by save_best_baud_rate() first
+ */
+void load_best_baud_rate()
+{
+    FILE *file = fopen(baud_rate_file_path().c_str(), "r");
+    if (file == nullptr) return;
+
+    unsigned int baud_rate;
+    if (fscanf(file, "%u", &baud_rate) == 1 && baud_rate != SERIAL_BAUD_RATE) {
+        if (comm.set_best_baud_rate((SerialBaudRate)baud_rate)) {
+            cout << "Trying " << baud_rate << " baud first" << endl;
+        }
+    }
+    fclose(file);
+}
+
+/**
+ * @brief Saves the fastest baud rate negotiate_baud_rate() found for the next run
+ */
+void save_best_baud_rate()
+{
+    FILE *file = fopen(baud_rate_file_path().c_str(), "w");
+    if (file == nullptr) return;
+
+    fprintf(file, "%u\n", (unsigned int)comm.get_best_baud_rate());
+    fclose(file);
+}
+
 bool connect_to_arduino()
 {
-    if (!device.ser_connect(SERIAL_BAUD_RATE)) return false;
-    device.ser_flush();
+    if (!comm.connect(SERIAL_BAUD_RATE)) return false;
+    comm.flush();
 
     cout << "Waiting for Arduino..." << flush;
-    while ((comm.check_for_message() != SERIAL_OK) || (comm.received_message().id != MSG_ID_PING));
+    while (comm.recv_message(MSG_ID_PING, 0, comm.reply_timeout()) != SERIAL_OK);
 
     // There might be more ping messages sitting in the buffer, so flush them all out
-    device.ser_flush();
+    comm.flush();
 
     cout << "Connected!" << endl;
+
+    // Older firmware ignores CHANGE_BAUD, in which case the link stays at SERIAL_BAUD_RATE
+    load_best_baud_rate();
+    if (comm.negotiate_baud_rate(SERIAL_BAUD_RATE_MAX, comm.reply_timeout()) != SERIAL_OK) return false;
+    cout << "Using " << comm.baud_rate() << " baud" << endl;
+    save_best_baud_rate();
+
+    // Older firmware ignores NEGOTIATE, in which case the link stays stop-and-wait
+    comm.negotiate(LINK_FEATURES_SUPPORTED, SERIAL_WINDOW_MAX, comm.reply_timeout());
+    if (comm.window_size() > 0) {
+        cout << "Using a window of " << (int)comm.window_size() << " messages";
+    }
+    else {
+        cout << "Using stop-and-wait";
+    }
+    cout << ((comm.features() & LINK_FEATURE_COBS) ? " with COBS framing" : "") << endl;
+
+    // The Arduino only sends its log on a windowed link
+    comm.set_log_handler(&log_printer);
     return true;
 }
 
@@ -258,8 +638,13 @@ Command commands[] = {
     [CMD_ID_STOP]         = { "stop", "Freeze all motor functions", "stop", stop },
     [CMD_ID_GET_POSITION] = { "get_position", "Retrieve the current position of the gantry", "get_position", get_position },
     [CMD_ID_GET_TEMP]     = { "get_temp", "Retrieve temperature readings", "get_temp", get_temp },
-    [CMD_ID_GET_AXIS_STATE]     = { "get_axis_state", "Retrieve axis state (moving + limits)", "get_axis_state", get_axis_state },
-    [CMD_ID_LINK_CHECK]   = { "link_check", "Verify the serial communication link is working", "link_check", link_check },
+    [CMD_ID_GET_AXIS_STATE]     = { "get_axis_state", "Retrieve axis state (moving, limits, velocity, segment, target)", "get_axis_state", get_axis_state },
+    [CMD_ID_GET_SNAPSHOT] = { "get_snapshot", "Retrieve status, position, axis state and temperatures at once", "get_snapshot", get_snapshot },
+    [CMD_ID_TELEMETRY]    = { "telemetry", "Stream telemetry from the Arduino for a while", "telemetry <rate_hz> or telemetry <rate_hz> <seconds>", telemetry },
+    [CMD_ID_POSITIONS]    = { "positions", "Stream delta encoded encoder positions from the Arduino for a while", "positions <rate_hz> or positions <rate_hz> <seconds>", positions },
+    [CMD_ID_LINK_CHECK]   = { "link_check", "Verify the serial communication link is working", "link_check or link_check <bytes>", link_check },
+    [CMD_ID_LINK_BENCH]   = { "link_bench", "Measure round trip latency and throughput of the serial link", "link_bench or link_bench <count>", link_bench },
+    [CMD_ID_LINK_STATS]   = { "link_stats", "Display the link health counters of both ends (or reset the host's)", "link_stats or link_stats reset", link_stats },
     [CMD_ID_RESET]        = { "reset", "Reset the Arduino", "reset", reset },
     [CMD_ID_HELP]         = { "help", "Display the help message", "help or help <command>", help },
     [CMD_ID_EXIT]         = { "exit", "Exit the program", "exit", exit }
@@ -351,7 +736,8 @@ int main(int argc, char *argv[])
 
     bool exit = false;
     while (!exit) {
-        // Output prompt
+        // Print whatever the Arduino logged since the last command, then output prompt
+        comm.poll();
         cout << "> ";
 
         // Read line
@@ -0,0 +1,283 @@
+// Room for the largest extended frame, which is fed in one go
+#define LOOPBACK_BUF_SIZE 0x40000
+
+#include "LoopbackSerialDevice.h"
+#include "FrameCapture.h"
+#include "TestStandComm.h"
+#include "TestStandCommHost.h"
+
+#include "SerialResult.h"
+#include "Messages.h"
+
+#include "shared_defs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+/*****************************************************************************/
+/*                                  DEFINES                                  */
+/*****************************************************************************/
+
+/** Largest frame data length (extended frames have a 16-bit length) */
+#define REPLAY_DATA_LENGTH_MAX 0xFFFF
+
+/*****************************************************************************/
+/*                                  TYPEDEFS                                 */
+/*****************************************************************************/
+
+typedef enum {
+    TARGET_HOST,
+    TARGET_CONTROLLER
+} ReplayTarget;
+
+typedef struct {
+    ReplayTarget target;
+    SerialCaptureDir dir;     //!< Which of the captured frames are fed to the target
+    bool dir_given;
+    double speed;             //!< 1 for the captured timing, 0 for as fast as possible
+    const char *capture_file; //!< Where to capture the frames of the target (nullptr for none)
+} ReplayOptions;
+
+/** Counts for one message ID */
+typedef struct {
+    uint32_t fed;
+    uint32_t delivered;
+} IdCounts;
+
+/*****************************************************************************/
+/*                                  GLOBALS                                  */
+/*****************************************************************************/
+
+ReplayOptions options = {
+    .target = TARGET_HOST,
+    .dir = SERIAL_CAPTURE_RX,
+    .dir_given = false,
+    .speed = 1.0,
+    .capture_file = nullptr
+};
+
+uint8_t feed_buf[REPLAY_DATA_LENGTH_MAX];
+uint8_t ext_buf[REPLAY_DATA_LENGTH_MAX];
+uint8_t drain_buf[4096];
+
+IdCounts id_counts[256];
+
+/*****************************************************************************/
+/*                                   REPLAY                                  */
+/*****************************************************************************/
+
+/**
+ * @brief Feeds the frames of a capture into a protocol stack
+ *
+ * The frames are sent from a bare SerialTransport on the other end of a loopback pair,
+ * with the framing and header fields they were captured with, and the target stack
+ * receives them like it would from the serial port. Whatever the target sends back (ACKs,
+ * NACKs) is discarded. In place of the negotiation itself, the target takes the window size
+ * of every NEGOTIATED message in the capture and follows the framing of the frames it is fed
+ * (the two ends of a link switch framing at slightly different times).
+ *
+ * Stop-and-wait ACKs are counted separately from errors, since the target never sent the
+ * frames they acknowledge.
+ *
+ * @return false if the target stack reported an error for any frame
+ */
+bool replay(FrameCaptureReader& reader, TestStandComm& target, LoopbackSerialPair& pair)
+{
+    SerialTransport feeder(pair.controller);
+    target.set_ext_buffer(ext_buf, sizeof(ext_buf));
+    target.set_link(0, 0);
+
+    FrameCaptureWriter capture;
+    if (options.capture_file != nullptr) {
+        if (!capture.open(options.capture_file)) return false;
+        target.set_capture(&capture);
+    }
+
+    uint32_t frames_total = 0;
+    uint32_t frames_fed = 0;
+    uint32_t messages = 0;
+    uint32_t errors = 0;
+    uint32_t unmatched_acks = 0;
+    uint8_t features = 0;
+    uint8_t window_size = 0;
+    uint64_t target_ns = 0;     //!< Time spent in the target's receive path
+    bool first = true;
+    uint64_t first_ns = 0;
+
+    const CaptureRecord *record;
+    const uint8_t *data;
+    auto start = chrono::steady_clock::now();
+    while (reader.next(&record, &data)) {
+        frames_total++;
+
+        bool feed = (record->dir == options.dir);
+        if (feed) {
+            if (first) {
+                first_ns = record->time_ns;
+                first = false;
+            }
+            if (options.speed > 0) {
+                auto due = start + chrono::nanoseconds((uint64_t)((record->time_ns - first_ns) / options.speed));
+                this_thread::sleep_until(due);
+            }
+
+            uint8_t cobs = ((record->flags & CAPTURE_FLAG_COBS) ? LINK_FEATURE_COBS : 0);
+            if ((features & LINK_FEATURE_COBS) != cobs) {
+                features = (features & ~LINK_FEATURE_COBS) | cobs;
+                target.set_link(features, window_size);
+            }
+
+            memcpy(feed_buf, data, record->length);
+            Message msg = {
+                .id = record->id,
+                .length = record->length,
+                .data = feed_buf,
+                .txn = record->txn,
+                .sequenced = (bool)(record->flags & CAPTURE_FLAG_SEQUENCED),
+                .seq = record->seq,
+                .extended = (bool)(record->flags & CAPTURE_FLAG_EXTENDED),
+                .retransmit = (bool)(record->flags & CAPTURE_FLAG_RETRANSMIT),
+                .alt = (bool)(record->flags & CAPTURE_FLAG_ALT)
+            };
+            feeder.set_framing(cobs ? SERIAL_FRAMING_COBS : SERIAL_FRAMING_DELIMITED);
+            feeder.send_message(msg);
+            frames_fed++;
+            id_counts[record->id].fed++;
+
+            // Let the target take in everything that arrived
+            auto target_start = chrono::steady_clock::now();
+            SerialResult res;
+            while ((res = target.check_for_message()) != SERIAL_OK_NO_MSG) {
+                if (res == SERIAL_OK) {
+                    messages++;
+                    id_counts[target.received_message().id].delivered++;
+                }
+                else if (res == SERIAL_ERR_WRONG_MSG && (record->id == MSG_ID_ACK || record->id == MSG_ID_NACK)) {
+                    unmatched_acks++;
+                }
+                else {
+                    errors++;
+                    printf("Frame %u (id 0x%02X): error %d\n", frames_total, record->id, res);
+                }
+            }
+            target_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - target_start).count();
+
+            // Throw away the target's ACKs so the loopback never fills up
+            while (pair.controller.ser_read_bulk(drain_buf, sizeof(drain_buf)) > 0);
+        }
+
+        // Both ends start over with the new window once the reply to a NEGOTIATE has gone through
+        if (record->id == MSG_ID_NEGOTIATED && record->length == sizeof(NegotiateMsgData)) {
+            NegotiateMsgData negotiated;
+            memcpy(&negotiated, data, sizeof(negotiated));
+            window_size = ((negotiated.features & LINK_FEATURE_WINDOWED) ? negotiated.window_size : 0);
+            features = (negotiated.features & ~LINK_FEATURE_COBS) | (features & LINK_FEATURE_COBS);
+            target.set_link(features, window_size);
+        }
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (capture.is_open()) {
+        target.set_capture(nullptr);
+        printf("Captured %u frames of the target (%u dropped) to %s\n", capture.records(), capture.dropped(), options.capture_file);
+        capture.close();
+    }
+
+    printf("Fed %u of %u frames into the %s stack in %.3f s\n",
+           frames_fed, frames_total, (options.target == TARGET_HOST ? "host" : "controller"), elapsed);
+    printf("Delivered %u messages, %u errors, %u unmatched stop-and-wait ACKs\n", messages, errors, unmatched_acks);
+    if (frames_fed > 0) {
+        printf("Target receive path: %.0f ns per frame, %.0f frames/s\n",
+               (double)target_ns / frames_fed, frames_fed / (target_ns / 1e9));
+    }
+
+    printf("\n  id     fed  delivered\n");
+    for (int id = 0; id < 256; id++) {
+        if (id_counts[id].fed == 0 && id_counts[id].delivered == 0) continue;
+        printf("0x%02X %7u %10u\n", id, id_counts[id].fed, id_counts[id].delivered);
+    }
+
+    return (errors == 0);
+}
+
+/*****************************************************************************/
+/*                                    MAIN                                   */
+/*****************************************************************************/
+
+void print_usage(const char *name)
+{
+    printf("\nusage: %s [options] <capture file>\n\n", name);
+    printf("    -t <target> stack to feed the frames into: host or controller (default host)\n");
+    printf("    -d <dir>    frames to feed: rx or tx, as seen by the end that captured them\n");
+    printf("                (default rx for host and tx for controller, i.e. a capture taken on the host)\n");
+    printf("    -s <speed>  1 for the captured timing, 10 for ten times faster, 0 for as fast\n");
+    printf("                as possible (default 1)\n");
+    printf("    -c <file>   capture the frames of the target to a file, to compare with the original\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "t:d:s:c:")) != -1) {
+        switch (opt) {
+            case 't':
+                if (strcmp(optarg, "host") == 0)            options.target = TARGET_HOST;
+                else if (strcmp(optarg, "controller") == 0) options.target = TARGET_CONTROLLER;
+                else {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'd':
+                if (strcmp(optarg, "rx") == 0)      options.dir = SERIAL_CAPTURE_RX;
+                else if (strcmp(optarg, "tx") == 0) options.dir = SERIAL_CAPTURE_TX;
+                else {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                options.dir_given = true;
+                break;
+            case 's': options.speed = strtod(optarg, nullptr); break;
+            case 'c': options.capture_file = optarg;           break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (!options.dir_given) {
+        options.dir = (options.target == TARGET_HOST ? SERIAL_CAPTURE_RX : SERIAL_CAPTURE_TX);
+    }
+
+    FrameCaptureReader reader;
+    if (!reader.open(argv[optind])) return 1;
+    const CaptureFileHeader& header = reader.header();
+    printf("%s: %u frames (%u dropped)%s\n", argv[optind], header.records, header.dropped,
+           (header.data_length == 0 ? ", not closed" : ""));
+
+    LoopbackSerialPair pair;
+    pair.controller.ser_connect(SERIAL_BAUD_RATE);
+
+    bool ok;
+    if (options.target == TARGET_HOST) {
+        TestStandCommHost host(pair.host);
+        host.connect(SERIAL_BAUD_RATE);
+        ok = replay(reader, host, pair);
+    }
+    else {
+        TestStandComm controller(pair.host);
+        controller.connect(SERIAL_BAUD_RATE);
+        ok = replay(reader, controller, pair);
+    }
+    return (ok ? 0 : 1);
+}
@@ -4,7 +4,11 @@
 /* ************************ Shared Project Includes ************************ */
 #include "LinuxSerialDevice.h"
 #include "TestStandCommHost.h"
+#include "TestStandCommThread.h"
+#include "TestStandCommAsync.h"
+#include "FrameCapture.h"
 #include "TestStandMessages.h"
+#include "BinaryLog.h"
 #include "shared_defs.h"
 
 // firmware headers
@@ -13,8 +17,11 @@
 
 /* **************************** System Includes **************************** */
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
+#include <chrono>
+
 /*****************************************************************************/
 /*                                 CONSTANTS                                 */
 /*****************************************************************************/
@@ -38,7 +45,9 @@ const char * serial_result_msgs[] = {
     [SERIAL_ERR_ACK_FAILED]      = "After receiving a message, failed to send an ACK",
     [SERIAL_ERR_WRONG_MSG]       = "An unexpected message was received",
     [SERIAL_ERR_DATA_LENGTH]     = "Wrong length of data was received",
-    [SERIAL_ERR_DATA_CORRUPT]    = "Received serial data was corrupted"
+    [SERIAL_ERR_DATA_CORRUPT]    = "Received serial data was corrupted",
+    [SERIAL_ERR_BUSY]            = "Too many requests are already waiting for a reply",
+    [SERIAL_ERR_REJECTED]        = "The request was refused"
 };
 
 const char * axis_result_msgs[] = {
@@ -61,6 +70,14 @@ extern float gCalGantryPulleyDia; // pulley diameter in mm, defined in feArduino
 
 static LinuxSerialDevice device;
 static TestStandCommHost comm(device);
+static TestStandCommThread comm_thread(comm);
+static TestStandCommAsync async_comm(comm_thread);
+static FrameCaptureWriter capture;
+static bool telemetry_subscribed = false;
+static bool snapshot_supported = false;
+
+// Only set while arduino_poll_commands() runs the callbacks of completed commands
+static ArduinoCommandDone command_done = nullptr;
 
 /*****************************************************************************/
 /*                             PRIVATE FUNCTIONS                             */
@@ -131,11 +148,6 @@ float steps_to_mm(uint32_t val_steps)
     return (val_steps * mm_per_step());
 }
 
-static AxisDirection get_direction(int32_t displacement)
-{
-    return (displacement < 0 ? AXIS_DIR_NEGATIVE : AXIS_DIR_POSITIVE);
-}
-
 static bool handle_serial_result(SerialResult res)
 {
     if (res == SERIAL_OK) return true;
@@ -152,27 +164,75 @@ static bool handle_axis_result(AxisId axis, AxisResult res)
     return false;
 }
 
-static bool move_axis(AxisId axis, int32_t cur_pos_counts, float dest_mm, float vel_mm_s)
+static bool handle_queued(bool queued)
 {
-    // Target position
-    int32_t target_counts = mm_to_cts(dest_mm);
+    if (!queued) cm_msg(MERROR, "handle_queued", "Serial command queue is full");
+    return queued;
+}
 
-    // Relative displacement
-    int32_t disp_counts = (target_counts - cur_pos_counts);
+/**
+ * @brief Waits for a request made through async_comm to complete
+ * 
+ * @return true if the request completed (successfully or not, @see CommResponse::res)
+ */
+static bool wait_response(std::future<CommResponse>& future, CommResponse *resp_out)
+{
+    if (future.wait_for(std::chrono::milliseconds(COMM_WAIT_MS)) != std::future_status::ready) {
+        cm_msg(MERROR, "wait_response", "Timed out waiting for the serial I/O thread");
+        return false;
+    }
 
-    // Direction
-    AxisDirection dir = get_direction(disp_counts);
+    *resp_out = future.get();
+    return true;
+}
 
-    // Velocity
-    uint32_t vel_steps_s = mm_to_steps(vel_mm_s);
+static bool handle_move_response(const CommResponse& resp)
+{
+    bool success = true;
+    for (int axis = AXIS_X; axis <= AXIS_Y; axis++) {
+        if (!handle_serial_result(resp.data.move_to.res[axis])
+            || !handle_axis_result((AxisId)axis, resp.data.move_to.axis_res[axis])) {
+            success = false;
+        }
+    }
+
+    if (success) {
+        cm_msg(MINFO, "arduino_move", "Moving to position (%.2f mm, %.2f mm) with velocity (%.2f mm/s, %.2f mm/s)",
+                cts_to_mm(resp.cmd.args.move_to.target_counts[AXIS_X]), cts_to_mm(resp.cmd.args.move_to.target_counts[AXIS_Y]),
+                steps_to_mm(resp.cmd.args.move_to.vel_steps_s[AXIS_X]), steps_to_mm(resp.cmd.args.move_to.vel_steps_s[AXIS_Y]));
+    }
+    // Otherwise error messages will have been printed above
+    return success;
+}
+
+static void convert_telemetry(const TelemetryMsgData& data, ArduinoTelemetry *out)
+{
+    out->time_s = data.time_us / 1e6;
+    out->gantry_x_mm = cts_to_mm(data.x_counts);
+    out->gantry_y_mm = cts_to_mm(data.y_counts);
+    out->vel_x_mm_s = steps_to_mm(data.x_velocity);
+    out->vel_y_mm_s = steps_to_mm(data.y_velocity);
+    out->flags = data.flags;
+}
 
-    // Send command
-    SerialResult ser_res;
-    AxisResult axis_res;
-    ser_res = comm.move(axis, dir, vel_steps_s, abs(disp_counts), &axis_res, MSG_RECEIVE_TIMEOUT_MS);
+static void report_command(ArduinoCommand cmd, bool success)
+{
+    if (command_done != nullptr) command_done(cmd, success);
+}
 
-    // Handle results
-    return (handle_serial_result(ser_res) && handle_axis_result(axis, axis_res));
+static void move_done(const CommResponse& resp)
+{
+    report_command(ARDUINO_CMD_MOVE, handle_move_response(resp));
+}
+
+static void home_done(const CommResponse& resp)
+{
+    report_command(ARDUINO_CMD_HOME, handle_serial_result(resp.res));
+}
+
+static void stop_done(const CommResponse& resp)
+{
+    report_command(ARDUINO_CMD_STOP, handle_serial_result(resp.res));
 }
 
 /*****************************************************************************/
@@ -185,83 +245,180 @@ static bool move_axis(AxisId axis, int32_t cur_pos_counts, float dest_mm, float
  * This includes opening the serial device as well as waiting to receive a
  * ping message from the Arduino to validate that it is running
  * 
- * @param device_file Path to the serial port's device file (e.g. /dev/ttyACM0)
+ * @param device_file    Path to the serial port's device file (e.g. /dev/ttyACM0)
+ * @param capture_file   Path of a file to capture every frame to (nullptr for none, @see Replay)
+ * @param best_baud_rate The fastest baud rate found on a previous connection, which is tried
+ *                       first, and is updated to the one found now (nullptr to step up from
+ *                       SERIAL_BAUD_RATE, @see TestStandCommHost::negotiate_baud_rate)
  * 
  * @return true if the connection was successfully established, otherwise false
  */
-bool arduino_connect(char *device_file)
+bool arduino_connect(char *device_file, char *capture_file, DWORD *best_baud_rate)
 {
+    if (capture_file != nullptr) {
+        if (!capture.open(capture_file)) return false;
+        comm.set_capture(&capture);
+        printf("Capturing frames to %s\n", capture_file);
+    }
+
     // Open the serial device
     device.set_device_file(device_file);
-    if (!device.ser_connect(SERIAL_BAUD_RATE)) return false;
-    device.ser_flush();
+    if (!comm.connect(SERIAL_BAUD_RATE)) return false;
+    comm.flush();
 
     printf("Waiting for Arduino...");
-    while (!(comm.check_for_message() && comm.received_message().id == MSG_ID_PING));
+    while (comm.recv_message(MSG_ID_PING, 0, comm.reply_timeout()) != SERIAL_OK);
     // There might be more ping messages sitting in the buffer, so flush them all out
-    device.ser_flush();
+    comm.flush();
     printf("Connected!\n");
 
     // Verify link
     printf("Verifying link...");
-    if (!handle_serial_result(comm.link_check(MSG_RECEIVE_TIMEOUT_MS))) return false;
+    if (!handle_serial_result(comm.link_check(comm.reply_timeout()))) return false;
     printf("SUCCESS\n");
 
+    // Older firmware ignores CHANGE_BAUD, in which case the link stays at SERIAL_BAUD_RATE
+    if (best_baud_rate != nullptr && *best_baud_rate != SERIAL_BAUD_RATE) {
+        if (comm.set_best_baud_rate((SerialBaudRate)*best_baud_rate)) {
+            printf("Trying %u baud first\n", *best_baud_rate);
+        }
+        else {
+            cm_msg(MINFO, "arduino_connect", "Ignoring unsupported baud rate %u", *best_baud_rate);
+        }
+    }
+    if (!handle_serial_result(comm.negotiate_baud_rate(SERIAL_BAUD_RATE_MAX, comm.reply_timeout()))) return false;
+    printf("Using %d baud\n", comm.baud_rate());
+    if (best_baud_rate != nullptr) *best_baud_rate = comm.get_best_baud_rate();
+
+    // Older firmware ignores NEGOTIATE, in which case the link stays stop-and-wait
+    comm.negotiate(LINK_FEATURES_SUPPORTED, SERIAL_WINDOW_MAX, comm.reply_timeout());
+    if (comm.window_size() > 0) {
+        printf("Using a window of %d messages", comm.window_size());
+    }
+    else {
+        printf("Using stop-and-wait");
+    }
+    printf("%s\n", (comm.features() & LINK_FEATURE_COBS) ? " with COBS framing" : "");
+
+    // The status and position then come from the telemetry rather than being polled for
+    // (older firmware and stop-and-wait links do not stream)
+    telemetry_subscribed = false;
+    if (ARDUINO_TELEMETRY_RATE_HZ > 0 && comm.window_size() > 0) {
+        uint16_t rate_hz;
+        telemetry_subscribed = (comm.subscribe_telemetry(ARDUINO_TELEMETRY_RATE_HZ, &rate_hz, comm.reply_timeout()) == SERIAL_OK);
+        if (telemetry_subscribed) printf("Streaming telemetry at %d Hz\n", rate_hz);
+    }
+
+    // Older firmware does not know GET_SNAPSHOT, the readout then queries each reading
+    Snapshot snapshot;
+    snapshot_supported = (comm.get_snapshot(&snapshot, comm.reply_timeout()) == SERIAL_OK);
+    if (!snapshot_supported) printf("Snapshots not supported, querying each reading\n");
+
+    // From here on only the I/O thread touches the serial port
+    comm_thread.start();
+
     return true;
 }
 
 /**
- * @brief Disconnects from the Arduino
+ * @brief Disconnects from the Arduino once all submitted commands have completed
  */
 void arduino_disconnect()
 {
+    if (telemetry_subscribed) {
+        std::future<CommResponse> future = async_comm.unsubscribe_telemetry();
+        CommResponse resp;
+        wait_response(future, &resp);
+        telemetry_subscribed = false;
+    }
+
+    comm_thread.stop();
     device.ser_disconnect();
+
+    if (capture.is_open()) {
+        comm.set_capture(nullptr);
+        printf("Captured %u frames (%u dropped)\n", capture.records(), capture.dropped());
+        capture.close();
+    }
 }
 
 /**
  * @brief Attempts to command the Arduino to move to the provided destination at the
  *        provided velocity
  * 
+ * The move is carried out in the background, its outcome is reported by
+ * arduino_poll_commands().
+ * 
  * @param dest_mm   Pointer to two floats (the absolute x and y coordinates in mm)
  * @param vel_mm_s  Pointer to two floats (the x and y velocities in mm/s)
+ * 
+ * @return true if the move was queued, otherwise false
  */
 bool arduino_move(float *dest_mm, float *vel_mm_s)
 {
     if (!validate_move_params(dest_mm, vel_mm_s)) return false;
 
-    // Get current position
-    PositionMsgData cur_pos_counts;
-    if (!handle_serial_result(comm.get_position(&cur_pos_counts, MSG_RECEIVE_TIMEOUT_MS))) return false;
-
-    // Attempt movement
-    bool x_success = move_axis(AXIS_X, cur_pos_counts.x_counts, dest_mm[AXIS_X], vel_mm_s[AXIS_X]);
-    bool y_success = move_axis(AXIS_Y, cur_pos_counts.y_counts, dest_mm[AXIS_Y], vel_mm_s[AXIS_Y]);
-
-    // Handle results
-    if (x_success && y_success) {
-        cm_msg(MINFO, "arduino_move", "Moving to position (%.2f mm, %.2f mm) with velocity (%.2f mm/s, %.2f mm/s)",
-                dest_mm[AXIS_X], dest_mm[AXIS_Y],
-                vel_mm_s[AXIS_X], vel_mm_s[AXIS_Y]);
-        return true;
+    int32_t target_counts[2];
+    uint32_t vel_steps_s[2];
+    for (int axis = AXIS_X; axis <= AXIS_Y; axis++) {
+        target_counts[axis] = mm_to_cts(dest_mm[axis]);
+        vel_steps_s[axis] = mm_to_steps(vel_mm_s[axis]);
     }
-    // Error messages will have been printed by move_axis
-    return false;
+    return handle_queued(async_comm.move_to(target_counts, vel_steps_s, move_done));
 }
 
 /**
  * @brief Tells the Arduino to start the homing routine
+ * 
+ * @return true if the command was queued (@see arduino_move), otherwise false
  */
 bool arduino_run_home()
 {
-    return handle_serial_result(comm.home());
+    return handle_queued(async_comm.home(home_done));
 }
 
 /**
  * @brief Tells the Arduino to cease all motor functions
+ * 
+ * @return true if the command was queued (@see arduino_move), otherwise false
  */
 bool arduino_stop()
 {
-    return handle_serial_result(comm.stop());
+    return handle_queued(async_comm.stop(stop_done));
+}
+
+/**
+ * @brief Reports the outcome of the commands queued by arduino_move(), arduino_run_home()
+ *        and arduino_stop() that have completed since the last call
+ * 
+ * @param done Called for each completed command (may be nullptr)
+ */
+void arduino_poll_commands(ArduinoCommandDone done)
+{
+    command_done = done;
+    async_comm.dispatch();
+    command_done = nullptr;
+}
+
+/**
+ * @brief Writes the entries the Arduino logged since the last call to the MIDAS message log
+ * 
+ * The Arduino only sends its log on a windowed link.
+ */
+void arduino_poll_log()
+{
+    LogEntry entry;
+    char text[MSG_DATA_LENGTH_MAX];
+    while (comm_thread.poll_log(&entry)) {
+        log_entry_format(entry, text, sizeof(text));
+        LogLevel level = log_entry_level(entry);
+        if (level >= LL_ERROR) {
+            cm_msg(MERROR, "arduino_log", "Arduino [%u ms]: %s", entry.time_ms, text);
+        }
+        else {
+            cm_msg(MINFO, "arduino_log", "Arduino %s [%u ms]: %s", log_level_name(level), entry.time_ms, text);
+        }
+    }
 }
 
 /**
@@ -273,9 +430,10 @@ bool arduino_stop()
  */
 bool arduino_get_status(DWORD *status_out)
 {
-    Status status;
-    if (!handle_serial_result(comm.get_status(&status, MSG_RECEIVE_TIMEOUT_MS))) return false;
-    *status_out = status;
+    std::future<CommResponse> future = async_comm.get_status();
+    CommResponse resp;
+    if (!wait_response(future, &resp) || !handle_serial_result(resp.res)) return false;
+    *status_out = resp.data.status;
     return true;
 }
 
@@ -290,11 +448,12 @@ bool arduino_get_status(DWORD *status_out)
 bool arduino_get_position(float *gantry_x_mm_out, float *gantry_y_mm_out)
 {
     // Retrieve current position
-    PositionMsgData pos_counts;
-    if (!handle_serial_result(comm.get_position(&pos_counts, MSG_RECEIVE_TIMEOUT_MS))) return false;
+    std::future<CommResponse> future = async_comm.get_position();
+    CommResponse resp;
+    if (!wait_response(future, &resp) || !handle_serial_result(resp.res)) return false;
     // Convert to mm
-    *gantry_x_mm_out = cts_to_mm(pos_counts.x_counts);
-    *gantry_y_mm_out = cts_to_mm(pos_counts.y_counts);
+    *gantry_x_mm_out = cts_to_mm(resp.data.position.x_counts);
+    *gantry_y_mm_out = cts_to_mm(resp.data.position.y_counts);
     return true;
 }
 
@@ -307,20 +466,185 @@ bool arduino_get_position(float *gantry_x_mm_out, float *gantry_y_mm_out)
  */
 bool arduino_get_temp(TempData *temp_out)
 {
-    return handle_serial_result(comm.get_temp(temp_out, MSG_RECEIVE_TIMEOUT_MS));
+    std::future<CommResponse> future = async_comm.get_temp();
+    CommResponse resp;
+    if (!wait_response(future, &resp) || !handle_serial_result(resp.res)) return false;
+    *temp_out = resp.data.temp;
+    return true;
+}
+
+/**
+ * @brief Retrieves the link health counters of both ends of the link
+ * 
+ * @param arduino_out Pointer to a struct where the Arduino's counters will be stored
+ * @param host_out    Pointer to a struct where the host's counters will be stored
+ *                    (filled in even if the Arduino's could not be retrieved, zeroed if
+ *                    the I/O thread did not respond)
+ * 
+ * @return true if the Arduino's counters were retrieved successfully, otherwise false
+ */
+bool arduino_get_link_stats(LinkStats *arduino_out, LinkStats *host_out)
+{
+    std::future<CommResponse> future = async_comm.get_link_stats();
+    CommResponse resp;
+    if (!wait_response(future, &resp)) {
+        memset(host_out, 0, sizeof(LinkStats));
+        return false;
+    }
+
+    *host_out = resp.data.link_stats.host;
+    if (!handle_serial_result(resp.res)) return false;
+    *arduino_out = resp.data.link_stats.device;
+    return true;
+}
+
+/**
+ * @brief Takes the telemetry samples received since the last call
+ * 
+ * @param state_out Where to store the samples, along with the status and gantry position of
+ *                  the latest one
+ */
+static void take_telemetry(ArduinoState *state_out)
+{
+    state_out->telemetry_count = 0;
+    state_out->status_valid = false;
+    state_out->position_valid = false;
+
+    TelemetryMsgData data;
+    while (comm_thread.poll_telemetry(&data)) {
+        if (state_out->telemetry_count < ARDUINO_TELEMETRY_MAX) {
+            convert_telemetry(data, &state_out->telemetry[state_out->telemetry_count]);
+        }
+        state_out->telemetry_count++;
+
+        state_out->status_valid = true;
+        state_out->status = data.status;
+        state_out->position_valid = true;
+        state_out->gantry_x_mm = cts_to_mm(data.x_counts);
+        state_out->gantry_y_mm = cts_to_mm(data.y_counts);
+    }
+}
+
+/**
+ * @brief Stores the readings of a snapshot, which are newer than any telemetry sample
+ */
+static void store_snapshot(const Snapshot& snapshot, ArduinoState *state_out)
+{
+    state_out->status_valid = true;
+    state_out->status = snapshot.status;
+    state_out->position_valid = true;
+    state_out->gantry_x_mm = cts_to_mm(snapshot.position.x_counts);
+    state_out->gantry_y_mm = cts_to_mm(snapshot.position.y_counts);
+    state_out->temp_valid = true;
+    state_out->temp = snapshot.temp;
+}
+
+/**
+ * @brief Retrieves the status, gantry position and temperatures from the Arduino in a
+ *        single round trip
+ * 
+ * @param state_out Pointer to a struct where the readings will be stored (the other
+ *                  fields are left alone)
+ * 
+ * @return true if the readings were retrieved successfully, otherwise false
+ */
+bool arduino_get_snapshot(ArduinoState *state_out)
+{
+    std::future<CommResponse> future = async_comm.get_snapshot();
+    CommResponse resp;
+    if (!wait_response(future, &resp) || !handle_serial_result(resp.res)) return false;
+    store_snapshot(resp.data.snapshot, state_out);
+    return true;
+}
+
+/**
+ * @brief Retrieves the status, gantry position, temperatures and link health counters
+ *        from the Arduino
+ * 
+ * The status, position and temperatures come back together in a snapshot (@see
+ * arduino_get_snapshot), and both queries are queued before waiting on either, so when the
+ * link is windowed the I/O thread sends them together and the readout costs a single round
+ * trip. With older firmware each reading is queried separately, and while the Arduino
+ * streams telemetry the status and position then come from the latest sample.
+ * 
+ * @param state_out Pointer to a struct where the readings will be stored, each reading
+ *                  has a flag indicating whether it was retrieved successfully
+ */
+void arduino_get_state(ArduinoState *state_out)
+{
+    take_telemetry(state_out);
+    bool query_position = (!snapshot_supported && state_out->telemetry_count == 0);
+
+    // Queue all of the queries
+    std::future<CommResponse> snapshot;
+    std::future<CommResponse> status;
+    std::future<CommResponse> position;
+    std::future<CommResponse> temp;
+    if (snapshot_supported) {
+        snapshot = async_comm.get_snapshot();
+    }
+    else {
+        if (query_position) {
+            status   = async_comm.get_status();
+            position = async_comm.get_position();
+        }
+        temp = async_comm.get_temp();
+    }
+    std::future<CommResponse> link_stats = async_comm.get_link_stats();
+
+    // Collect the replies
+    CommResponse resp;
+    if (snapshot_supported) {
+        state_out->temp_valid = false;
+        if (wait_response(snapshot, &resp) && handle_serial_result(resp.res)) {
+            store_snapshot(resp.data.snapshot, state_out);
+        }
+    }
+    else {
+        if (query_position) {
+            state_out->status_valid = (wait_response(status, &resp) && handle_serial_result(resp.res));
+            if (state_out->status_valid) state_out->status = resp.data.status;
+
+            state_out->position_valid = (wait_response(position, &resp) && handle_serial_result(resp.res));
+            if (state_out->position_valid) {
+                state_out->gantry_x_mm = cts_to_mm(resp.data.position.x_counts);
+                state_out->gantry_y_mm = cts_to_mm(resp.data.position.y_counts);
+            }
+        }
+
+        state_out->temp_valid = (wait_response(temp, &resp) && handle_serial_result(resp.res));
+        if (state_out->temp_valid) state_out->temp = resp.data.temp;
+    }
+
+    state_out->link_stats_valid = false;
+    memset(&state_out->link_stats_host, 0, sizeof(LinkStats));
+    if (wait_response(link_stats, &resp)) {
+        state_out->link_stats_host = resp.data.link_stats.host;
+        state_out->link_stats_valid = handle_serial_result(resp.res);
+        if (state_out->link_stats_valid) state_out->link_stats_arduino = resp.data.link_stats.device;
+    }
 }
 
 /**
  * @brief Update a calibration parameter on the Arduino
  * 
  * @param key The CalibrationKey
- * @param value Pointer to the value to set
+ * @param value The value to set
  * 
  * @return true if the calibration succeeds, otherwise false
  */
-static bool arduino_calibrate(CalibrationKey key, void *value)
+static bool arduino_calibrate(CalibrationKey key, uint32_t value)
+{
+    std::future<CommResponse> future = async_comm.calibrate(key, value);
+    CommResponse resp;
+    return (wait_response(future, &resp) && handle_serial_result(resp.res));
+}
+
+static bool arduino_calibrate(CalibrationKey key, double value)
 {
-    return handle_serial_result(comm.calibrate(key, value));
+    std::future<CommResponse> future = async_comm.calibrate(key, value);
+    CommResponse resp;
+    return (wait_response(future, &resp) && handle_serial_result(resp.res));
 }
 
 /**
@@ -332,13 +656,13 @@ static bool arduino_calibrate(CalibrationKey key, void *value)
  */
 bool arduino_calibrate(Calibration *calibration)
 {
-    if (!arduino_calibrate(CAL_GANTRY_ACCEL, &calibration->cal_gantry.accel)) return false;
-    if (!arduino_calibrate(CAL_GANTRY_VEL_START, &calibration->cal_gantry.vel_start)) return false;
-    if (!arduino_calibrate(CAL_GANTRY_VEL_HOME, &calibration->cal_gantry.vel_home)) return false;
-    if (!arduino_calibrate(CAL_TEMP_ALL_C1, &calibration->cal_temp.all.c1)) return false;
-    if (!arduino_calibrate(CAL_TEMP_ALL_C2, &calibration->cal_temp.all.c2)) return false;
-    if (!arduino_calibrate(CAL_TEMP_ALL_C3, &calibration->cal_temp.all.c3)) return false;
-    if (!arduino_calibrate(CAL_TEMP_ALL_RESISTOR, &calibration->cal_temp.all.resistor)) return false;
+    if (!arduino_calibrate(CAL_GANTRY_ACCEL, calibration->cal_gantry.accel)) return false;
+    if (!arduino_calibrate(CAL_GANTRY_VEL_START, calibration->cal_gantry.vel_start)) return false;
+    if (!arduino_calibrate(CAL_GANTRY_VEL_HOME, calibration->cal_gantry.vel_home)) return false;
+    if (!arduino_calibrate(CAL_TEMP_ALL_C1, calibration->cal_temp.all.c1)) return false;
+    if (!arduino_calibrate(CAL_TEMP_ALL_C2, calibration->cal_temp.all.c2)) return false;
+    if (!arduino_calibrate(CAL_TEMP_ALL_C3, calibration->cal_temp.all.c3)) return false;
+    if (!arduino_calibrate(CAL_TEMP_ALL_RESISTOR, calibration->cal_temp.all.resistor)) return false;
 
     cm_msg(MINFO, "arduino_calibrate", "Arduino calibration updated");
 
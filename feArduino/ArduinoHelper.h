@@ -3,24 +3,70 @@
 
 #include "TemperatureDAQ.h"
 #include "Calibration.h"
+#include "LinkStats.h"
 
 #include "midas.h"
 
+/** Rate the Arduino is asked to stream telemetry at (Hz, 0 to poll instead) */
+#ifndef ARDUINO_TELEMETRY_RATE_HZ
+#define ARDUINO_TELEMETRY_RATE_HZ 50
+#endif // ARDUINO_TELEMETRY_RATE_HZ
+
+/** Most telemetry samples kept between two readouts (later ones are only counted) */
+#define ARDUINO_TELEMETRY_MAX 128
+
+typedef struct {
+    double time_s;       //!< Arduino time the sample was taken (wraps after ~71 minutes)
+    float gantry_x_mm;
+    float gantry_y_mm;
+    float vel_x_mm_s;    //!< Speed of each axis (the direction is not reported)
+    float vel_y_mm_s;
+    DWORD flags;         //!< Bitmask of TELEMETRY_*
+} ArduinoTelemetry;
+
+typedef struct {
+    bool status_valid;
+    DWORD status;
+    bool position_valid;
+    float gantry_x_mm;
+    float gantry_y_mm;
+    bool temp_valid;
+    TempData temp;
+    bool link_stats_valid;
+    LinkStats link_stats_arduino;
+    LinkStats link_stats_host; //!< Always valid (zeroed if the serial I/O thread did not respond)
+    uint32_t telemetry_count;  //!< Samples received since the last readout
+    ArduinoTelemetry telemetry[ARDUINO_TELEMETRY_MAX];
+} ArduinoState;
+
+typedef enum {
+    ARDUINO_CMD_MOVE,
+    ARDUINO_CMD_HOME,
+    ARDUINO_CMD_STOP
+} ArduinoCommand;
+
+typedef void (*ArduinoCommandDone)(ArduinoCommand cmd, bool success);
+
 int32_t mm_to_cts(float val_mm);
 float cts_to_mm(int32_t val_cts);
 uint32_t mm_to_steps(float val_mm);
 float steps_to_mm(uint32_t val_steps);
 
-bool arduino_connect(char *device_file);
+bool arduino_connect(char *device_file, char *capture_file = nullptr, DWORD *best_baud_rate = nullptr);
 void arduino_disconnect();
 
 bool arduino_move(float *dest_mm, float *vel_mm_s);
 bool arduino_run_home();
 bool arduino_stop();
+void arduino_poll_commands(ArduinoCommandDone done);
+void arduino_poll_log();
 
 bool arduino_get_status(DWORD *status_out);
 bool arduino_get_position(float *gantry_x_mm_out, float *gantry_y_mm_out);
 bool arduino_get_temp(TempData *temp_out);
+bool arduino_get_link_stats(LinkStats *arduino_out, LinkStats *host_out);
+bool arduino_get_snapshot(ArduinoState *state_out);
+void arduino_get_state(ArduinoState *state_out);
 
 bool arduino_calibrate(Calibration *calibration);
 
@@ -8,6 +8,7 @@ Arduino frontend for mPMT test stand.
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <unistd.h>
 #include <iostream>
@@ -21,6 +22,7 @@ Arduino frontend for mPMT test stand.
 #include "feArduino.h"
 #include "ArduinoHelper.h"
 #include "DefaultCalibration.h"
+#include "shared_defs.h"
 
 #define  EQ_NAME   EQ_ARDUINO
 #define  EQ_EVID   1
@@ -40,7 +42,7 @@ const char *frontend_name = "feArduino";
 const char *frontend_file_name = (char*)__FILE__;
 
 /* frontend_loop is called periodically if this variable is TRUE    */
-BOOL frontend_call_loop = FALSE;
+BOOL frontend_call_loop = TRUE;
 
 /* a frontend status page is displayed with this frequency in ms */
 INT display_period = 000;
@@ -176,6 +178,20 @@ void update_calibration(INT hDB, INT hkey, void *info)
     db_set_data_index1(hDB, handleUpdateCal, &update_cal, sizeof(update_cal), 0, TID_BOOL, FALSE);
 }
 
+static void set_move_response(bool move_success)
+{
+  BOOL response[2];
+  response[0] = true;         // Index 0 just indicates we have a response
+  response[1] = move_success; // Index 1 indicates success or failure
+  db_set_value(hDB, 0, ODB_KEY_ARDUINO_MOVE_RESPONSE, &response, sizeof(response), 2, TID_BOOL);
+}
+
+// Called from frontend_loop for each command that completed in the background
+static void command_done(ArduinoCommand cmd, bool success)
+{
+  if (cmd == ARDUINO_CMD_MOVE) set_move_response(success);
+}
+
 void move_request(INT hDB, INT hkey, void *info)
 {
   if(!gMoveRequest) return; // Just return if move not requested...
@@ -210,14 +226,8 @@ void move_request(INT hDB, INT hkey, void *info)
     return;
   }
 
-  // Send MOVE to Arduino
-  bool move_success = arduino_move(destination, velocity);
-
-  // Set MoveResponse
-  response[0] = true;         // Index 0 just indicates we have a response
-  response[1] = move_success; // Index 0 indicates success or failure
-  size = sizeof(response);
-  status = db_set_value(hDB, 0, ODB_KEY_ARDUINO_MOVE_RESPONSE, &response, size, 2, TID_BOOL);
+  // Queue MOVE for the Arduino, MoveResponse is set once it completes (see command_done)
+  if (!arduino_move(destination, velocity)) set_move_response(false);
 
   // Reset MoveRequest
   BOOL move = false;
@@ -281,6 +291,14 @@ static INT setup_odb_var(const char *key, void *data, INT size, DWORD type)
 /*-- Frontend Init -------------------------------------------------*/
 INT frontend_init()
 {
+  /* ***************************** CONNECT TO ODB ***************************** */
+
+  int status = cm_get_experiment_database(&hDB, NULL);
+  if (status != CM_SUCCESS) {
+    cm_msg(MERROR, "frontend_init", "Cannot connect to ODB, cm_get_experiment_database() returned %d", status);
+    return FE_ERR_ODB;
+  }
+
   /* *************************** CONNECT TO ARDUINO *************************** */
 
   // Read the name of the serial device from the command line arguments
@@ -292,18 +310,18 @@ INT frontend_init()
     puts(argv[i]);
   }
 
-  if (argc != 2) {
-    printf("\nusage: %s <serial device file>\n\nexample:\n    %s /dev/ttyACM0\n\n", argv[0], argv[0]);
+  if (argc != 2 && argc != 3) {
+    printf("\nusage: %s <serial device file> [capture file]\n\nexample:\n    %s /dev/ttyACM0\n\n", argv[0], argv[0]);
     return FE_ERR_HW;
   }
 
-  if (!arduino_connect(argv[1])) return FE_ERR_HW;
-
-  /* ***************************** CONNECT TO ODB ***************************** */
-
-  int status = cm_get_experiment_database(&hDB, NULL);
-  if (status != CM_SUCCESS) {
-    cm_msg(MERROR, "frontend_init", "Cannot connect to ODB, cm_get_experiment_database() returned %d", status);
+  // The fastest baud rate found last time is tried first, and the one found now is kept for next time
+  DWORD baud_rate = SERIAL_BAUD_RATE;
+  if (setup_odb_var(ODB_KEY_ARDUINO_BAUD_RATE, &baud_rate, sizeof(baud_rate), TID_DWORD) != DB_SUCCESS) return FE_ERR_ODB;
+  if (!arduino_connect(argv[1], (argc == 3 ? argv[2] : nullptr), &baud_rate)) return FE_ERR_HW;
+  status = db_set_value(hDB, 0, ODB_KEY_ARDUINO_BAUD_RATE, &baud_rate, sizeof(baud_rate), 1, TID_DWORD);
+  if (status != DB_SUCCESS) {
+    cm_msg(MERROR, "frontend_init", "db_set_value failed for key: %s. Error: %d", ODB_KEY_ARDUINO_BAUD_RATE, status);
     return FE_ERR_ODB;
   }
 
@@ -379,6 +397,9 @@ INT resume_run(INT run_number, char *error)
 /*-- Frontend Loop -------------------------------------------------*/
 INT frontend_loop()
 {
+  // Report commands from the hotlinks as soon as they complete, rather than at the next
+  // readout (up to a readout period later)
+  arduino_poll_commands(command_done);
 
   return SUCCESS;
 }
@@ -431,38 +452,72 @@ INT read_arduino_state(char *pevent, INT off)
   // Create event header
   bk_init32(pevent);
 
+  // Pass on what the Arduino logged since the last readout
+  arduino_poll_log();
+
+  // Query everything at once
+  ArduinoState state;
+  arduino_get_state(&state);
+
   // Status Bank
-  DWORD status;
-  if (arduino_get_status(&status)) {
+  if (state.status_valid) {
     DWORD *pddata_status;
     bk_create(pevent, ODB_BANK_ARDUINO_STATUS, TID_DWORD, (void**)&pddata_status);
-    *pddata_status++ = status;
+    *pddata_status++ = state.status;
     bk_close(pevent, pddata_status);
   }
 
   // Gantry Bank
-  float gantry_x_mm, gantry_y_mm;
-  if (arduino_get_position(&gantry_x_mm, &gantry_y_mm)) {
+  if (state.position_valid) {
     float *pddata_gantry;
     bk_create(pevent, ODB_BANK_ARDUINO_GANTRY, TID_FLOAT, (void**)&pddata_gantry);
-    *pddata_gantry++ = gantry_x_mm;
-    *pddata_gantry++ = gantry_y_mm;
+    *pddata_gantry++ = state.gantry_x_mm;
+    *pddata_gantry++ = state.gantry_y_mm;
     bk_close(pevent, pddata_gantry);
   }
 
   // Temp Bank
-  TempData temp_data;
-  if (arduino_get_temp(&temp_data)) {
+  if (state.temp_valid) {
     double *pddata_temp;
     bk_create(pevent, ODB_BANK_ARDUINO_TEMP, TID_DOUBLE, (void**)&pddata_temp);
-    *pddata_temp++ = temp_data.temp_ambient;
-    *pddata_temp++ = temp_data.temp_motor_x;
-    *pddata_temp++ = temp_data.temp_motor_y;
-    *pddata_temp++ = temp_data.temp_mpmt;
-    *pddata_temp++ = temp_data.temp_optical;
+    *pddata_temp++ = state.temp.temp_ambient;
+    *pddata_temp++ = state.temp.temp_motor_x;
+    *pddata_temp++ = state.temp.temp_motor_y;
+    *pddata_temp++ = state.temp.temp_mpmt;
+    *pddata_temp++ = state.temp.temp_optical;
     bk_close(pevent, pddata_temp);
   }
 
+  // Telemetry Bank (time [s], x [mm], y [mm], x speed [mm/s], y speed [mm/s], flags per sample)
+  if (state.telemetry_count > 0) {
+    uint32_t count = (state.telemetry_count < ARDUINO_TELEMETRY_MAX ? state.telemetry_count : ARDUINO_TELEMETRY_MAX);
+    double *pddata_telem;
+    bk_create(pevent, ODB_BANK_ARDUINO_TELEMETRY, TID_DOUBLE, (void**)&pddata_telem);
+    for (uint32_t i = 0; i < count; i++) {
+      *pddata_telem++ = state.telemetry[i].time_s;
+      *pddata_telem++ = state.telemetry[i].gantry_x_mm;
+      *pddata_telem++ = state.telemetry[i].gantry_y_mm;
+      *pddata_telem++ = state.telemetry[i].vel_x_mm_s;
+      *pddata_telem++ = state.telemetry[i].vel_y_mm_s;
+      *pddata_telem++ = state.telemetry[i].flags;
+    }
+    bk_close(pevent, pddata_telem);
+  }
+
+  // Link Banks (LinkStats is all 32-bit counters, in the order they are declared)
+  if (state.link_stats_valid) {
+    DWORD *pddata_link;
+    bk_create(pevent, ODB_BANK_ARDUINO_LINK, TID_DWORD, (void**)&pddata_link);
+    memcpy(pddata_link, &state.link_stats_arduino, sizeof(LinkStats));
+    bk_close(pevent, pddata_link + sizeof(LinkStats) / sizeof(DWORD));
+  }
+  {
+    DWORD *pddata_link;
+    bk_create(pevent, ODB_BANK_HOST_LINK, TID_DWORD, (void**)&pddata_link);
+    memcpy(pddata_link, &state.link_stats_host, sizeof(LinkStats));
+    bk_close(pevent, pddata_link + sizeof(LinkStats) / sizeof(DWORD));
+  }
+
   return bk_size(pevent);
 
 }
@@ -15,6 +15,9 @@
 #define ODB_BANK_ARDUINO_STATUS            "STAT"
 #define ODB_BANK_ARDUINO_GANTRY            "GANT"
 #define ODB_BANK_ARDUINO_TEMP              "TEMP"
+#define ODB_BANK_ARDUINO_LINK              "LNKA" // Link health counters of the Arduino
+#define ODB_BANK_HOST_LINK                 "LNKH" // Link health counters of the host
+#define ODB_BANK_ARDUINO_TELEMETRY         "TELM" // Telemetry samples since the last readout
 
 // Keys
 #define ODB_KEY_ARDUINO_UPDATE_CAL         ODB_PATH_ARDUINO_SETTINGS "/UpdateCalibration"
@@ -23,6 +26,7 @@
 #define ODB_KEY_ARDUINO_MOVE_RESPONSE      ODB_PATH_ARDUINO_SETTINGS "/MoveResponse"
 #define ODB_KEY_ARDUINO_DESTINATION        ODB_PATH_ARDUINO_SETTINGS "/Destination"
 #define ODB_KEY_ARDUINO_VELOCITY           ODB_PATH_ARDUINO_SETTINGS "/Velocity"
+#define ODB_KEY_ARDUINO_BAUD_RATE          ODB_PATH_ARDUINO_SETTINGS "/BaudRate" // Fastest baud rate found, tried first
 
 #define ODB_KEY_ARDUINO_GANTRY_PULLEY_DIA  ODB_PATH_ARDUINO_SETTINGS "/Calibration/Gantry_PulleyDiameter"
 #define ODB_KEY_ARDUINO_GANTRY_ACCEL       ODB_PATH_ARDUINO_SETTINGS "/Calibration/Gantry_Accel"
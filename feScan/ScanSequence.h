@@ -0,0 +1,108 @@
+#ifndef SCAN_SEQUENCE_H
+#define SCAN_SEQUENCE_H
+
+#include <deque>
+#include <memory>
+
+/**
+ * @class ScanStep
+ *
+ * @brief One operation of a ScanSequence (e.g. a move or a measurement)
+ *
+ * Steps never block, they are polled from frontend_loop until they are done.
+ */
+class ScanStep
+{
+    public:
+        virtual ~ScanStep() {}
+
+        /**
+         * @brief Called once, when the previous step is done
+         *
+         * @return false if the step could not be started, which aborts the sequence
+         */
+        virtual bool start() = 0;
+
+        /**
+         * @return true once the step is done
+         */
+        virtual bool poll() = 0;
+};
+
+/**
+ * @class ScanSequence
+ *
+ * @brief Runs ScanSteps one after the other from a single-threaded loop
+ *
+ * A multi-step operation is written as a list of steps, in the order they happen, instead
+ * of as a state machine spread across flags:
+ *
+ *     seq.then(new MoveToStep(x, y));
+ *     seq.then(new WaitIdleStep());
+ *     seq.then(new MeasureStep(time_ms));
+ */
+class ScanSequence
+{
+    private:
+        std::deque<std::unique_ptr<ScanStep>> steps;
+        bool current_started;
+        bool aborted;
+
+    public:
+        ScanSequence() : current_started(false), aborted(false) {}
+
+        /**
+         * @brief Adds a step to the end of the sequence (the sequence takes ownership of it)
+         */
+        void then(ScanStep *step)
+        {
+            this->steps.push_back(std::unique_ptr<ScanStep>(step));
+        }
+
+        /**
+         * @brief Starts and polls steps until one is still in progress
+         *
+         * @return true if steps remain, false once the sequence is done (or aborted)
+         */
+        bool poll()
+        {
+            while (!this->steps.empty()) {
+                ScanStep& step = *this->steps.front();
+                if (!this->current_started) {
+                    if (!step.start()) {
+                        this->aborted = true;
+                        this->clear();
+                        return false;
+                    }
+                    this->current_started = true;
+                }
+                if (!step.poll()) return true;
+
+                this->steps.pop_front();
+                this->current_started = false;
+            }
+            return false;
+        }
+
+        /**
+         * @brief Drops all of the remaining steps
+         */
+        void clear()
+        {
+            this->steps.clear();
+            this->current_started = false;
+        }
+
+        /**
+         * @return true if a step failed to start since the last reset()
+         */
+        bool failed() { return this->aborted; }
+
+        void reset()
+        {
+            this->clear();
+            this->aborted = false;
+        }
+};
+
+#endif // SCAN_SEQUENCE_H
@@ -23,6 +23,7 @@ March 2022
 
 #include "feArduino.h"
 #include "shared_defs.h"
+#include "ScanSequence.h"
 
 #define  EQ_NAME   "Scan"
 #define  EQ_EVID   1
@@ -33,6 +34,8 @@ March 2022
 #define SCAN_STATUS_MOVING 2
 #define SCAN_STATUS_MEASURING 3
 
+#define MOVE_START_MS 500 // Time given to feMotor and feMove to notice that a move has started
+
 /* Hardware */
 extern HNDLE hDB;
 BOOL equipment_common_overwrite = FALSE;
@@ -66,7 +69,6 @@ INT event_buffer_size = 2 * max_event_size + 10000;
 
 /* Scan Type Flags  */
 BOOL gbl_called_BOR = FALSE;
-bool gGantryWasMoving = false; // Was gantry previously moving?
 int gbl_current_point = -1; // Which point are we on?
 bool gNewScanningPoint = false;
 bool gNewMoveStarted = false;
@@ -75,6 +77,7 @@ float gScanTime; // Scan time in milliseconds.
 typedef std::chrono::high_resolution_clock Clock;
 Clock::time_point timeStartMeasurement;  // time at the start of the measurement at particular point.   
 DWORD gScanStatus;
+ScanSequence gScanSequence; // Steps of the point being scanned
 
 /*-- Function declarations -----------------------------------------*/
 INT frontend_init();
@@ -147,6 +150,7 @@ INT begin_of_run(INT run_number, char *error)
   gScanStatus = SCAN_STATUS_STARTED;
   gNewScanningPoint = false;
   gNewMoveStarted = false;
+  gScanSequence.reset();
   // Get Scan parameters...
   std::string path;
   path += "/Equipment/";
@@ -253,7 +257,6 @@ INT begin_of_run(INT run_number, char *error)
 
   /* Start cycle */
   gbl_current_point = -1;
-  gGantryWasMoving = false;
 
   // We are starting to move;
   gbl_called_BOR = TRUE;
@@ -271,7 +274,7 @@ INT end_of_run(INT run_number, char *error)
 
   //Finished moving
   gbl_called_BOR = FALSE;
-  gGantryWasMoving = false;
+  gScanSequence.reset();
 
   gScanStatus = SCAN_STATUS_STOPPED;
 
@@ -333,15 +336,8 @@ bool measurement_complete()
   return (timediff >= (gScanTime + 1000));
 }
 
-int feloop_counter = 0;
-/*-- Frontend Loop -------------------------------------------------*/
-INT frontend_loop()
+bool gantry_moving()
 {
-  INT status;
-  char str[128];
-
-  feloop_counter++;
-
   midas::odb move_var = {
     {"Completed", false},
     {"Moving", false},
@@ -351,86 +347,118 @@ INT frontend_loop()
 
   move_var.connect("/Equipment/Move/Variables");
 
+  return (bool)move_var["Moving"];
+}
 
-  // Only want to start checking if the begin_of_run has been called.                                   
-  if (!gbl_called_BOR) return SUCCESS;
-
-  // Make sure we are running
-  if (run_state != STATE_RUNNING) return SUCCESS;
-
+int feloop_counter = 0;
 
-  // Are we making a move?
-  bool gantry_moving = (bool)move_var["Moving"];
-  
-  //std::cout << "Checking " << gantry_moving << " " << gGantryWasMoving << std::endl;
-  if (!gantry_moving ) { // No, we are not moving; 
-
-    if(gGantryWasMoving) { // We just finished moving.  Start the measurement (record current time)
-      start_measurement();
-      gScanStatus = SCAN_STATUS_MEASURING;
-      //      gGantryWasMoving = false;
-      gNewScanningPoint = true;
-      std::cout << "    Starting measurement at this point. " << feloop_counter << std::endl;
-    }
-    gGantryWasMoving = false;
+/*-- Scan Steps ----------------------------------------------------*/
 
-    // Have we finished doing the measurements at this point (or have we not moved at all yet)
-    if (measurement_complete() || (gbl_current_point < 0)) {
-      if (gbl_current_point >= 0) {
-        std::cout << "    Finished measurement at this point. " << feloop_counter << std::endl;
-      }
-    }
-    else { // If no, keep waiting
-      return SUCCESS;
-    }
+// Asks feMove to move the gantry to a scan point
+class MoveToStep : public ScanStep
+{
+  int point;
+  Clock::time_point time_start;
 
-    // Terminate the sequence once we have finished last move.
-    if (gbl_current_point >= (int)gScanPoints.size()) {
-      cm_msg(MINFO, "frontend_loop", "Stopping run after all points are done. Resetting current point number.");
-      gbl_current_point = 0;
-      // Stop the run
-      status = cm_transition(TR_STOP, 0, str, sizeof(str), TR_SYNC, 0);   
-      return status;
-    }
+public:
+  MoveToStep(int point) : point(point) {}
 
-    // increment for next position
-    gbl_current_point++;
+  bool start()
+  {
+    gbl_current_point = point;
     printf("POINT %d / %d: %i\n", (gbl_current_point + 1), (int)gScanPoints.size(),feloop_counter);
 
-    // Move
-    float x_mm = gScanPoints[gbl_current_point].first;
-    float y_mm = gScanPoints[gbl_current_point].second;
-    status = request_move(x_mm, y_mm);
-    if (status == SUCCESS) {
-        gScanStatus = SCAN_STATUS_MOVING;
-        gGantryWasMoving = true;
-        printf("    Started move to position (%.2f mm, %.2f mm) %i\n", x_mm, y_mm,feloop_counter);
-	// Sleep for 0.3s to make sure feMotor and feMove have correctly noticed that the move has started
-	usleep(500000);
-
-	gNewMoveStarted = true;     // Flag for BONM bank creation
-    }
-    else { // Move failed
-      // Stop the run
+    float x_mm = gScanPoints[point].first;
+    float y_mm = gScanPoints[point].second;
+    INT status = request_move(x_mm, y_mm);
+    if (status != SUCCESS) {
       printf("    MoveRequest failed. Error: %d\n", status);
-      status = cm_transition(TR_STOP, 0, str, sizeof(str), TR_SYNC, 0);
-      return status;
+      return false;
     }
 
-  } else {  // Yes, we are moving;
+    gScanStatus = SCAN_STATUS_MOVING;
+    gNewMoveStarted = true;     // Flag for BONM bank creation
+    printf("    Started move to position (%.2f mm, %.2f mm) %i\n", x_mm, y_mm,feloop_counter);
+    time_start = Clock::now();
+    return true;
+  }
 
-    //    if(!gGantryWasMoving){ // We just started moving; save appropriate point
-    // std::cout << "Recheck: actually started move
-    //  gNewMoveStarted = true;
-    //}
+  bool poll()
+  {
+    // Done once feMove reports the move, or has had plenty of time to
+    std::chrono::milliseconds ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - time_start);
+    return (gantry_moving() || ms.count() >= MOVE_START_MS);
+  }
+};
+
+// Waits for the gantry to stop moving
+class WaitIdleStep : public ScanStep
+{
+public:
+  bool start() { return true; }
+  bool poll() { return !gantry_moving(); }
+};
+
+// Measures at the current point
+class MeasureStep : public ScanStep
+{
+public:
+  bool start()
+  {
+    start_measurement();
+    gScanStatus = SCAN_STATUS_MEASURING;
+    gNewScanningPoint = true;
+    std::cout << "    Starting measurement at this point. " << feloop_counter << std::endl;
+    return true;
+  }
+
+  bool poll()
+  {
+    if (!measurement_complete()) return false;
+    std::cout << "    Finished measurement at this point. " << feloop_counter << std::endl;
+    return true;
+  }
+};
+
+/*-- Frontend Loop -------------------------------------------------*/
+INT frontend_loop()
+{
+  INT status;
+  char str[128];
 
-    gGantryWasMoving = true;
+  feloop_counter++;
 
+  // Only want to start checking if the begin_of_run has been called.                                   
+  if (!gbl_called_BOR) return SUCCESS;
 
+  // Make sure we are running
+  if (run_state != STATE_RUNNING) return SUCCESS;
 
+  // Carry on with the current point
+  if (gScanSequence.poll()) {
     usleep(1000);
+    return SUCCESS;
+  }
+
+  if (gScanSequence.failed()) { // Move failed
+    // Stop the run
+    status = cm_transition(TR_STOP, 0, str, sizeof(str), TR_SYNC, 0);
+    return status;
   }
-  usleep(1000);
+
+  // Terminate the sequence once we have finished last move.
+  if (gbl_current_point + 1 >= (int)gScanPoints.size()) {
+    cm_msg(MINFO, "frontend_loop", "Stopping run after all points are done. Resetting current point number.");
+    gbl_current_point = 0;
+    // Stop the run
+    status = cm_transition(TR_STOP, 0, str, sizeof(str), TR_SYNC, 0);   
+    return status;
+  }
+
+  // Scan the next point
+  gScanSequence.then(new MoveToStep(gbl_current_point + 1));
+  gScanSequence.then(new WaitIdleStep());
+  gScanSequence.then(new MeasureStep());
 
   return SUCCESS;
 }
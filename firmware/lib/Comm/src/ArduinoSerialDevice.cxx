@@ -1,6 +1,6 @@
 #include "ArduinoSerialDevice.h"
 
-ArduinoSerialDevice::ArduinoSerialDevice(HardwareSerial &device) : device(device)
+ArduinoSerialDevice::ArduinoSerialDevice(HardwareSerial &device) : ArduinoStreamDevice(device), device(device)
 {
     // Nothing else to do
 }
@@ -11,39 +11,11 @@ bool ArduinoSerialDevice::ser_connect(SerialBaudRate baud_rate)
     return true;
 }
 
-void ArduinoSerialDevice::ser_flush()
+bool ArduinoSerialDevice::ser_set_baud_rate(SerialBaudRate baud_rate)
 {
-    // Wait for 10 ms for last bits of data
-    delay(10);
-    uint32_t avail = this->device.available();
-    while (avail > 0) {
-        this->device.read();
-        avail--;
-    }
-}
-
-uint32_t ArduinoSerialDevice::ser_available()
-{
-    return this->device.available();
-}
-
-bool ArduinoSerialDevice::ser_read(uint8_t *out)
-{
-    *out = this->device.read();
+    // Wait for pending data to go out at the old baud rate
+    this->device.flush();
+    this->device.end();
+    this->device.begin(baud_rate);
     return true;
-}
-
-bool ArduinoSerialDevice::ser_write(uint8_t *data, uint32_t length)
-{
-    return this->device.write(data, length) == length;
-}
-
-void ArduinoSerialDevice::ser_disconnect()
-{
-    // Do nothing
-}
-
-uint64_t ArduinoSerialDevice::platform_millis()
-{
-    return millis();
 }
\ No newline at end of file
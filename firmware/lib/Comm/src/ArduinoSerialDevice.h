@@ -1,25 +1,23 @@
 #ifndef ARDUINO_SERIAL_DEVICE_H
 #define ARDUINO_SERIAL_DEVICE_H
 
-#include <SerialDevice.h>
-#include <Arduino.h>
+#include "ArduinoStreamDevice.h"
 
-class ArduinoSerialDevice: public SerialDevice
+/**
+ * @class ArduinoSerialDevice
+ *
+ * @brief Implementation of SerialDevice for a UART of the Due (e.g. Serial, the programming port)
+ */
+class ArduinoSerialDevice: public ArduinoStreamDevice
 {
     private:
         HardwareSerial &device;
 
     public:
         ArduinoSerialDevice(HardwareSerial &device);
-        
-        bool ser_connect(SerialBaudRate baud_rate);
-        void ser_flush();
-        uint32_t ser_available();
-        bool ser_read(uint8_t *out);
-        bool ser_write(uint8_t *data, uint32_t length);
-        void ser_disconnect();
 
-        uint64_t platform_millis();
+        bool ser_connect(SerialBaudRate baud_rate);
+        bool ser_set_baud_rate(SerialBaudRate baud_rate);
 };
 
 #endif // ARDUINO_SERIAL_DEVICE_H
\ No newline at end of file
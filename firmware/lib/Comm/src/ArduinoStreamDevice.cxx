@@ -0,0 +1,99 @@
+#include "ArduinoStreamDevice.h"
+
+ArduinoStreamDevice::ArduinoStreamDevice(Stream &stream) : stream(stream)
+{
+    // Nothing else to do
+}
+
+void ArduinoStreamDevice::ser_flush()
+{
+    // Wait for 10 ms for last bits of data
+    delay(10);
+    uint32_t avail = this->stream.available();
+    while (avail > 0) {
+        this->stream.read();
+        avail--;
+    }
+}
+
+uint32_t ArduinoStreamDevice::ser_available()
+{
+    return this->stream.available();
+}
+
+bool ArduinoStreamDevice::ser_read(uint8_t *out)
+{
+    int byte_in = this->stream.read();
+    if (byte_in < 0) return false;
+    *out = (uint8_t)byte_in;
+    return true;
+}
+
+uint32_t ArduinoStreamDevice::ser_read_bulk(uint8_t *buf, uint32_t max_length)
+{
+    uint32_t avail = this->stream.available();
+    if (avail > max_length) avail = max_length;
+
+    for (uint32_t i = 0; i < avail; i++) {
+        buf[i] = this->stream.read();
+    }
+    return avail;
+}
+
+bool ArduinoStreamDevice::ser_wait(uint32_t timeout_ms)
+{
+    uint32_t time_start = millis();
+    while (this->stream.available() == 0) {
+        if ((millis() - time_start) >= timeout_ms) return false;
+        // Sleep until the next interrupt: either the port's receive interrupt (UART RX or
+        // USB endpoint, which moves the received data into the ring buffer) or the 1 ms SysTick
+        __WFI();
+    }
+    return true;
+}
+
+bool ArduinoStreamDevice::ser_write(uint8_t *data, uint32_t length)
+{
+    return this->stream.write(data, length) == length;
+}
+
+bool ArduinoStreamDevice::ser_writev(const SerialIOVec *iov, uint32_t count)
+{
+    // Coalesce the buffers so the port sees as few writes as possible (on the USB port each
+    // write goes out as its own packet)
+    uint8_t tx_buf[ARDUINO_SERIAL_TX_BUF_SIZE];
+    uint32_t tx_len = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *data = iov[i].data;
+        uint32_t remaining = iov[i].length;
+        while (remaining > 0) {
+            uint32_t chunk = ARDUINO_SERIAL_TX_BUF_SIZE - tx_len;
+            if (chunk > remaining) chunk = remaining;
+            memcpy(&tx_buf[tx_len], data, chunk);
+            tx_len += chunk;
+            data += chunk;
+            remaining -= chunk;
+
+            if (tx_len == ARDUINO_SERIAL_TX_BUF_SIZE) {
+                if (!this->ser_write(tx_buf, tx_len)) return false;
+                tx_len = 0;
+            }
+        }
+    }
+
+    if (tx_len > 0) {
+        return this->ser_write(tx_buf, tx_len);
+    }
+    return true;
+}
+
+void ArduinoStreamDevice::ser_disconnect()
+{
+    // Do nothing
+}
+
+uint64_t ArduinoStreamDevice::platform_millis()
+{
+    return millis();
+}
@@ -0,0 +1,39 @@
+#ifndef ARDUINO_STREAM_DEVICE_H
+#define ARDUINO_STREAM_DEVICE_H
+
+#include <SerialDevice.h>
+#include <Arduino.h>
+
+/** Size of the staging buffer used to coalesce gather-writes (one full speed USB bulk packet) */
+#define ARDUINO_SERIAL_TX_BUF_SIZE 64
+
+/**
+ * @class ArduinoStreamDevice
+ *
+ * @brief Implementation of SerialDevice for any Arduino Stream (a UART or the native USB port)
+ *
+ * Reading, writing and waiting for data are the same on every port. Opening the port and
+ * changing its baud rate are not, so they are left to ArduinoSerialDevice and
+ * ArduinoUSBSerialDevice.
+ */
+class ArduinoStreamDevice: public SerialDevice
+{
+    protected:
+        Stream &stream;
+
+    public:
+        ArduinoStreamDevice(Stream &stream);
+
+        void ser_flush();
+        uint32_t ser_available();
+        bool ser_read(uint8_t *out);
+        uint32_t ser_read_bulk(uint8_t *buf, uint32_t max_length);
+        bool ser_wait(uint32_t timeout_ms);
+        bool ser_write(uint8_t *data, uint32_t length);
+        bool ser_writev(const SerialIOVec *iov, uint32_t count);
+        void ser_disconnect();
+
+        uint64_t platform_millis();
+};
+
+#endif // ARDUINO_STREAM_DEVICE_H
@@ -0,0 +1,22 @@
+#include "ArduinoUSBSerialDevice.h"
+
+ArduinoUSBSerialDevice::ArduinoUSBSerialDevice(Serial_ &device) : ArduinoStreamDevice(device), device(device)
+{
+    // Nothing else to do
+}
+
+bool ArduinoUSBSerialDevice::ser_connect(SerialBaudRate baud_rate)
+{
+    // The baud rate only matters to a UART on the other end of the USB, there is none here
+    this->device.begin(baud_rate);
+    return true;
+}
+
+bool ArduinoUSBSerialDevice::ser_set_baud_rate(SerialBaudRate baud_rate)
+{
+    // Deliberately a no-op: the baud rate the host sets only reaches us as a CDC line coding
+    // request, and USB transfers run at full speed whatever it is. Returning true lets the
+    // host's baud rate negotiation go through, and the link keeps working at every rate it
+    // tries since neither end's data rate actually changes.
+    return true;
+}
@@ -0,0 +1,27 @@
+#ifndef ARDUINO_USB_SERIAL_DEVICE_H
+#define ARDUINO_USB_SERIAL_DEVICE_H
+
+#include "ArduinoStreamDevice.h"
+
+/**
+ * @class ArduinoUSBSerialDevice
+ * 
+ * @brief Implementation of SerialDevice for the native USB port of the Due (SerialUSB)
+ * 
+ * The port is a USB CDC device running at full speed, so unlike ArduinoSerialDevice there
+ * is no UART or USB bridge between the protocol stack and the host. The baud rate is
+ * ignored, data always moves at USB speed.
+ */
+class ArduinoUSBSerialDevice: public ArduinoStreamDevice
+{
+    private:
+        Serial_ &device;
+
+    public:
+        ArduinoUSBSerialDevice(Serial_ &device);
+
+        bool ser_connect(SerialBaudRate baud_rate);
+        bool ser_set_baud_rate(SerialBaudRate baud_rate);
+};
+
+#endif // ARDUINO_USB_SERIAL_DEVICE_H
@@ -1,30 +1,49 @@
 #include "TestStandCommController.h"
+#include "TestStandCodec.h"
 
 #include <Arduino.h>
 
-#define EXTRACT(_dest, _src, _conv)        \
-do {                                       \
-    memcpy(_dest, _src, sizeof(*(_dest))); \
-    *(_dest) = _conv(*(_dest));            \
-} while (0)
-
-TestStandCommController::TestStandCommController(SerialDevice &device) : TestStandComm(device)
+TestStandCommController::TestStandCommController(SerialDevice &device) : TestStandComm(device), log_flushed_ms(0)
 {
     // Nothing else to do
 }
 
-SerialResult TestStandCommController::log(LogLevel log_level, const char *fmt, ...)
+void TestStandCommController::record_log(LogFormatId id, const uint32_t *args, uint8_t argc)
+{
+    // The main loop and ISRs may both log, and the main loop drains the buffer
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    this->log_buffer.record(millis(), (uint8_t)id, args, argc);
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Sends the recorded log entries in one MSG_ID_LOG frame
+ * 
+ * Meant to be called when the link is idle. Like telemetry, logs are only sent on a
+ * windowed link with room in the send window, and at most every LOG_FLUSH_INTERVAL_MS so
+ * entries are batched. Entries that do not fit in the frame wait for the next call.
+ * 
+ * @return SERIAL_OK_NO_MSG if there was nothing to send or it is not time yet
+ *         SERIAL_ERR_BUSY if the link has no room for the frame
+ *         @see SerialSession::send_message(Message& msg)
+ */
+SerialResult TestStandCommController::flush_log()
 {
-    this->send_buf[0] = (uint8_t)log_level;
+    uint32_t now_ms = millis();
+    if (now_ms - this->log_flushed_ms < LOG_FLUSH_INTERVAL_MS) return SERIAL_OK_NO_MSG;
+    if (this->log_buffer.empty()) return SERIAL_OK_NO_MSG;
+    if (this->session.get_window_free() == 0) return SERIAL_ERR_BUSY;
 
-    va_list args;
-    va_start(args, fmt);
-    uint8_t length = (uint8_t)vsnprintf((char *)(this->send_buf + 1), (MSG_DATA_LENGTH_MAX - 1), fmt, args);
-    va_end(args);
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t length = this->log_buffer.drain(this->send_buf, MSG_DATA_LENGTH_MAX, now_ms);
+    __set_PRIMASK(primask);
 
+    this->log_flushed_ms = now_ms;
     Message msg = {
         .id = MSG_ID_LOG,
-        .length = (uint8_t)(1 + length + 1), // 1 byte for log level + string length
+        .length = length,
         .data = this->send_buf
     };
     return this->session.send_message(msg);
@@ -36,7 +55,8 @@ SerialResult TestStandCommController::status(Status status)
     Message msg = {
         .id = MSG_ID_STATUS,
         .length = 1,
-        .data = &status8
+        .data = &status8,
+        .txn = this->received_message().txn // Reply to the request being handled
     };
     return this->session.send_message(msg);
 }
@@ -44,33 +64,26 @@ SerialResult TestStandCommController::status(Status status)
 SerialResult TestStandCommController::position(int32_t x_counts, int32_t y_counts)
 {
     PositionMsgData data = {
-        .x_counts = htonl(x_counts),
-        .y_counts = htonl(y_counts)
+        .x_counts = x_counts,
+        .y_counts = y_counts
     };
 
-    Message msg = {
-        .id = MSG_ID_POSITION,
-        .length = sizeof(data),
-        .data = (uint8_t *)&data
-    };
+    // Reply to the request being handled
+    Message msg = codec_encode<MSG_ID_POSITION>(data, this->send_buf, this->received_message().txn);
     return this->session.send_message(msg);
 }
 
-SerialResult TestStandCommController::temp(TempData *temp_data)
+SerialResult TestStandCommController::axis_state(const AxisStateData& state)
 {
-    TempMsgData data = {
-        .temp_ambient = htonl(round(temp_data->temp_ambient * temp_data_scaler)),
-        .temp_motor_x = htonl(round(temp_data->temp_motor_x * temp_data_scaler)),
-        .temp_motor_y = htonl(round(temp_data->temp_motor_y * temp_data_scaler)),
-        .temp_mpmt    = htonl(round(temp_data->temp_mpmt    * temp_data_scaler)),
-        .temp_optical = htonl(round(temp_data->temp_optical * temp_data_scaler))
-    };
+    // Reply to the request being handled
+    Message msg = codec_encode<MSG_ID_AXIS_STATE>(state, this->send_buf, this->received_message().txn);
+    return this->session.send_message(msg);
+}
 
-    Message msg = {
-        .id = MSG_ID_TEMP,
-        .length = sizeof(data),
-        .data = (uint8_t *)&data
-    };
+SerialResult TestStandCommController::temp(TempData *temp_data)
+{
+    // Reply to the request being handled
+    Message msg = codec_encode<MSG_ID_TEMP>(*temp_data, this->send_buf, this->received_message().txn);
     return this->session.send_message(msg);
 }
 
@@ -81,22 +94,105 @@ SerialResult TestStandCommController::axis_result(AxisResult result)
     Message msg = {
         .id = MSG_ID_AXIS_RESULT,
         .length = 1,
-        .data = &result8
+        .data = &result8,
+        .txn = this->received_message().txn // Reply to the request being handled
     };
     return this->session.send_message(msg);
 }
 
+SerialResult TestStandCommController::telemetry_rate(uint16_t rate_hz)
+{
+    // Reply to the request being handled
+    Message msg = codec_encode<MSG_ID_TELEMETRY_RATE>(rate_hz, this->send_buf, this->received_message().txn);
+    return this->session.send_message(msg);
+}
+
+SerialResult TestStandCommController::snapshot(const Snapshot& snapshot)
+{
+    // Reply to the request being handled
+    Message msg = codec_encode<MSG_ID_SNAPSHOT>(snapshot, this->send_buf, this->received_message().txn);
+    return this->session.send_message(msg);
+}
+
+/**
+ * @brief Sends a telemetry sample, unless it would have to wait for room in the send window
+ * 
+ * @return SERIAL_ERR_BUSY if the sample was skipped
+ *         @see SerialSession::send_message(Message& msg)
+ */
+SerialResult TestStandCommController::telemetry(const TelemetryMsgData& data)
+{
+    // A late sample is worth less than a late control loop
+    if (this->session.get_window_free() == 0) return SERIAL_ERR_BUSY;
+
+    Message msg = codec_encode<MSG_ID_TELEMETRY>(data, this->send_buf);
+    return this->session.send_message(msg);
+}
+
+SerialResult TestStandCommController::position_stream_rate(uint16_t rate_hz)
+{
+    // Reply to the request being handled
+    Message msg = codec_encode<MSG_ID_POSITION_STREAM_RATE>(rate_hz, this->send_buf, this->received_message().txn);
+    return this->session.send_message(msg);
+}
+
+/**
+ * @brief Starts a new position stream, its first frame is a key frame
+ * 
+ * @param period_us Time between the samples that will be added
+ */
+void TestStandCommController::start_position_stream(uint32_t period_us)
+{
+    this->position_encoder.reset(period_us);
+}
+
+/**
+ * @brief Adds a sample to the position stream, sending the batch once it is full
+ * 
+ * Like telemetry, a full batch that would have to wait for room in the send window is
+ * dropped rather than holding up the control loop (@see PositionStreamEncoder::drop).
+ * 
+ * @return SERIAL_OK if the sample was batched or the batch was sent
+ *         SERIAL_ERR_BUSY if the batch was dropped
+ *         @see SerialSession::send_message(Message& msg)
+ */
+SerialResult TestStandCommController::position_sample(uint32_t time_us, int32_t x_counts, int32_t y_counts)
+{
+    if (!this->position_encoder.add(time_us, x_counts, y_counts)) return SERIAL_OK;
+
+    if (this->session.get_window_free() == 0) {
+        this->position_encoder.drop();
+        return SERIAL_ERR_BUSY;
+    }
+
+    Message msg = {
+        .id = MSG_ID_POSITION_STREAM,
+        .length = this->position_encoder.encode(this->send_buf),
+        .data = this->send_buf
+    };
+    SerialResult res = this->session.send_message(msg);
+    if (res == SERIAL_OK) {
+        this->position_encoder.commit();
+    }
+    else {
+        this->position_encoder.drop();
+    }
+    return res;
+}
+
 bool TestStandCommController::recv_move(MoveMsgData *data_out)
 {
-    if (this->received_message().length != sizeof(MoveMsgData)) return false;
+    return codec_decode<MSG_ID_MOVE>(this->received_message(), data_out) == SERIAL_OK;
+}
 
-    // Copy message data into output struct
-    memcpy(data_out, this->received_message().data, sizeof(MoveMsgData));
-    // Fixup byte order
-    data_out->vel_hold    = ntohl(data_out->vel_hold);
-    data_out->dist_counts = ntohl(data_out->dist_counts);
+bool TestStandCommController::recv_set_telemetry(uint16_t *rate_hz_out)
+{
+    return codec_decode<MSG_ID_SET_TELEMETRY>(this->received_message(), rate_hz_out) == SERIAL_OK;
+}
 
-    return true;
+bool TestStandCommController::recv_set_position_stream(uint16_t *rate_hz_out)
+{
+    return codec_decode<MSG_ID_SET_POSITION_STREAM>(this->received_message(), rate_hz_out) == SERIAL_OK;
 }
 
 bool TestStandCommController::recv_calibrate(Calibration *cal_out)
@@ -104,16 +200,16 @@ bool TestStandCommController::recv_calibrate(Calibration *cal_out)
     if (this->received_message().length < 1) return false;
 
     uint8_t *data = this->received_message().data;
+    uint8_t length = this->received_message().length - 1;
 
     switch (data[0]) {
-        case CAL_GANTRY_ACCEL:      EXTRACT(&(cal_out->cal_gantry.accel),      &data[1], ntohl); break;
-        case CAL_GANTRY_VEL_START:  EXTRACT(&(cal_out->cal_gantry.vel_start),  &data[1], ntohl); break;
-        case CAL_GANTRY_VEL_HOME:   EXTRACT(&(cal_out->cal_gantry.vel_home),   &data[1], ntohl); break;
-        case CAL_TEMP_ALL_C1:       EXTRACT(&(cal_out->cal_temp.all.c1),       &data[1], ntohd); break;
-        case CAL_TEMP_ALL_C2:       EXTRACT(&(cal_out->cal_temp.all.c2),       &data[1], ntohd); break;
-        case CAL_TEMP_ALL_C3:       EXTRACT(&(cal_out->cal_temp.all.c3),       &data[1], ntohd); break;
-        case CAL_TEMP_ALL_RESISTOR: EXTRACT(&(cal_out->cal_temp.all.resistor), &data[1], ntohd); break;
+        case CAL_GANTRY_ACCEL:      return codec_get(&data[1], length, &cal_out->cal_gantry.accel);
+        case CAL_GANTRY_VEL_START:  return codec_get(&data[1], length, &cal_out->cal_gantry.vel_start);
+        case CAL_GANTRY_VEL_HOME:   return codec_get(&data[1], length, &cal_out->cal_gantry.vel_home);
+        case CAL_TEMP_ALL_C1:       return codec_get(&data[1], length, &cal_out->cal_temp.all.c1);
+        case CAL_TEMP_ALL_C2:       return codec_get(&data[1], length, &cal_out->cal_temp.all.c2);
+        case CAL_TEMP_ALL_C3:       return codec_get(&data[1], length, &cal_out->cal_temp.all.c3);
+        case CAL_TEMP_ALL_RESISTOR: return codec_get(&data[1], length, &cal_out->cal_temp.all.resistor);
         default: return false;
     }
-    return true;
 }
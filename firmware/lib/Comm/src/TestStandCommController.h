@@ -14,6 +14,14 @@
 
 /* ************************ Shared Project Includes ************************ */
 #include "shared_defs.h"
+#include "TestStandCodec.h"
+#include "PositionStream.h"
+#include "BinaryLog.h"
+
+/** Least time between two MSG_ID_LOG frames (ms) */
+#ifndef LOG_FLUSH_INTERVAL_MS
+#define LOG_FLUSH_INTERVAL_MS 100
+#endif // LOG_FLUSH_INTERVAL_MS
 
 /**
  * @class TestStandCommController
@@ -22,18 +30,49 @@
  */
 class TestStandCommController : public TestStandComm
 {
+    private:
+        PositionStreamEncoder position_encoder;
+        LogBuffer log_buffer;
+        uint32_t log_flushed_ms;
+
+        void record_log(LogFormatId id, const uint32_t *args, uint8_t argc);
+
     public:
         TestStandCommController(SerialDevice &device);
 
-        SerialResult log(LogLevel log_level, const char *fmt, ...);
+        /**
+         * @brief Records a log entry to be sent later (@see flush_log)
+         * 
+         * Only the ID and the arguments are stored, the host formats the text. Safe to call
+         * from an ISR.
+         * 
+         * @param args Up to LOG_ARGS_MAX integer arguments, matching the format of the ID
+         */
+        template<typename... Args>
+        void log(LogFormatId id, Args... args)
+        {
+            static_assert(sizeof...(args) <= LOG_ARGS_MAX, "Too many log arguments");
+            const uint32_t words[] = { 0, (uint32_t)args... };
+            this->record_log(id, &words[1], sizeof...(args));
+        }
+        SerialResult flush_log();
+
         SerialResult status(Status status);
         SerialResult position(int32_t x_counts, int32_t y_counts);
-        SerialResult axis_state(/*TODO*/);
+        SerialResult axis_state(const AxisStateData& state);
         SerialResult temp(TempData *temp_data);
         SerialResult axis_result(AxisResult result);
+        SerialResult telemetry_rate(uint16_t rate_hz);
+        SerialResult telemetry(const TelemetryMsgData& data);
+        SerialResult snapshot(const Snapshot& snapshot);
+        SerialResult position_stream_rate(uint16_t rate_hz);
+        void start_position_stream(uint32_t period_us);
+        SerialResult position_sample(uint32_t time_us, int32_t x_counts, int32_t y_counts);
 
         bool recv_move(MoveMsgData *data_out);
         bool recv_calibrate(Calibration *cal_out);
+        bool recv_set_telemetry(uint16_t *rate_hz_out);
+        bool recv_set_position_stream(uint16_t *rate_hz_out);
 };
 
 #endif // TEST_STAND_COMM_CONTROLLER_H
@@ -0,0 +1,88 @@
+/* ************************ Shared Project Includes ************************ */
+#include "ParserBench.h"
+
+/* **************************** System Includes **************************** */
+#include <Arduino.h>
+
+#include <stdio.h>
+
+/*
+ * Cycle counts for the SerialTransport receive state machine on the Due, built by the
+ * parser_bench environment instead of the test stand firmware. The streams are the same ones
+ * CommBench times on the host PC (@see ParserBench.h), just shorter to fit in RAM.
+ */
+
+/** Size of the synthetic stream buffer (bytes) */
+#ifndef PARSER_BENCH_STREAM_SIZE
+#define PARSER_BENCH_STREAM_SIZE (16 * 1024)
+#endif // PARSER_BENCH_STREAM_SIZE
+
+/** Number of times each stream is parsed */
+#ifndef PARSER_BENCH_PASSES
+#define PARSER_BENCH_PASSES 10
+#endif // PARSER_BENCH_PASSES
+
+uint8_t stream_buf[PARSER_BENCH_STREAM_SIZE];
+StreamDevice stream_device(stream_buf, sizeof(stream_buf));
+
+char line[128];
+
+/**
+ * @brief Starts the DWT cycle counter, which counts core clock cycles
+ */
+static void cycle_counter_init()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static void bench_parser(SerialFraming framing, ParserStream stream)
+{
+    uint32_t frames = parser_stream_build(stream, framing, stream_device);
+    uint32_t bytes = stream_device.bytes();
+
+    // One pass is a few million cycles, well short of the 32-bit counter wrapping
+    uint64_t cycles = 0;
+    uint32_t received = 0;
+    for (uint32_t pass = 0; pass < PARSER_BENCH_PASSES; pass++) {
+        uint32_t start = DWT->CYCCNT;
+        received = parser_stream_parse(stream, framing, stream_device);
+        cycles += (uint32_t)(DWT->CYCCNT - start);
+    }
+
+    // No float printing on the Due, so cycles/byte in tenths
+    uint64_t total_bytes = (uint64_t)bytes * PARSER_BENCH_PASSES;
+    uint32_t cycles_per_byte_x10 = (uint32_t)((cycles * 10) / total_bytes);
+    uint32_t frames_per_sec = (uint32_t)(((uint64_t)frames * PARSER_BENCH_PASSES * VARIANT_MCK) / cycles);
+
+    snprintf(line, sizeof(line), "%-10s %-8s %7lu.%lu %12lu %8lu %10lu\n",
+             (framing == SERIAL_FRAMING_COBS ? "cobs" : "delimited"), parser_stream_name(stream),
+             (unsigned long)(cycles_per_byte_x10 / 10), (unsigned long)(cycles_per_byte_x10 % 10),
+             (unsigned long)frames_per_sec, (unsigned long)frames, (unsigned long)received);
+    Serial.print(line);
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    while (!Serial);
+    cycle_counter_init();
+
+    snprintf(line, sizeof(line), "Receive state machine (%d passes over %lu byte streams, %lu MHz)\n",
+             PARSER_BENCH_PASSES, (unsigned long)sizeof(stream_buf), (unsigned long)(VARIANT_MCK / 1000000));
+    Serial.print(line);
+    Serial.print("framing    stream   cycles/byte     frames/s   frames   received\n");
+
+    SerialFraming framings[] = { SERIAL_FRAMING_DELIMITED, SERIAL_FRAMING_COBS };
+    for (SerialFraming framing : framings) {
+        for (int stream = 0; stream < PARSER_STREAM_COUNT; stream++) {
+            bench_parser(framing, (ParserStream)stream);
+        }
+    }
+}
+
+void loop()
+{
+    // Nothing to do, the results are printed once
+}
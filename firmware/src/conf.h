@@ -6,7 +6,11 @@
 
 const mPMTTestStandConfig conf = {
     // Serial Devices
-    .serial_comm            = Serial,
+#ifdef SERIAL_COMM_NATIVE_USB
+    .serial_comm            = SerialUSB, // Native USB port
+#else // !SERIAL_COMM_NATIVE_USB
+    .serial_comm            = Serial,    // Programming port
+#endif // !SERIAL_COMM_NATIVE_USB
     .serial_comm_baud_rate  = SERIAL_BAUD_RATE,
     // Gantry X-Axis Pins
     .io_axis_x = {
@@ -21,6 +21,10 @@ mPMTTestStand::mPMTTestStand(const mPMTTestStandConfig &conf, Calibration cal) :
     this->y_state = axis_get_state(AXIS_Y);
 
     this->status = STATUS_IDLE;
+    this->telemetry_period_us = 0;
+    this->telemetry_last_us = 0;
+    this->position_period_us = 0;
+    this->position_last_us = 0;
 }
 
 void mPMTTestStand::setup()
@@ -37,7 +41,8 @@ void mPMTTestStand::setup()
     this->thermistors.setup();
 
     // Connect serial communications
-    this->comm_dev.ser_connect(this->conf.serial_comm_baud_rate);
+    this->comm.connect(this->conf.serial_comm_baud_rate);
+    this->comm.set_ext_buffer(this->comm_ext_buf, sizeof(this->comm_ext_buf));
 
     // Wait until we can successfully ping the host
     while (this->comm.ping() != SERIAL_OK) {
@@ -45,6 +50,7 @@ void mPMTTestStand::setup()
         DEBUG_PRINTLN("Waiting for host...");
     }
     DEBUG_PRINTLN("Host connected!");
+    this->comm.log(LOG_FMT_STARTED, (uint32_t)this->comm.baud_rate());
 
     this->status = STATUS_IDLE;
 }
@@ -54,6 +60,30 @@ void mPMTTestStand::handle_echo()
     this->comm.recv_echo();
 }
 
+void mPMTTestStand::handle_negotiate()
+{
+    // The host subscribes again once the link is set up
+    this->telemetry_period_us = 0;
+    this->position_period_us = 0;
+    this->comm.recv_negotiate();
+    DEBUG_PRINT_VAL("Window size ", this->comm.window_size());
+    this->comm.log(LOG_FMT_NEGOTIATED, this->comm.features(), this->comm.window_size());
+}
+
+void mPMTTestStand::handle_change_baud()
+{
+    this->telemetry_period_us = 0;
+    this->position_period_us = 0;
+    this->comm.recv_change_baud_rate();
+    DEBUG_PRINT_VAL("Baud rate ", this->comm.baud_rate());
+    this->comm.log(LOG_FMT_BAUD_CHANGED, (uint32_t)this->comm.baud_rate());
+}
+
+void mPMTTestStand::handle_get_link_stats()
+{
+    this->comm.recv_get_link_stats();
+}
+
 /**
  * @brief Handles the first part of the homing routine (part A)
  * 
@@ -99,7 +129,7 @@ void mPMTTestStand::handle_home_b()
 
 void mPMTTestStand::handle_move()
 {
-    MoveMsgData data;
+    MoveMsgData data = {};
     AxisResult res;
     if (this->comm.recv_move(&data)) {
         AxisMotionSpec motion = {
@@ -119,6 +149,7 @@ void mPMTTestStand::handle_move()
     else {
         res = AXIS_ERR_INVALID;
     }
+    if (res != AXIS_OK) this->comm.log(LOG_FMT_MOVE_REJECTED, data.axis, res);
     this->comm.axis_result(res);
 }
 
@@ -127,6 +158,7 @@ void mPMTTestStand::handle_stop()
     axis_stop(AXIS_X);
     axis_stop(AXIS_Y);
     this->status = STATUS_IDLE;
+    this->comm.log(LOG_FMT_STOPPED, this->x_state->encoder_current, this->y_state->encoder_current);
 }
 
 void mPMTTestStand::handle_get_status()
@@ -141,7 +173,20 @@ void mPMTTestStand::handle_get_position()
 
 void mPMTTestStand::handle_get_axis_state()
 {
-    // TODO
+    const AxisState *axis_states[2] = { this->x_state, this->y_state };
+
+    AxisStateData data;
+    for (int axis = AXIS_X; axis <= AXIS_Y; axis++) {
+        const AxisState *state = axis_states[axis];
+        data.axis[axis].moving           = state->moving;
+        data.axis[axis].ls_home_pressed  = state->ls_home_pressed;
+        data.axis[axis].ls_far_pressed   = state->ls_far_pressed;
+        data.axis[axis].velocity_segment = (uint8_t)state->velocity_segment;
+        data.axis[axis].velocity         = state->velocity;
+        data.axis[axis].next_velocity    = state->next_velocity;
+        data.axis[axis].encoder_target   = state->encoder_target;
+    }
+    this->comm.axis_state(data);
 }
 
 void mPMTTestStand::handle_get_temp()
@@ -151,9 +196,128 @@ void mPMTTestStand::handle_get_temp()
     this->comm.temp(&temp_data);
 }
 
+/**
+ * @brief Replies with the status, position, axis state and temperatures in one message
+ */
+void mPMTTestStand::handle_get_snapshot()
+{
+    Snapshot snapshot = {
+        .status   = this->status,
+        .position = {
+            .x_counts = this->x_state->encoder_current,
+            .y_counts = this->y_state->encoder_current
+        },
+        .axis_state = {
+            .x_motion  = this->x_state->moving,
+            .y_motion  = this->y_state->moving,
+            .x_ls_far  = this->x_state->ls_far_pressed,
+            .y_ls_far  = this->y_state->ls_far_pressed,
+            .x_ls_home = this->x_state->ls_home_pressed,
+            .y_ls_home = this->y_state->ls_home_pressed
+        }
+    };
+    this->thermistors.read_temp_data(snapshot.temp);
+    this->comm.snapshot(snapshot);
+}
+
 void mPMTTestStand::handle_calibrate()
 {
-    this->comm.recv_calibrate(&this->cal);
+    if (this->comm.recv_calibrate(&this->cal)) {
+        this->comm.log(LOG_FMT_CALIBRATED, this->comm.received_message().data[0]);
+    }
+    else {
+        this->comm.log(LOG_FMT_CALIBRATE_INVALID);
+    }
+}
+
+/**
+ * @brief Subscribes the host to telemetry at the requested rate (or unsubscribes it)
+ * 
+ * Telemetry is only streamed on a windowed link. Sent stop-and-wait, every sample would
+ * hold up the control loop for a round trip and collide with the host's requests.
+ */
+void mPMTTestStand::handle_set_telemetry()
+{
+    uint16_t rate_hz;
+    if (!this->comm.recv_set_telemetry(&rate_hz) || this->comm.window_size() == 0) rate_hz = 0;
+    if (rate_hz > TELEMETRY_RATE_MAX) rate_hz = TELEMETRY_RATE_MAX;
+
+    this->telemetry_period_us = (rate_hz > 0 ? 1000000UL / rate_hz : 0);
+    this->telemetry_last_us = micros();
+    this->comm.telemetry_rate(rate_hz);
+    DEBUG_PRINT_VAL("Telemetry rate ", rate_hz);
+    this->comm.log(LOG_FMT_TELEMETRY_RATE, rate_hz);
+}
+
+/**
+ * @brief Sends a telemetry sample if one is due
+ * 
+ * Samples that would have to wait for room in the send window are skipped, the next one
+ * is sent a full period later.
+ */
+void mPMTTestStand::send_telemetry()
+{
+    if (this->telemetry_period_us == 0) return;
+
+    uint32_t now_us = micros();
+    if ((now_us - this->telemetry_last_us) < this->telemetry_period_us) return;
+    this->telemetry_last_us = now_us;
+
+    TelemetryMsgData data = {
+        .time_us            = now_us,
+        .status             = (uint8_t)this->status,
+        .flags              = (uint8_t)((this->x_state->moving          ? TELEMETRY_X_MOVING  : 0) |
+                                        (this->x_state->ls_home_pressed ? TELEMETRY_X_LS_HOME : 0) |
+                                        (this->x_state->ls_far_pressed  ? TELEMETRY_X_LS_FAR  : 0) |
+                                        (this->y_state->moving          ? TELEMETRY_Y_MOVING  : 0) |
+                                        (this->y_state->ls_home_pressed ? TELEMETRY_Y_LS_HOME : 0) |
+                                        (this->y_state->ls_far_pressed  ? TELEMETRY_Y_LS_FAR  : 0)),
+        .x_counts           = this->x_state->encoder_current,
+        .y_counts           = this->y_state->encoder_current,
+        .x_velocity         = this->x_state->velocity,
+        .y_velocity         = this->y_state->velocity,
+        .x_velocity_segment = (uint8_t)this->x_state->velocity_segment,
+        .y_velocity_segment = (uint8_t)this->y_state->velocity_segment
+    };
+    this->comm.telemetry(data);
+}
+
+/**
+ * @brief Subscribes the host to the position stream at the requested rate (or unsubscribes it)
+ * 
+ * Like telemetry, the position stream is only sent on a windowed link.
+ */
+void mPMTTestStand::handle_set_position_stream()
+{
+    uint16_t rate_hz;
+    if (!this->comm.recv_set_position_stream(&rate_hz) || this->comm.window_size() == 0) rate_hz = 0;
+    if (rate_hz > POSITION_STREAM_RATE_MAX) rate_hz = POSITION_STREAM_RATE_MAX;
+
+    this->position_period_us = (rate_hz > 0 ? 1000000UL / rate_hz : 0);
+    this->position_last_us = micros();
+    this->comm.start_position_stream(this->position_period_us);
+    this->comm.position_stream_rate(rate_hz);
+    DEBUG_PRINT_VAL("Position stream rate ", rate_hz);
+    this->comm.log(LOG_FMT_POSITION_RATE, rate_hz);
+}
+
+/**
+ * @brief Samples the position if a sample is due
+ * 
+ * Samples are taken on a fixed schedule, since the host spaces the samples of a frame
+ * evenly rather than being told when each was taken.
+ */
+void mPMTTestStand::send_position_sample()
+{
+    if (this->position_period_us == 0) return;
+
+    uint32_t now_us = micros();
+    if ((now_us - this->position_last_us) < this->position_period_us) return;
+    this->position_last_us += this->position_period_us;
+    // Start over rather than sending a burst if the loop fell behind
+    if ((now_us - this->position_last_us) >= this->position_period_us) this->position_last_us = now_us;
+
+    this->comm.position_sample(this->position_last_us, this->x_state->encoder_current, this->y_state->encoder_current);
 }
 
 #ifdef DEBUG
@@ -245,6 +409,7 @@ void mPMTTestStand::execute()
                     axis_reset(AXIS_Y);
                     this->status = STATUS_IDLE;
                     this->home_a_done = false;
+                    this->comm.log(LOG_FMT_HOME_DONE);
                 }
             }
             break;
@@ -253,11 +418,17 @@ void mPMTTestStand::execute()
             break;
     }
 
+    this->send_telemetry();
+    this->send_position_sample();
+
     // Check for any messages
     if (this->comm.check_for_message() == SERIAL_OK) {
         uint8_t id = this->comm.received_message().id;
         switch (id) {
             case MSG_ID_ECHO:           this->handle_echo();           break;
+            case MSG_ID_NEGOTIATE:      this->handle_negotiate();      break;
+            case MSG_ID_CHANGE_BAUD:    this->handle_change_baud();    break;
+            case MSG_ID_GET_LINK_STATS: this->handle_get_link_stats(); break;
             case MSG_ID_HOME:           this->handle_home_a();         break;
             case MSG_ID_MOVE:           this->handle_move();           break;
             case MSG_ID_STOP:           this->handle_stop();           break;
@@ -266,7 +437,14 @@ void mPMTTestStand::execute()
             case MSG_ID_GET_AXIS_STATE: this->handle_get_axis_state(); break;
             case MSG_ID_GET_TEMP:       this->handle_get_temp();       break;
             case MSG_ID_CALIBRATE:      this->handle_calibrate();      break;
+            case MSG_ID_SET_TELEMETRY:  this->handle_set_telemetry();  break;
+            case MSG_ID_GET_SNAPSHOT:   this->handle_get_snapshot();   break;
+            case MSG_ID_SET_POSITION_STREAM: this->handle_set_position_stream(); break;
             default:                                                   break;
         }
     }
+    else {
+        // Nothing to handle, send the log while the link is idle
+        this->comm.flush_log();
+    }
 }
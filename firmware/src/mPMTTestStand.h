@@ -4,6 +4,7 @@
 /* **************************** Local Includes ***************************** */
 // Serial Communication
 #include "ArduinoSerialDevice.h"
+#include "ArduinoUSBSerialDevice.h"
 #include "TestStandCommController.h"
 // Gantry
 #include "Gantry.h"
@@ -19,9 +20,19 @@
 /* **************************** System Includes **************************** */
 #include <Arduino.h>
 
+// The host link is on the programming port (UART through the USB bridge) unless
+// SERIAL_COMM_NATIVE_USB is defined (see platformio.ini)
+#ifdef SERIAL_COMM_NATIVE_USB
+typedef Serial_ CommSerialPort;
+typedef ArduinoUSBSerialDevice CommSerialDevice;
+#else // !SERIAL_COMM_NATIVE_USB
+typedef UARTClass CommSerialPort;
+typedef ArduinoSerialDevice CommSerialDevice;
+#endif // !SERIAL_COMM_NATIVE_USB
+
 typedef struct {
     // Serial Devices
-    UARTClass &serial_comm;
+    CommSerialPort &serial_comm;
     SerialBaudRate serial_comm_baud_rate;
     // Gantry Axes
     AxisIO io_axis_x;
@@ -37,18 +48,27 @@ class mPMTTestStand
         const mPMTTestStandConfig &conf;
         Calibration cal;
 
-        ArduinoSerialDevice comm_dev;
+        CommSerialDevice comm_dev;
         TestStandCommController comm;
+        uint8_t comm_ext_buf[MSG_EXT_BUFFER_SIZE];
 
         ThermistorArray thermistors;
 
         Status status;
         bool home_a_done;
 
+        uint32_t telemetry_period_us; //!< 0 if the host is not subscribed
+        uint32_t telemetry_last_us;
+        uint32_t position_period_us;  //!< 0 if the host is not subscribed to the position stream
+        uint32_t position_last_us;
+
         const AxisState *x_state;
         const AxisState *y_state;
 
         void handle_echo();
+        void handle_negotiate();
+        void handle_change_baud();
+        void handle_get_link_stats();
         void handle_home_a();
         void handle_home_b();
         void handle_move();
@@ -57,7 +77,12 @@ class mPMTTestStand
         void handle_get_position();
         void handle_get_axis_state();
         void handle_get_temp();
+        void handle_get_snapshot();
         void handle_calibrate();
+        void handle_set_telemetry();
+        void send_telemetry();
+        void handle_set_position_stream();
+        void send_position_sample();
 
 #ifdef DEBUG
         void debug_dump_axis(AxisId axis_id);
@@ -0,0 +1,273 @@
+#ifndef BINARY_LOG_H
+#define BINARY_LOG_H
+
+#include "LogFormats.h"
+#include "TestStandMessages.h"
+#include "Varint.h"
+#include "Messages.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Deferred binary logging. The firmware records a LogFormatId and the raw arguments of each
+ * entry in a LogBuffer, which costs a few bytes and no formatting, and sends the entries in
+ * batches (MSG_ID_LOG) when the link is idle. The host looks the format up in
+ * LOG_FORMAT_LIST and formats the text.
+ *
+ * A MSG_ID_LOG frame is:
+ *
+ *   time_ms      varint, firmware time of the first entry (millis())
+ *   per entry:   id (1 byte), argument count (1 byte), varint time since the previous
+ *                entry (0 for the first), then a zig-zag varint of each argument
+ */
+
+/** Most arguments an entry can have */
+#define LOG_ARGS_MAX 4
+
+/** Size of the firmware's log buffer (bytes) */
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 1024
+#endif // LOG_BUFFER_SIZE
+
+/** Longest entry in a frame */
+#define LOG_ENTRY_LENGTH_MAX (2 + VARINT_LENGTH_MAX + LOG_ARGS_MAX * VARINT_LENGTH_MAX)
+
+/** Longest entry in a LogBuffer: its length and time, then the id, count and arguments */
+#define LOG_RECORD_LENGTH_MAX (1 + 4 + 2 + LOG_ARGS_MAX * VARINT_LENGTH_MAX)
+
+static_assert(VARINT_LENGTH_MAX + LOG_ENTRY_LENGTH_MAX <= MSG_DATA_LENGTH_MAX, "An entry must fit in a message");
+
+typedef struct {
+    uint32_t time_ms; //!< Firmware time the entry was recorded (millis())
+    uint8_t id;       //!< LogFormatId
+    uint8_t argc;
+    uint32_t args[LOG_ARGS_MAX];
+} LogEntry;
+
+/*****************************************************************************/
+/*                                 FIRMWARE                                  */
+/*****************************************************************************/
+
+/**
+ * @class LogBuffer
+ *
+ * @brief Ring buffer of log entries waiting to be sent
+ *
+ * Entries are stored with their arguments already varint encoded. When the buffer is full,
+ * new entries are counted and dropped, and the count is sent once there is room
+ * (LOG_FMT_LOG_DROPPED). The buffer does no locking, the caller keeps record() and drain()
+ * from running over each other (e.g. by disabling interrupts around record()).
+ */
+class LogBuffer
+{
+    private:
+        uint8_t buf[LOG_BUFFER_SIZE];
+        uint32_t head;    //!< Total bytes written (free running)
+        uint32_t tail;    //!< Total bytes read (free running)
+        uint32_t dropped;
+
+        void put(uint32_t offset, uint8_t byte) { this->buf[offset % LOG_BUFFER_SIZE] = byte; }
+        uint8_t get(uint32_t offset) { return this->buf[offset % LOG_BUFFER_SIZE]; }
+
+        uint32_t get_time(uint32_t offset)
+        {
+            uint32_t time_ms = 0;
+            for (int i = 0; i < 4; i++) time_ms |= (uint32_t)this->get(offset + i) << (8 * i);
+            return time_ms;
+        }
+
+    public:
+        LogBuffer() : head(0), tail(0), dropped(0) {}
+
+        bool empty() { return (this->head == this->tail && this->dropped == 0); }
+
+        /**
+         * @return false if the entry did not fit and was dropped
+         */
+        bool record(uint32_t time_ms, uint8_t id, const uint32_t *args, uint8_t argc)
+        {
+            if (argc > LOG_ARGS_MAX) argc = LOG_ARGS_MAX;
+
+            uint8_t record[LOG_RECORD_LENGTH_MAX];
+            uint8_t length = 1;
+            for (int i = 0; i < 4; i++) record[length++] = (uint8_t)(time_ms >> (8 * i));
+            record[length++] = id;
+            record[length++] = argc;
+            for (uint8_t i = 0; i < argc; i++) length += varint_put(&record[length], zigzag_encode((int32_t)args[i]));
+            record[0] = length;
+
+            if (LOG_BUFFER_SIZE - (this->head - this->tail) < length) {
+                this->dropped++;
+                return false;
+            }
+            for (uint8_t i = 0; i < length; i++) this->put(this->head + i, record[i]);
+            this->head += length;
+            return true;
+        }
+
+        /**
+         * @brief Takes as many whole entries as fit into a MSG_ID_LOG frame
+         *
+         * @param out        Where to encode the frame
+         * @param max_length Space at out (at least VARINT_LENGTH_MAX + LOG_ENTRY_LENGTH_MAX)
+         * @param now_ms     Time to give the note of dropped entries, if there is one
+         *
+         * @return The frame length (0 if there was nothing to send)
+         */
+        uint8_t drain(uint8_t *out, uint8_t max_length, uint32_t now_ms)
+        {
+            if (this->empty()) return 0;
+
+            uint32_t frame_time_ms = (this->head != this->tail ? this->get_time(this->tail + 1) : now_ms);
+            uint32_t prev_ms = frame_time_ms;
+            uint8_t length = varint_put(out, frame_time_ms);
+
+            while (this->head != this->tail) {
+                uint8_t record_length = this->get(this->tail);
+                uint32_t time_ms = this->get_time(this->tail + 1);
+
+                // id and argc, then the time goes in between them and the arguments
+                uint8_t entry[LOG_ENTRY_LENGTH_MAX];
+                uint8_t entry_length = 0;
+                entry[entry_length++] = this->get(this->tail + 5);
+                entry[entry_length++] = this->get(this->tail + 6);
+                entry_length += varint_put(&entry[entry_length], time_ms - prev_ms);
+                for (uint8_t i = 7; i < record_length; i++) entry[entry_length++] = this->get(this->tail + i);
+
+                if (length + entry_length > max_length) break;
+                for (uint8_t i = 0; i < entry_length; i++) out[length++] = entry[i];
+                prev_ms = time_ms;
+                this->tail += record_length;
+            }
+
+            // Entries were dropped after the ones in the buffer, so the note goes last
+            if (this->dropped > 0 && this->head == this->tail &&
+                length + 2 + 2 * VARINT_LENGTH_MAX <= max_length) {
+                out[length++] = LOG_FMT_LOG_DROPPED;
+                out[length++] = 1;
+                length += varint_put(&out[length], now_ms - prev_ms);
+                length += varint_put(&out[length], zigzag_encode((int32_t)this->dropped));
+                this->dropped = 0;
+            }
+            return length;
+        }
+};
+
+/*****************************************************************************/
+/*                                   HOST                                    */
+/*****************************************************************************/
+
+/**
+ * @class LogFrameReader
+ *
+ * @brief Reads the entries of a MSG_ID_LOG frame in order
+ */
+class LogFrameReader
+{
+    private:
+        const uint8_t *data;
+        uint8_t length;
+        uint8_t pos;
+        uint32_t time_ms;
+        bool malformed;
+
+    public:
+        LogFrameReader(const uint8_t *data, uint8_t length) : data(data), length(length), pos(0), time_ms(0), malformed(false)
+        {
+            uint8_t n = varint_get(data, length, &this->time_ms);
+            if (n == 0) this->malformed = true;
+            this->pos = n;
+        }
+
+        /**
+         * @return false once there are no more entries (@see error)
+         */
+        bool next(LogEntry *entry_out)
+        {
+            if (this->malformed || this->pos >= this->length) return false;
+
+            if (this->length - this->pos < 2 || this->data[this->pos + 1] > LOG_ARGS_MAX) {
+                this->malformed = true;
+                return false;
+            }
+            entry_out->id = this->data[this->pos++];
+            entry_out->argc = this->data[this->pos++];
+
+            uint32_t delta_ms;
+            uint8_t n = varint_get(&this->data[this->pos], this->length - this->pos, &delta_ms);
+            if (n == 0) {
+                this->malformed = true;
+                return false;
+            }
+            this->pos += n;
+            this->time_ms += delta_ms;
+            entry_out->time_ms = this->time_ms;
+
+            for (uint8_t i = 0; i < entry_out->argc; i++) {
+                uint32_t value;
+                n = varint_get(&this->data[this->pos], this->length - this->pos, &value);
+                if (n == 0) {
+                    this->malformed = true;
+                    return false;
+                }
+                this->pos += n;
+                entry_out->args[i] = (uint32_t)zigzag_decode(value);
+            }
+            return true;
+        }
+
+        /**
+         * @return true if reading stopped at a malformed entry
+         */
+        bool error() { return this->malformed; }
+};
+
+/**
+ * @return The level of an entry (LL_WARNING for IDs this build does not know)
+ */
+static inline LogLevel log_entry_level(const LogEntry& entry)
+{
+#define LOG_FORMAT_LEVEL(id, level, format) level,
+    static const LogLevel levels[] = { LOG_FORMAT_LIST(LOG_FORMAT_LEVEL) };
+#undef LOG_FORMAT_LEVEL
+
+    return (entry.id < LOG_FMT_COUNT ? levels[entry.id] : LL_WARNING);
+}
+
+/**
+ * @brief Formats the text of an entry
+ *
+ * @return The length of the text (see snprintf)
+ */
+static inline int log_entry_format(const LogEntry& entry, char *buf, size_t size)
+{
+#define LOG_FORMAT_STRING(id, level, format) format,
+    static const char *formats[] = { LOG_FORMAT_LIST(LOG_FORMAT_STRING) };
+#undef LOG_FORMAT_STRING
+
+    if (entry.id >= LOG_FMT_COUNT) {
+        return snprintf(buf, size, "Unknown log entry %u (firmware newer than host?)", entry.id);
+    }
+
+    // Arguments the format does not use are ignored
+    uint32_t args[LOG_ARGS_MAX] = { 0 };
+    for (uint8_t i = 0; i < entry.argc && i < LOG_ARGS_MAX; i++) args[i] = entry.args[i];
+    return snprintf(buf, size, formats[entry.id], args[0], args[1], args[2], args[3]);
+}
+
+/**
+ * @return The name of a log level
+ */
+static inline const char *log_level_name(LogLevel level)
+{
+    switch (level) {
+        case LL_DEBUG:    return "DEBUG";
+        case LL_INFO:     return "INFO";
+        case LL_WARNING:  return "WARNING";
+        case LL_ERROR:    return "ERROR";
+        default:          return "CRITICAL";
+    }
+}
+
+#endif // BINARY_LOG_H
@@ -0,0 +1,35 @@
+#ifndef LOG_FORMATS_H
+#define LOG_FORMATS_H
+
+/*
+ * Every message the firmware logs. The firmware only sends the ID and the raw arguments
+ * (@see BinaryLog.h), the host looks the level and format up here, so both sides must be
+ * built from the same list.
+ *
+ * Each format takes at most LOG_ARGS_MAX arguments, all of them 32-bit (%d, %u or %x).
+ * Only add entries at the end, so a host that is newer than the firmware still matches the
+ * IDs up.
+ */
+#define LOG_FORMAT_LIST(X)                                                                      \
+    X(LOG_FMT_LOG_DROPPED,        LL_WARNING, "%u log entries did not fit in the log buffer")   \
+    X(LOG_FMT_STARTED,            LL_INFO,    "Firmware started at %u baud")                    \
+    X(LOG_FMT_NEGOTIATED,         LL_INFO,    "Link negotiated, features 0x%x, window size %u") \
+    X(LOG_FMT_BAUD_CHANGED,       LL_INFO,    "Baud rate changed to %u")                        \
+    X(LOG_FMT_MOVE_REJECTED,      LL_WARNING, "Move on axis %u rejected (AxisResult %u)")       \
+    X(LOG_FMT_HOME_DONE,          LL_INFO,    "Homing done")                                    \
+    X(LOG_FMT_STOPPED,            LL_INFO,    "Stopped at (%d, %d) counts")                     \
+    X(LOG_FMT_CALIBRATED,         LL_INFO,    "Calibration key %u updated")                     \
+    X(LOG_FMT_CALIBRATE_INVALID,  LL_ERROR,   "Invalid calibration message")                    \
+    X(LOG_FMT_TELEMETRY_RATE,     LL_DEBUG,   "Telemetry rate %u Hz")                           \
+    X(LOG_FMT_POSITION_RATE,      LL_DEBUG,   "Position stream rate %u Hz")
+
+#define LOG_FORMAT_ENUM(id, level, format) id,
+
+typedef enum {
+    LOG_FORMAT_LIST(LOG_FORMAT_ENUM)
+    LOG_FMT_COUNT
+} LogFormatId;
+
+#undef LOG_FORMAT_ENUM
+
+#endif // LOG_FORMATS_H
@@ -0,0 +1,227 @@
+#ifndef PARSER_BENCH_H
+#define PARSER_BENCH_H
+
+#include "SerialDevice.h"
+#include "SerialTransport.h"
+#include "SerialResult.h"
+#include "Messages.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Synthetic streams for timing the SerialTransport receive state machine. Shared by CommBench
+ * (timed on the host PC) and the firmware's parser_bench environment (cycle counted on the Due),
+ * so both parse exactly the same bytes with exactly the same code.
+ */
+
+/** Largest run of garbage between frames in PARSER_STREAM_GARBAGE */
+#define PARSER_GARBAGE_MAX 16
+
+/** Largest piece of a PARSER_STREAM_SPLIT stream handed to the transport by one read */
+#define PARSER_SPLIT_MAX 32
+
+typedef enum {
+    PARSER_STREAM_SMALL,   //!< Back-to-back frames with 0 to 8 bytes of data
+    PARSER_STREAM_MAX,     //!< Back-to-back frames with MSG_DATA_LENGTH_MAX bytes of data
+    PARSER_STREAM_GARBAGE, //!< Small frames with runs of noise in between (@see parser_garbage_byte)
+    PARSER_STREAM_SPLIT,   //!< Small and max frames, read in random pieces of 1 to PARSER_SPLIT_MAX bytes
+    PARSER_STREAM_COUNT
+} ParserStream;
+
+static inline const char *parser_stream_name(ParserStream stream)
+{
+    switch (stream) {
+        case PARSER_STREAM_SMALL:   return "small";
+        case PARSER_STREAM_MAX:     return "max";
+        case PARSER_STREAM_GARBAGE: return "garbage";
+        default:                    return "split";
+    }
+}
+
+/**
+ * @brief xorshift32, so the streams are the same on every platform
+ */
+static inline uint32_t parser_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/**
+ * @brief Returns a random byte that cannot start a frame
+ *
+ * Noise that starts a frame costs the frames it swallows (measured by CommBench resync), not
+ * parser time, so the garbage stream leaves it out and every frame should still be received.
+ */
+static inline uint8_t parser_garbage_byte(uint32_t *state)
+{
+    while (true) {
+        uint8_t byte = (uint8_t)parser_rand(state);
+        if (byte != MSG_DELIM_START && byte != MSG_DELIM_START_SEQ && byte != MSG_DELIM_START_EXT &&
+            byte != MSG_DELIM_START_RETX && byte != MSG_DELIM_START_ALT &&
+            byte != MSG_DELIM_START_RETX_ALT && byte != MSG_DELIM_COBS) {
+            return byte;
+        }
+    }
+}
+
+/**
+ * @class StreamDevice
+ *
+ * @brief SerialDevice backed by a fixed buffer
+ *
+ * Writes append to the buffer and reads consume it from the front, either as much as is
+ * asked for or in random pieces (@see rewind).
+ */
+class StreamDevice : public SerialDevice
+{
+    private:
+        uint8_t *buf;
+        uint32_t size;
+        uint32_t length;
+        uint32_t read_pos;
+        bool split;
+        uint32_t rng;
+
+    public:
+        StreamDevice(uint8_t *buf, uint32_t size) : buf(buf), size(size), length(0), read_pos(0), split(false), rng(1) {}
+
+        void clear()
+        {
+            this->length = 0;
+            this->read_pos = 0;
+        }
+
+        /**
+         * @brief Goes back to the start of the stream
+         *
+         * @param split true to hand out the stream in random pieces of 1 to PARSER_SPLIT_MAX bytes
+         */
+        void rewind(bool split)
+        {
+            this->read_pos = 0;
+            this->split = split;
+            this->rng = 1;
+        }
+
+        uint32_t bytes() { return this->length; }
+        uint32_t space() { return this->size - this->length; }
+
+        bool ser_connect(SerialBaudRate baud_rate) { return true; }
+        bool ser_set_baud_rate(SerialBaudRate baud_rate) { return true; }
+        void ser_flush() { this->read_pos = this->length; }
+        uint32_t ser_available() { return this->length - this->read_pos; }
+
+        bool ser_read(uint8_t *out)
+        {
+            return (this->ser_read_bulk(out, 1) == 1);
+        }
+
+        uint32_t ser_read_bulk(uint8_t *out, uint32_t max_length)
+        {
+            uint32_t count = this->ser_available();
+            if (count > max_length) count = max_length;
+            if (this->split) {
+                uint32_t piece = 1 + parser_rand(&this->rng) % PARSER_SPLIT_MAX;
+                if (count > piece) count = piece;
+            }
+            memcpy(out, &this->buf[this->read_pos], count);
+            this->read_pos += count;
+            return count;
+        }
+
+        bool ser_wait(uint32_t timeout_ms) { return (this->ser_available() > 0); }
+
+        bool ser_write(uint8_t *data, uint32_t count)
+        {
+            if (count > this->space()) return false;
+            memcpy(&this->buf[this->length], data, count);
+            this->length += count;
+            return true;
+        }
+
+        bool ser_writev(const SerialIOVec *iov, uint32_t count)
+        {
+            for (uint32_t i = 0; i < count; i++) {
+                if (!this->ser_write((uint8_t *)iov[i].data, iov[i].length)) return false;
+            }
+            return true;
+        }
+
+        void ser_disconnect() {}
+
+        uint64_t platform_millis() { return 0; }
+};
+
+/**
+ * @brief Fills a StreamDevice with one of the synthetic streams
+ *
+ * Frame data is random, so delimiter bytes (and zeros for COBS) turn up in it at their
+ * natural rate.
+ *
+ * @return The number of frames in the stream
+ */
+static inline uint32_t parser_stream_build(ParserStream stream, SerialFraming framing, StreamDevice& device)
+{
+    SerialTransport tx(device);
+    tx.set_framing(framing);
+    device.clear();
+
+    uint32_t rng = 1;
+    uint8_t payload[MSG_DATA_LENGTH_MAX];
+    uint32_t frames = 0;
+
+    // Room for the worst case frame plus a run of garbage
+    while (device.space() >= COBS_ENCODED_LENGTH_MAX(MSG_FRAME_LENGTH_MAX) + 1 + PARSER_GARBAGE_MAX) {
+        if (stream == PARSER_STREAM_GARBAGE) {
+            uint32_t count = 1 + parser_rand(&rng) % PARSER_GARBAGE_MAX;
+            for (uint32_t i = 0; i < count; i++) payload[i] = parser_garbage_byte(&rng);
+            // With COBS framing the noise only ends at the next delimiter
+            if (framing == SERIAL_FRAMING_COBS) payload[count - 1] = MSG_DELIM_COBS;
+            device.ser_write(payload, count);
+        }
+
+        uint8_t length;
+        if (stream == PARSER_STREAM_MAX || (stream == PARSER_STREAM_SPLIT && (frames & 1))) {
+            length = MSG_DATA_LENGTH_MAX;
+        }
+        else {
+            length = (uint8_t)(parser_rand(&rng) % 9);
+        }
+        for (uint32_t i = 0; i < length; i++) payload[i] = (uint8_t)parser_rand(&rng);
+
+        Message msg = { .id = MSG_ID_ECHO, .length = length, .data = payload };
+        if (!tx.send_message(msg)) break;
+        frames++;
+    }
+    return frames;
+}
+
+/**
+ * @brief Runs the whole stream through a fresh receiver, this is the part that is timed
+ *
+ * @return The number of frames received with a valid CRC
+ */
+static inline uint32_t parser_stream_parse(ParserStream stream, SerialFraming framing, StreamDevice& device)
+{
+    SerialTransport rx(device);
+    rx.set_framing(framing);
+    device.rewind(stream == PARSER_STREAM_SPLIT);
+
+    uint8_t data[MSG_DATA_LENGTH_MAX];
+    Message msg = { .id = 0, .length = 0, .data = data };
+    uint32_t received = 0;
+
+    SerialResult res;
+    while ((res = rx.check_for_message(msg)) != SERIAL_OK_NO_MSG) {
+        if (res == SERIAL_OK) received++;
+    }
+    return received;
+}
+
+#endif // PARSER_BENCH_H
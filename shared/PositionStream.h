@@ -0,0 +1,266 @@
+#ifndef POSITION_STREAM_H
+#define POSITION_STREAM_H
+
+#include "Messages.h"
+#include "SerialResult.h"
+#include "Varint.h"
+
+#include <stdint.h>
+
+/*
+ * Compact encoding of encoder positions for MSG_ID_POSITION_STREAM. Shared by the firmware
+ * (TestStandCommController encodes) and the host (TestStandCommHost decodes).
+ *
+ * A frame carries a batch of samples taken period_us apart:
+ *
+ *   flags        1 byte, bitmask of POSITION_STREAM_FLAG_*
+ *   count        1 byte, number of samples
+ *   period_us    varint
+ *   time_us      varint, time of the first sample minus the reference time
+ *   per sample:  zig-zag varint of x minus the previous x, then the same for y
+ *
+ * The reference for the first sample is the last sample of the previous frame that was sent.
+ * A key frame has a reference of zero, so it carries absolute values and lets the receiver
+ * (re)synchronize. Key frames are sent when streaming starts and every
+ * POSITION_STREAM_KEY_INTERVAL frames after that.
+ *
+ * While the gantry holds still a sample costs 2 bytes, and at the speeds the gantry moves
+ * each delta fits in 1 or 2 bytes, against 8 bytes for a POSITION reply.
+ */
+
+/** Samples per frame */
+#ifndef POSITION_STREAM_BATCH
+#define POSITION_STREAM_BATCH 16
+#endif // POSITION_STREAM_BATCH
+
+/** Frames between key frames */
+#ifndef POSITION_STREAM_KEY_INTERVAL
+#define POSITION_STREAM_KEY_INTERVAL 32
+#endif // POSITION_STREAM_KEY_INTERVAL
+
+/** Fastest rate the firmware samples the position at (Hz) */
+#define POSITION_STREAM_RATE_MAX 1000
+
+#define POSITION_STREAM_FLAG_KEY (1 << 0) //!< Deltas are against zero rather than the previous frame
+
+/** Longest frame (bytes) */
+#define POSITION_STREAM_LENGTH_MAX (2 + 2 * VARINT_LENGTH_MAX + POSITION_STREAM_BATCH * 2 * VARINT_LENGTH_MAX)
+
+static_assert(POSITION_STREAM_BATCH <= 0xFF, "The sample count must fit in a byte");
+static_assert(POSITION_STREAM_LENGTH_MAX <= MSG_DATA_LENGTH_MAX, "A full batch must fit in a message");
+
+typedef struct {
+    uint32_t time_us;  //!< Firmware time the sample was taken (micros(), wraps after ~71 minutes)
+    int32_t x_counts;
+    int32_t y_counts;
+} PositionSample;
+
+/*****************************************************************************/
+/*                                  ENCODER                                  */
+/*****************************************************************************/
+
+/**
+ * @class PositionStreamEncoder
+ *
+ * @brief Batches position samples and encodes them into frames
+ *
+ * A frame is only taken as the reference for the next one once it has been sent
+ * (@see commit), so the deltas are always against a sample the receiver has or will get.
+ */
+class PositionStreamEncoder
+{
+    private:
+        uint32_t period_us;
+        uint32_t frames_to_key;
+        PositionSample ref;
+        PositionSample samples[POSITION_STREAM_BATCH];
+        uint8_t count;
+
+    public:
+        PositionStreamEncoder() : period_us(0), frames_to_key(0), ref(), count(0) {}
+
+        /**
+         * @brief Starts a new stream, its first frame is a key frame
+         */
+        void reset(uint32_t period_us)
+        {
+            this->period_us = period_us;
+            this->frames_to_key = 0;
+            this->count = 0;
+        }
+
+        /**
+         * @return true if the batch is full and should be sent
+         */
+        bool add(uint32_t time_us, int32_t x_counts, int32_t y_counts)
+        {
+            if (this->count < POSITION_STREAM_BATCH) {
+                this->samples[this->count].time_us = time_us;
+                this->samples[this->count].x_counts = x_counts;
+                this->samples[this->count].y_counts = y_counts;
+                this->count++;
+            }
+            return (this->count == POSITION_STREAM_BATCH);
+        }
+
+        uint8_t samples_buffered() { return this->count; }
+
+        /**
+         * @brief Encodes the batch into a frame without consuming it
+         *
+         * @param buf Where to encode it (at least POSITION_STREAM_LENGTH_MAX bytes)
+         *
+         * @return The frame length
+         */
+        uint8_t encode(uint8_t *buf)
+        {
+            bool key = (this->frames_to_key == 0);
+            PositionSample prev = { 0, 0, 0 };
+            if (!key) prev = this->ref;
+
+            uint8_t length = 0;
+            buf[length++] = (key ? POSITION_STREAM_FLAG_KEY : 0);
+            buf[length++] = this->count;
+            length += varint_put(&buf[length], this->period_us);
+            length += varint_put(&buf[length], (this->count > 0 ? this->samples[0].time_us - prev.time_us : 0));
+
+            for (uint8_t i = 0; i < this->count; i++) {
+                // Differences wrap like the counters do, the receiver adds them back the same way
+                length += varint_put(&buf[length], zigzag_encode((int32_t)((uint32_t)this->samples[i].x_counts - (uint32_t)prev.x_counts)));
+                length += varint_put(&buf[length], zigzag_encode((int32_t)((uint32_t)this->samples[i].y_counts - (uint32_t)prev.y_counts)));
+                prev = this->samples[i];
+            }
+            return length;
+        }
+
+        /**
+         * @brief The encoded batch was sent, its last sample is the reference for the next one
+         *
+         * The receiver spaces the samples of a frame evenly, so the reference time is where it
+         * puts the last one rather than when it was taken, otherwise the error would add up
+         * from frame to frame.
+         */
+        void commit()
+        {
+            if (this->count > 0) {
+                this->ref = this->samples[this->count - 1];
+                this->ref.time_us = this->samples[0].time_us + (this->count - 1) * this->period_us;
+            }
+            else if (this->frames_to_key == 0) {
+                this->ref.time_us = 0;
+                this->ref.x_counts = 0;
+                this->ref.y_counts = 0;
+            }
+            this->frames_to_key = (this->frames_to_key == 0 ? POSITION_STREAM_KEY_INTERVAL : this->frames_to_key) - 1;
+            this->count = 0;
+        }
+
+        /**
+         * @brief The encoded batch could not be sent, its samples are lost
+         *
+         * The next frame is still encoded against the last one sent, the receiver sees the
+         * gap in the sample times.
+         */
+        void drop()
+        {
+            this->count = 0;
+        }
+};
+
+/*****************************************************************************/
+/*                                  DECODER                                  */
+/*****************************************************************************/
+
+/**
+ * @class PositionStreamDecoder
+ *
+ * @brief Decodes frames encoded by a PositionStreamEncoder, in the order they were sent
+ */
+class PositionStreamDecoder
+{
+    private:
+        bool have_ref;
+        PositionSample ref;
+
+    public:
+        PositionStreamDecoder() : have_ref(false), ref() {}
+
+        /**
+         * @brief Waits for the next key frame
+         */
+        void reset()
+        {
+            this->have_ref = false;
+        }
+
+        /**
+         * @brief Decodes a frame
+         *
+         * @param samples_out At least POSITION_STREAM_BATCH samples
+         * @param count_out   Where to store the number of samples decoded
+         *
+         * @return SERIAL_OK if the frame was decoded
+         *         SERIAL_OK_NO_MSG if the frame was skipped while waiting for a key frame
+         *         SERIAL_ERR_DATA_LENGTH if the frame is malformed (the decoder then waits
+         *         for a key frame)
+         */
+        SerialResult decode(const uint8_t *data, uint8_t length, PositionSample *samples_out, uint8_t *count_out)
+        {
+            *count_out = 0;
+
+            bool key = (length > 0 && (data[0] & POSITION_STREAM_FLAG_KEY));
+            if (!key && !this->have_ref) return SERIAL_OK_NO_MSG;
+
+            PositionSample prev = { 0, 0, 0 };
+            if (!key) prev = this->ref;
+
+            if (!this->decode_samples(data, length, prev, samples_out, count_out)) {
+                *count_out = 0;
+                this->have_ref = false;
+                return SERIAL_ERR_DATA_LENGTH;
+            }
+
+            if (*count_out > 0) this->ref = samples_out[*count_out - 1];
+            else this->ref = prev;
+            this->have_ref = true;
+            return SERIAL_OK;
+        }
+
+    private:
+        /**
+         * @return false if the frame is malformed
+         */
+        static bool decode_samples(const uint8_t *data, uint8_t length, PositionSample prev,
+                                   PositionSample *samples_out, uint8_t *count_out)
+        {
+            if (length < 2 || data[1] > POSITION_STREAM_BATCH) return false;
+            uint8_t count = data[1];
+            uint8_t pos = 2;
+
+            uint32_t period_us, time_us;
+            uint8_t n;
+            if ((n = varint_get(&data[pos], length - pos, &period_us)) == 0) return false;
+            pos += n;
+            if ((n = varint_get(&data[pos], length - pos, &time_us)) == 0) return false;
+            pos += n;
+            time_us += prev.time_us;
+
+            for (uint8_t i = 0; i < count; i++) {
+                uint32_t dx, dy;
+                if ((n = varint_get(&data[pos], length - pos, &dx)) == 0) return false;
+                pos += n;
+                if ((n = varint_get(&data[pos], length - pos, &dy)) == 0) return false;
+                pos += n;
+
+                samples_out[i].time_us = time_us + i * period_us;
+                samples_out[i].x_counts = (int32_t)((uint32_t)prev.x_counts + (uint32_t)zigzag_decode(dx));
+                samples_out[i].y_counts = (int32_t)((uint32_t)prev.y_counts + (uint32_t)zigzag_decode(dy));
+                prev = samples_out[i];
+            }
+
+            *count_out = count;
+            return (pos == length);
+        }
+};
+
+#endif // POSITION_STREAM_H
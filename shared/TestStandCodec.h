@@ -0,0 +1,367 @@
+#ifndef TEST_STAND_CODEC_H
+#define TEST_STAND_CODEC_H
+
+#include "TestStandComm.h"
+#include "TestStandMessages.h"
+
+#include "Gantry.h"
+#include "TemperatureDAQ.h"
+
+#include "shared_defs.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/*****************************************************************************/
+/*                                  VALUES                                   */
+/*****************************************************************************/
+
+/**
+ * @struct AxisStateData
+ *
+ * @brief The motion state of both axes, as carried by an AXIS_STATE reply
+ */
+typedef struct {
+    struct {
+        bool moving;
+        bool ls_home_pressed;
+        bool ls_far_pressed;
+        uint8_t velocity_segment; //!< VelSeg
+        uint32_t velocity;        //!< [motor steps / s]
+        uint32_t next_velocity;
+        int32_t encoder_target;
+    } axis[2];                    //!< Indexed by AxisId
+} AxisStateData;
+
+/**
+ * @struct Snapshot
+ *
+ * @brief Everything a GET_SNAPSHOT reply carries (@see SnapshotMsgData)
+ */
+typedef struct {
+    Status status;
+    PositionMsgData position;
+    StateMsgData axis_state;
+    TempData temp;
+} Snapshot;
+
+/*****************************************************************************/
+/*                              MESSAGE CODECS                               */
+/*****************************************************************************/
+
+/**
+ * @struct MessageCodec
+ *
+ * @brief Converts the payload of one message ID between its value and its wire format
+ *
+ * Each message with a fixed payload has a specialization defining:
+ *   - Value:  what the application works with (in host byte order)
+ *   - Wire:   the packed struct that goes on the wire (in network byte order)
+ *   - encode: fills in a Wire from a Value
+ *   - decode: fills in a Value from a Wire
+ *
+ * Wire structs are packed, so encode and decode work directly on the send buffer and the
+ * received message data. There is deliberately no generic definition, so using a message
+ * ID that has no codec does not compile.
+ */
+template <uint8_t ID>
+struct MessageCodec;
+
+template <>
+struct MessageCodec<MSG_ID_MOVE>
+{
+    typedef MoveMsgData Value;
+    typedef MoveMsgData Wire;
+
+    static void encode(const Value& value, Wire *wire)
+    {
+        wire->vel_hold    = (uint32_t)htonl(value.vel_hold);
+        wire->dist_counts = (uint32_t)htonl(value.dist_counts);
+        wire->axis        = value.axis;
+        wire->dir         = value.dir;
+    }
+
+    static void decode(const Wire *wire, Value *value)
+    {
+        value->vel_hold    = (uint32_t)ntohl(wire->vel_hold);
+        value->dist_counts = (uint32_t)ntohl(wire->dist_counts);
+        value->axis        = wire->axis;
+        value->dir         = wire->dir;
+    }
+};
+
+template <>
+struct MessageCodec<MSG_ID_POSITION>
+{
+    typedef PositionMsgData Value;
+    typedef PositionMsgData Wire;
+
+    static void encode(const Value& value, Wire *wire)
+    {
+        wire->x_counts = htonl(value.x_counts);
+        wire->y_counts = htonl(value.y_counts);
+    }
+
+    static void decode(const Wire *wire, Value *value)
+    {
+        value->x_counts = ntohl(wire->x_counts);
+        value->y_counts = ntohl(wire->y_counts);
+    }
+};
+
+/** Temperatures go on the wire as fixed point, scaled by temp_data_scaler */
+template <>
+struct MessageCodec<MSG_ID_TEMP>
+{
+    typedef TempData Value;
+    typedef TempMsgData Wire;
+
+    static void encode(const Value& value, Wire *wire)
+    {
+        wire->temp_ambient = htonl(round(value.temp_ambient * temp_data_scaler));
+        wire->temp_motor_x = htonl(round(value.temp_motor_x * temp_data_scaler));
+        wire->temp_motor_y = htonl(round(value.temp_motor_y * temp_data_scaler));
+        wire->temp_mpmt    = htonl(round(value.temp_mpmt    * temp_data_scaler));
+        wire->temp_optical = htonl(round(value.temp_optical * temp_data_scaler));
+    }
+
+    static void decode(const Wire *wire, Value *value)
+    {
+        value->temp_ambient = (double)ntohl(wire->temp_ambient) / temp_data_scaler;
+        value->temp_motor_x = (double)ntohl(wire->temp_motor_x) / temp_data_scaler;
+        value->temp_motor_y = (double)ntohl(wire->temp_motor_y) / temp_data_scaler;
+        value->temp_mpmt    = (double)ntohl(wire->temp_mpmt)    / temp_data_scaler;
+        value->temp_optical = (double)ntohl(wire->temp_optical) / temp_data_scaler;
+    }
+};
+
+/** The six limit switch and motion bools go on the wire as one byte of flags */
+template <>
+struct MessageCodec<MSG_ID_AXIS_STATE>
+{
+    typedef AxisStateData Value;
+    typedef AxisStateMsgData Wire;
+
+    /** The Y axis flags are the X axis flags shifted up by 3 */
+    static uint8_t axis_flag(uint8_t x_flag, int axis) { return (uint8_t)(x_flag << (3 * axis)); }
+
+    static void encode(const Value& value, Wire *wire)
+    {
+        wire->flags = 0;
+        wire->velocity_segments = 0;
+        for (int axis = AXIS_X; axis <= AXIS_Y; axis++) {
+            if (value.axis[axis].moving)          wire->flags |= axis_flag(TELEMETRY_X_MOVING, axis);
+            if (value.axis[axis].ls_home_pressed) wire->flags |= axis_flag(TELEMETRY_X_LS_HOME, axis);
+            if (value.axis[axis].ls_far_pressed)  wire->flags |= axis_flag(TELEMETRY_X_LS_FAR, axis);
+            wire->velocity_segments |= (uint8_t)((value.axis[axis].velocity_segment & 0x0F) << (4 * axis));
+
+            wire->axis[axis].velocity       = (uint32_t)htonl(value.axis[axis].velocity);
+            wire->axis[axis].next_velocity  = (uint32_t)htonl(value.axis[axis].next_velocity);
+            wire->axis[axis].encoder_target = htonl(value.axis[axis].encoder_target);
+        }
+    }
+
+    static void decode(const Wire *wire, Value *value)
+    {
+        for (int axis = AXIS_X; axis <= AXIS_Y; axis++) {
+            value->axis[axis].moving           = ((wire->flags & axis_flag(TELEMETRY_X_MOVING, axis)) != 0);
+            value->axis[axis].ls_home_pressed  = ((wire->flags & axis_flag(TELEMETRY_X_LS_HOME, axis)) != 0);
+            value->axis[axis].ls_far_pressed   = ((wire->flags & axis_flag(TELEMETRY_X_LS_FAR, axis)) != 0);
+            value->axis[axis].velocity_segment = (wire->velocity_segments >> (4 * axis)) & 0x0F;
+
+            value->axis[axis].velocity       = (uint32_t)ntohl(wire->axis[axis].velocity);
+            value->axis[axis].next_velocity  = (uint32_t)ntohl(wire->axis[axis].next_velocity);
+            value->axis[axis].encoder_target = ntohl(wire->axis[axis].encoder_target);
+        }
+    }
+};
+
+template <>
+struct MessageCodec<MSG_ID_SET_TELEMETRY>
+{
+    typedef uint16_t Value; //!< Rate (Hz)
+    typedef TelemetryRateMsgData Wire;
+
+    static void encode(const Value& value, Wire *wire) { wire->rate_hz = htons(value); }
+    static void decode(const Wire *wire, Value *value) { *value = ntohs(wire->rate_hz); }
+};
+
+template <>
+struct MessageCodec<MSG_ID_TELEMETRY_RATE> : MessageCodec<MSG_ID_SET_TELEMETRY> {};
+
+template <>
+struct MessageCodec<MSG_ID_SET_POSITION_STREAM> : MessageCodec<MSG_ID_SET_TELEMETRY> {};
+
+template <>
+struct MessageCodec<MSG_ID_POSITION_STREAM_RATE> : MessageCodec<MSG_ID_SET_TELEMETRY> {};
+
+template <>
+struct MessageCodec<MSG_ID_TELEMETRY>
+{
+    typedef TelemetryMsgData Value;
+    typedef TelemetryMsgData Wire;
+
+    static void encode(const Value& value, Wire *wire)
+    {
+        wire->time_us            = (uint32_t)htonl(value.time_us);
+        wire->status             = value.status;
+        wire->flags              = value.flags;
+        wire->x_counts           = htonl(value.x_counts);
+        wire->y_counts           = htonl(value.y_counts);
+        wire->x_velocity         = (uint32_t)htonl(value.x_velocity);
+        wire->y_velocity         = (uint32_t)htonl(value.y_velocity);
+        wire->x_velocity_segment = value.x_velocity_segment;
+        wire->y_velocity_segment = value.y_velocity_segment;
+    }
+
+    static void decode(const Wire *wire, Value *value)
+    {
+        value->time_us            = (uint32_t)ntohl(wire->time_us);
+        value->status             = wire->status;
+        value->flags              = wire->flags;
+        value->x_counts           = ntohl(wire->x_counts);
+        value->y_counts           = ntohl(wire->y_counts);
+        value->x_velocity         = (uint32_t)ntohl(wire->x_velocity);
+        value->y_velocity         = (uint32_t)ntohl(wire->y_velocity);
+        value->x_velocity_segment = wire->x_velocity_segment;
+        value->y_velocity_segment = wire->y_velocity_segment;
+    }
+};
+
+/** Encoded field by field, with the codecs of the replies it stands in for where they share a wire format */
+template <>
+struct MessageCodec<MSG_ID_SNAPSHOT>
+{
+    typedef Snapshot Value;
+    typedef SnapshotMsgData Wire;
+
+    static void encode(const Value& value, Wire *wire)
+    {
+        wire->status = (uint8_t)value.status;
+        MessageCodec<MSG_ID_POSITION>::encode(value.position, &wire->position);
+        wire->axis_state = value.axis_state;
+        MessageCodec<MSG_ID_TEMP>::encode(value.temp, &wire->temp);
+    }
+
+    static void decode(const Wire *wire, Value *value)
+    {
+        value->status = (Status)wire->status;
+        MessageCodec<MSG_ID_POSITION>::decode(&wire->position, &value->position);
+        value->axis_state = wire->axis_state;
+        MessageCodec<MSG_ID_TEMP>::decode(&wire->temp, &value->temp);
+    }
+};
+
+// The wire formats must not change size between the Due and the host PC
+static_assert(sizeof(MoveMsgData) == 10, "MoveMsgData must be 10 bytes");
+static_assert(sizeof(PositionMsgData) == 8, "PositionMsgData must be 8 bytes");
+static_assert(sizeof(TempMsgData) == 20, "TempMsgData must be 20 bytes");
+static_assert(sizeof(StateMsgData) == 6, "StateMsgData must be 6 bytes");
+static_assert(sizeof(AxisStateMsgData) == 26, "AxisStateMsgData must be 26 bytes");
+static_assert(sizeof(TelemetryRateMsgData) == 2, "TelemetryRateMsgData must be 2 bytes");
+static_assert(sizeof(TelemetryMsgData) == 24, "TelemetryMsgData must be 24 bytes");
+static_assert(sizeof(SnapshotMsgData) == 35, "SnapshotMsgData must be 35 bytes");
+
+/**
+ * @return The data length of a message
+ */
+template <uint8_t ID>
+constexpr uint8_t codec_length()
+{
+    return sizeof(typename MessageCodec<ID>::Wire);
+}
+
+/**
+ * @brief Encodes a payload straight into a buffer
+ *
+ * @param value The payload to send
+ * @param buf   Where to encode it (at least codec_length<ID>() bytes, e.g. send_buf)
+ * @param txn   Correlation ID of the message (@see Message::txn)
+ *
+ * @return A message ready to be sent
+ */
+template <uint8_t ID>
+inline Message codec_encode(const typename MessageCodec<ID>::Value& value, uint8_t *buf, uint8_t txn = 0)
+{
+    typedef MessageCodec<ID> Codec;
+    static_assert(sizeof(typename Codec::Wire) <= MSG_DATA_LENGTH_MAX, "Payload does not fit in a message");
+
+    Codec::encode(value, (typename Codec::Wire *)buf);
+
+    Message msg = {
+        .id = ID,
+        .length = codec_length<ID>(),
+        .data = buf,
+        .txn = txn
+    };
+    return msg;
+}
+
+/**
+ * @brief Decodes a payload straight out of a received message
+ *
+ * @return SERIAL_OK if the payload was decoded into value_out
+ *         SERIAL_ERR_WRONG_MSG if the message has a different ID
+ *         SERIAL_ERR_DATA_LENGTH if the message has the wrong data length
+ */
+template <uint8_t ID>
+inline SerialResult codec_decode(const Message& msg, typename MessageCodec<ID>::Value *value_out)
+{
+    typedef MessageCodec<ID> Codec;
+
+    if (msg.id != ID) return SERIAL_ERR_WRONG_MSG;
+    if (msg.length != codec_length<ID>()) return SERIAL_ERR_DATA_LENGTH;
+
+    Codec::decode((const typename Codec::Wire *)msg.data, value_out);
+    return SERIAL_OK;
+}
+
+/*****************************************************************************/
+/*                               SCALAR VALUES                               */
+/*****************************************************************************/
+
+/**
+ * @brief Encodes a single value in network byte order (e.g. a calibration value)
+ *
+ * @return The number of bytes written
+ */
+static inline uint8_t codec_put(uint8_t *buf, uint32_t value)
+{
+    uint32_t wire = (uint32_t)htonl(value);
+    memcpy(buf, &wire, sizeof(wire));
+    return sizeof(wire);
+}
+
+static inline uint8_t codec_put(uint8_t *buf, double value)
+{
+    double wire = htond(value);
+    memcpy(buf, &wire, sizeof(wire));
+    return sizeof(wire);
+}
+
+/**
+ * @brief Decodes a single value from network byte order
+ *
+ * @param buf    Where to decode it from
+ * @param length Number of bytes available at buf
+ *
+ * @return false if there are not enough bytes
+ */
+static inline bool codec_get(const uint8_t *buf, uint8_t length, uint32_t *value_out)
+{
+    if (length < sizeof(*value_out)) return false;
+    memcpy(value_out, buf, sizeof(*value_out));
+    *value_out = (uint32_t)ntohl(*value_out);
+    return true;
+}
+
+static inline bool codec_get(const uint8_t *buf, uint8_t length, double *value_out)
+{
+    if (length < sizeof(*value_out)) return false;
+    memcpy(value_out, buf, sizeof(*value_out));
+    *value_out = ntohd(*value_out);
+    return true;
+}
+
+#endif // TEST_STAND_CODEC_H
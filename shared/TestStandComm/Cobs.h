@@ -0,0 +1,137 @@
+#ifndef COBS_H
+#define COBS_H
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Consistent Overhead Byte Stuffing
+ * 
+ * Encodes data so that it contains no zero bytes, which leaves 0x00 free to be used as an
+ * unambiguous frame delimiter. The overhead is one byte per 254 bytes of data (plus one).
+ */
+
+/** Maximum number of data bytes in a single block (the code byte is one more than this) */
+#define COBS_BLOCK_LENGTH_MAX 254
+
+/** Maximum size of the encoded form of length bytes of data (not including the delimiter) */
+#define COBS_ENCODED_LENGTH_MAX(length) ((length) + ((length) / 254) + 1)
+
+/**
+ * @brief State of an in-progress encode
+ * 
+ * Allows a frame to be encoded from several separate pieces without copying them together first.
+ */
+typedef struct {
+    uint8_t *out;      //!< Output buffer
+    uint32_t length;   //!< Number of bytes written to out so far
+    uint32_t code_idx; //!< Position of the code byte for the current block
+    uint8_t code;      //!< Code for the current block (1 + number of non-zero bytes in it)
+} CobsEncoder;
+
+/**
+ * @brief Starts encoding into an output buffer
+ * 
+ * @param enc The encoder state
+ * @param out The output buffer (@see COBS_ENCODED_LENGTH_MAX for sizing, plus 1 for the delimiter)
+ */
+static inline void cobs_encode_begin(CobsEncoder *enc, uint8_t *out)
+{
+    enc->out = out;
+    enc->code_idx = 0;
+    enc->length = 1;
+    enc->code = 1;
+}
+
+/**
+ * @brief Encodes the next piece of data
+ * 
+ * @param enc    The encoder state
+ * @param data   Pointer to the data
+ * @param length Number of bytes in data
+ */
+static inline void cobs_encode(CobsEncoder *enc, const uint8_t *data, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        if (data[i] != 0) {
+            enc->out[enc->length++] = data[i];
+            enc->code++;
+        }
+        if (data[i] == 0 || enc->code == 0xFF) {
+            // End of a block
+            enc->out[enc->code_idx] = enc->code;
+            enc->code_idx = enc->length++;
+            enc->code = 1;
+        }
+    }
+}
+
+/**
+ * @brief Returns the number of bytes at the start of the output buffer that are final
+ * 
+ * Everything before the code byte of the current block will not change anymore, so it can be
+ * transmitted before the encode is finished (@see cobs_encode_shift).
+ */
+static inline uint32_t cobs_encode_ready(const CobsEncoder *enc)
+{
+    return enc->code_idx;
+}
+
+/**
+ * @brief Removes the final bytes (@see cobs_encode_ready) from the start of the output buffer
+ * 
+ * Lets data of any length be encoded in pieces into a fixed size buffer. Afterwards the buffer
+ * holds at most COBS_BLOCK_LENGTH_MAX bytes, so it needs room for that plus the encoded size of
+ * the next piece (and the delimiter).
+ * 
+ * @param enc The encoder state
+ */
+static inline void cobs_encode_shift(CobsEncoder *enc)
+{
+    memmove(enc->out, &enc->out[enc->code_idx], enc->length - enc->code_idx);
+    enc->length -= enc->code_idx;
+    enc->code_idx = 0;
+}
+
+/**
+ * @brief Finishes encoding and appends the 0x00 frame delimiter
+ * 
+ * @param enc The encoder state
+ * 
+ * @return The total number of bytes written to the output buffer
+ */
+static inline uint32_t cobs_encode_end(CobsEncoder *enc)
+{
+    enc->out[enc->code_idx] = enc->code;
+    enc->out[enc->length++] = 0x00;
+    return enc->length;
+}
+
+/**
+ * @brief Decodes a frame in place
+ * 
+ * @param buf        The encoded frame (without the delimiter), overwritten with the decoded data
+ * @param length     Number of bytes in buf
+ * @param length_out Where to store the number of decoded bytes
+ * 
+ * @return true if the frame was decoded, false if it is not validly encoded
+ */
+static inline bool cobs_decode(uint8_t *buf, uint32_t length, uint32_t *length_out)
+{
+    uint32_t in = 0;
+    uint32_t out = 0;
+    while (in < length) {
+        uint8_t code = buf[in++];
+        if (code == 0 || (in + code - 1) > length) return false;
+
+        for (uint8_t i = 1; i < code; i++) {
+            buf[out++] = buf[in++];
+        }
+        // Every block except the last and those at the 254 byte limit was followed by a zero
+        if (code != 0xFF && in < length) buf[out++] = 0x00;
+    }
+    *length_out = out;
+    return true;
+}
+
+#endif // COBS_H
@@ -0,0 +1,127 @@
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <stdint.h>
+
+/**
+ * CRC-16/CCITT-FALSE
+ * 
+ * Polynomial 0x1021, initial value 0xFFFF, no reflection, no final XOR.
+ * Check value for the ASCII string "123456789" is 0x29B1.
+ */
+
+#define CRC16_POLY 0x1021
+#define CRC16_INIT 0xFFFF
+
+/**
+ * @brief Advances a CRC by a single bit (bitwise algorithm)
+ */
+constexpr uint16_t crc16_shift(uint16_t crc)
+{
+    return (crc & 0x8000) ? (uint16_t)((crc << 1) ^ CRC16_POLY) : (uint16_t)(crc << 1);
+}
+
+/**
+ * @brief Advances a CRC by n bits (bitwise algorithm)
+ * 
+ * Written recursively so it is a valid C++11 constexpr function (the Due toolchain
+ * does not support C++14 constexpr loops).
+ */
+constexpr uint16_t crc16_shift_n(uint16_t crc, uint8_t n)
+{
+    return (n == 0) ? crc : crc16_shift_n(crc16_shift(crc), n - 1);
+}
+
+/**
+ * @brief Computes the lookup table entry for a single byte value
+ */
+constexpr uint16_t crc16_table_entry(uint8_t i)
+{
+    return crc16_shift_n((uint16_t)(i << 8), 8);
+}
+
+/**
+ * @brief Advances a CRC over one zero byte
+ */
+constexpr uint16_t crc16_zero_byte(uint16_t crc)
+{
+    return (uint16_t)((crc << 8) ^ crc16_table_entry((uint8_t)(crc >> 8)));
+}
+
+/**
+ * @brief Computes the slice-by-4 table entry for a byte value followed by k zero bytes
+ */
+constexpr uint16_t crc16_slice_entry(uint8_t k, uint8_t i)
+{
+    return (k == 0) ? crc16_table_entry(i) : crc16_zero_byte(crc16_slice_entry(k - 1, i));
+}
+
+#define CRC16_ENTRY_4(_k, _i)  crc16_slice_entry(_k, (_i) + 0), crc16_slice_entry(_k, (_i) + 1), \
+                               crc16_slice_entry(_k, (_i) + 2), crc16_slice_entry(_k, (_i) + 3)
+#define CRC16_ENTRY_16(_k, _i) CRC16_ENTRY_4(_k, (_i) + 0), CRC16_ENTRY_4(_k, (_i) + 4),   \
+                               CRC16_ENTRY_4(_k, (_i) + 8), CRC16_ENTRY_4(_k, (_i) + 12)
+#define CRC16_ENTRY_64(_k, _i) CRC16_ENTRY_16(_k, (_i) + 0),  CRC16_ENTRY_16(_k, (_i) + 16), \
+                               CRC16_ENTRY_16(_k, (_i) + 32), CRC16_ENTRY_16(_k, (_i) + 48)
+#define CRC16_TABLE(_k)        { CRC16_ENTRY_64(_k, 0), CRC16_ENTRY_64(_k, 64), \
+                                 CRC16_ENTRY_64(_k, 128), CRC16_ENTRY_64(_k, 192) }
+
+/**
+ * Lookup table generated at compile time (lives in flash on the Arduino)
+ */
+constexpr uint16_t crc16_table[256] = CRC16_TABLE(0);
+
+/**
+ * Slice-by-4 tables: crc16_slice_table[k - 1] is the table for a byte followed by k zero
+ * bytes (crc16_table being the one for k = 0). 1.5 KB of flash on the Arduino.
+ */
+constexpr uint16_t crc16_slice_table[3][256] = { CRC16_TABLE(1), CRC16_TABLE(2), CRC16_TABLE(3) };
+
+#undef CRC16_ENTRY_4
+#undef CRC16_ENTRY_16
+#undef CRC16_ENTRY_64
+#undef CRC16_TABLE
+
+static_assert(crc16_table[1] == 0x1021, "CRC-16 table generation is broken");
+static_assert(crc16_table[255] == 0x1EF0, "CRC-16 table generation is broken");
+static_assert(crc16_slice_table[0][1] == crc16_zero_byte(0x1021), "CRC-16 slice table generation is broken");
+
+/**
+ * @brief Adds a single byte to a running CRC
+ * 
+ * @param crc  The running CRC (start with CRC16_INIT)
+ * @param byte The next byte of data
+ * 
+ * @return The updated CRC
+ */
+static inline uint16_t crc16_update(uint16_t crc, uint8_t byte)
+{
+    return (uint16_t)((crc << 8) ^ crc16_table[(uint8_t)(crc >> 8) ^ byte]);
+}
+
+/**
+ * @brief Adds a buffer of bytes to a running CRC
+ * 
+ * Takes four bytes per step (slice-by-4), which is about four times as fast as a byte at a
+ * time on the host (@see CommBench crc). The four lookups do not depend on each other.
+ * 
+ * @param crc    The running CRC (start with CRC16_INIT)
+ * @param data   Pointer to the data
+ * @param length Number of bytes in data
+ * 
+ * @return The updated CRC
+ */
+static inline uint16_t crc16_update(uint16_t crc, const uint8_t *data, uint32_t length)
+{
+    for (; length >= 4; data += 4, length -= 4) {
+        crc = crc16_slice_table[2][(uint8_t)(crc >> 8) ^ data[0]] ^
+              crc16_slice_table[1][(uint8_t)crc ^ data[1]] ^
+              crc16_slice_table[0][data[2]] ^
+              crc16_table[data[3]];
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        crc = crc16_update(crc, data[i]);
+    }
+    return crc;
+}
+
+#endif // CRC16_H
@@ -0,0 +1,66 @@
+#ifndef LINK_STATS_H
+#define LINK_STATS_H
+
+#include <stdint.h>
+
+/** Number of buckets in the ACK latency histogram */
+#define LINK_ACK_HIST_BUCKETS 8
+
+/**
+ * @struct TransportStats
+ *
+ * @brief Link health counters maintained by SerialTransport
+ */
+typedef struct {
+    uint32_t frames_sent;     //!< Frames handed to the SerialDevice
+    uint32_t frames_received; //!< Frames received with a valid CRC
+    uint32_t bytes_sent;      //!< Bytes written to the SerialDevice (including framing)
+    uint32_t bytes_received;  //!< Bytes read from the SerialDevice
+    uint32_t bytes_discarded; //!< Bytes received outside of a frame (before a START delimiter)
+    uint32_t bad_end_delims;  //!< Frames that did not end with a delimiter right after the CRC
+    uint32_t crc_errors;      //!< Frames that failed the CRC check
+} TransportStats;
+
+/**
+ * @struct SessionStats
+ *
+ * @brief Link health counters maintained by SerialSession
+ *
+ * Bucket i of the ACK latency histogram counts ACKs that arrived less than 2^i ms after the
+ * frame was sent, the last bucket counts everything slower. Retransmitted frames are left out
+ * since their ACK cannot be matched to a transmission.
+ */
+typedef struct {
+    uint32_t ack_timeouts;   //!< ACKs that did not arrive in time
+    uint32_t nacks_sent;
+    uint32_t nacks_received;
+    uint32_t retransmits;    //!< Frames sent again from the send window
+    uint32_t ack_latency_hist[LINK_ACK_HIST_BUCKETS];
+} SessionStats;
+
+/**
+ * @struct LinkStats
+ *
+ * @brief All of the link health counters of one end of the link
+ *
+ * Only made up of uint32_t (so there is no padding) and byte swapped a word at a time for
+ * MSG_ID_LINK_STATS.
+ */
+typedef struct {
+    TransportStats transport;
+    SessionStats session;
+} LinkStats;
+
+static_assert(sizeof(LinkStats) % sizeof(uint32_t) == 0, "LinkStats must only contain uint32_t");
+
+/**
+ * @return The ACK latency histogram bucket for a latency
+ */
+static inline uint8_t link_ack_hist_bucket(uint64_t latency_ms)
+{
+    uint8_t bucket = 0;
+    while (bucket < LINK_ACK_HIST_BUCKETS - 1 && latency_ms >= (1ULL << bucket)) bucket++;
+    return bucket;
+}
+
+#endif // LINK_STATS_H
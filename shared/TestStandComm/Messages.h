@@ -4,9 +4,19 @@
 #include <stdint.h>
 
 #define MSG_DATA_LENGTH_MAX  0xFF
+#define MSG_EXT_LENGTH_MAX   0xFFFF // Extended frames (16-bit length)
 
 #define MSG_DELIM_START      0x7B
+#define MSG_DELIM_START_SEQ  0x5B // Start of a frame with a sequence number and correlation ID (windowed session)
+#define MSG_DELIM_START_EXT  0x3C // Start of an extended frame (16-bit length, never sequenced)
+#define MSG_DELIM_START_RETX 0x28 // Start of a stop-and-wait frame that is being retransmitted
+#define MSG_DELIM_START_ALT  0x7C // MSG_DELIM_START with the alternating bit set
+#define MSG_DELIM_START_RETX_ALT 0x29 // MSG_DELIM_START_RETX with the alternating bit set
 #define MSG_DELIM_END        0x7D
+#define MSG_DELIM_COBS       0x00 // End of a COBS encoded frame
+
+#define MSG_HEADER_LENGTH_MAX 5 // START + ID + SEQ + TXN + LENGTH
+#define MSG_FRAME_LENGTH_MAX  (MSG_HEADER_LENGTH_MAX + MSG_DATA_LENGTH_MAX + 2) // Not including END
 
 #define MSG_ID_INVALID       0x00
 
@@ -16,11 +26,37 @@
 #define MSG_ID_PING          0x10
 #define MSG_ID_ECHO          0x11
 #define MSG_ID_ECHOED        0x12
+#define MSG_ID_NEGOTIATE     0x13
+#define MSG_ID_NEGOTIATED    0x14
+#define MSG_ID_CHANGE_BAUD   0x15
+#define MSG_ID_CHANGED_BAUD  0x16
+#define MSG_ID_GET_LINK_STATS 0x17
+#define MSG_ID_LINK_STATS    0x18 // Data is a LinkStats with every word in network byte order
+
+// Link features that can be enabled with MSG_ID_NEGOTIATE
+#define LINK_FEATURE_WINDOWED    0x01 // Sliding-window session with sequence numbers and cumulative ACKs
+#define LINK_FEATURE_CORRELATION 0x02 // Replies carry the correlation ID of the request they answer
+#define LINK_FEATURE_COBS        0x04 // COBS framing (zero byte delimited)
 
 typedef struct {
     uint8_t id;
-    uint8_t length;
+    uint16_t length; //!< Data length (at most MSG_DATA_LENGTH_MAX unless extended)
     uint8_t *data;
+    uint8_t txn;     //!< Correlation ID of a request, echoed in its reply (0 if none, only sent in sequenced frames)
+    bool sequenced;  //!< true if the frame carries a sequence number (windowed session)
+    uint8_t seq;     //!< Sequence number for data frames, acknowledgement number for ACK / NACK frames
+    bool extended;   //!< true if the frame has a 16-bit length (@see SerialTransport::set_ext_buffer)
+    bool retransmit; //!< true if the frame is a retransmission of a stop-and-wait frame (never sequenced or extended)
+    bool alt;        //!< Alternating bit of a stop-and-wait frame, flipped for every new message (never sequenced or extended)
 } Message;
 
+typedef struct {
+    uint8_t features;    //!< Bitmask of LINK_FEATURE_*
+    uint8_t window_size; //!< Maximum number of unacknowledged frames (if LINK_FEATURE_WINDOWED)
+} __attribute__((__packed__)) NegotiateMsgData;
+
+typedef struct {
+    uint32_t baud_rate; //!< Proposed baud rate (network byte order), 0 in the reply if it is refused
+} __attribute__((__packed__)) BaudMsgData;
+
 #endif // MESSAGES_H
@@ -0,0 +1,42 @@
+#ifndef SERIAL_CAPTURE_H
+#define SERIAL_CAPTURE_H
+
+#include "Messages.h"
+
+#include <stdint.h>
+
+/**
+ * @enum SerialCaptureDir
+ *
+ * @brief Which way a captured frame went, as seen by the end of the link that captured it
+ */
+typedef enum {
+    SERIAL_CAPTURE_RX = 1,
+    SERIAL_CAPTURE_TX = 2
+} SerialCaptureDir;
+
+/**
+ * @class SerialCapture
+ *
+ * @brief Receives a copy of every frame a SerialTransport sends or receives
+ *
+ * Attached with SerialTransport::set_capture(). Frames are passed on as soon as they have
+ * been sent or received with a valid CRC, from whichever thread is using the transport, so
+ * implementations must be quick and must not block.
+ */
+class SerialCapture
+{
+    public:
+        virtual ~SerialCapture() {}
+
+        /**
+         * @param dir     Whether the frame was received or sent
+         * @param cobs    true if the frame was COBS framed (@see SerialFraming)
+         * @param msg     The frame's header fields
+         * @param data    The frame's data (msg.length bytes, may differ from msg.data for
+         *                received extended frames)
+         */
+        virtual void capture_frame(SerialCaptureDir dir, bool cobs, const Message& msg, const uint8_t *data) = 0;
+};
+
+#endif // SERIAL_CAPTURE_H
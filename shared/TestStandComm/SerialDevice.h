@@ -11,9 +11,21 @@ typedef enum {
     BAUD_115200 = 115200,
     BAUD_230400 = 230400,
     BAUD_460800 = 460800,
-    BAUD_500000 = 500000
+    BAUD_500000 = 500000,
+    BAUD_1000000 = 1000000,
+    BAUD_2000000 = 2000000
 } SerialBaudRate;
 
+/**
+ * @struct SerialIOVec
+ * 
+ * @brief Describes one buffer in a gather-write (@see SerialDevice::ser_writev)
+ */
+typedef struct {
+    uint8_t *data;   //!< Pointer to the data buffer
+    uint32_t length; //!< Number of bytes to transmit from the buffer
+} SerialIOVec;
+
 /**
  * @class SerialDevice
  * 
@@ -35,6 +47,18 @@ class SerialDevice
          */
         virtual bool ser_connect(SerialBaudRate baud_rate) = 0;
 
+        /**
+         * @brief Change the baud rate of an open connection
+         * 
+         * Data already handed to the device for transmission must go out at the old
+         * baud rate before the switch.
+         * 
+         * @param baud_rate The new baud rate
+         * 
+         * @return true if the baud rate was changed, false if it is not supported
+         */
+        virtual bool ser_set_baud_rate(SerialBaudRate baud_rate) = 0;
+
         /**
          * @brief Flush all data currently in the receive buffer of the serial device
          */
@@ -57,6 +81,30 @@ class SerialDevice
          */
         virtual bool ser_read(uint8_t *out) = 0;
 
+        /**
+         * @brief Read as many bytes as are currently available (up to max_length)
+         *        from the serial device without blocking
+         * 
+         * @param buf        Pointer to where the read bytes will be stored
+         * @param max_length The maximum number of bytes to read into buf
+         * 
+         * @return The number of bytes read (0 if no data was available)
+         */
+        virtual uint32_t ser_read_bulk(uint8_t *buf, uint32_t max_length) = 0;
+
+        /**
+         * @brief Block until data is available in the receive buffer of the serial device
+         *        or until the timeout has elapsed
+         * 
+         * Implementations should put the calling thread (or CPU) to sleep while waiting
+         * rather than repeatedly polling ser_available.
+         * 
+         * @param timeout_ms Maximum time (in milliseconds) to wait for data
+         * 
+         * @return true if data is available to be read, otherwise false
+         */
+        virtual bool ser_wait(uint32_t timeout_ms) = 0;
+
         /**
          * @brief Transmits a buffer of data on the serial device
          * 
@@ -67,6 +115,19 @@ class SerialDevice
          */
         virtual bool ser_write(uint8_t *data, uint32_t length) = 0;
 
+        /**
+         * @brief Transmits several buffers of data on the serial device as a single write
+         * 
+         * The buffers are transmitted back-to-back in the order given. Implementations
+         * should hand all the data to the hardware / OS in as few operations as possible.
+         * 
+         * @param iov   Array of buffers to transmit
+         * @param count The number of buffers in iov
+         * 
+         * @return true if all the bytes were transmitted, otherwise false
+         */
+        virtual bool ser_writev(const SerialIOVec *iov, uint32_t count) = 0;
+
         /**
          * @brief Closes an open connection to the serial hardware
          * 
@@ -19,7 +19,9 @@ typedef enum {
     SERIAL_ERR_ACK_FAILED,      //!< After receiving a message, failed to send an ACK
     SERIAL_ERR_WRONG_MSG,       //!< An unexpected message was received
     SERIAL_ERR_DATA_LENGTH,     //!< Wrong length of data was received
-    SERIAL_ERR_DATA_CORRUPT     //!< Received serial data was corrupted
+    SERIAL_ERR_DATA_CORRUPT,    //!< Received serial data was corrupted
+    SERIAL_ERR_BUSY,            //!< Too many requests are already waiting for a reply
+    SERIAL_ERR_REJECTED         //!< The other device refused a request, or it did not work out
 } SerialResult;
 
 #endif // SERIAL_RESULT_H
\ No newline at end of file
@@ -1,7 +1,12 @@
 #include "SerialSession.h"
 
-/** Maximum time to wait to receive an ACK after sending a message (milliseconds) */
-#define ACK_TIMEOUT_MS 100
+#include <string.h>
+
+/** Bits on the wire per byte (start bit + 8 data bits + stop bit) */
+#define SERIAL_BITS_PER_BYTE 10
+
+static_assert((SERIAL_WINDOW_MAX & (SERIAL_WINDOW_MAX - 1)) == 0, "SERIAL_WINDOW_MAX must be a power of 2");
+static_assert(SERIAL_WINDOW_MAX <= 128, "SERIAL_WINDOW_MAX must fit in half the sequence number space");
 
 /**
  * @brief Constructs a new SerialSession
@@ -11,7 +16,221 @@
  */
 SerialSession::SerialSession(SerialTransport& transport, Message& received_msg) : received_msg(received_msg), transport(transport)
 {
-    // Nothing else to do
+    this->window_size = 0;
+    this->max_retries = SERIAL_MAX_RETRIES;
+    this->baud_rate = BAUD_115200;
+    this->reset();
+    this->reset_stats();
+}
+
+/**
+ * @brief Resets all sequence numbers and discards any frames held in the send and receive windows
+ * 
+ * The RTO estimate starts over as well (@see reset_rto()).
+ */
+void SerialSession::reset()
+{
+    this->tx_base = 0;
+    this->tx_next = 0;
+    this->tx_error = SERIAL_OK;
+
+    this->rx_deliver = 0;
+    this->rx_expected = 0;
+    this->peer_sequenced = false;
+    for (uint8_t i = 0; i < SERIAL_WINDOW_MAX; i++) {
+        this->rx_slots[i].valid = false;
+    }
+
+    this->tx_alt = false;
+    this->last_rx_valid = false;
+    this->reset_rto();
+}
+
+/**
+ * @brief Sets the send window size
+ * 
+ * @param window_size The maximum number of unacknowledged frames (clamped to SERIAL_WINDOW_MAX)
+ *                    or 0 to send stop-and-wait
+ */
+void SerialSession::set_window_size(uint8_t window_size)
+{
+    this->window_size = (window_size > SERIAL_WINDOW_MAX ? SERIAL_WINDOW_MAX : window_size);
+}
+
+/**
+ * @return The send window size (0 if sending stop-and-wait)
+ */
+uint8_t SerialSession::get_window_size()
+{
+    return this->window_size;
+}
+
+/**
+ * @return The number of messages that can be sent without send_message blocking (0 if
+ *         sending stop-and-wait, which always waits for the ACK)
+ */
+uint8_t SerialSession::get_window_free()
+{
+    uint8_t outstanding = this->tx_outstanding();
+    return (outstanding < this->window_size ? this->window_size - outstanding : 0);
+}
+
+/**
+ * @brief Sets how many times an unacknowledged frame is retransmitted before giving up
+ * 
+ * @param max_retries The number of retransmissions (0 to send every frame only once)
+ */
+void SerialSession::set_max_retries(uint8_t max_retries)
+{
+    this->max_retries = max_retries;
+}
+
+/**
+ * @return The number of times an unacknowledged frame is retransmitted before giving up
+ */
+uint8_t SerialSession::get_max_retries()
+{
+    return this->max_retries;
+}
+
+/**
+ * @brief Sets the baud rate the time to transmit frames is worked out at
+ * 
+ * The RTO estimate starts over as well (@see reset_rto()), since the round trip time is
+ * different at the new baud rate.
+ * 
+ * @param baud_rate The baud rate of the SerialDevice
+ */
+void SerialSession::set_baud_rate(SerialBaudRate baud_rate)
+{
+    this->baud_rate = baud_rate;
+    this->reset_rto();
+}
+
+/**
+ * @brief Works out how long a frame takes to transmit at the current baud rate
+ * 
+ * @param data_length Number of data bytes in the frame
+ * 
+ * @return The time (milliseconds, rounded up) for the longest the frame can be on the wire,
+ *         i.e. with every header field and COBS encoding
+ */
+uint32_t SerialSession::wire_ms(uint32_t data_length)
+{
+    uint32_t bytes = COBS_ENCODED_LENGTH_MAX(MSG_HEADER_LENGTH_MAX + data_length + 2) + 1;
+    return (bytes * SERIAL_BITS_PER_BYTE * 1000 + this->baud_rate - 1) / this->baud_rate;
+}
+
+/**
+ * @brief Discards the round trip time measurements, the RTO goes back to SERIAL_RTO_INIT_MS
+ * 
+ * Should be done whenever the round trip time changes drastically (e.g. a new baud rate).
+ */
+void SerialSession::reset_rto()
+{
+    this->rtt_measured = false;
+    this->srtt_x8 = 0;
+    this->rttvar_x4 = 0;
+    this->rto = SERIAL_RTO_INIT_MS;
+}
+
+/**
+ * @return The current retransmission timeout (milliseconds)
+ */
+uint32_t SerialSession::get_rto()
+{
+    return this->rto;
+}
+
+/**
+ * @brief Estimates how long one exchange takes: the request going out, a round trip at the
+ *        RTO (SRTT + 4 * RTTVAR) and the reply coming back
+ * 
+ * Nothing is allowed for lost frames, those are left to retransmission. When sending
+ * stop-and-wait the request is already on the wire by the time send_message returns, so
+ * only windowed sends count it, along with every frame queued in the window ahead of it.
+ * 
+ * @param request_length Number of data bytes in the request
+ * @param reply_length   Number of data bytes in the reply
+ * 
+ * @return The exchange time (milliseconds)
+ */
+uint32_t SerialSession::exchange_ms(uint32_t request_length, uint32_t reply_length)
+{
+    uint32_t total = this->rto + this->wire_ms(reply_length);
+
+    // Extended requests are always sent stop-and-wait
+    if (this->window_size > 0 && request_length <= MSG_DATA_LENGTH_MAX) {
+        total += this->wire_ms(request_length);
+        for (uint8_t seq = this->tx_base; seq != this->tx_next; seq++) {
+            total += this->wire_ms(this->tx_slots[seq % SERIAL_WINDOW_MAX].frame.length);
+        }
+    }
+    return total;
+}
+
+/**
+ * @return The link health counters of this end of the link
+ */
+const SessionStats& SerialSession::get_stats()
+{
+    return this->stats;
+}
+
+/**
+ * @brief Zeroes all of the link health counters
+ */
+void SerialSession::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(this->stats));
+}
+
+/**
+ * @brief Measures the round trip time of a frame that was just acknowledged
+ * 
+ * The measurement is added to the ACK latency histogram and updates the RTO, using the
+ * fixed point arithmetic from Jacobson's "Congestion Avoidance and Control".
+ * 
+ * @param sent_ms When the frame was sent (@see SerialTransport::platform_millis()), it
+ *                must not have been retransmitted since
+ * @param wire_ms The time that was allowed for transmitting the frame, it is left out of
+ *                the round trip time
+ */
+void SerialSession::record_rtt(uint64_t sent_ms, uint32_t wire_ms)
+{
+    uint64_t latency_ms = this->transport.platform_millis() - sent_ms;
+    this->stats.ack_latency_hist[link_ack_hist_bucket(latency_ms)]++;
+
+    latency_ms = (latency_ms > wire_ms ? latency_ms - wire_ms : 0);
+    uint32_t rtt = (latency_ms < SERIAL_RTO_MAX_MS ? (uint32_t)latency_ms : SERIAL_RTO_MAX_MS);
+    if (!this->rtt_measured) {
+        // SRTT = R, RTTVAR = R / 2
+        this->srtt_x8 = rtt << 3;
+        this->rttvar_x4 = rtt << 1;
+        this->rtt_measured = true;
+    }
+    else {
+        // SRTT += (R - SRTT) / 8, RTTVAR += (|R - SRTT| - RTTVAR) / 4
+        int32_t err = (int32_t)rtt - (int32_t)(this->srtt_x8 >> 3);
+        this->srtt_x8 += err;
+        if (err < 0) err = -err;
+        this->rttvar_x4 += err - (int32_t)(this->rttvar_x4 >> 2);
+    }
+
+    // RTO = SRTT + 4 * RTTVAR (at least one clock tick)
+    uint32_t rto = (this->srtt_x8 >> 3) + (this->rttvar_x4 > 1 ? this->rttvar_x4 : 1);
+    if (rto < SERIAL_RTO_MIN_MS) rto = SERIAL_RTO_MIN_MS;
+    if (rto > SERIAL_RTO_MAX_MS) rto = SERIAL_RTO_MAX_MS;
+    this->rto = rto;
+}
+
+/**
+ * @brief Doubles the RTO after a timeout, until the next round trip time measurement
+ */
+void SerialSession::backoff()
+{
+    this->stats.ack_timeouts++;
+    this->rto = (this->rto * 2 < SERIAL_RTO_MAX_MS ? this->rto * 2 : SERIAL_RTO_MAX_MS);
 }
 
 /**
@@ -27,10 +246,32 @@ bool SerialSession::ack()
     return this->transport.send_message(ack);
 }
 
+/**
+ * @brief Transmits a sequenced ACK or NACK message
+ * 
+ * @param id  MSG_ID_ACK or MSG_ID_NACK
+ * @param seq The next sequence number expected (everything before it has been received)
+ */
+bool SerialSession::ack_seq(uint8_t id, uint8_t seq)
+{
+    Message ack = {
+        .id = id,
+        .length = 0,
+        .data = nullptr,
+        .txn = 0,
+        .sequenced = true,
+        .seq = seq
+    };
+    if (id == MSG_ID_NACK) this->stats.nacks_sent++;
+    return this->transport.send_message(ack);
+}
+
 /**
  * @brief Checks if the received message was expected and sends an ACK if it was
  * 
  * @return SERIAL_OK             if the received message was expected
+ *         SERIAL_OK_NO_MSG      if the message was a retransmission of the last one received
+ *                               (it is ACKed again but not delivered)
  *         SERIAL_ERR_ACK_FAILED if sending the ACK failed
  *         SERIAL_ERR_WRONG_MSG  if an unexpected message was received
  */
@@ -46,10 +287,256 @@ SerialResult SerialSession::check_received_msg()
         if (!this->ack()) {
             return SERIAL_ERR_ACK_FAILED;
         }
+        // Our ACK of the original got lost
+        if (this->is_duplicate()) return SERIAL_OK_NO_MSG;
         return SERIAL_OK;
     }
 }
 
+/**
+ * @brief Checks if a stop-and-wait frame repeats the last one delivered and remembers it
+ * 
+ * Only frames marked as retransmissions are compared, by their alternating bit rather than
+ * their contents, so sending the same command twice in a row delivers it twice.
+ * 
+ * @return true if received_msg is a retransmission of the last frame delivered
+ */
+bool SerialSession::is_duplicate()
+{
+    Message& msg = this->received_msg;
+
+    // Extended frames are never retransmitted
+    if (msg.extended) {
+        this->last_rx_valid = false;
+        return false;
+    }
+
+    bool duplicate = (msg.retransmit && this->last_rx_valid && msg.alt == this->last_rx_alt);
+
+    this->last_rx_valid = true;
+    this->last_rx_alt = msg.alt;
+    return duplicate;
+}
+
+/**
+ * @brief Handles a frame that was just received into received_msg
+ * 
+ * @param deliver true if the caller can accept a message for the application, false if
+ *                the caller is only waiting on ACKs (data frames are then held in the
+ *                receive window until they can be delivered)
+ * 
+ * @return SERIAL_OK        if received_msg holds a message for the application
+ *         SERIAL_OK_NO_MSG if the frame was consumed by the session layer
+ *         @see check_received_msg() for stop-and-wait frames
+ */
+SerialResult SerialSession::handle_frame(bool deliver)
+{
+    if (this->received_msg.sequenced) {
+        this->peer_sequenced = true;
+        return this->handle_sequenced_frame(deliver);
+    }
+
+    // Stop-and-wait frames cannot be held back since they carry no sequence number
+    // (the sender will report a missing ACK)
+    if (!deliver) return SERIAL_OK_NO_MSG;
+    return this->check_received_msg();
+}
+
+/**
+ * @brief Handles a received frame carrying a sequence number
+ * 
+ * @see handle_frame(bool deliver)
+ */
+SerialResult SerialSession::handle_sequenced_frame(bool deliver)
+{
+    Message& msg = this->received_msg;
+
+    if (msg.id == MSG_ID_ACK) {
+        this->handle_ack(msg.seq);
+        return SERIAL_OK_NO_MSG;
+    }
+    if (msg.id == MSG_ID_NACK) {
+        // Everything before the NACKed frame was received, the NACKed frame was not
+        this->stats.nacks_received++;
+        this->handle_ack(msg.seq);
+        if (this->tx_outstanding() > 0 && msg.seq == this->tx_base) {
+            TxSlot& slot = this->tx_slots[msg.seq % SERIAL_WINDOW_MAX];
+            // Only fast-retransmit once, the peer NACKs every out-of-order frame it receives
+            if (!slot.fast_retransmitted) {
+                slot.fast_retransmitted = true;
+                this->stats.retransmits++;
+                this->transmit_slot(msg.seq);
+            }
+        }
+        return SERIAL_OK_NO_MSG;
+    }
+
+    // Frame from before the window: our ACK got lost so ACK it again
+    if ((uint8_t)(msg.seq - this->rx_expected) >= (uint8_t)(256 - SERIAL_WINDOW_MAX)) {
+        if (!this->ack_seq(MSG_ID_ACK, this->rx_expected)) return SERIAL_ERR_ACK_FAILED;
+        return SERIAL_OK_NO_MSG;
+    }
+
+    // Frame too far ahead to be buffered, the sender will retransmit it
+    if ((uint8_t)(msg.seq - this->rx_deliver) >= SERIAL_WINDOW_MAX) return SERIAL_OK_NO_MSG;
+
+    // Fast path: the next frame in sequence with nothing buffered ahead of it
+    if (deliver && msg.seq == this->rx_deliver && this->rx_deliver == this->rx_expected) {
+        this->rx_deliver++;
+        this->rx_expected++;
+        if (!this->ack_seq(MSG_ID_ACK, this->rx_expected)) return SERIAL_ERR_ACK_FAILED;
+        return SERIAL_OK;
+    }
+
+    // Hold on to the frame until it can be delivered in order
+    uint8_t expected = this->rx_expected;
+    RxSlot& slot = this->rx_slots[msg.seq % SERIAL_WINDOW_MAX];
+    if (!slot.valid) {
+        slot.frame.id = msg.id;
+        slot.frame.length = msg.length;
+        slot.frame.txn = msg.txn;
+        memcpy(slot.frame.data, msg.data, msg.length);
+        slot.valid = true;
+    }
+    while (this->rx_slots[this->rx_expected % SERIAL_WINDOW_MAX].valid &&
+           (uint8_t)(this->rx_expected - this->rx_deliver) < SERIAL_WINDOW_MAX) {
+        this->rx_expected++;
+    }
+
+    // If the frame skipped ahead, NACK the first missing frame so it is retransmitted right away
+    bool gap = (msg.seq != expected);
+    if (!this->ack_seq(gap ? MSG_ID_NACK : MSG_ID_ACK, this->rx_expected)) return SERIAL_ERR_ACK_FAILED;
+
+    if (deliver && this->deliver_buffered()) return SERIAL_OK;
+    return SERIAL_OK_NO_MSG;
+}
+
+/**
+ * @brief Moves the next in-sequence frame from the receive window into received_msg
+ * 
+ * @return true if a frame was delivered, otherwise false
+ */
+bool SerialSession::deliver_buffered()
+{
+    if (this->rx_deliver == this->rx_expected) return false;
+
+    RxSlot& slot = this->rx_slots[this->rx_deliver % SERIAL_WINDOW_MAX];
+    this->received_msg.id = slot.frame.id;
+    this->received_msg.length = slot.frame.length;
+    this->received_msg.txn = slot.frame.txn;
+    memcpy(this->received_msg.data, slot.frame.data, slot.frame.length);
+    this->received_msg.sequenced = true;
+    this->received_msg.seq = this->rx_deliver;
+
+    slot.valid = false;
+    this->rx_deliver++;
+    return true;
+}
+
+/**
+ * @return The number of frames sent but not acknowledged yet
+ */
+uint8_t SerialSession::tx_outstanding()
+{
+    return (uint8_t)(this->tx_next - this->tx_base);
+}
+
+/**
+ * @brief (Re)transmits a frame from the send window
+ * 
+ * Every unacknowledged frame before it may still be waiting to go out, so the time to
+ * transmit all of them is added to its ACK timeout.
+ */
+bool SerialSession::transmit_slot(uint8_t seq)
+{
+    TxSlot& slot = this->tx_slots[seq % SERIAL_WINDOW_MAX];
+    slot.wire_ms = 0;
+    for (uint8_t i = this->tx_base; i != (uint8_t)(seq + 1); i++) {
+        slot.wire_ms += this->wire_ms(this->tx_slots[i % SERIAL_WINDOW_MAX].frame.length);
+    }
+
+    Message msg = {
+        .id = slot.frame.id,
+        .length = slot.frame.length,
+        .data = slot.frame.data,
+        .txn = slot.frame.txn,
+        .sequenced = true,
+        .seq = seq
+    };
+    slot.sent_ms = this->transport.platform_millis();
+    return this->transport.send_message(msg);
+}
+
+/**
+ * @brief Processes a cumulative acknowledgement
+ * 
+ * @param ack_num All frames with a sequence number before ack_num have been received
+ */
+void SerialSession::handle_ack(uint8_t ack_num)
+{
+    // Ignore stale ACKs or ACKs for frames that were never sent
+    if ((uint8_t)(ack_num - this->tx_base) > this->tx_outstanding()) return;
+
+    // Only frames sent once have a known round trip time
+    for (uint8_t seq = this->tx_base; seq != ack_num; seq++) {
+        TxSlot& slot = this->tx_slots[seq % SERIAL_WINDOW_MAX];
+        if (slot.retries == 0 && !slot.fast_retransmitted) this->record_rtt(slot.sent_ms, slot.wire_ms);
+    }
+    this->tx_base = ack_num;
+}
+
+/**
+ * @brief Retransmits any frames whose ACK has not arrived within the RTO (plus the time
+ *        to transmit them, @see transmit_slot)
+ * 
+ * If a frame has been retransmitted max_retries times without being acknowledged,
+ * SERIAL_ERR_NO_ACK is reported on the next send. The frame stays in the send window and
+ * keeps being retransmitted, since skipping over it would leave the receiver waiting for
+ * it forever. Renegotiating the link starts both sides over.
+ */
+void SerialSession::check_retransmit()
+{
+    uint64_t now = this->transport.platform_millis();
+    uint32_t rto = this->rto;
+    bool timed_out = false;
+    for (uint8_t seq = this->tx_base; seq != this->tx_next; seq++) {
+        TxSlot& slot = this->tx_slots[seq % SERIAL_WINDOW_MAX];
+        if ((now - slot.sent_ms) < rto + slot.wire_ms) continue;
+
+        timed_out = true;
+        this->stats.retransmits++;
+        if (slot.retries >= this->max_retries) {
+            this->tx_error = SERIAL_ERR_NO_ACK;
+        }
+        else {
+            slot.retries++;
+        }
+        if (!this->transmit_slot(seq)) {
+            this->tx_error = SERIAL_ERR_SEND_FAILED;
+        }
+    }
+
+    if (timed_out) this->backoff();
+}
+
+/**
+ * @brief Processes at most one received frame and services retransmission timers
+ * 
+ * Data frames are held in the receive window rather than delivered.
+ */
+void SerialSession::service()
+{
+    this->check_retransmit();
+
+    SerialResult res = this->transport.check_for_message(this->received_msg);
+    if (res == SERIAL_OK) {
+        this->handle_frame(false);
+    }
+    else if (res == SERIAL_ERR_DATA_CORRUPT && this->peer_sequenced) {
+        this->ack_seq(MSG_ID_NACK, this->rx_expected);
+    }
+}
+
 /**
  * @brief Checks if a full message has been received
  * 
@@ -58,18 +545,31 @@ SerialResult SerialSession::check_received_msg()
  * it will be stored into the received_msg struct passed to the constructor.
  * 
  * If a full message was received, an ACK response will automatically be sent.
+ * In windowed mode this also retransmits any frames whose ACK is overdue.
  * 
- * @return SERIAL_OK             if a full message was received and an ACK was sent
- *         SERIAL_ERR_ACK_FAILED if a full message was received but sending the ACK failed
- *         SERIAL_ERR_WRONG_MSG  if an unexpected ACK or NACK was received
- *         SERIAL_OK_NO_MSG      if no message was received
+ * @return SERIAL_OK               if a full message was received and an ACK was sent
+ *         SERIAL_ERR_ACK_FAILED   if a full message was received but sending the ACK failed
+ *         SERIAL_ERR_WRONG_MSG    if an unexpected ACK or NACK was received
+ *         SERIAL_ERR_DATA_CORRUPT if a full message was received but failed the CRC check
+ *         SERIAL_ERR_DATA_LENGTH  if an extended message did not fit in the extended buffer
+ *                                 (it is not ACKed)
+ *         SERIAL_OK_NO_MSG        if no message was received
  */
 SerialResult SerialSession::check_for_message()
 {
-    if (this->transport.check_for_message(this->received_msg)) {
-        return this->check_received_msg();
+    // Frames that arrived while we were waiting on ACKs are delivered first
+    if (this->deliver_buffered()) return SERIAL_OK;
+
+    if (this->tx_outstanding() > 0) this->check_retransmit();
+
+    SerialResult res = this->transport.check_for_message(this->received_msg);
+    if (res == SERIAL_ERR_DATA_CORRUPT && this->peer_sequenced) {
+        // Ask for the first missing frame right away rather than waiting for the sender to time out
+        this->ack_seq(MSG_ID_NACK, this->rx_expected);
     }
-    return SERIAL_OK_NO_MSG;
+    if (res != SERIAL_OK) return res;
+
+    return this->handle_frame(true);
 }
 
 /**
@@ -78,7 +578,8 @@ SerialResult SerialSession::check_for_message()
  * This method is blocking. It will continually check for serial data until a full message is received
  * or until timeout_ms has elapsed. If a message is received, an ACK will automatically be sent back.
  * 
- * If a partial message has been received when this method is called, it will not attempt to receive a full message.
+ * If a partial message has been received when this method is called, it will not attempt to receive a full message
+ * (only applies when sending stop-and-wait).
  * 
  * @param timeout_ms Maximum time (in milliseconds) to wait for a message
  * 
@@ -87,17 +588,35 @@ SerialResult SerialSession::check_for_message()
  *         SERIAL_ERR_ACK_FAILED      if a full message was received but sending the ACK failed
  *         SERIAL_ERR_WRONG_MSG       if an unexpected ACK or NACK was received
  *         SERIAL_ERR_TIMEOUT         if no message was received
+ *         SERIAL_ERR_DATA_CORRUPT    if a full message was received but failed the CRC check
+ *                                    (only from a stop-and-wait peer, sequenced frames are retransmitted)
+ *         SERIAL_ERR_DATA_LENGTH     if an extended message did not fit in the extended buffer
  */
 SerialResult SerialSession::recv_message(uint32_t timeout_ms)
 {
     // Cannot try to receive a full message while a partial one is in progress
-    if (this->transport.msg_in_progress) return SERIAL_ERR_MSG_IN_PROGRESS;
+    if (this->window_size == 0 && this->transport.msg_in_progress) return SERIAL_ERR_MSG_IN_PROGRESS;
+
+    uint64_t time_start = this->transport.platform_millis();
+    while (true) {
+        SerialResult res = this->check_for_message();
+        // A sequenced peer retransmits corrupted frames (they were NACKed), so keep waiting
+        if (res == SERIAL_ERR_DATA_CORRUPT && this->peer_sequenced) res = SERIAL_OK_NO_MSG;
+        if (res != SERIAL_OK_NO_MSG) return res;
+
+        // Check if we've hit the timeout
+        uint64_t elapsed = this->transport.platform_millis() - time_start;
+        if (elapsed >= timeout_ms) {
+            // Abandon the message
+            this->transport.abandon();
+            return SERIAL_ERR_TIMEOUT;
+        }
 
-    // Continually check for messages until a full one is received
-    if (this->transport.recv_message(this->received_msg, timeout_ms)) {
-        return this->check_received_msg();
+        // Sleep until there is more data, the timeout expires or a retransmission is due
+        uint32_t wait_ms = timeout_ms - elapsed;
+        if (this->tx_outstanding() > 0 && wait_ms > this->rto) wait_ms = this->rto;
+        this->transport.wait(wait_ms);
     }
-    return SERIAL_ERR_TIMEOUT;
 }
 
 /**
@@ -106,25 +625,171 @@ SerialResult SerialSession::recv_message(uint32_t timeout_ms)
  * If a partial message has been received when this method is called,
  * the message will not be sent.
  * 
+ * In windowed mode (@see set_window_size), the message is copied into the send window and
+ * this method returns as soon as it has been transmitted; it only blocks while the window
+ * is full. Delivery failures are reported by a later call to send_message or wait_acked
+ * (the frame is still delivered if the link recovers).
+ * 
+ * When sending stop-and-wait, the message is retransmitted up to max_retries times if no
+ * ACK arrives within the RTO (plus the time to transmit it) or the response is corrupted.
+ * A response that is not an ACK means the other device did not wait for our message, so
+ * it is not retransmitted.
+ * 
+ * Extended frames are always sent stop-and-wait, without retransmission
+ * (@see send_extended(Message& msg)).
+ * 
  * @param msg A reference to the Message to send
  * 
  * @return SERIAL_OK                  if the message sent and an ACK was received
  *         SERIAL_ERR_MSG_IN_PROGRESS if a message is already in progress
  *         SERIAL_ERR_SEND_FAILED     if the message failed to be transmitted
- *         SERIAL_ERR_NO_MSG          if a response was not received after sending
+ *         SERIAL_ERR_NO_MSG          if a response was not received after the last retransmission
  *         SERIAL_ERR_NO_ACK          if a response was received but it was not an ACK
+ *         SERIAL_ERR_DATA_CORRUPT    if the response to the last retransmission failed the CRC check
  */
 SerialResult SerialSession::send_message(Message& msg)
 {
+    if (msg.extended) return this->send_extended(msg);
+
+    if (this->window_size > 0) {
+        // Report failures of previously sent frames
+        if (this->tx_error != SERIAL_OK) {
+            SerialResult res = this->tx_error;
+            this->tx_error = SERIAL_OK;
+            return res;
+        }
+
+        Frame *src = nullptr;
+        if (this->tx_outstanding() >= this->window_size) {
+            // Stage the message before servicing the link since the payload might point
+            // into received_msg, which gets overwritten by incoming frames
+            this->tx_stage.id = msg.id;
+            this->tx_stage.length = msg.length;
+            this->tx_stage.txn = msg.txn;
+            memcpy(this->tx_stage.data, msg.data, msg.length);
+            src = &this->tx_stage;
+
+            // Wait for room in the window
+            while (this->tx_outstanding() >= this->window_size) {
+                this->transport.wait(this->rto);
+                this->service();
+                if (this->tx_error != SERIAL_OK) {
+                    SerialResult res = this->tx_error;
+                    this->tx_error = SERIAL_OK;
+                    return res;
+                }
+            }
+        }
+
+        uint8_t seq = this->tx_next;
+        TxSlot& slot = this->tx_slots[seq % SERIAL_WINDOW_MAX];
+        slot.frame.id = (src ? src->id : msg.id);
+        slot.frame.length = (src ? src->length : msg.length);
+        slot.frame.txn = (src ? src->txn : msg.txn);
+        memcpy(slot.frame.data, (src ? src->data : msg.data), slot.frame.length);
+        slot.retries = 0;
+        slot.fast_retransmitted = false;
+        this->tx_next++;
+
+        if (!this->transmit_slot(seq)) return SERIAL_ERR_SEND_FAILED;
+        return SERIAL_OK;
+    }
+
+    // Cannot send a message while receiving a message is in progress
+    if (this->transport.msg_in_progress) return SERIAL_ERR_MSG_IN_PROGRESS;
+
+    // Every new message flips the alternating bit, retransmissions keep it
+    Message first = msg;
+    first.alt = this->tx_alt;
+    this->tx_alt = !this->tx_alt;
+    Message retransmit = first;
+    retransmit.retransmit = true;
+    uint32_t wire_ms = this->wire_ms(msg.length);
+
+    for (uint8_t attempt = 0; ; attempt++) {
+        // Send the message
+        uint64_t sent_ms = this->transport.platform_millis();
+        if (!this->transport.send_message(attempt == 0 ? first : retransmit)) return SERIAL_ERR_SEND_FAILED;
+
+        SerialResult res = this->recv_ack(this->rto + wire_ms);
+        if (res == SERIAL_OK) {
+            if (attempt == 0) this->record_rtt(sent_ms, wire_ms);
+            return SERIAL_OK;
+        }
+
+        // Either the message or its ACK may have been lost
+        if (res != SERIAL_ERR_NO_MSG && res != SERIAL_ERR_DATA_CORRUPT) return res;
+        if (res == SERIAL_ERR_NO_MSG) this->backoff();
+        if (attempt >= this->max_retries) return res;
+        this->stats.retransmits++;
+    }
+}
+
+/**
+ * @brief Sends an extended frame and waits to receive an ACK
+ * 
+ * Extended frames are too large for the send window, so they are always sent stop-and-wait
+ * once every frame already in the window has been acknowledged. Like any other frame, the
+ * ACK timeout is extended by the time it takes to transmit it.
+ * 
+ * @return @see send_message(Message& msg)
+ */
+SerialResult SerialSession::send_extended(Message& msg)
+{
+    if (this->window_size > 0) {
+        SerialResult res = this->wait_acked();
+        if (res != SERIAL_OK) return res;
+    }
+
     // Cannot send a message while receiving a message is in progress
     if (this->transport.msg_in_progress) return SERIAL_ERR_MSG_IN_PROGRESS;
 
-    // Send the message
     if (!this->transport.send_message(msg)) return SERIAL_ERR_SEND_FAILED;
 
-    // Wait for ACK
-    if (!this->transport.recv_message(this->received_msg, ACK_TIMEOUT_MS)) return SERIAL_ERR_NO_MSG;
+    SerialResult res = this->recv_ack(this->rto + this->wire_ms(msg.length));
+    if (res == SERIAL_ERR_NO_MSG) this->backoff();
+    return res;
+}
+
+/**
+ * @brief Waits for the ACK of a message sent stop-and-wait
+ * 
+ * @param timeout_ms Maximum time (in milliseconds) to wait for the ACK
+ * 
+ * @return @see send_message(Message& msg)
+ */
+SerialResult SerialSession::recv_ack(uint32_t timeout_ms)
+{
+    while (true) {
+        SerialResult res = this->transport.recv_message(this->received_msg, timeout_ms);
+        if (res == SERIAL_ERR_TIMEOUT) return SERIAL_ERR_NO_MSG;
+        if (res != SERIAL_OK) return res;
+        // A windowed peer may have sequenced frames in flight, keep them for later
+        if (!this->received_msg.sequenced) break;
+        this->handle_frame(false);
+    }
     if (this->received_msg.id != MSG_ID_ACK) return SERIAL_ERR_NO_ACK;
 
     return SERIAL_OK;
 }
+
+/**
+ * @brief Waits until every frame in the send window has been acknowledged
+ * 
+ * Returns immediately when sending stop-and-wait, since send_message already waited.
+ * 
+ * @return SERIAL_OK              if all frames were acknowledged
+ *         SERIAL_ERR_NO_ACK      if a frame was not acknowledged after max_retries retransmissions
+ *         SERIAL_ERR_SEND_FAILED if a retransmission failed to send
+ */
+SerialResult SerialSession::wait_acked()
+{
+    while (this->tx_outstanding() > 0 && this->tx_error == SERIAL_OK) {
+        this->transport.wait(this->rto);
+        this->service();
+    }
+
+    SerialResult res = this->tx_error;
+    this->tx_error = SERIAL_OK;
+    return res;
+}
@@ -2,8 +2,34 @@
 #define SERIAL_SESSION_H
 
 #include "SerialTransport.h"
+#include "SerialDevice.h"
 #include "SerialResult.h"
 
+/** Maximum number of unacknowledged frames in windowed mode (must be a power of 2) */
+#ifndef SERIAL_WINDOW_MAX
+#define SERIAL_WINDOW_MAX 8
+#endif // SERIAL_WINDOW_MAX
+
+/** Default number of times an unacknowledged frame is retransmitted before giving up (@see set_max_retries) */
+#ifndef SERIAL_MAX_RETRIES
+#define SERIAL_MAX_RETRIES 3
+#endif // SERIAL_MAX_RETRIES
+
+/** Retransmission timeout used until a round trip time has been measured (milliseconds) */
+#ifndef SERIAL_RTO_INIT_MS
+#define SERIAL_RTO_INIT_MS 100
+#endif // SERIAL_RTO_INIT_MS
+
+/** Lower bound of the retransmission timeout (milliseconds) */
+#ifndef SERIAL_RTO_MIN_MS
+#define SERIAL_RTO_MIN_MS 10
+#endif // SERIAL_RTO_MIN_MS
+
+/** Upper bound of the retransmission timeout (milliseconds) */
+#ifndef SERIAL_RTO_MAX_MS
+#define SERIAL_RTO_MAX_MS 1000
+#endif // SERIAL_RTO_MAX_MS
+
 /**
  * @class SerialSession
  * 
@@ -11,22 +37,126 @@
  * 
  * This layer is responsible for sending/verifying ACK and NACK messages in response to
  * sending and receiving messages.
+ * 
+ * By default every message is sent stop-and-wait: send_message blocks until the ACK
+ * arrives. Once a window size has been negotiated (@see set_window_size), messages are
+ * sent with sequence numbers and up to window_size of them can be outstanding at once.
+ * The receiver sends cumulative ACKs and requests selective retransmission of a missing
+ * frame with a NACK. Sequenced frames are always accepted on the receive side, so the two
+ * modes can interoperate while one end is switching over.
+ * 
+ * Frames that are not acknowledged within the retransmission timeout (RTO) are sent again,
+ * up to max_retries times. The RTO is estimated from measured ACK round trip times the same
+ * way as in TCP (RFC 6298): the smoothed round trip time plus four times its variation,
+ * doubled after every timeout until the next measurement. Round trips of retransmitted
+ * frames are never measured, since the ACK cannot be matched to a transmission.
+ * 
+ * The RTO covers the round trip itself. The time it takes to put a frame on the wire, and
+ * the frames queued in the send window ahead of it, is added on top at the current baud
+ * rate (@see set_baud_rate), so a full size frame or a full window does not time out just
+ * because it is long. Measured round trips have that time taken back out.
+ * 
+ * Stop-and-wait frames carry an alternating bit that is flipped for every new message, and
+ * retransmissions start with MSG_DELIM_START_RETX(_ALT). A retransmission with the same bit
+ * as the last frame delivered repeats it, so the receiver only ACKs it again rather than
+ * delivering it twice. A new message that happens to have the same contents is still
+ * delivered.
  */
 class SerialSession
 {
     private:
+        typedef struct {
+            uint8_t id;
+            uint8_t length;
+            uint8_t txn;
+            uint8_t data[MSG_DATA_LENGTH_MAX];
+        } Frame;
+
+        typedef struct {
+            Frame frame;
+            uint64_t sent_ms;
+            uint32_t wire_ms; //!< Time to transmit the frame and those queued ahead of it
+            uint8_t retries;
+            bool fast_retransmitted;
+        } TxSlot;
+
+        typedef struct {
+            Frame frame;
+            bool valid;
+        } RxSlot;
+
         Message& received_msg;
         SerialTransport& transport;
 
+        // Transmit window
+        uint8_t window_size;
+        TxSlot tx_slots[SERIAL_WINDOW_MAX];
+        uint8_t tx_base; //!< Oldest unacknowledged sequence number
+        uint8_t tx_next; //!< Next sequence number to assign
+        Frame tx_stage;  //!< Holds a message while waiting for room in the window
+        SerialResult tx_error;
+
+        // Receive window
+        RxSlot rx_slots[SERIAL_WINDOW_MAX];
+        uint8_t rx_deliver;  //!< Next sequence number to deliver to the application
+        uint8_t rx_expected; //!< Next sequence number not yet received (cumulative ACK)
+        bool peer_sequenced;
+
+        // Alternating bit of the next stop-and-wait message sent and of the last one delivered
+        // (for recognizing retransmissions of it)
+        bool tx_alt;
+        bool last_rx_valid;
+        bool last_rx_alt;
+
+        // Retransmission
+        uint8_t max_retries;
+        bool rtt_measured;
+        uint32_t srtt_x8;   //!< Smoothed round trip time (milliseconds, scaled by 8)
+        uint32_t rttvar_x4; //!< Round trip time variation (milliseconds, scaled by 4)
+        uint32_t rto;       //!< Retransmission timeout (milliseconds)
+        uint32_t baud_rate;
+
+        SessionStats stats;
+
         bool ack();
+        bool ack_seq(uint8_t id, uint8_t seq);
         SerialResult check_received_msg();
+        bool is_duplicate();
+        SerialResult handle_frame(bool deliver);
+        SerialResult handle_sequenced_frame(bool deliver);
+        bool deliver_buffered();
+        bool transmit_slot(uint8_t seq);
+        void handle_ack(uint8_t ack_num);
+        void check_retransmit();
+        void service();
+        SerialResult send_extended(Message& msg);
+        SerialResult recv_ack(uint32_t timeout_ms);
+        uint8_t tx_outstanding();
+        uint32_t wire_ms(uint32_t data_length);
+        void record_rtt(uint64_t sent_ms, uint32_t wire_ms);
+        void backoff();
 
     public:
         SerialSession(SerialTransport& transport, Message& received_msg);
-        
+
+        void reset();
+        void set_window_size(uint8_t window_size);
+        uint8_t get_window_size();
+        uint8_t get_window_free();
+        void set_max_retries(uint8_t max_retries);
+        uint8_t get_max_retries();
+        void set_baud_rate(SerialBaudRate baud_rate);
+        void reset_rto();
+        uint32_t get_rto();
+        uint32_t exchange_ms(uint32_t request_length, uint32_t reply_length);
+
         SerialResult check_for_message();
         SerialResult recv_message(uint32_t timeout_ms);
         SerialResult send_message(Message& msg);
+        SerialResult wait_acked();
+
+        const SessionStats& get_stats();
+        void reset_stats();
 };
 
-#endif // SERIAL_SESSION_H
\ No newline at end of file
+#endif // SERIAL_SESSION_H
@@ -1,4 +1,7 @@
 #include "SerialTransport.h"
+#include "Crc16.h"
+
+#include <string.h>
 
 /**
  * @brief Constructs a new SerialTransport
@@ -6,10 +9,135 @@
  * @param device The underlying SerialDevice that will be used for transmitting / receiving data
  */
 SerialTransport::SerialTransport(SerialDevice& device) : device(device)
+{
+    this->rx_head = 0;
+    this->rx_tail = 0;
+    this->ext_buf = nullptr;
+    this->ext_buf_size = 0;
+    this->framing = SERIAL_FRAMING_DELIMITED;
+    this->capture = nullptr;
+    this->reset();
+    this->reset_stats();
+}
+
+/**
+ * @brief Discards all received serial data
+ * 
+ * This includes data still in the SerialDevice as well as any data already read
+ * into the receive buffer that has not been processed yet.
+ */
+void SerialTransport::flush()
+{
+    this->device.ser_flush();
+    this->rx_head = 0;
+    this->rx_tail = 0;
+    this->reset();
+}
+
+/**
+ * @brief Abandons any partially received message
+ * 
+ * Data that has not been processed yet is kept.
+ */
+void SerialTransport::abandon()
 {
     this->reset();
 }
 
+/**
+ * @brief Selects how frames are delimited on the wire
+ * 
+ * Takes effect for the next message sent or received, any partially received message is abandoned.
+ * 
+ * @param framing The new framing
+ */
+void SerialTransport::set_framing(SerialFraming framing)
+{
+    this->framing = framing;
+    this->reset();
+}
+
+/**
+ * @return The framing currently in use
+ */
+SerialFraming SerialTransport::get_framing()
+{
+    return this->framing;
+}
+
+/**
+ * @brief Sets where the data of received extended frames is stored
+ * 
+ * The data is written into the buffer as it arrives. Extended frames that do not fit are
+ * still received (so the link stays in sync) but their data is discarded.
+ * 
+ * @param buf  The buffer (nullptr to discard the data of all extended frames)
+ * @param size Size of buf in bytes
+ */
+void SerialTransport::set_ext_buffer(uint8_t *buf, uint16_t size)
+{
+    this->ext_buf = buf;
+    this->ext_buf_size = (buf != nullptr ? size : 0);
+}
+
+/**
+ * @brief Sets where a copy of every frame sent and received is passed on to
+ * 
+ * @param capture The capture (nullptr to stop capturing)
+ */
+void SerialTransport::set_capture(SerialCapture *capture)
+{
+    this->capture = capture;
+}
+
+/**
+ * @brief Passes a frame that was received with a valid CRC on to the capture, if there is one
+ */
+void SerialTransport::capture_received(Message& msg)
+{
+    if (this->capture == nullptr) return;
+
+    const uint8_t *data = (msg.extended ? this->ext_buf : msg.data);
+    this->capture->capture_frame(SERIAL_CAPTURE_RX, this->framing == SERIAL_FRAMING_COBS, msg, data);
+}
+
+/**
+ * @return The link health counters of this end of the link
+ */
+const TransportStats& SerialTransport::get_stats()
+{
+    return this->stats;
+}
+
+/**
+ * @brief Zeroes all of the link health counters
+ */
+void SerialTransport::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(this->stats));
+}
+
+/**
+ * @brief Blocks until there is received data to process or the timeout has elapsed
+ * 
+ * @param timeout_ms Maximum time (in milliseconds) to wait
+ * 
+ * @return true if there is data to process, otherwise false
+ */
+bool SerialTransport::wait(uint32_t timeout_ms)
+{
+    if (this->rx_head != this->rx_tail) return true;
+    return this->device.ser_wait(timeout_ms);
+}
+
+/**
+ * @brief Wrapper around @see SerialDevice::platform_millis()
+ */
+uint64_t SerialTransport::platform_millis()
+{
+    return this->device.platform_millis();
+}
+
 /**
  * @brief Resets the state of the receiver state machine
  * 
@@ -20,77 +148,158 @@ void SerialTransport::reset()
     this->pending_message.current_segment = MSG_SEG_START;
     this->pending_message.bytes_read = 0;
     this->pending_message.msg_length = 0;
-    this->pending_message.crc = 0;
+    this->pending_message.dest = nullptr;
+    this->pending_message.crc = CRC16_INIT;
+    this->pending_message.crc_received = 0;
+
+    this->cobs_code_left = 0;
+    this->cobs_zero_pending = false;
+    this->cobs_rx_bad = false;
 
     this->msg_in_progress = false;
 }
 
 /**
- * @brief Checks if a full message has been received
+ * @brief Makes sure there is data in the receive buffer
  * 
- * This method is non-blocking. It will read the currently available serial data and
- * process it into a partial or fully complete Message.
- * Sequential calls to this method will continue to build off a previous partial message
- * until it is complete.
+ * Once the buffer has been consumed it is refilled with all the data currently available
+ * from the SerialDevice in a single read.
  * 
- * As soon as a message is complete, this method will return (even if there is more serial data
- * available), so a subsequent call will be required to process the leftover data.
+ * @return true if there is data in the receive buffer, false if no serial data is available
+ */
+inline bool SerialTransport::fill()
+{
+    if (this->rx_head != this->rx_tail) return true;
+
+    this->rx_head = 0;
+    this->rx_tail = this->device.ser_read_bulk(this->rx_buf, SERIAL_RX_BUF_SIZE);
+    this->stats.bytes_received += this->rx_tail;
+    return (this->rx_tail != 0);
+}
+
+/**
+ * @return true if the byte is one of the delimiters a frame can start with
+ */
+static inline bool is_start_delim(uint8_t byte)
+{
+    return (byte == MSG_DELIM_START || byte == MSG_DELIM_START_SEQ ||
+            byte == MSG_DELIM_START_EXT || byte == MSG_DELIM_START_RETX ||
+            byte == MSG_DELIM_START_ALT || byte == MSG_DELIM_START_RETX_ALT);
+}
+
+/**
+ * @brief Runs the receiver state machine over a run of frame data
  * 
- * This method is intended to be called in a loop so the serial buffer is regularly cleared
- * and full Messages are identified as they arrive.
+ * Frame data is everything from the START delimiter up to and including the CRC. Data bytes
+ * are copied to their destination (and added to the CRC) as a block rather than one at a time.
  * 
- * @param msg As serial data comes in, the processed fields will be placed into
- *            this Message reference
+ * With delimited framing an extended frame that is longer than the extended buffer is dropped
+ * as soon as its length is read. With COBS framing its data is discarded up to the delimiter
+ * and the frame is reported by frame_result().
+ * 
+ * @param data   Pointer to the data
+ * @param length Number of bytes in data
+ * @param msg    The Message the processed fields are placed into
  * 
- * @return true if a full message has been received (msg will be complete), otherwise false
+ * @return The number of bytes consumed, processing stops once the CRC has been read
+ *         (the state machine is then in MSG_SEG_END)
  */
-bool SerialTransport::check_for_message(Message& msg)
+uint32_t SerialTransport::parse(const uint8_t *data, uint32_t length, Message& msg)
 {
-    uint8_t byte_in;
-    while (this->device.ser_available() > 0) {
-        // Read next byte in
-        if (!this->device.ser_read(&byte_in)) break;
+    PendingMessage& pending = this->pending_message;
+    uint32_t i = 0;
 
-        switch (this->pending_message.current_segment) {
+    while (i < length) {
+        if (pending.current_segment == MSG_SEG_DATA) {
+            // Take as much of the data as has arrived in one go
+            uint32_t count = pending.msg_length - pending.bytes_read;
+            if (count > length - i) count = length - i;
+            if (pending.dest != nullptr) memcpy(&pending.dest[pending.bytes_read], &data[i], count);
+            pending.crc = crc16_update(pending.crc, &data[i], count);
+            pending.bytes_read += count;
+            i += count;
+
+            if (pending.bytes_read == pending.msg_length) {
+                pending.bytes_read = 0;
+                pending.current_segment = MSG_SEG_CRC;
+            }
+            continue;
+        }
+        if (pending.current_segment == MSG_SEG_END) break;
+
+        uint8_t byte_in = data[i++];
+        switch (pending.current_segment) {
             case MSG_SEG_START:
-                if (byte_in == MSG_DELIM_START) {
+                // With delimited framing a START_EXT is only taken while there is an extended
+                // buffer, otherwise a stray '<' would have the receiver skip a long frame
+                if (is_start_delim(byte_in) &&
+                    (byte_in != MSG_DELIM_START_EXT || this->ext_buf != nullptr || this->framing == SERIAL_FRAMING_COBS)) {
+                    msg.sequenced = (byte_in == MSG_DELIM_START_SEQ);
+                    msg.extended = (byte_in == MSG_DELIM_START_EXT);
+                    msg.retransmit = (byte_in == MSG_DELIM_START_RETX || byte_in == MSG_DELIM_START_RETX_ALT);
+                    msg.alt = (byte_in == MSG_DELIM_START_ALT || byte_in == MSG_DELIM_START_RETX_ALT);
+                    msg.seq = 0;
+                    msg.txn = 0;
                     this->msg_in_progress = true;
-                    this->pending_message.current_segment = MSG_SEG_ID;
+                    pending.current_segment = MSG_SEG_ID;
+                }
+                else {
+                    this->stats.bytes_discarded++;
                 }
                 break;
             case MSG_SEG_ID:
                 msg.id = byte_in;
-                this->pending_message.current_segment = MSG_SEG_LENGTH;
+                pending.crc = crc16_update(pending.crc, byte_in);
+                if (msg.sequenced)     pending.current_segment = MSG_SEG_SEQ;
+                else if (msg.extended) pending.current_segment = MSG_SEG_LENGTH_HI;
+                else                   pending.current_segment = MSG_SEG_LENGTH;
                 break;
-            case MSG_SEG_LENGTH:
-                msg.length = byte_in;
-                this->pending_message.msg_length = byte_in;
-                this->pending_message.bytes_read = 0;
-                this->pending_message.current_segment = (byte_in == 0 ? MSG_SEG_CRC : MSG_SEG_DATA);
+            case MSG_SEG_SEQ:
+                msg.seq = byte_in;
+                pending.crc = crc16_update(pending.crc, byte_in);
+                pending.current_segment = MSG_SEG_TXN;
                 break;
-            case MSG_SEG_DATA:
-                msg.data[this->pending_message.bytes_read] = byte_in;
-                this->pending_message.bytes_read++;
-
-                if (this->pending_message.bytes_read == this->pending_message.msg_length) {
-                    this->pending_message.bytes_read = 0;
-                    this->pending_message.current_segment = MSG_SEG_CRC;
-                }
+            case MSG_SEG_TXN:
+                msg.txn = byte_in;
+                pending.crc = crc16_update(pending.crc, byte_in);
+                pending.current_segment = MSG_SEG_LENGTH;
                 break;
-            case MSG_SEG_CRC:
-                ((uint8_t *)&(this->pending_message.crc))[this->pending_message.bytes_read] = byte_in;
-                this->pending_message.bytes_read++;
-                if (this->pending_message.bytes_read == sizeof(this->pending_message.crc)) {
-                    this->pending_message.bytes_read = 0;
-                    // TODO CRC check
-                    this->pending_message.current_segment = MSG_SEG_END;
+            case MSG_SEG_LENGTH_HI:
+                // Extended length is transmitted most significant byte first
+                pending.msg_length = (uint16_t)(byte_in << 8);
+                pending.crc = crc16_update(pending.crc, byte_in);
+                pending.current_segment = MSG_SEG_LENGTH;
+                break;
+            case MSG_SEG_LENGTH:
+                pending.msg_length = (msg.extended ? pending.msg_length | byte_in : byte_in);
+                if (msg.extended && pending.msg_length > this->ext_buf_size && this->framing == SERIAL_FRAMING_DELIMITED) {
+                    // Nothing ends a delimited frame early, so rather than swallowing up to
+                    // 64 KiB on a corrupted length, give up on the frame and look for a START
+                    // in the rest of its header
+                    uint8_t header[3] = { msg.id, (uint8_t)(pending.msg_length >> 8), byte_in };
+                    this->stats.bytes_discarded++;
+                    this->reset();
+                    this->parse(header, sizeof(header), msg);
+                    break;
+                }
+                msg.length = pending.msg_length;
+                pending.crc = crc16_update(pending.crc, byte_in);
+                pending.bytes_read = 0;
+                if (!msg.extended) {
+                    pending.dest = msg.data;
+                }
+                else {
+                    pending.dest = (pending.msg_length <= this->ext_buf_size ? this->ext_buf : nullptr);
                 }
+                pending.current_segment = (pending.msg_length == 0 ? MSG_SEG_CRC : MSG_SEG_DATA);
                 break;
-            case MSG_SEG_END:
-                this->reset();
-                if (byte_in == MSG_DELIM_END) {
-                    // Stop processing serial data as soon as we've read in a full message
-                    return true;
+            case MSG_SEG_CRC:
+                // CRC is transmitted most significant byte first
+                pending.crc_received = (pending.crc_received << 8) | byte_in;
+                pending.bytes_read++;
+                if (pending.bytes_read == sizeof(pending.crc_received)) {
+                    pending.bytes_read = 0;
+                    pending.current_segment = MSG_SEG_END;
                 }
                 break;
             default:
@@ -98,65 +307,329 @@ bool SerialTransport::check_for_message(Message& msg)
         }
     }
 
-    return false;
+    return i;
+}
+
+/**
+ * @brief Determines the outcome of a frame that ended right after its CRC
+ * 
+ * The frame is counted in the link health counters.
+ * 
+ * @return SERIAL_OK               if the frame is valid
+ *         SERIAL_ERR_DATA_CORRUPT if the frame failed the CRC check
+ *         SERIAL_ERR_DATA_LENGTH  if the frame is valid but it is an extended frame that
+ *                                 did not fit in the extended buffer (COBS framing only,
+ *                                 @see parse)
+ */
+SerialResult SerialTransport::frame_result()
+{
+    if (this->pending_message.crc != this->pending_message.crc_received) {
+        this->stats.crc_errors++;
+        return SERIAL_ERR_DATA_CORRUPT;
+    }
+    this->stats.frames_received++;
+    if (this->pending_message.msg_length > 0 && this->pending_message.dest == nullptr) return SERIAL_ERR_DATA_LENGTH;
+    return SERIAL_OK;
+}
+
+/**
+ * @brief Checks if a full message has been received
+ * 
+ * This method is non-blocking. It will read the currently available serial data and
+ * process it into a partial or fully complete Message.
+ * Sequential calls to this method will continue to build off a previous partial message
+ * until it is complete.
+ * 
+ * As soon as a message is complete, this method will return (even if there is more serial data
+ * available), so a subsequent call will be required to process the leftover data. Any leftover
+ * data that was already read from the SerialDevice is kept in the receive buffer.
+ * 
+ * This method is intended to be called in a loop so the serial buffer is regularly cleared
+ * and full Messages are identified as they arrive.
+ * 
+ * @param msg As serial data comes in, the processed fields will be placed into
+ *            this Message reference (the data of extended frames is placed into the
+ *            extended buffer, @see set_ext_buffer)
+ * 
+ * @return SERIAL_OK               if a full message has been received (msg will be complete)
+ *         SERIAL_OK_NO_MSG        if a full message has not been received yet
+ *         SERIAL_ERR_DATA_CORRUPT if a full message was received but failed the CRC check
+ *         SERIAL_ERR_DATA_LENGTH  if a full extended message was received but did not fit
+ *                                 in the extended buffer (with delimited framing such a frame
+ *                                 is dropped as soon as its length is read, like one that
+ *                                 arrives while there is no extended buffer)
+ */
+SerialResult SerialTransport::check_for_message(Message& msg)
+{
+    if (this->framing == SERIAL_FRAMING_COBS) return this->check_for_message_cobs(msg);
+
+    while (this->fill()) {
+        if (this->pending_message.current_segment == MSG_SEG_END) {
+            uint8_t byte_in = this->rx_buf[this->rx_head++];
+            if (byte_in != MSG_DELIM_END) {
+                this->stats.bad_end_delims++;
+                this->reset();
+                continue;
+            }
+            SerialResult res = this->frame_result();
+            this->reset();
+            if (res == SERIAL_OK) this->capture_received(msg);
+            // Stop processing serial data as soon as we've read in a full message
+            return res;
+        }
+
+        this->rx_head += this->parse(&this->rx_buf[this->rx_head], this->rx_tail - this->rx_head, msg);
+    }
+
+    return SERIAL_OK_NO_MSG;
+}
+
+/**
+ * @brief COBS framing version of @see check_for_message(Message& msg)
+ * 
+ * Received data is scanned for the next MSG_DELIM_COBS a buffer at a time, so after
+ * corruption the receiver is back in sync as soon as the next frame ends. The data in
+ * between is decoded as it arrives.
+ */
+SerialResult SerialTransport::check_for_message_cobs(Message& msg)
+{
+    while (this->fill()) {
+        uint8_t *start = &this->rx_buf[this->rx_head];
+        uint32_t available = this->rx_tail - this->rx_head;
+        uint8_t *delim = (uint8_t *)memchr(start, MSG_DELIM_COBS, available);
+        uint32_t length = (delim != nullptr ? (uint32_t)(delim - start) : available);
+
+        if (length > 0) {
+            this->decode_cobs(start, length, msg);
+            this->msg_in_progress = true;
+        }
+        this->rx_head += length;
+
+        if (delim == nullptr) continue;
+        this->rx_head++;
+
+        // Empty frames (consecutive delimiters) are ignored
+        if (!this->msg_in_progress) continue;
+
+        // The frame must end exactly at the end of the CRC and of a COBS block
+        bool complete = (!this->cobs_rx_bad && this->cobs_code_left == 0 &&
+                         this->pending_message.current_segment == MSG_SEG_END);
+        if (!complete && !this->cobs_rx_bad) {
+            // Frame ended before its CRC
+            this->stats.bad_end_delims++;
+        }
+        SerialResult res = (complete ? this->frame_result() : SERIAL_ERR_DATA_CORRUPT);
+        this->reset();
+        if (res == SERIAL_OK) this->capture_received(msg);
+        // Stop processing serial data as soon as we've read in a full message
+        return res;
+    }
+
+    return SERIAL_OK_NO_MSG;
+}
+
+/**
+ * @brief Decodes a run of COBS encoded data (containing no delimiters)
+ * 
+ * The data bytes of each block are passed on in place, only the zeros that end blocks
+ * are inserted (@see parse_cobs).
+ */
+void SerialTransport::decode_cobs(const uint8_t *data, uint32_t length, Message& msg)
+{
+    static const uint8_t zero = 0x00;
+
+    while (length > 0) {
+        if (this->cobs_code_left == 0) {
+            // Every block except the last and those at the size limit is followed by a zero
+            uint8_t code = *data++;
+            length--;
+            if (this->cobs_zero_pending) this->parse_cobs(&zero, 1, msg);
+            this->cobs_code_left = code - 1;
+            this->cobs_zero_pending = (code != COBS_BLOCK_LENGTH_MAX + 1);
+            continue;
+        }
+
+        uint32_t count = (this->cobs_code_left < length ? this->cobs_code_left : length);
+        this->parse_cobs(data, count, msg);
+        this->cobs_code_left -= count;
+        data += count;
+        length -= count;
+    }
+}
+
+/**
+ * @brief Passes decoded COBS frame data to the receiver state machine
+ * 
+ * Unlike delimited framing, the frame must begin with a START delimiter and end with the CRC,
+ * otherwise the rest of the frame is discarded.
+ */
+void SerialTransport::parse_cobs(const uint8_t *data, uint32_t length, Message& msg)
+{
+    if (this->cobs_rx_bad) {
+        this->stats.bytes_discarded += length;
+        return;
+    }
+
+    if (this->pending_message.current_segment == MSG_SEG_START && !is_start_delim(data[0])) {
+        this->cobs_rx_bad = true;
+        this->stats.bytes_discarded += length;
+        return;
+    }
+
+    uint32_t consumed = this->parse(data, length, msg);
+    if (consumed != length) {
+        // Data after the CRC
+        this->cobs_rx_bad = true;
+        this->stats.bad_end_delims++;
+        this->stats.bytes_discarded += length - consumed;
+    }
 }
 
 /**
  * @brief Waits until a full message has been received
  * 
- * This is blocking version of check_for_message that will repeatedly call
- * check_for_message until a full message has been received or the timeout has elapsed.
+ * This is blocking version of check_for_message that will call check_for_message
+ * until a full message has been received or the timeout has elapsed. Between calls
+ * it sleeps in SerialDevice::ser_wait until more serial data arrives, rather than
+ * spinning.
  * 
  * @param msg        The received Message will be placed here
  * @param timeout_ms The timeout in milliseconds
  * 
- * @return true if a full message was received before the timeout, otherwise false
+ * @return SERIAL_OK               if a full message was received before the timeout
+ *         SERIAL_ERR_TIMEOUT      if a full message was not received before the timeout
+ *         SERIAL_ERR_DATA_CORRUPT if a full message was received but failed the CRC check
  */
-bool SerialTransport::recv_message(Message& msg, uint32_t timeout_ms)
+SerialResult SerialTransport::recv_message(Message& msg, uint32_t timeout_ms)
 {
-    uint32_t time_start = this->device.platform_millis();
-    // Continually check for messages
-    while (!this->check_for_message(msg)) {
+    uint64_t time_start = this->device.platform_millis();
+    // Process data as it arrives
+    SerialResult res;
+    while ((res = this->check_for_message(msg)) == SERIAL_OK_NO_MSG) {
         // Check if we've hit the timeout
-        if ((this->device.platform_millis() - time_start) > timeout_ms) {
+        uint64_t elapsed = this->device.platform_millis() - time_start;
+        if (elapsed >= timeout_ms) {
             // Abandon the message
             this->reset();
-            return false;
+            return SERIAL_ERR_TIMEOUT;
         }
+
+        // Sleep until there is more data or the timeout expires
+        this->device.ser_wait(timeout_ms - elapsed);
     }
 
-    return true;
+    return res;
 }
 
 /**
  * @brief Sends a message
  * 
- * @param msg The message to send
+ * The whole frame is handed to the SerialDevice in a single write (a gather-write for
+ * delimited framing), except for COBS encoded extended frames, which are written in
+ * pieces of about SERIAL_COBS_TX_CHUNK bytes.
+ * 
+ * @param msg The message to send (an extended frame if msg.extended is set, in which case
+ *            it is never sequenced)
  * 
  * @return true if the entirety of the message was successfully sent
  *         false if any part of the message failed to send
  */
 bool SerialTransport::send_message(Message& msg)
 {
-    uint8_t byte_out;
+    if (!msg.extended && msg.length > MSG_DATA_LENGTH_MAX) return false;
 
-    // START
-    byte_out = MSG_DELIM_START;
-    if (!this->device.ser_write(&byte_out, 1)) return false;
+    // START + ID + (SEQ + TXN) + LENGTH, or START + ID + LENGTH (16-bit) for extended frames
+    uint8_t header[MSG_HEADER_LENGTH_MAX];
+    uint8_t header_length = 0;
+    if (msg.extended) {
+        header[header_length++] = MSG_DELIM_START_EXT;
+        header[header_length++] = msg.id;
+        header[header_length++] = (uint8_t)((msg.length >> 8) & 0xFF);
+    }
+    else {
+        if (msg.sequenced)       header[header_length++] = MSG_DELIM_START_SEQ;
+        else if (msg.retransmit) header[header_length++] = (msg.alt ? MSG_DELIM_START_RETX_ALT : MSG_DELIM_START_RETX);
+        else                     header[header_length++] = (msg.alt ? MSG_DELIM_START_ALT : MSG_DELIM_START);
+        header[header_length++] = msg.id;
+        if (msg.sequenced) {
+            header[header_length++] = msg.seq;
+            header[header_length++] = msg.txn;
+        }
+    }
+    header[header_length++] = (uint8_t)(msg.length & 0xFF);
 
-    // MESSAGE
-    if (!this->device.ser_write(&(msg.id), sizeof(msg.id))) return false;
-    if (!this->device.ser_write(&(msg.length), sizeof (msg.length))) return false;
-    if (!this->device.ser_write(msg.data, msg.length)) return false;
+    // CRC (covers everything between the delimiters)
+    uint16_t crc = CRC16_INIT;
+    crc = crc16_update(crc, &header[1], header_length - 1);
+    crc = crc16_update(crc, msg.data, msg.length);
 
-    // TODO CRC
-    byte_out = 0;
-    if (!this->device.ser_write(&byte_out, 1)) return false;
-    if (!this->device.ser_write(&byte_out, 1)) return false;
+    // CRC (most significant byte first) + END
+    uint8_t trailer[] = { (uint8_t)((crc >> 8) & 0xFF), (uint8_t)((crc >> 0) & 0xFF), MSG_DELIM_END };
 
-    // END
-    byte_out = MSG_DELIM_END;
-    if (!this->device.ser_write(&byte_out, 1)) return false;
+    bool cobs = (this->framing == SERIAL_FRAMING_COBS);
+    if (cobs) {
+        if (!this->send_cobs(header, header_length, msg, trailer)) return false;
+    }
+    else {
+        // Transmit the whole frame in a single write
+        SerialIOVec iov[] = {
+            { .data = header,   .length = header_length },
+            { .data = msg.data, .length = msg.length },
+            { .data = trailer,  .length = sizeof(trailer) }
+        };
+        if (!this->device.ser_writev(iov, sizeof(iov) / sizeof(iov[0]))) return false;
+
+        this->stats.frames_sent++;
+        this->stats.bytes_sent += header_length + msg.length + sizeof(trailer);
+    }
 
+    if (this->capture != nullptr) this->capture->capture_frame(SERIAL_CAPTURE_TX, cobs, msg, msg.data);
     return true;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Encodes everything up to the CRC and transmits it terminated with MSG_DELIM_COBS
+ * 
+ * @param header        The frame header (from START up to LENGTH)
+ * @param header_length Number of bytes in header
+ * @param msg           The message being sent
+ * @param crc           The two CRC bytes
+ * 
+ * @return @see send_message(Message& msg)
+ */
+bool SerialTransport::send_cobs(const uint8_t *header, uint32_t header_length, Message& msg, const uint8_t *crc)
+{
+    CobsEncoder enc;
+    cobs_encode_begin(&enc, this->cobs_tx_buf);
+    cobs_encode(&enc, header, header_length);
+
+    // Frames longer than the encode buffer are transmitted one piece at a time
+    for (uint32_t offset = 0; offset < msg.length; offset += SERIAL_COBS_TX_CHUNK) {
+        uint32_t count = msg.length - offset;
+        if (count > SERIAL_COBS_TX_CHUNK) count = SERIAL_COBS_TX_CHUNK;
+        cobs_encode(&enc, &msg.data[offset], count);
+
+        if (msg.length > MSG_DATA_LENGTH_MAX && cobs_encode_ready(&enc) > 0) {
+            if (!this->write(this->cobs_tx_buf, cobs_encode_ready(&enc))) return false;
+            cobs_encode_shift(&enc);
+        }
+    }
+
+    cobs_encode(&enc, crc, 2);
+    uint32_t length = cobs_encode_end(&enc);
+    if (!this->write(this->cobs_tx_buf, length)) return false;
+
+    this->stats.frames_sent++;
+    return true;
+}
+
+/**
+ * @brief Writes data to the SerialDevice and counts it in the link health counters
+ */
+bool SerialTransport::write(const uint8_t *data, uint32_t length)
+{
+    if (!this->device.ser_write((uint8_t *)data, length)) return false;
+
+    this->stats.bytes_sent += length;
+    return true;
+}
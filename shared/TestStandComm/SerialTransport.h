@@ -3,6 +3,28 @@
 
 #include "SerialDevice.h"
 #include "Messages.h"
+#include "SerialResult.h"
+#include "Cobs.h"
+#include "LinkStats.h"
+#include "SerialCapture.h"
+
+/** Size of the buffer used to read serial data in bulk from the SerialDevice */
+#ifndef SERIAL_RX_BUF_SIZE
+#define SERIAL_RX_BUF_SIZE 64
+#endif // SERIAL_RX_BUF_SIZE
+
+/** Number of bytes of an extended frame that are COBS encoded between writes to the SerialDevice */
+#define SERIAL_COBS_TX_CHUNK 254
+
+/**
+ * @enum SerialFraming
+ * 
+ * @brief How frames are delimited on the wire
+ */
+typedef enum {
+    SERIAL_FRAMING_DELIMITED, //!< Frames start with MSG_DELIM_START(_SEQ) and end with MSG_DELIM_END
+    SERIAL_FRAMING_COBS       //!< Frames are COBS encoded and end with MSG_DELIM_COBS
+} SerialFraming;
 
 /**
  * @class SerialTransport
@@ -11,6 +33,15 @@
  * 
  * The layer is aware of "Messages" (distinct packets of data with a defined structure)
  * and is responsible for sending and receiving entire Messages.
+ * 
+ * With delimited framing the delimiters can also appear inside a frame, so after a dropped
+ * byte the receiver may stay misaligned for several frames. With COBS framing the frame
+ * contents (START byte through CRC) are encoded so they contain no zero bytes, and the
+ * receiver always resynchronizes at the next MSG_DELIM_COBS.
+ * 
+ * Extended frames carry a 16-bit length. Their data is streamed straight into a buffer
+ * provided by the caller (@see set_ext_buffer) as it arrives, so no layer of the stack
+ * needs a buffer sized for the largest possible frame.
  */
 class SerialTransport
 {
@@ -18,6 +49,9 @@ class SerialTransport
         typedef enum {
             MSG_SEG_START,
             MSG_SEG_ID,
+            MSG_SEG_SEQ,
+            MSG_SEG_TXN,
+            MSG_SEG_LENGTH_HI,
             MSG_SEG_LENGTH,
             MSG_SEG_DATA,
             MSG_SEG_CRC,
@@ -26,24 +60,62 @@ class SerialTransport
 
         typedef struct {
             MessageSegment current_segment;
-            uint8_t bytes_read;
-            uint8_t msg_length;
+            uint16_t bytes_read;
+            uint16_t msg_length;
+            uint8_t *dest;  //!< Where the data is stored (nullptr to discard it)
             uint16_t crc;
+            uint16_t crc_received;
         } PendingMessage;
 
         SerialDevice& device;
         PendingMessage pending_message;
 
+        uint8_t rx_buf[SERIAL_RX_BUF_SIZE];
+        uint32_t rx_head;
+        uint32_t rx_tail;
+
+        uint8_t *ext_buf;
+        uint16_t ext_buf_size;
+
+        SerialFraming framing;
+        uint8_t cobs_code_left;  //!< Bytes left in the current COBS block (0 if the next byte is a code)
+        bool cobs_zero_pending;  //!< The current COBS block is followed by a zero if another block follows
+        bool cobs_rx_bad;        //!< The COBS frame being received is invalid and is discarded
+        uint8_t cobs_tx_buf[COBS_ENCODED_LENGTH_MAX(MSG_FRAME_LENGTH_MAX) + COBS_BLOCK_LENGTH_MAX];
+
+        TransportStats stats;
+        SerialCapture *capture;
+
         void reset();
+        bool fill();
+        uint32_t parse(const uint8_t *data, uint32_t length, Message& msg);
+        SerialResult frame_result();
+        SerialResult check_for_message_cobs(Message& msg);
+        void decode_cobs(const uint8_t *data, uint32_t length, Message& msg);
+        void parse_cobs(const uint8_t *data, uint32_t length, Message& msg);
+        bool send_cobs(const uint8_t *header, uint32_t header_length, Message& msg, const uint8_t *crc);
+        bool write(const uint8_t *data, uint32_t length);
+        void capture_received(Message& msg);
 
     public:
         bool msg_in_progress = false;
 
         SerialTransport(SerialDevice& device);
-        
-        bool check_for_message(Message& msg);
-        bool recv_message(Message& msg, uint32_t timeout_ms);
+
+        void flush();
+        void abandon();
+        void set_framing(SerialFraming framing);
+        SerialFraming get_framing();
+        void set_ext_buffer(uint8_t *buf, uint16_t size);
+        void set_capture(SerialCapture *capture);
+        bool wait(uint32_t timeout_ms);
+        uint64_t platform_millis();
+        SerialResult check_for_message(Message& msg);
+        SerialResult recv_message(Message& msg, uint32_t timeout_ms);
         bool send_message(Message& msg);
+
+        const TransportStats& get_stats();
+        void reset_stats();
 };
 
 #endif // SERIAL_TRANSPORT_H
\ No newline at end of file
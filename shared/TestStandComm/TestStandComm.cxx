@@ -1,5 +1,19 @@
 #include "TestStandComm.h"
 
+#include <string.h>
+
+/** Number of pings sent to confirm the other device switched to COBS framing */
+#define COBS_VERIFY_ATTEMPTS 3
+
+/** Number of link checks sent to confirm a new baud rate works */
+#define BAUD_VERIFY_ATTEMPTS 3
+
+/** Time the device that accepted a new baud rate waits for it to be confirmed before it switches back (milliseconds) */
+#define BAUD_VERIFY_TIMEOUT_MS 2000
+
+/** Time given to the other device to switch baud rates after it received our ACK (milliseconds) */
+#define BAUD_SETTLE_MS 20
+
 /**
  * @brief Constructs a new TestStandComm
  * 
@@ -11,6 +25,28 @@
 TestStandComm::TestStandComm(SerialDevice& device) : device(device), transport(device), session(transport, this->received_msg)
 {
     this->received_msg.data = this->received_data;
+    this->link_features = 0;
+    this->link_baud_rate = BAUD_115200;
+    this->ext_buf = nullptr;
+    this->ext_buf_size = 0;
+}
+
+/**
+ * @brief Opens the connection to the serial hardware
+ * 
+ * Wrapper around @see SerialDevice::ser_connect(SerialBaudRate baud_rate) that keeps track
+ * of the baud rate, so it can be restored if a change of baud rate does not work out
+ * (@see change_baud_rate).
+ * 
+ * @param baud_rate The baud rate to connect at
+ * 
+ * @return true if the connection opened successfully, otherwise false
+ */
+bool TestStandComm::connect(SerialBaudRate baud_rate)
+{
+    this->link_baud_rate = baud_rate;
+    this->session.set_baud_rate(baud_rate);
+    return this->device.ser_connect(baud_rate);
 }
 
 /**
@@ -39,7 +75,9 @@ SerialResult TestStandComm::send_basic_msg(uint8_t id)
  */
 SerialResult TestStandComm::ping()
 {
-    return this->send_basic_msg(MSG_ID_PING);
+    SerialResult res = this->send_basic_msg(MSG_ID_PING);
+    if (res != SERIAL_OK) return res;
+    return this->session.wait_acked();
 }
 
 SerialResult TestStandComm::echo(uint8_t *data, uint8_t length)
@@ -85,23 +123,627 @@ SerialResult TestStandComm::link_check(uint32_t timeout_ms)
     return SERIAL_OK;
 }
 
+/**
+ * @brief Sends an extended ECHO message to measure sustained throughput of the serial link
+ * 
+ * buf is filled with a pattern that is not periodic over 256 bytes (so a dropped or repeated
+ * chunk is caught), sent, and overwritten with the ECHOED data. The other device must have
+ * an extended buffer of at least length bytes (@see set_ext_buffer).
+ * 
+ * @param buf        Buffer of at least length bytes
+ * @param length     Number of bytes to send
+ * @param timeout_ms Maximum time (in milliseconds) to wait for a response
+ * 
+ * @return SERIAL_ERR_DATA_CORRUPT if the ECHOED data does not match
+ *         @see send_extended(uint8_t id, uint8_t *data, uint16_t length)
+ *         @see recv_extended(uint8_t expect_id, uint8_t *buf, uint16_t size, uint16_t *length_out, uint32_t timeout_ms)
+ */
+SerialResult TestStandComm::link_check(uint8_t *buf, uint16_t length, uint32_t timeout_ms)
+{
+    uint32_t i;
+
+    for (i = 0; i < length; i++) {
+        buf[i] = (uint8_t)(i ^ (i >> 8));
+    }
+
+    // Send ECHO
+    SerialResult res = this->send_extended(MSG_ID_ECHO, buf, length);
+    if (res != SERIAL_OK) return res;
+
+    // Receive ECHOED
+    uint16_t received;
+    res = this->recv_extended(MSG_ID_ECHOED, buf, length, &received, timeout_ms);
+    if (res != SERIAL_OK) return res;
+    if (received != length) return SERIAL_ERR_DATA_LENGTH;
+
+    // Verify data
+    for (i = 0; i < length; i++) {
+        if (buf[i] != (uint8_t)(i ^ (i >> 8))) return SERIAL_ERR_DATA_CORRUPT;
+    }
+
+    return SERIAL_OK;
+}
+
+/**
+ * @brief Sets where the data of received extended messages is stored
+ * 
+ * Until this is called extended messages are rejected. They are not acknowledged, so the
+ * sender reports that the message was not received.
+ * 
+ * @param buf  The buffer (nullptr to reject extended messages again)
+ * @param size Size of buf in bytes
+ */
+void TestStandComm::set_ext_buffer(uint8_t *buf, uint16_t size)
+{
+    this->ext_buf = buf;
+    this->ext_buf_size = (buf != nullptr ? size : 0);
+    this->transport.set_ext_buffer(this->ext_buf, this->ext_buf_size);
+}
+
+/**
+ * @brief Sends an extended message (up to MSG_EXT_LENGTH_MAX bytes of data)
+ * 
+ * The message is sent stop-and-wait (@see SerialSession::send_message(Message& msg)).
+ * 
+ * @param id     The message ID
+ * @param data   Pointer to the data
+ * @param length Number of bytes in data
+ * 
+ * @return @see SerialSession::send_message(Message& msg)
+ */
+SerialResult TestStandComm::send_extended(uint8_t id, uint8_t *data, uint16_t length)
+{
+    Message msg = {
+        .id = id,
+        .length = length,
+        .data = data,
+        .txn = 0,
+        .sequenced = false,
+        .seq = 0,
+        .extended = true
+    };
+
+    return this->session.send_message(msg);
+}
+
+/**
+ * @brief Receives an extended message into a caller provided buffer
+ * 
+ * The data is streamed into buf as it arrives. The extended buffer set with set_ext_buffer
+ * is restored afterwards.
+ * 
+ * @param expect_id  The expected ID of the message being received
+ * @param buf        Where to store the data
+ * @param size       Size of buf in bytes
+ * @param length_out Where to store the number of bytes received
+ * @param timeout_ms Maximum time (in milliseconds) to wait for a message
+ * 
+ * @return @see SerialSession::recv_message(uint32_t timeout_ms)
+ *         SERIAL_ERR_WRONG_MSG if the received message is not extended or its ID does not match expect_id
+ *         SERIAL_ERR_DATA_LENGTH if the data did not fit in buf
+ */
+SerialResult TestStandComm::recv_extended(uint8_t expect_id, uint8_t *buf, uint16_t size, uint16_t *length_out, uint32_t timeout_ms)
+{
+    this->transport.set_ext_buffer(buf, size);
+    uint64_t time_start = this->platform_millis();
+    SerialResult res = this->session.recv_message(timeout_ms);
+    while (res == SERIAL_OK && !this->received_message().extended && this->handle_unsolicited(this->received_message())) {
+        uint64_t elapsed = this->platform_millis() - time_start;
+        res = (elapsed < timeout_ms ? this->session.recv_message(timeout_ms - elapsed) : SERIAL_ERR_TIMEOUT);
+    }
+    this->transport.set_ext_buffer(this->ext_buf, this->ext_buf_size);
+    if (res != SERIAL_OK) return res;
+
+    if (!this->received_message().extended) return SERIAL_ERR_WRONG_MSG;
+    if (this->received_message().id != expect_id) return SERIAL_ERR_WRONG_MSG;
+    *length_out = this->received_message().length;
+    return SERIAL_OK;
+}
+
 /**
  * @brief Handles receiving an ECHO message by sending the same data back in an ECHOED message
  * 
+ * Extended ECHO messages are echoed from the extended buffer (@see set_ext_buffer).
+ * 
  * @return @see SerialSession::send_message(Message& msg)
  */
 SerialResult TestStandComm::recv_echo()
 {
+    if (this->received_message().extended) {
+        return this->send_extended(MSG_ID_ECHOED, this->ext_buf, this->received_message().length);
+    }
+
     // Send the exact same data back
     Message msg = {
         .id = MSG_ID_ECHOED,
         .length = this->received_message().length,
-        .data = this->received_message().data
+        .data = this->received_message().data,
+        .txn = this->received_message().txn
+    };
+
+    return this->session.send_message(msg);
+}
+
+/**
+ * @brief Negotiates optional link features with the other device
+ * 
+ * Resets the session and sends a NEGOTIATE message requesting the given features. If the
+ * other device replies with NEGOTIATED, the features it accepted are used from then on
+ * (@see features()). Devices that do not understand NEGOTIATE never reply, in which case
+ * the link stays stop-and-wait.
+ * 
+ * The exchange uses the framing already in use, so the link can be renegotiated. The other
+ * device only switches to COBS framing once it receives the ACK for its reply, so the switch
+ * is confirmed with a ping and undone if the ping fails.
+ * 
+ * @param features    Bitmask of the LINK_FEATURE_* to request
+ * @param window_size Requested maximum number of unacknowledged frames (0 for stop-and-wait)
+ * @param timeout_ms  Maximum time (in milliseconds) to wait for a response
+ * 
+ * @return SERIAL_OK if the other device replied
+ *         SERIAL_ERR_DATA_LENGTH if the response has the wrong length
+ *         @see SerialSession::send_message(Message& msg)
+ *         @see recv_message(uint8_t expect_id, uint8_t expect_length, uint32_t timeout_ms)
+ */
+SerialResult TestStandComm::negotiate(uint8_t features, uint8_t window_size, uint32_t timeout_ms)
+{
+    // Start over in stop-and-wait so both sides agree on sequence numbers
+    this->session.set_window_size(0);
+    this->session.reset();
+    this->link_features = 0;
+
+    // Correlation IDs only travel in sequenced frames
+    features &= LINK_FEATURES_SUPPORTED;
+    if (window_size == 0) features &= ~(LINK_FEATURE_WINDOWED | LINK_FEATURE_CORRELATION);
+
+    NegotiateMsgData data = {
+        .features = features,
+        .window_size = window_size
+    };
+
+    Message msg = {
+        .id = MSG_ID_NEGOTIATE,
+        .length = sizeof(data),
+        .data = (uint8_t *)&data
+    };
+
+    SerialResult res = this->session.send_message(msg);
+    if (res != SERIAL_OK) return res;
+
+    res = this->recv_message(MSG_ID_NEGOTIATED, sizeof(NegotiateMsgData), timeout_ms);
+    if (res != SERIAL_OK) return res;
+
+    memcpy(&data, this->received_message().data, sizeof(data));
+    if (data.features & LINK_FEATURE_WINDOWED) {
+        this->session.set_window_size(data.window_size);
+    }
+    this->link_features = data.features;
+
+    if (data.features & LINK_FEATURE_COBS) {
+        this->transport.set_framing(SERIAL_FRAMING_COBS);
+
+        res = SERIAL_ERR_NO_ACK;
+        for (int i = 0; i < COBS_VERIFY_ATTEMPTS && res != SERIAL_OK; i++) {
+            res = this->ping();
+        }
+        if (res != SERIAL_OK) {
+            // The other device missed our ACK and fell back to delimited framing
+            this->transport.set_framing(SERIAL_FRAMING_DELIMITED);
+            this->link_features &= ~LINK_FEATURE_COBS;
+        }
+    }
+    else {
+        this->transport.set_framing(SERIAL_FRAMING_DELIMITED);
+    }
+
+    return SERIAL_OK;
+}
+
+/**
+ * @brief Handles receiving a NEGOTIATE message
+ * 
+ * Replies with the subset of the requested features that are supported and switches
+ * the session over once the reply has been sent. COBS framing is only switched on once
+ * the reply has been acknowledged (@see negotiate()).
+ * 
+ * @return SERIAL_ERR_DATA_LENGTH if the NEGOTIATE message has the wrong length
+ *         @see SerialSession::send_message(Message& msg)
+ */
+SerialResult TestStandComm::recv_negotiate()
+{
+    NegotiateMsgData data;
+    if (this->received_message().length != sizeof(data)) return SERIAL_ERR_DATA_LENGTH;
+    memcpy(&data, this->received_message().data, sizeof(data));
+
+    data.features &= LINK_FEATURES_SUPPORTED;
+    if (data.features & LINK_FEATURE_WINDOWED) {
+        if (data.window_size > SERIAL_WINDOW_MAX) data.window_size = SERIAL_WINDOW_MAX;
+        if (data.window_size == 0) data.features &= ~LINK_FEATURE_WINDOWED;
+    }
+    else {
+        data.window_size = 0;
+    }
+
+    // Correlation IDs only travel in sequenced frames
+    if (!(data.features & LINK_FEATURE_WINDOWED)) data.features &= ~LINK_FEATURE_CORRELATION;
+
+    // The other device starts its sequence numbers over as well
+    this->session.set_window_size(0);
+    this->session.reset();
+
+    Message msg = {
+        .id = MSG_ID_NEGOTIATED,
+        .length = sizeof(data),
+        .data = (uint8_t *)&data
+    };
+    SerialResult res = this->session.send_message(msg);
+
+    // Switch over even if the ACK was lost, the other device has acted on the reply as
+    // soon as it received it
+    this->session.set_window_size(data.window_size);
+
+    if ((data.features & LINK_FEATURE_COBS) && res == SERIAL_OK) {
+        this->transport.set_framing(SERIAL_FRAMING_COBS);
+    }
+    else {
+        this->transport.set_framing(SERIAL_FRAMING_DELIMITED);
+        data.features &= ~LINK_FEATURE_COBS;
+    }
+    this->link_features = data.features;
+    return res;
+}
+
+/**
+ * @return true if baud_rate is one of the SerialBaudRate values
+ */
+static bool baud_rate_valid(uint32_t baud_rate)
+{
+    switch (baud_rate) {
+        case BAUD_9600:
+        case BAUD_19200:
+        case BAUD_38400:
+        case BAUD_57600:
+        case BAUD_115200:
+        case BAUD_230400:
+        case BAUD_460800:
+        case BAUD_500000:
+        case BAUD_1000000:
+        case BAUD_2000000:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Discards all serial data received for the given amount of time
+ * 
+ * Used while the two devices may be at different baud rates, when anything received is garbage.
+ * 
+ * @param duration_ms How long to wait (in milliseconds)
+ */
+void TestStandComm::idle(uint32_t duration_ms)
+{
+    uint64_t time_start = this->platform_millis();
+    uint64_t elapsed;
+    while ((elapsed = this->platform_millis() - time_start) < duration_ms) {
+        this->device.ser_wait(duration_ms - elapsed);
+        this->transport.flush();
+    }
+    this->transport.flush();
+}
+
+/**
+ * @brief Switches both devices to a different baud rate
+ * 
+ * Sends a CHANGE_BAUD message proposing the new baud rate. Once the other device accepts
+ * it both devices switch, and the new rate is confirmed with link_check(). If that fails
+ * both devices go back to the old rate (the other device does so on its own if it does
+ * not receive the link check within BAUD_VERIFY_TIMEOUT_MS).
+ * 
+ * This should be done on a stop-and-wait link (before negotiate()), so no frames are in
+ * flight when the baud rate changes.
+ * 
+ * @param baud_rate  The proposed baud rate
+ * @param timeout_ms Maximum time (in milliseconds) to wait for each response
+ * 
+ * @return SERIAL_OK if both devices now use the new baud rate
+ *         SERIAL_ERR_REJECTED if the other device refused the baud rate or the link did not
+ *                             work at that rate (both devices are back at the old rate)
+ *         @see SerialSession::send_message(Message& msg)
+ *         @see recv_message(uint8_t expect_id, uint8_t expect_length, uint32_t timeout_ms)
+ *         @see ping()
+ */
+SerialResult TestStandComm::change_baud_rate(SerialBaudRate baud_rate, uint32_t timeout_ms)
+{
+    SerialBaudRate old_baud_rate = this->link_baud_rate;
+    if (baud_rate == old_baud_rate) return SERIAL_OK;
+
+    BaudMsgData data = {
+        .baud_rate = (uint32_t)htonl(baud_rate)
+    };
+
+    Message msg = {
+        .id = MSG_ID_CHANGE_BAUD,
+        .length = sizeof(data),
+        .data = (uint8_t *)&data
     };
 
+    SerialResult res = this->session.send_message(msg);
+    if (res != SERIAL_OK) return res;
+
+    res = this->recv_message(MSG_ID_CHANGED_BAUD, sizeof(BaudMsgData), timeout_ms);
+    if (res != SERIAL_OK) return res;
+
+    memcpy(&data, this->received_message().data, sizeof(data));
+    if ((uint32_t)ntohl(data.baud_rate) != (uint32_t)baud_rate) return SERIAL_ERR_REJECTED;
+
+    // The ACK for the reply goes out at the old baud rate before the switch
+    if (!this->device.ser_set_baud_rate(baud_rate)) {
+        // The other device has switched, wait for it to give up and switch back
+        this->idle(BAUD_VERIFY_TIMEOUT_MS);
+        return SERIAL_ERR_REJECTED;
+    }
+    this->idle(BAUD_SETTLE_MS);
+
+    // The round trip time is different at the new baud rate. The verification attempts take
+    // the place of retransmissions, so they fit in the time the other device waits for them
+    uint8_t max_retries = this->session.get_max_retries();
+    this->session.set_max_retries(0);
+    this->session.set_baud_rate(baud_rate);
+    res = SERIAL_ERR_NO_ACK;
+    for (int i = 0; i < BAUD_VERIFY_ATTEMPTS && res != SERIAL_OK; i++) {
+        res = this->link_check(this->reply_timeout());
+    }
+    this->session.set_max_retries(max_retries);
+    if (res == SERIAL_OK) {
+        this->link_baud_rate = baud_rate;
+        return SERIAL_OK;
+    }
+
+    // Fall back once the other device has given up on the new baud rate as well
+    this->device.ser_set_baud_rate(old_baud_rate);
+    this->session.set_baud_rate(old_baud_rate);
+    this->idle(BAUD_VERIFY_TIMEOUT_MS);
+    if (this->ping() == SERIAL_OK) return SERIAL_ERR_REJECTED;
+
+    // The other device did confirm the new baud rate, even though we did not
+    this->device.ser_set_baud_rate(baud_rate);
+    this->session.set_baud_rate(baud_rate);
+    this->idle(BAUD_SETTLE_MS);
+    res = this->ping();
+    if (res == SERIAL_OK) {
+        this->link_baud_rate = baud_rate;
+        return SERIAL_OK;
+    }
+
+    this->device.ser_set_baud_rate(old_baud_rate);
+    this->session.set_baud_rate(old_baud_rate);
+    return res;
+}
+
+/**
+ * @brief Handles receiving a CHANGE_BAUD message
+ * 
+ * Replies with the proposed baud rate if it is a valid SerialBaudRate (or 0 to refuse it)
+ * and switches to it once the reply has been acknowledged. The new rate is kept once an
+ * ECHO (@see link_check()) is received and answered at it within BAUD_VERIFY_TIMEOUT_MS,
+ * otherwise the old rate is restored. This blocks until then.
+ * 
+ * @return SERIAL_OK if the baud rate was changed (or the proposal was refused)
+ *         SERIAL_ERR_DATA_LENGTH if the CHANGE_BAUD message has the wrong length
+ *         SERIAL_ERR_SEND_FAILED if the SerialDevice does not support the baud rate
+ *         SERIAL_ERR_TIMEOUT if the new baud rate was not confirmed in time
+ *         @see SerialSession::send_message(Message& msg)
+ */
+SerialResult TestStandComm::recv_change_baud_rate()
+{
+    BaudMsgData data;
+    if (this->received_message().length != sizeof(data)) return SERIAL_ERR_DATA_LENGTH;
+    memcpy(&data, this->received_message().data, sizeof(data));
+
+    uint32_t baud_rate = ntohl(data.baud_rate);
+    bool accepted = baud_rate_valid(baud_rate);
+    if (!accepted) data.baud_rate = 0;
+
+    Message msg = {
+        .id = MSG_ID_CHANGED_BAUD,
+        .length = sizeof(data),
+        .data = (uint8_t *)&data,
+        .txn = this->received_message().txn
+    };
+    SerialResult res = this->session.send_message(msg);
+    if (res == SERIAL_OK && this->session.get_window_size() > 0) res = this->session.wait_acked();
+    if (res != SERIAL_OK || !accepted) return res;
+
+    SerialBaudRate old_baud_rate = this->link_baud_rate;
+    if (!this->device.ser_set_baud_rate((SerialBaudRate)baud_rate)) return SERIAL_ERR_SEND_FAILED;
+    this->transport.flush();
+    this->session.set_baud_rate((SerialBaudRate)baud_rate);
+
+    // Wait for the other device to confirm the new baud rate works
+    uint64_t time_start = this->platform_millis();
+    uint64_t elapsed;
+    while ((elapsed = this->platform_millis() - time_start) < BAUD_VERIFY_TIMEOUT_MS) {
+        res = this->session.recv_message(BAUD_VERIFY_TIMEOUT_MS - elapsed);
+        if (res != SERIAL_OK || this->received_message().id != MSG_ID_ECHO) continue;
+
+        res = this->recv_echo();
+        if (res == SERIAL_OK && this->session.get_window_size() > 0) res = this->session.wait_acked();
+        if (res == SERIAL_OK) {
+            this->link_baud_rate = (SerialBaudRate)baud_rate;
+            return SERIAL_OK;
+        }
+    }
+
+    this->device.ser_set_baud_rate(old_baud_rate);
+    this->transport.flush();
+    this->session.set_baud_rate(old_baud_rate);
+    return SERIAL_ERR_TIMEOUT;
+}
+
+/**
+ * @return The baud rate currently used on the link
+ */
+SerialBaudRate TestStandComm::baud_rate()
+{
+    return this->link_baud_rate;
+}
+
+/**
+ * @brief Retrieves the link health counters of this end of the link
+ * 
+ * @param stats_out Pointer to a struct where the counters will be stored
+ */
+void TestStandComm::link_stats(LinkStats *stats_out)
+{
+    stats_out->transport = this->transport.get_stats();
+    stats_out->session = this->session.get_stats();
+}
+
+/**
+ * @brief Zeroes the link health counters of this end of the link
+ */
+void TestStandComm::reset_link_stats()
+{
+    this->transport.reset_stats();
+    this->session.reset_stats();
+}
+
+/**
+ * @brief Replies to a GET_LINK_STATS message with the link health counters of this end
+ * 
+ * The counters are taken before the reply is sent, so the reply itself is not included.
+ * 
+ * @return @see SerialSession::send_message(Message& msg)
+ */
+SerialResult TestStandComm::recv_get_link_stats()
+{
+    LinkStats stats;
+    this->link_stats(&stats);
+
+    // Fixup byte order
+    uint32_t *words = (uint32_t *)&stats;
+    for (size_t i = 0; i < sizeof(stats) / sizeof(uint32_t); i++) {
+        words[i] = htonl(words[i]);
+    }
+
+    Message msg = {
+        .id = MSG_ID_LINK_STATS,
+        .length = sizeof(stats),
+        .data = (uint8_t *)&stats,
+        .txn = this->received_message().txn
+    };
     return this->session.send_message(msg);
 }
 
+/**
+ * @return Bitmask of the LINK_FEATURE_* negotiated with the other device
+ */
+uint8_t TestStandComm::features()
+{
+    return this->link_features;
+}
+
+/**
+ * @brief Puts the link in the state a negotiation with the given outcome leaves it in,
+ *        without exchanging any messages
+ * 
+ * Used to replay captured traffic (where the negotiation has already happened) into this end
+ * of the link.
+ * 
+ * @param features    Bitmask of the negotiated LINK_FEATURE_*
+ * @param window_size The negotiated send window size (0 for stop-and-wait)
+ */
+void TestStandComm::set_link(uint8_t features, uint8_t window_size)
+{
+    this->session.set_window_size(window_size);
+    this->session.reset();
+    this->transport.set_framing((features & LINK_FEATURE_COBS) ? SERIAL_FRAMING_COBS : SERIAL_FRAMING_DELIMITED);
+    this->link_features = features;
+}
+
+/**
+ * @brief Wrapper around @see SerialDevice::platform_millis()
+ */
+uint64_t TestStandComm::platform_millis()
+{
+    return this->device.platform_millis();
+}
+
+/**
+ * @return The negotiated send window size (0 if the link is stop-and-wait)
+ */
+uint8_t TestStandComm::window_size()
+{
+    return this->session.get_window_size();
+}
+
+/**
+ * @brief Wrapper around @see SerialSession::wait_acked()
+ */
+SerialResult TestStandComm::wait_acked()
+{
+    return this->session.wait_acked();
+}
+
+/**
+ * @brief Wrapper around @see SerialSession::set_max_retries(uint8_t max_retries)
+ */
+void TestStandComm::set_max_retries(uint8_t max_retries)
+{
+    this->session.set_max_retries(max_retries);
+}
+
+/**
+ * @brief Estimates how long to wait for the reply to a request
+ * 
+ * This is one exchange at the measured round trip time and the current baud rate
+ * (@see SerialSession::exchange_ms()), plus SERIAL_REPLY_PROCESSING_MS for the other device
+ * to act on the request. Lost frames are retransmitted by the session layer rather than
+ * allowed for here.
+ * 
+ * @param request_length Number of data bytes in the request
+ * @param reply_length   Number of data bytes in the reply
+ * 
+ * @return The reply timeout (milliseconds)
+ */
+uint32_t TestStandComm::reply_timeout(uint32_t request_length, uint32_t reply_length)
+{
+    return this->session.exchange_ms(request_length, reply_length) + SERIAL_REPLY_PROCESSING_MS;
+}
+
+/**
+ * @brief Wrapper around @see SerialTransport::set_capture(SerialCapture *capture)
+ */
+void TestStandComm::set_capture(SerialCapture *capture)
+{
+    this->transport.set_capture(capture);
+}
+
+/**
+ * @brief Discards all pending received serial data
+ * 
+ * Wrapper around @see SerialTransport::flush()
+ */
+void TestStandComm::flush()
+{
+    this->transport.flush();
+}
+
+/**
+ * @brief Blocks until there is received data to process or the timeout has elapsed
+ * 
+ * Unlike waiting on the SerialDevice, this also sees data that was already read but not
+ * processed yet (e.g. a frame that arrived right behind an ACK).
+ * 
+ * Wrapper around @see SerialTransport::wait(uint32_t timeout_ms)
+ */
+bool TestStandComm::wait(uint32_t timeout_ms)
+{
+    return this->transport.wait(timeout_ms);
+}
+
 /**
  * @brief Wrapper around @see SerialSession::check_for_message()
  */
@@ -118,19 +760,41 @@ SerialResult TestStandComm::check_for_message()
  * @param timeout_ms    Maximum time (in milliseconds) to wait for a message
  * 
  * @return @see SerialSession::recv_message(uint32_t timeout_ms)
- *         SERIAL_ERR_WRONG_MSG if the received ID does not match expect_id
+ *         SERIAL_ERR_WRONG_MSG if the received ID does not match expect_id (or the message is extended)
  *         SERIAL_ERR_DATA_LENGTH if the received data length does not match expect_length
  */
 SerialResult TestStandComm::recv_message(uint8_t expect_id, uint8_t expect_length, uint32_t timeout_ms)
 {
+    // Messages the other device sends on its own can arrive ahead of the one expected
+    uint64_t time_start = this->platform_millis();
     SerialResult res = this->session.recv_message(timeout_ms);
+    while (res == SERIAL_OK && this->received_message().id != expect_id && this->handle_unsolicited(this->received_message())) {
+        uint64_t elapsed = this->platform_millis() - time_start;
+        res = (elapsed < timeout_ms ? this->session.recv_message(timeout_ms - elapsed) : SERIAL_ERR_TIMEOUT);
+    }
     if (res != SERIAL_OK) return res;
 
+    if (this->received_message().extended) return SERIAL_ERR_WRONG_MSG;
     if (this->received_message().id != expect_id) return SERIAL_ERR_WRONG_MSG;
     if (this->received_message().length != expect_length) return SERIAL_ERR_DATA_LENGTH;
     return SERIAL_OK;
 }
 
+/**
+ * @brief Takes a message the other device sent on its own (e.g. telemetry) while waiting
+ *        for another one
+ * 
+ * Called by recv_message and recv_extended for messages other than the one expected, they
+ * keep waiting if it returns true. Does nothing here, devices that receive unsolicited
+ * messages override it.
+ * 
+ * @return true if the message was handled
+ */
+bool TestStandComm::handle_unsolicited(Message& msg)
+{
+    return false;
+}
+
 /**
  * @return A reference to the Message struct holding the most recently received message
  */
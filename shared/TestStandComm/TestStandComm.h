@@ -4,8 +4,18 @@
 #include "SerialDevice.h"
 #include "SerialTransport.h"
 #include "SerialSession.h"
+#include "LinkStats.h"
 
 #include <stddef.h>
+#include <string.h>
+
+/** Time the other device is given to act on a request before it replies (milliseconds, @see reply_timeout()) */
+#ifndef SERIAL_REPLY_PROCESSING_MS
+#define SERIAL_REPLY_PROCESSING_MS 50
+#endif // SERIAL_REPLY_PROCESSING_MS
+
+/** Link features this build of the protocol stack supports */
+#define LINK_FEATURES_SUPPORTED (LINK_FEATURE_WINDOWED | LINK_FEATURE_CORRELATION | LINK_FEATURE_COBS)
 
 /**
  * @class TestStandComm
@@ -27,35 +37,79 @@ class TestStandComm
         SerialDevice& device;
         SerialTransport transport;
 
+        uint8_t link_features;
+        SerialBaudRate link_baud_rate;
+
+        uint8_t *ext_buf;
+        uint16_t ext_buf_size;
+
+        void idle(uint32_t duration_ms);
+
     protected:
+        virtual bool handle_unsolicited(Message& msg);
         SerialResult send_basic_msg(uint8_t id);
+        uint64_t platform_millis();
         SerialSession session;
         uint8_t send_buf[MSG_DATA_LENGTH_MAX];
 
     public:
         TestStandComm(SerialDevice& device);
 
+        bool connect(SerialBaudRate baud_rate);
+
         SerialResult ping();
         SerialResult echo(uint8_t *data, uint8_t length);
         SerialResult recv_echo();
 
         SerialResult link_check(uint32_t timeout_ms);
+        SerialResult link_check(uint8_t *buf, uint16_t length, uint32_t timeout_ms);
+
+        void set_ext_buffer(uint8_t *buf, uint16_t size);
+        SerialResult send_extended(uint8_t id, uint8_t *data, uint16_t length);
+        SerialResult recv_extended(uint8_t expect_id, uint8_t *buf, uint16_t size, uint16_t *length_out, uint32_t timeout_ms);
+
+        SerialResult negotiate(uint8_t features, uint8_t window_size, uint32_t timeout_ms);
+        SerialResult recv_negotiate();
+        uint8_t window_size();
+        uint8_t features();
+        void set_link(uint8_t features, uint8_t window_size);
+        SerialResult wait_acked();
+
+        void set_max_retries(uint8_t max_retries);
+        uint32_t reply_timeout(uint32_t request_length = MSG_DATA_LENGTH_MAX, uint32_t reply_length = MSG_DATA_LENGTH_MAX);
+
+        SerialResult change_baud_rate(SerialBaudRate baud_rate, uint32_t timeout_ms);
+        SerialResult recv_change_baud_rate();
+        SerialBaudRate baud_rate();
+
+        void link_stats(LinkStats *stats_out);
+        void reset_link_stats();
+        SerialResult recv_get_link_stats();
+
+        void set_capture(SerialCapture *capture);
+
+        void flush();
+        bool wait(uint32_t timeout_ms);
 
         SerialResult check_for_message();
         SerialResult recv_message(uint8_t expect_id, uint8_t expect_length, uint32_t timeout_ms);
         Message& received_message();
 };
 
+#ifndef __BYTE_ORDER__
+#error "__BYTE_ORDER__ must be defined"
+#endif
+
 /**
  * @brief Convert a uint32_t from network byte order (big endian) to host byte order
  */
 int32_t inline ntohl(int32_t val)
 {
-    uint8_t *ptr = (uint8_t *)&val;
-    return (ptr[0] << 24 |
-            ptr[1] << 16 |
-            ptr[2] <<  8 |
-            ptr[3] <<  0 );
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return val;
+#else // __ORDER_LITTLE_ENDIAN__
+    return (int32_t)__builtin_bswap32((uint32_t)val);
+#endif // __ORDER_LITTLE_ENDIAN__
 }
 
 /**
@@ -63,13 +117,27 @@ int32_t inline ntohl(int32_t val)
  */
 int32_t inline htonl(int32_t val)
 {
-    uint32_t out;
-    uint8_t *ptr = (uint8_t *)&out;
-    ptr[0] = (val >> 24) & 0xFF;
-    ptr[1] = (val >> 16) & 0xFF;
-    ptr[2] = (val >>  8) & 0xFF;
-    ptr[3] = (val >>  0) & 0xFF;
-    return out;
+    return ntohl(val);
+}
+
+/**
+ * @brief Convert a uint16_t from network byte order (big endian) to host byte order
+ */
+uint16_t inline ntohs(uint16_t val)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return val;
+#else // __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap16(val);
+#endif // __ORDER_LITTLE_ENDIAN__
+}
+
+/**
+ * @brief Convert a uint16_t from host byte order to network byte order (big endian)
+ */
+uint16_t inline htons(uint16_t val)
+{
+    return ntohs(val);
 }
 
 #ifndef __FLOAT_WORD_ORDER__
@@ -82,14 +150,11 @@ int32_t inline htonl(int32_t val)
 
 static double inline reverse(double val)
 {
-    double out;
-
-    uint8_t *ptr_val = (uint8_t *)&val;
-    uint8_t *ptr_out = (uint8_t *)&out;
-    for (size_t i = 0; i < sizeof(double); i++) {
-        ptr_out[i] = ptr_val[sizeof(double) - i - 1];
-    }
-    return out;
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    bits = __builtin_bswap64(bits);
+    memcpy(&val, &bits, sizeof(val));
+    return val;
 }
 
 double inline ntohd(double val)
@@ -16,14 +16,37 @@
 #define MSG_ID_GET_AXIS_STATE   0x45
 #define MSG_ID_GET_TEMP         0x46
 #define MSG_ID_CALIBRATE        0x47
+#define MSG_ID_SET_TELEMETRY    0x48 // Data is a TelemetryRateMsgData (rate 0 to unsubscribe)
+#define MSG_ID_GET_SNAPSHOT     0x49
+#define MSG_ID_SET_POSITION_STREAM 0x4A // Data is a TelemetryRateMsgData (rate 0 to unsubscribe)
 
 // Arduino -> PC Messages
-#define MSG_ID_LOG              0x80
+#define MSG_ID_LOG              0x80 // Batch of binary log entries (@see BinaryLog.h)
 #define MSG_ID_STATUS           0x81
 #define MSG_ID_POSITION         0x82
 #define MSG_ID_AXIS_STATE       0x83
 #define MSG_ID_TEMP             0x84
 #define MSG_ID_AXIS_RESULT      0x85
+#define MSG_ID_TELEMETRY_RATE   0x86 // Reply to SET_TELEMETRY with the rate in use (0 if refused)
+#define MSG_ID_TELEMETRY        0x87 // Sent unsolicited at the subscribed rate
+#define MSG_ID_SNAPSHOT         0x88 // Reply to GET_SNAPSHOT, data is a SnapshotMsgData
+#define MSG_ID_POSITION_STREAM_RATE 0x89 // Reply to SET_POSITION_STREAM with the rate in use (0 if refused)
+#define MSG_ID_POSITION_STREAM  0x8A // Sent unsolicited, data is encoded by a PositionStreamEncoder
+
+/*****************************************************************************/
+/*                                 TELEMETRY                                 */
+/*****************************************************************************/
+
+/** Fastest telemetry rate the firmware streams at (Hz) */
+#define TELEMETRY_RATE_MAX      200
+
+// TelemetryMsgData::flags and AxisStateMsgData::flags
+#define TELEMETRY_X_MOVING      (1 << 0)
+#define TELEMETRY_X_LS_HOME     (1 << 1)
+#define TELEMETRY_X_LS_FAR      (1 << 2)
+#define TELEMETRY_Y_MOVING      (1 << 3)
+#define TELEMETRY_Y_LS_HOME     (1 << 4)
+#define TELEMETRY_Y_LS_FAR      (1 << 5)
 
 /*****************************************************************************/
 /*                                   ENUMS                                   */
@@ -75,4 +98,44 @@ typedef struct{
     bool y_ls_home;
 } __attribute__((__packed__)) StateMsgData;
 
+typedef struct {
+    uint32_t velocity;           //!< Step rate [motor steps / s]
+    uint32_t next_velocity;      //!< Step rate the axis changes to at the next update
+    int32_t encoder_target;      //!< Position at which the next segment transition will occur
+} __attribute__((__packed__)) AxisMotionMsgData;
+
+typedef struct {
+    uint8_t flags;               //!< Bitmask of TELEMETRY_*
+    uint8_t velocity_segments;   //!< VelSeg of the X axis in the low nibble, Y axis in the high nibble
+    AxisMotionMsgData axis[2];   //!< Indexed by AxisId
+} __attribute__((__packed__)) AxisStateMsgData;
+
+typedef struct {
+    uint16_t rate_hz;            //!< Telemetry messages per second (at most TELEMETRY_RATE_MAX)
+} __attribute__((__packed__)) TelemetryRateMsgData;
+
+typedef struct {
+    uint32_t time_us;            //!< Firmware time the sample was taken (micros(), wraps after ~71 minutes)
+    uint8_t status;              //!< Status
+    uint8_t flags;               //!< Bitmask of TELEMETRY_*
+    int32_t x_counts;            //!< Encoder position of each axis
+    int32_t y_counts;
+    uint32_t x_velocity;         //!< Step rate of each axis [motor steps / s]
+    uint32_t y_velocity;
+    uint8_t x_velocity_segment;  //!< VelSeg of each axis
+    uint8_t y_velocity_segment;
+} __attribute__((__packed__)) TelemetryMsgData;
+
+/**
+ * The replies to GET_STATUS, GET_POSITION and GET_TEMP, along with the motion and limit
+ * switches of each axis, in one frame so a readout costs one round trip rather than one
+ * per query
+ */
+typedef struct {
+    uint8_t status;              //!< Status
+    PositionMsgData position;
+    StateMsgData axis_state;
+    TempMsgData temp;
+} __attribute__((__packed__)) SnapshotMsgData;
+
 #endif // TEST_STAND_MESSAGES_H
\ No newline at end of file
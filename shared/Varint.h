@@ -0,0 +1,65 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <stdint.h>
+
+/*
+ * Variable length integers for the compact message encodings (@see PositionStream.h and
+ * BinaryLog.h)
+ */
+
+/** Longest varint of a 32-bit value */
+#define VARINT_LENGTH_MAX 5
+
+/**
+ * @brief Maps signed values to unsigned ones so small magnitudes of either sign stay small
+ */
+static inline uint32_t zigzag_encode(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t zigzag_decode(uint32_t value)
+{
+    return (int32_t)((value >> 1) ^ (0 - (value & 1)));
+}
+
+/**
+ * @brief Writes a value 7 bits at a time, least significant first, with the top bit of each
+ *        byte set if more follow
+ *
+ * @return The number of bytes written (at most VARINT_LENGTH_MAX)
+ */
+static inline uint8_t varint_put(uint8_t *buf, uint32_t value)
+{
+    uint8_t length = 0;
+    while (value >= 0x80) {
+        buf[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buf[length++] = (uint8_t)value;
+    return length;
+}
+
+/**
+ * @brief Reads a varint
+ *
+ * @param buf    Where to read it from
+ * @param length Number of bytes available at buf
+ *
+ * @return The number of bytes read, 0 if the varint is cut off or too long
+ */
+static inline uint8_t varint_get(const uint8_t *buf, uint8_t length, uint32_t *value_out)
+{
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < length && i < VARINT_LENGTH_MAX; i++) {
+        value |= (uint32_t)(buf[i] & 0x7F) << (7 * i);
+        if (!(buf[i] & 0x80)) {
+            *value_out = value;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+#endif // VARINT_H
@@ -1,9 +1,10 @@
 #ifndef SHARED_DEFS_H
 #define SHARED_DEFS_H
 
-#define SERIAL_BAUD_RATE       BAUD_115200
+#define SERIAL_BAUD_RATE       BAUD_115200  // Baud rate the link starts at
+#define SERIAL_BAUD_RATE_MAX   BAUD_2000000 // Fastest baud rate the host will negotiate
 
-#define MSG_RECEIVE_TIMEOUT_MS 250
+#define MSG_EXT_BUFFER_SIZE    4096 // Largest extended message the firmware accepts
 
 #define ENCODER_COUNTS_PER_REV 500
 #define MOTOR_STEPS_PER_REV    800
@@ -0,0 +1,291 @@
+#include "FrameCapture.h"
+
+// C library headers
+#include <stdio.h>
+#include <string.h>
+
+// Linux headers
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/**
+ * @return The current time of the given clock (nanoseconds)
+ */
+static uint64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*****************************************************************************/
+/*                                   WRITER                                  */
+/*****************************************************************************/
+
+FrameCaptureWriter::FrameCaptureWriter() : fd(-1), map(nullptr), map_length(0), start_ns(0),
+                                           reserved(0), committed_end(0), record_count(0), dropped_count(0)
+{
+    // Nothing else to do
+}
+
+FrameCaptureWriter::~FrameCaptureWriter()
+{
+    this->close();
+}
+
+/**
+ * @brief Creates a capture file (replacing any existing file) and starts capturing
+ *
+ * The whole file is allocated and mapped up front, so the disk is not touched while
+ * frames are captured.
+ *
+ * @param path Path of the capture file
+ * @param size Size of the file (bytes), which caps how much can be captured
+ *
+ * @return true if the file was created
+ */
+bool FrameCaptureWriter::open(const char *path, uint64_t size)
+{
+    this->close();
+    if (size <= sizeof(CaptureFileHeader)) return false;
+
+    this->fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (this->fd < 0) {
+        printf("Error %i from open: %s\n", errno, strerror(errno));
+        return false;
+    }
+
+    int err = posix_fallocate(this->fd, 0, (off_t)size);
+    if (err != 0) {
+        printf("Error %i from posix_fallocate: %s\n", err, strerror(err));
+        ::close(this->fd);
+        this->fd = -1;
+        return false;
+    }
+
+    // Fault the pages in now rather than on the first write to each of them
+    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, 0);
+    if (map == MAP_FAILED) {
+        printf("Error %i from mmap: %s\n", errno, strerror(errno));
+        ::close(this->fd);
+        this->fd = -1;
+        return false;
+    }
+    this->map = (uint8_t *)map;
+    this->map_length = size;
+
+    this->start_ns = clock_ns(CLOCK_MONOTONIC);
+    this->reserved = 0;
+    this->committed_end = 0;
+    this->record_count = 0;
+    this->dropped_count = 0;
+
+    CaptureFileHeader *header = (CaptureFileHeader *)this->map;
+    header->magic = CAPTURE_MAGIC;
+    header->version = CAPTURE_VERSION;
+    header->header_length = sizeof(CaptureFileHeader);
+    header->start_realtime_ns = clock_ns(CLOCK_REALTIME);
+    header->data_length = 0;
+    header->records = 0;
+    header->dropped = 0;
+    return true;
+}
+
+/**
+ * @brief Stops capturing, fills in the totals and trims the file to what was captured
+ *
+ * The transports must no longer be using the capture (@see SerialTransport::set_capture).
+ */
+void FrameCaptureWriter::close()
+{
+    if (this->map == nullptr) return;
+
+    uint64_t data_length = this->committed_end.load();
+    CaptureFileHeader *header = (CaptureFileHeader *)this->map;
+    header->data_length = data_length;
+    header->records = this->record_count.load();
+    header->dropped = this->dropped_count.load();
+
+    munmap(this->map, this->map_length);
+    this->map = nullptr;
+    this->map_length = 0;
+
+    if (ftruncate(this->fd, (off_t)(sizeof(CaptureFileHeader) + data_length)) != 0) {
+        printf("Error %i from ftruncate: %s\n", errno, strerror(errno));
+    }
+    ::close(this->fd);
+    this->fd = -1;
+}
+
+/**
+ * @return true if frames are being captured
+ */
+bool FrameCaptureWriter::is_open()
+{
+    return (this->map != nullptr);
+}
+
+void FrameCaptureWriter::capture_frame(SerialCaptureDir dir, bool cobs, const Message& msg, const uint8_t *data)
+{
+    if (this->map == nullptr) return;
+
+    uint64_t time_ns = clock_ns(CLOCK_MONOTONIC) - this->start_ns;
+    uint64_t size = sizeof(CaptureRecord) + msg.length;
+    uint64_t offset = this->reserved.fetch_add(size, std::memory_order_relaxed);
+    if (sizeof(CaptureFileHeader) + offset + size > this->map_length) {
+        this->dropped_count++;
+        return;
+    }
+
+    uint8_t *dest = this->map + sizeof(CaptureFileHeader) + offset;
+    CaptureRecord *record = (CaptureRecord *)dest;
+    record->time_ns = time_ns;
+    record->length = msg.length;
+    record->dir = (uint8_t)dir;
+    record->flags = ((msg.sequenced  ? CAPTURE_FLAG_SEQUENCED  : 0) |
+                     (msg.extended   ? CAPTURE_FLAG_EXTENDED   : 0) |
+                     (msg.retransmit ? CAPTURE_FLAG_RETRANSMIT : 0) |
+                     (msg.alt        ? CAPTURE_FLAG_ALT        : 0) |
+                     (cobs           ? CAPTURE_FLAG_COBS       : 0));
+    record->id = msg.id;
+    record->seq = msg.seq;
+    record->txn = msg.txn;
+    record->reserved = 0;
+    if (msg.length > 0 && data != nullptr) memcpy(dest + sizeof(CaptureRecord), data, msg.length);
+
+    // Records can finish out of order when several threads capture, keep the furthest end
+    uint64_t end = offset + size;
+    uint64_t prev = this->committed_end.load(std::memory_order_relaxed);
+    while (prev < end && !this->committed_end.compare_exchange_weak(prev, end));
+    this->record_count++;
+}
+
+/**
+ * @return The number of frames captured
+ */
+uint32_t FrameCaptureWriter::records()
+{
+    return this->record_count.load();
+}
+
+/**
+ * @return The number of frames that did not fit in the file
+ */
+uint32_t FrameCaptureWriter::dropped()
+{
+    return this->dropped_count.load();
+}
+
+/*****************************************************************************/
+/*                                   READER                                  */
+/*****************************************************************************/
+
+FrameCaptureReader::FrameCaptureReader() : fd(-1), map(nullptr), map_length(0), data_end(0), offset(0)
+{
+    // Nothing else to do
+}
+
+FrameCaptureReader::~FrameCaptureReader()
+{
+    this->close();
+}
+
+/**
+ * @brief Opens a capture file
+ *
+ * A capture that was not closed (e.g. the program crashed) is read up to its first empty record.
+ *
+ * @return true if the file is a capture file of a version that can be read
+ */
+bool FrameCaptureReader::open(const char *path)
+{
+    this->close();
+
+    this->fd = ::open(path, O_RDONLY);
+    if (this->fd < 0) {
+        printf("Error %i from open: %s\n", errno, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(this->fd, &st) != 0 || (uint64_t)st.st_size < sizeof(CaptureFileHeader)) {
+        printf("%s is not a capture file\n", path);
+        this->close();
+        return false;
+    }
+
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, this->fd, 0);
+    if (map == MAP_FAILED) {
+        printf("Error %i from mmap: %s\n", errno, strerror(errno));
+        this->close();
+        return false;
+    }
+    this->map = (const uint8_t *)map;
+    this->map_length = st.st_size;
+
+    const CaptureFileHeader& header = this->header();
+    if (header.magic != CAPTURE_MAGIC || header.version != CAPTURE_VERSION) {
+        printf("%s is not a version %d capture file\n", path, CAPTURE_VERSION);
+        this->close();
+        return false;
+    }
+
+    this->data_end = this->map_length;
+    if (header.data_length > 0 && header.header_length + header.data_length < this->data_end) {
+        this->data_end = header.header_length + header.data_length;
+    }
+    this->rewind();
+    return true;
+}
+
+void FrameCaptureReader::close()
+{
+    if (this->map != nullptr) munmap((void *)this->map, this->map_length);
+    this->map = nullptr;
+    this->map_length = 0;
+
+    if (this->fd >= 0) ::close(this->fd);
+    this->fd = -1;
+}
+
+/**
+ * @return The header of the open capture file
+ */
+const CaptureFileHeader& FrameCaptureReader::header()
+{
+    return *(const CaptureFileHeader *)this->map;
+}
+
+/**
+ * @brief Reads the next record
+ *
+ * The record and its data point straight into the mapped file, they stay valid until the
+ * file is closed.
+ *
+ * @return false once there are no more records
+ */
+bool FrameCaptureReader::next(const CaptureRecord **record_out, const uint8_t **data_out)
+{
+    if (this->offset + sizeof(CaptureRecord) > this->data_end) return false;
+
+    const CaptureRecord *record = (const CaptureRecord *)(this->map + this->offset);
+    if (record->dir == 0) return false;
+    if (this->offset + sizeof(CaptureRecord) + record->length > this->data_end) return false;
+
+    *record_out = record;
+    *data_out = this->map + this->offset + sizeof(CaptureRecord);
+    this->offset += sizeof(CaptureRecord) + record->length;
+    return true;
+}
+
+/**
+ * @brief Goes back to the first record
+ */
+void FrameCaptureReader::rewind()
+{
+    this->offset = this->header().header_length;
+}
@@ -0,0 +1,122 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include "SerialCapture.h"
+
+#include <stdint.h>
+
+#include <atomic>
+
+/** Identifies a capture file ("TSCP") */
+#define CAPTURE_MAGIC 0x50435354
+
+#define CAPTURE_VERSION 1
+
+/** Size of a capture file if none is given (bytes) */
+#ifndef CAPTURE_FILE_SIZE_DEFAULT
+#define CAPTURE_FILE_SIZE_DEFAULT (64 * 1024 * 1024)
+#endif // CAPTURE_FILE_SIZE_DEFAULT
+
+#define CAPTURE_FLAG_SEQUENCED  (1 << 0)
+#define CAPTURE_FLAG_EXTENDED   (1 << 1)
+#define CAPTURE_FLAG_RETRANSMIT (1 << 2)
+#define CAPTURE_FLAG_COBS       (1 << 3) //!< The frame was COBS framed
+#define CAPTURE_FLAG_ALT        (1 << 4) //!< Alternating bit of a stop-and-wait frame
+
+/**
+ * @struct CaptureFileHeader
+ *
+ * @brief Start of a capture file, followed by data_length bytes of records
+ *
+ * Capture files are in host byte order, they are meant to be replayed on the kind of PC
+ * they were captured on.
+ */
+typedef struct {
+    uint32_t magic;             //!< CAPTURE_MAGIC
+    uint16_t version;           //!< CAPTURE_VERSION
+    uint16_t header_length;     //!< sizeof(CaptureFileHeader)
+    uint64_t start_realtime_ns; //!< Wall clock time the capture started (to match it up with logs)
+    uint64_t data_length;       //!< Bytes of records (0 if the capture was not closed)
+    uint32_t records;           //!< Frames captured
+    uint32_t dropped;           //!< Frames that did not fit in the file
+} __attribute__((__packed__)) CaptureFileHeader;
+
+/**
+ * @struct CaptureRecord
+ *
+ * @brief One captured frame, followed by length bytes of data
+ */
+typedef struct {
+    uint64_t time_ns; //!< Monotonic time since the capture started
+    uint16_t length;
+    uint8_t dir;      //!< SerialCaptureDir (never 0, so an all-zero record marks the end)
+    uint8_t flags;    //!< Bitmask of CAPTURE_FLAG_*
+    uint8_t id;
+    uint8_t seq;
+    uint8_t txn;
+    uint8_t reserved;
+} __attribute__((__packed__)) CaptureRecord;
+
+/**
+ * @class FrameCaptureWriter
+ *
+ * @brief Writes the frames of one or more SerialTransports to a capture file
+ *
+ * The file is allocated in full when it is opened and written through a shared memory
+ * mapping, so capturing a frame is a couple of memcpy()s and never waits on the disk. Each
+ * frame reserves its space with an atomic add, so transports on different threads can share a
+ * capture. Frames that do not fit once the file is full are counted and dropped.
+ */
+class FrameCaptureWriter : public SerialCapture
+{
+    private:
+        int fd;
+        uint8_t *map;
+        uint64_t map_length;
+        uint64_t start_ns;
+        std::atomic<uint64_t> reserved;      //!< Bytes of records handed out
+        std::atomic<uint64_t> committed_end; //!< End of the last record that fit
+        std::atomic<uint32_t> record_count;
+        std::atomic<uint32_t> dropped_count;
+
+    public:
+        FrameCaptureWriter();
+        ~FrameCaptureWriter();
+
+        bool open(const char *path, uint64_t size = CAPTURE_FILE_SIZE_DEFAULT);
+        void close();
+        bool is_open();
+
+        void capture_frame(SerialCaptureDir dir, bool cobs, const Message& msg, const uint8_t *data);
+
+        uint32_t records();
+        uint32_t dropped();
+};
+
+/**
+ * @class FrameCaptureReader
+ *
+ * @brief Reads the records of a capture file in order
+ */
+class FrameCaptureReader
+{
+    private:
+        int fd;
+        const uint8_t *map;
+        uint64_t map_length;
+        uint64_t data_end;
+        uint64_t offset;
+
+    public:
+        FrameCaptureReader();
+        ~FrameCaptureReader();
+
+        bool open(const char *path);
+        void close();
+
+        const CaptureFileHeader& header();
+        bool next(const CaptureRecord **record_out, const uint8_t **data_out);
+        void rewind();
+};
+
+#endif // FRAME_CAPTURE_H
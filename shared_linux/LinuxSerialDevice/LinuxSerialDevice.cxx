@@ -10,8 +10,14 @@
 #include <termios.h> // Contains POSIX terminal control definitions
 #include <unistd.h> // write(), read(), close()
 #include <sys/ioctl.h> // ioctl()
+#include <sys/uio.h> // writev()
+#include <poll.h> // poll()
+#include <limits.h>
 #include <time.h>
 
+/** Maximum number of buffers passed to a single writev() call */
+#define SERIAL_IOV_MAX 8
+
 LinuxSerialDevice::LinuxSerialDevice()
 {
     // Nothing to do
@@ -33,6 +39,13 @@ static speed_t get_termios_baud_rate(SerialBaudRate baud_rate)
         case BAUD_230400 : return B230400;
         case BAUD_460800 : return B460800;
         case BAUD_500000 : return B500000;
+        // Not every kernel / libc defines the faster rates
+#ifdef B1000000
+        case BAUD_1000000: return B1000000;
+#endif // B1000000
+#ifdef B2000000
+        case BAUD_2000000: return B2000000;
+#endif // B2000000
         default          : return 0;
     }
 }
@@ -101,6 +114,29 @@ bool LinuxSerialDevice::ser_connect(SerialBaudRate baud_rate)
     return true;
 }
 
+bool LinuxSerialDevice::ser_set_baud_rate(SerialBaudRate baud_rate)
+{
+    speed_t termios_baud_rate = get_termios_baud_rate(baud_rate);
+    if (termios_baud_rate == 0) return false;
+
+    struct termios tty;
+    if (tcgetattr(this->serial_port, &tty) != 0) {
+        printf("Error %i from tcgetattr: %s\n", errno, strerror(errno));
+        return false;
+    }
+
+    cfsetispeed(&tty, termios_baud_rate);
+    cfsetospeed(&tty, termios_baud_rate);
+
+    // TCSADRAIN lets already written data go out at the old baud rate first
+    if (tcsetattr(this->serial_port, TCSADRAIN, &tty) != 0) {
+        printf("Error %i from tcsetattr: %s\n", errno, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
 void LinuxSerialDevice::ser_flush()
 {
     // Wait for 10 ms for last bits of data
@@ -120,11 +156,52 @@ bool LinuxSerialDevice::ser_read(uint8_t *out)
     return (read(this->serial_port, out, 1) == 1);
 }
 
+uint32_t LinuxSerialDevice::ser_read_bulk(uint8_t *buf, uint32_t max_length)
+{
+    // The tty is configured with VMIN = VTIME = 0, so this returns immediately
+    // with whatever data is available (no need for a separate FIONREAD ioctl)
+    ssize_t bytes_read = read(this->serial_port, buf, max_length);
+    return (bytes_read > 0 ? bytes_read : 0);
+}
+
+bool LinuxSerialDevice::ser_wait(uint32_t timeout_ms)
+{
+    struct pollfd pfd;
+    pfd.fd = this->serial_port;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    // Sleep in the kernel until the tty has data or the timeout expires
+    int timeout = (timeout_ms > INT_MAX ? INT_MAX : (int)timeout_ms);
+    int res = poll(&pfd, 1, timeout);
+    return (res > 0 && (pfd.revents & POLLIN));
+}
+
 bool LinuxSerialDevice::ser_write(uint8_t *data, uint32_t length)
 {
     return (write(this->serial_port, data, length) == length);
 }
 
+bool LinuxSerialDevice::ser_writev(const SerialIOVec *iov, uint32_t count)
+{
+    // Hand the buffers to the kernel in a single syscall (per SERIAL_IOV_MAX buffers)
+    struct iovec vecs[SERIAL_IOV_MAX];
+    while (count > 0) {
+        uint32_t batch = (count > SERIAL_IOV_MAX ? SERIAL_IOV_MAX : count);
+        ssize_t total = 0;
+        for (uint32_t i = 0; i < batch; i++) {
+            vecs[i].iov_base = iov[i].data;
+            vecs[i].iov_len = iov[i].length;
+            total += iov[i].length;
+        }
+        if (writev(this->serial_port, vecs, batch) != total) return false;
+
+        iov += batch;
+        count -= batch;
+    }
+    return true;
+}
+
 void LinuxSerialDevice::ser_disconnect()
 {
     close(this->serial_port);
@@ -21,10 +21,14 @@ class LinuxSerialDevice: public SerialDevice
         void set_device_file(const char *device_file);
 
         bool ser_connect(SerialBaudRate baud_rate);
+        bool ser_set_baud_rate(SerialBaudRate baud_rate);
         void ser_flush();
         uint32_t ser_available();
         bool ser_read(uint8_t *out);
+        uint32_t ser_read_bulk(uint8_t *buf, uint32_t max_length);
+        bool ser_wait(uint32_t timeout_ms);
         bool ser_write(uint8_t *data, uint32_t length);
+        bool ser_writev(const SerialIOVec *iov, uint32_t count);
         void ser_disconnect();
 
         uint64_t platform_millis();
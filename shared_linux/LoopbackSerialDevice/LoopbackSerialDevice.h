@@ -0,0 +1,296 @@
+#ifndef LOOPBACK_SERIAL_DEVICE_H
+#define LOOPBACK_SERIAL_DEVICE_H
+
+#include "SerialDevice.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+
+/** Number of bytes that can be in flight in each direction (must be a power of 2) */
+#ifndef LOOPBACK_BUF_SIZE
+#define LOOPBACK_BUF_SIZE 0x10000
+#endif // LOOPBACK_BUF_SIZE
+
+static_assert((LOOPBACK_BUF_SIZE & (LOOPBACK_BUF_SIZE - 1)) == 0, "LOOPBACK_BUF_SIZE must be a power of 2");
+
+/** Bits on the wire per byte (start bit + 8 data bits + stop bit) */
+#define LOOPBACK_BITS_PER_BYTE 10
+
+/**
+ * @struct LoopbackConfig
+ *
+ * @brief Imperfections of the simulated wire between the two ends of a LoopbackSerialPair
+ */
+typedef struct {
+    bool paced;            //!< Bytes arrive no faster than the baud rate allows
+    uint32_t latency_us;   //!< Time from a byte being written until it can be read (microseconds)
+    double bit_error_rate; //!< Probability of each bit being flipped in transit
+    uint32_t seed;         //!< Seed for the bit error generator
+} LoopbackConfig;
+
+/**
+ * @class LoopbackChannel
+ *
+ * @brief One direction of a LoopbackSerialPair
+ *
+ * A lock-free single-producer / single-consumer ring buffer. Each byte carries the time
+ * it is delivered at, so pacing and latency are applied by the reader simply not seeing
+ * bytes before then. The mutex is only used to sleep on while waiting for data, never to
+ * move data.
+ */
+class LoopbackChannel
+{
+    public:
+        uint8_t data[LOOPBACK_BUF_SIZE];
+        uint64_t deliver_us[LOOPBACK_BUF_SIZE];
+        std::atomic<uint32_t> head; //!< Next byte to read (only written by the reader)
+        std::atomic<uint32_t> tail; //!< Next byte to write (only written by the writer)
+
+        std::mutex wait_mutex;
+        std::condition_variable wait_cond;
+
+        // Writer state
+        uint64_t last_deliver_us;
+        std::mt19937 rng;
+
+        LoopbackChannel() : head(0), tail(0), last_deliver_us(0) {}
+
+        static uint64_t now_us()
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        /**
+         * @return The number of bytes that have been delivered and not read yet
+         */
+        uint32_t delivered(uint64_t now)
+        {
+            uint32_t h = this->head.load(std::memory_order_relaxed);
+            uint32_t t = this->tail.load(std::memory_order_acquire);
+
+            // Delivery times never decrease, so find the first undelivered byte by bisection
+            uint32_t lo = 0, hi = t - h;
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (this->deliver_us[(h + mid) & (LOOPBACK_BUF_SIZE - 1)] <= now) lo = mid + 1;
+                else hi = mid;
+            }
+            return lo;
+        }
+
+        /**
+         * @return The delivery time of the next byte to read, or 0 if nothing has been written
+         */
+        uint64_t next_deliver_us()
+        {
+            uint32_t h = this->head.load(std::memory_order_relaxed);
+            if (h == this->tail.load(std::memory_order_acquire)) return 0;
+            return this->deliver_us[h & (LOOPBACK_BUF_SIZE - 1)];
+        }
+
+        void wake()
+        {
+            // Taking the lock orders this against a reader that is about to sleep
+            { std::lock_guard<std::mutex> lock(this->wait_mutex); }
+            this->wait_cond.notify_one();
+        }
+};
+
+/**
+ * @class LoopbackSerialDevice
+ *
+ * @brief One end of a LoopbackSerialPair
+ *
+ * Each end may only be used by one thread at a time (the two ends by different threads).
+ */
+class LoopbackSerialDevice : public SerialDevice
+{
+    private:
+        LoopbackChannel& rx;
+        LoopbackChannel& tx;
+        const LoopbackConfig& config;
+        std::atomic<uint32_t> baud_rate;
+        const LoopbackSerialDevice *peer;
+
+        /**
+         * @brief Puts one byte on the wire, applying the imperfections of the config
+         */
+        void transmit(uint8_t byte, uint64_t now, uint64_t byte_us, bool garble)
+        {
+            LoopbackChannel& ch = this->tx;
+
+            // Wait for room, like a full transmit buffer
+            while (ch.tail.load(std::memory_order_relaxed) - ch.head.load(std::memory_order_acquire) >= LOOPBACK_BUF_SIZE) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+
+            if (garble) {
+                // Receiver at a different baud rate, only noise comes through
+                byte = (uint8_t)ch.rng();
+            }
+            else if (this->config.bit_error_rate > 0) {
+                std::uniform_real_distribution<double> dist(0.0, 1.0);
+                for (int bit = 0; bit < 8; bit++) {
+                    if (dist(ch.rng) < this->config.bit_error_rate) byte ^= (uint8_t)(1 << bit);
+                }
+            }
+
+            uint64_t deliver = now + this->config.latency_us;
+            if (this->config.paced) {
+                // Serialized behind the bytes already on the wire
+                uint64_t on_wire = (ch.last_deliver_us > now ? ch.last_deliver_us : now) + byte_us;
+                if (on_wire + this->config.latency_us > deliver) deliver = on_wire + this->config.latency_us;
+                ch.last_deliver_us = on_wire;
+            }
+
+            uint32_t t = ch.tail.load(std::memory_order_relaxed);
+            ch.data[t & (LOOPBACK_BUF_SIZE - 1)] = byte;
+            ch.deliver_us[t & (LOOPBACK_BUF_SIZE - 1)] = deliver;
+            ch.tail.store(t + 1, std::memory_order_release);
+        }
+
+    public:
+        LoopbackSerialDevice(LoopbackChannel& rx, LoopbackChannel& tx, const LoopbackConfig& config)
+            : rx(rx), tx(tx), config(config), baud_rate(0), peer(nullptr) {}
+
+        void set_peer(const LoopbackSerialDevice *peer) { this->peer = peer; }
+
+        bool ser_connect(SerialBaudRate baud_rate)
+        {
+            this->baud_rate = baud_rate;
+            return true;
+        }
+
+        bool ser_set_baud_rate(SerialBaudRate baud_rate)
+        {
+            // Data already written went out at the old rate
+            this->baud_rate = baud_rate;
+            return true;
+        }
+
+        void ser_flush()
+        {
+            // Wait for 10 ms for last bits of data
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            this->rx.head.store(this->rx.head.load(std::memory_order_relaxed) + this->rx.delivered(LoopbackChannel::now_us()),
+                                std::memory_order_release);
+        }
+
+        uint32_t ser_available()
+        {
+            return this->rx.delivered(LoopbackChannel::now_us());
+        }
+
+        bool ser_read(uint8_t *out)
+        {
+            return (this->ser_read_bulk(out, 1) == 1);
+        }
+
+        uint32_t ser_read_bulk(uint8_t *buf, uint32_t max_length)
+        {
+            uint32_t length = this->ser_available();
+            if (length > max_length) length = max_length;
+
+            uint32_t h = this->rx.head.load(std::memory_order_relaxed);
+            for (uint32_t i = 0; i < length; i++) {
+                buf[i] = this->rx.data[(h + i) & (LOOPBACK_BUF_SIZE - 1)];
+            }
+            this->rx.head.store(h + length, std::memory_order_release);
+            return length;
+        }
+
+        bool ser_wait(uint32_t timeout_ms)
+        {
+            uint64_t deadline = LoopbackChannel::now_us() + (uint64_t)timeout_ms * 1000;
+            while (true) {
+                uint64_t now = LoopbackChannel::now_us();
+                if (this->rx.delivered(now) > 0) return true;
+                if (now >= deadline) return false;
+
+                // Sleep until the next byte is delivered, more data is written, or the timeout
+                uint64_t wake = deadline;
+                uint64_t next = this->rx.next_deliver_us();
+                if (next != 0 && next < wake) wake = next;
+
+                std::unique_lock<std::mutex> lock(this->rx.wait_mutex);
+                if (next == 0 && this->rx.next_deliver_us() != 0) continue;
+                this->rx.wait_cond.wait_for(lock, std::chrono::microseconds(wake - now));
+            }
+        }
+
+        bool ser_write(uint8_t *data, uint32_t length)
+        {
+            SerialIOVec iov = { .data = data, .length = length };
+            return this->ser_writev(&iov, 1);
+        }
+
+        bool ser_writev(const SerialIOVec *iov, uint32_t count)
+        {
+            uint32_t rate = this->baud_rate;
+            uint64_t byte_us = (rate > 0 ? (LOOPBACK_BITS_PER_BYTE * 1000000ULL + rate - 1) / rate : 0);
+            bool garble = (this->peer != nullptr && this->peer->baud_rate != rate);
+            uint64_t now = LoopbackChannel::now_us();
+
+            for (uint32_t i = 0; i < count; i++) {
+                for (uint32_t j = 0; j < iov[i].length; j++) {
+                    this->transmit(iov[i].data[j], now, byte_us, garble);
+                }
+            }
+            this->tx.wake();
+            return true;
+        }
+
+        void ser_disconnect()
+        {
+            // Nothing to do
+        }
+
+        uint64_t platform_millis()
+        {
+            return LoopbackChannel::now_us() / 1000;
+        }
+};
+
+/**
+ * @class LoopbackSerialPair
+ *
+ * @brief Two SerialDevices connected to each other in memory
+ *
+ * Everything written to host is read from controller and vice versa, so a host and a
+ * controller protocol stack can run against each other in two threads of one process.
+ * Data written while the two ends are at different baud rates arrives as noise.
+ */
+class LoopbackSerialPair
+{
+    private:
+        LoopbackConfig config;
+        LoopbackChannel to_controller;
+        LoopbackChannel to_host;
+
+    public:
+        LoopbackSerialDevice host;
+        LoopbackSerialDevice controller;
+
+        LoopbackSerialPair(const LoopbackConfig& config)
+            : config(config),
+              host(to_host, to_controller, this->config),
+              controller(to_controller, to_host, this->config)
+        {
+            this->to_controller.rng.seed(config.seed);
+            this->to_host.rng.seed(config.seed + 1);
+            this->host.set_peer(&this->controller);
+            this->controller.set_peer(&this->host);
+        }
+
+        LoopbackSerialPair() : LoopbackSerialPair(LoopbackConfig{ false, 0, 0.0, 1 }) {}
+};
+
+#endif // LOOPBACK_SERIAL_DEVICE_H
@@ -1,126 +1,523 @@
 #include "TestStandCommHost.h"
+#include "TestStandCodec.h"
 
 #include <stdio.h>
 #include <string.h>
 
 TestStandCommHost::TestStandCommHost(SerialDevice& device) : TestStandComm(device)
 {
-    // Nothing else to do
+    for (int i = 0; i < HOST_PENDING_MAX; i++) {
+        this->pending[i].in_use = false;
+    }
+    this->next_txn = 1;
+    this->best_baud_rate = SERIAL_BAUD_RATE;
+    this->telemetry_handler = nullptr;
+    this->telemetry_rate_hz = 0;
+    this->telemetry_count = 0;
+    this->position_rate_hz = 0;
+    this->position_count = 0;
+    this->position_bytes = 0;
+    this->position_skipped = 0;
+    this->log_handler = nullptr;
+    this->log_count = 0;
+    this->log_frames_malformed = 0;
 }
 
-SerialResult TestStandCommHost::get_status(Status *status_out, uint32_t timeout_ms)
+/** Baud rates tried by negotiate_baud_rate(), slowest first */
+static const SerialBaudRate negotiated_baud_rates[] = {
+    BAUD_230400,
+    BAUD_460800,
+    BAUD_500000,
+    BAUD_1000000,
+    BAUD_2000000
+};
+
+/**
+ * @brief Moves the link to the fastest baud rate that works, up to max_baud_rate
+ * 
+ * Steps up through the faster baud rates one at a time (@see TestStandComm::change_baud_rate)
+ * and stays at the last one that worked. The best baud rate found is remembered, so when
+ * reconnecting it is proposed straight away rather than stepping up again. It can be saved
+ * and restored across restarts with get_best_baud_rate() and set_best_baud_rate().
+ * 
+ * @param max_baud_rate The fastest baud rate to try
+ * @param timeout_ms    Maximum time (in milliseconds) to wait for each response
+ * 
+ * @return SERIAL_OK if the link works (at whichever baud rate, @see baud_rate())
+ *         @see TestStandComm::change_baud_rate(SerialBaudRate baud_rate, uint32_t timeout_ms)
+ */
+SerialResult TestStandCommHost::negotiate_baud_rate(SerialBaudRate max_baud_rate, uint32_t timeout_ms)
 {
-    SerialResult res = this->send_basic_msg(MSG_ID_GET_STATUS);
-    if (res != SERIAL_OK) return res;
+    SerialResult res;
+
+    if (this->best_baud_rate > this->baud_rate() && this->best_baud_rate <= max_baud_rate) {
+        res = this->change_baud_rate(this->best_baud_rate, timeout_ms);
+        if (res == SERIAL_OK) return SERIAL_OK;
+        if (res != SERIAL_ERR_REJECTED) return res;
+    }
+
+    for (size_t i = 0; i < sizeof(negotiated_baud_rates) / sizeof(negotiated_baud_rates[0]); i++) {
+        SerialBaudRate baud_rate = negotiated_baud_rates[i];
+        if (baud_rate <= this->baud_rate()) continue;
+        if (baud_rate > max_baud_rate) break;
+
+        res = this->change_baud_rate(baud_rate, timeout_ms);
+        if (res == SERIAL_ERR_REJECTED) break;
+        if (res != SERIAL_OK) return res;
+    }
+
+    this->best_baud_rate = this->baud_rate();
+    return SERIAL_OK;
+}
+
+/**
+ * @return The fastest baud rate negotiate_baud_rate() found to work (SERIAL_BAUD_RATE until
+ *         it has run), to be restored with set_best_baud_rate() after a restart
+ */
+SerialBaudRate TestStandCommHost::get_best_baud_rate()
+{
+    return this->best_baud_rate;
+}
+
+/**
+ * @brief Sets the baud rate negotiate_baud_rate() proposes first
+ * 
+ * If the link no longer works at this rate, negotiate_baud_rate() steps up from the current
+ * baud rate as usual.
+ * 
+ * @param baud_rate A baud rate saved from get_best_baud_rate()
+ * 
+ * @return true if baud_rate is one negotiate_baud_rate() may use, otherwise false (and the
+ *         best baud rate is left as it was)
+ */
+bool TestStandCommHost::set_best_baud_rate(SerialBaudRate baud_rate)
+{
+    for (size_t i = 0; i < sizeof(negotiated_baud_rates) / sizeof(negotiated_baud_rates[0]); i++) {
+        if (negotiated_baud_rates[i] == baud_rate) {
+            this->best_baud_rate = baud_rate;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Looks up an outstanding request by its correlation ID
+ * 
+ * @return The matching entry in the pending-request table or nullptr if there is none
+ */
+TestStandCommHost::PendingRequest *TestStandCommHost::find_pending(uint8_t txn)
+{
+    for (int i = 0; i < HOST_PENDING_MAX; i++) {
+        if (this->pending[i].in_use && this->pending[i].txn == txn) return &this->pending[i];
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Finds the outstanding request that a received message is a reply to
+ * 
+ * Devices that do not echo correlation IDs send replies with an ID of 0, those are matched
+ * on the reply message ID instead (only one request is ever outstanding in that case).
+ * Extended messages are never replies.
+ * 
+ * @return The matching entry in the pending-request table or nullptr if there is none
+ */
+TestStandCommHost::PendingRequest *TestStandCommHost::match_reply(Message& msg)
+{
+    if (msg.extended) return nullptr;
+
+    if (msg.txn != 0) {
+        PendingRequest *req = this->find_pending(msg.txn);
+        return (req != nullptr && !req->replied) ? req : nullptr;
+    }
+
+    for (int i = 0; i < HOST_PENDING_MAX; i++) {
+        PendingRequest& req = this->pending[i];
+        if (req.in_use && !req.replied && req.reply_id == msg.id) return &req;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Holds on to a reply that arrived while waiting for something else, for whoever
+ *        is waiting on it
+ */
+void TestStandCommHost::hold_reply(PendingRequest *req, Message& msg)
+{
+    req->replied = true;
+    req->id = msg.id;
+    req->length = msg.length;
+    memcpy(req->data, msg.data, msg.length);
+}
+
+/**
+ * @brief Takes telemetry, the position stream and log entries as they arrive, while waiting
+ *        for a reply or from poll()
+ * 
+ * @return true if the message was streamed by the device
+ */
+bool TestStandCommHost::handle_unsolicited(Message& msg)
+{
+    if (msg.extended) return false;
+    if (msg.id == MSG_ID_POSITION_STREAM) {
+        this->handle_position_stream(msg);
+        return true;
+    }
+    if (msg.id == MSG_ID_LOG) {
+        this->handle_log(msg);
+        return true;
+    }
+    if (msg.id != MSG_ID_TELEMETRY) return false;
+
+    TelemetryMsgData data;
+    if (codec_decode<MSG_ID_TELEMETRY>(msg, &data) != SERIAL_OK) return true;
+
+    this->telemetry_count++;
+    if (this->telemetry_handler != nullptr) this->telemetry_handler->telemetry(data);
+    return true;
+}
+
+/**
+ * @brief Sends a request and adds it to the pending-request table
+ * 
+ * @param msg      The request to send (its correlation ID is filled in)
+ * @param reply_id The message ID of the expected reply
+ * @param txn_out  Where to store the correlation ID to pass to recv_reply()
+ * 
+ * @return SERIAL_ERR_BUSY if HOST_PENDING_MAX requests are outstanding, or if one is
+ *                         outstanding and the link is stop-and-wait
+ *         @see SerialSession::send_message(Message& msg)
+ */
+SerialResult TestStandCommHost::request(Message& msg, uint8_t reply_id, uint8_t *txn_out)
+{
+    PendingRequest *req = nullptr;
+    for (int i = 0; i < HOST_PENDING_MAX; i++) {
+        if (this->pending[i].in_use) {
+            // On a stop-and-wait link the reply would arrive while waiting for the next ACK
+            if (this->window_size() == 0) return SERIAL_ERR_BUSY;
+        }
+        else if (req == nullptr) {
+            req = &this->pending[i];
+        }
+    }
+    if (req == nullptr) return SERIAL_ERR_BUSY;
+
+    // Skip 0 (no correlation ID) and IDs of requests that are still outstanding
+    while (this->next_txn == 0 || this->find_pending(this->next_txn) != nullptr) {
+        this->next_txn++;
+    }
+    msg.txn = this->next_txn++;
+
+    req->in_use = true;
+    req->replied = false;
+    req->txn = msg.txn;
+    req->reply_id = reply_id;
+
+    SerialResult res = this->session.send_message(msg);
+    if (res != SERIAL_OK) {
+        req->in_use = false;
+        return res;
+    }
+
+    *txn_out = msg.txn;
+    return SERIAL_OK;
+}
+
+/**
+ * @brief Waits for the reply to an outstanding request
+ * 
+ * Replies to other outstanding requests that arrive first are stored in the pending-request
+ * table and telemetry is handed to the TelemetryHandler. Other messages that do not answer
+ * any outstanding request (e.g. late replies to cancelled requests) are discarded. The
+ * request is removed from the table whether or not a reply was received.
+ * 
+ * @param txn           The correlation ID returned by request()
+ * @param expect_length The expected data length of the reply
+ * @param timeout_ms    Maximum time (in milliseconds) to wait for the reply
+ * 
+ * @return SERIAL_OK if the reply was received, it is then available in received_message()
+ *         SERIAL_ERR_NO_MSG if there is no outstanding request with that correlation ID
+ *         SERIAL_ERR_WRONG_MSG if the reply ID does not match the one given to request()
+ *         SERIAL_ERR_DATA_LENGTH if the reply data length does not match expect_length
+ *         @see SerialSession::recv_message(uint32_t timeout_ms)
+ */
+SerialResult TestStandCommHost::recv_reply(uint8_t txn, uint8_t expect_length, uint32_t timeout_ms)
+{
+    PendingRequest *req = this->find_pending(txn);
+    if (req == nullptr) return SERIAL_ERR_NO_MSG;
+
+    Message& msg = this->received_message();
+    if (req->replied) {
+        // The reply arrived while waiting on another request
+        msg.id = req->id;
+        msg.length = req->length;
+        msg.txn = req->txn;
+        memcpy(msg.data, req->data, req->length);
+    }
+    else {
+        uint64_t time_start = this->platform_millis();
+        while (true) {
+            uint64_t elapsed = this->platform_millis() - time_start;
+            if (elapsed >= timeout_ms) {
+                req->in_use = false;
+                return SERIAL_ERR_TIMEOUT;
+            }
+
+            SerialResult res = this->session.recv_message(timeout_ms - elapsed);
+            if (res == SERIAL_ERR_TIMEOUT) continue;
+            if (res != SERIAL_OK) {
+                req->in_use = false;
+                return res;
+            }
+
+            PendingRequest *match = this->match_reply(msg);
+            if (match == req) break;
+            if (match == nullptr) {
+                this->handle_unsolicited(msg);
+                continue;
+            }
+            this->hold_reply(match, msg);
+        }
+    }
+    req->in_use = false;
 
-    res = this->recv_message(MSG_ID_STATUS, 1, timeout_ms);
+    if (msg.id != req->reply_id) return SERIAL_ERR_WRONG_MSG;
+    if (msg.length != expect_length) return SERIAL_ERR_DATA_LENGTH;
+    return SERIAL_OK;
+}
+
+/**
+ * @brief Removes a request from the pending-request table without waiting for its reply
+ * 
+ * @param txn The correlation ID returned by request()
+ */
+void TestStandCommHost::cancel(uint8_t txn)
+{
+    PendingRequest *req = this->find_pending(txn);
+    if (req != nullptr) req->in_use = false;
+}
+
+/**
+ * @brief Takes in every message that has already arrived, without waiting
+ * 
+ * Replies are held for recv_reply() and telemetry is handed to the TelemetryHandler. While
+ * subscribed to telemetry, call this whenever nothing else is using the link, so the samples
+ * are taken in (and acknowledged) as they arrive.
+ * 
+ * @return SERIAL_OK unless receiving failed, @see SerialSession::check_for_message()
+ */
+SerialResult TestStandCommHost::poll()
+{
+    SerialResult res;
+    while ((res = this->check_for_message()) != SERIAL_OK_NO_MSG) {
+        if (res != SERIAL_OK) return res;
+
+        Message& msg = this->received_message();
+        PendingRequest *match = this->match_reply(msg);
+        if (match != nullptr) {
+            this->hold_reply(match, msg);
+        }
+        else {
+            this->handle_unsolicited(msg);
+        }
+    }
+    return SERIAL_OK;
+}
+
+SerialResult TestStandCommHost::request_status(uint8_t *txn_out)
+{
+    Message msg = {
+        .id = MSG_ID_GET_STATUS,
+        .length = 0,
+        .data = nullptr
+    };
+    return this->request(msg, MSG_ID_STATUS, txn_out);
+}
+
+SerialResult TestStandCommHost::recv_status(uint8_t txn, Status *status_out, uint32_t timeout_ms)
+{
+    SerialResult res = this->recv_reply(txn, 1, timeout_ms);
     if (res != SERIAL_OK) return res;
 
     *status_out = (Status)((this->received_message().data)[0]);
     return SERIAL_OK;
 }
 
+SerialResult TestStandCommHost::get_status(Status *status_out, uint32_t timeout_ms)
+{
+    uint8_t txn;
+    SerialResult res = this->request_status(&txn);
+    if (res != SERIAL_OK) return res;
+
+    return this->recv_status(txn, status_out, timeout_ms);
+}
+
 SerialResult TestStandCommHost::home()
 {
-    return this->send_basic_msg(MSG_ID_HOME);
+    SerialResult res = this->send_basic_msg(MSG_ID_HOME);
+    if (res != SERIAL_OK) return res;
+
+    // Nothing comes back, so make sure the command was received before reporting success
+    return this->wait_acked();
 }
 
-SerialResult TestStandCommHost::move(AxisId axis, AxisDirection dir, uint32_t vel_hold, uint32_t dist_counts, AxisResult *res_out, uint32_t timeout_ms)
+SerialResult TestStandCommHost::request_move(AxisId axis, AxisDirection dir, uint32_t vel_hold, uint32_t dist_counts, uint8_t *txn_out)
 {
-    // Send move message
     MoveMsgData data = {
-        .vel_hold = (uint32_t)htonl(vel_hold),
-        .dist_counts = (uint32_t)htonl(dist_counts),
+        .vel_hold = vel_hold,
+        .dist_counts = dist_counts,
         .axis = (uint8_t)axis,
         .dir = (uint8_t)dir
     };
 
-    Message msg = {
-        .id = MSG_ID_MOVE,
-        .length = sizeof(data),
-        .data = (uint8_t *)&data
-    };
-    
-    SerialResult res = this->session.send_message(msg);
-    if (res != SERIAL_OK) return res;
+    uint8_t buf[codec_length<MSG_ID_MOVE>()];
+    Message msg = codec_encode<MSG_ID_MOVE>(data, buf);
+    return this->request(msg, MSG_ID_AXIS_RESULT, txn_out);
+}
 
-    // Get result
-    res = this->recv_message(MSG_ID_AXIS_RESULT, 1, timeout_ms);
+SerialResult TestStandCommHost::recv_move(uint8_t txn, AxisResult *res_out, uint32_t timeout_ms)
+{
+    SerialResult res = this->recv_reply(txn, 1, timeout_ms);
     if (res != SERIAL_OK) return res;
 
     *res_out = (AxisResult)((this->received_message().data)[0]);
     return SERIAL_OK;
 }
 
+SerialResult TestStandCommHost::move(AxisId axis, AxisDirection dir, uint32_t vel_hold, uint32_t dist_counts, AxisResult *res_out, uint32_t timeout_ms)
+{
+    uint8_t txn;
+    SerialResult res = this->request_move(axis, dir, vel_hold, dist_counts, &txn);
+    if (res != SERIAL_OK) return res;
+
+    return this->recv_move(txn, res_out, timeout_ms);
+}
+
 SerialResult TestStandCommHost::stop()
 {
-    return this->send_basic_msg(MSG_ID_STOP);
+    SerialResult res = this->send_basic_msg(MSG_ID_STOP);
+    if (res != SERIAL_OK) return res;
+
+    // Nothing comes back, so make sure the command was received before reporting success
+    return this->wait_acked();
 }
 
-SerialResult TestStandCommHost::get_position(PositionMsgData *position_out, uint32_t timeout_ms)
+SerialResult TestStandCommHost::request_position(uint8_t *txn_out)
 {
-    SerialResult res = this->send_basic_msg(MSG_ID_GET_POSITION);
+    Message msg = {
+        .id = MSG_ID_GET_POSITION,
+        .length = 0,
+        .data = nullptr
+    };
+    return this->request(msg, MSG_ID_POSITION, txn_out);
+}
+
+SerialResult TestStandCommHost::recv_position(uint8_t txn, PositionMsgData *position_out, uint32_t timeout_ms)
+{
+    SerialResult res = this->recv_reply(txn, codec_length<MSG_ID_POSITION>(), timeout_ms);
     if (res != SERIAL_OK) return res;
 
-    res = this->recv_message(MSG_ID_POSITION, sizeof(PositionMsgData), timeout_ms);
+    return codec_decode<MSG_ID_POSITION>(this->received_message(), position_out);
+}
+
+SerialResult TestStandCommHost::get_position(PositionMsgData *position_out, uint32_t timeout_ms)
+{
+    uint8_t txn;
+    SerialResult res = this->request_position(&txn);
     if (res != SERIAL_OK) return res;
 
-    // Copy message data into output struct
-    memcpy(position_out, this->received_message().data, sizeof(PositionMsgData));
-    // Fixup byte order
-    position_out->x_counts = ntohl(position_out->x_counts);
-    position_out->y_counts = ntohl(position_out->y_counts);
+    return this->recv_position(txn, position_out, timeout_ms);
+}
 
-    return SERIAL_OK;
+SerialResult TestStandCommHost::request_temp(uint8_t *txn_out)
+{
+    Message msg = {
+        .id = MSG_ID_GET_TEMP,
+        .length = 0,
+        .data = nullptr
+    };
+    return this->request(msg, MSG_ID_TEMP, txn_out);
 }
 
-SerialResult TestStandCommHost::get_temp(TempData *temp_out, uint32_t timeout_ms)
+SerialResult TestStandCommHost::recv_temp(uint8_t txn, TempData *temp_out, uint32_t timeout_ms)
 {
-    SerialResult res = this->send_basic_msg(MSG_ID_GET_TEMP);
+    SerialResult res = this->recv_reply(txn, codec_length<MSG_ID_TEMP>(), timeout_ms);
     if (res != SERIAL_OK) return res;
 
-    res = this->recv_message(MSG_ID_TEMP, sizeof(TempMsgData), timeout_ms);
-    if (res != SERIAL_OK) return res;
+    return codec_decode<MSG_ID_TEMP>(this->received_message(), temp_out);
+}
 
-    // Copy message data into output struct
-    TempMsgData msg_data;
-    memcpy(&msg_data, this->received_message().data, sizeof(TempMsgData));
-    // Fixup byte order and re-scale
-    temp_out->temp_ambient = (double)ntohl(msg_data.temp_ambient) / temp_data_scaler;
-    temp_out->temp_motor_x = (double)ntohl(msg_data.temp_motor_x) / temp_data_scaler;
-    temp_out->temp_motor_y = (double)ntohl(msg_data.temp_motor_y) / temp_data_scaler;
-    temp_out->temp_mpmt    = (double)ntohl(msg_data.temp_mpmt) / temp_data_scaler;
-    temp_out->temp_optical = (double)ntohl(msg_data.temp_optical) / temp_data_scaler;
+SerialResult TestStandCommHost::get_temp(TempData *temp_out, uint32_t timeout_ms)
+{
+    uint8_t txn;
+    SerialResult res = this->request_temp(&txn);
+    if (res != SERIAL_OK) return res;
 
-    return SERIAL_OK;
+    return this->recv_temp(txn, temp_out, timeout_ms);
 }
 
-SerialResult TestStandCommHost::get_axis_state(StateMsgData *status_out, uint32_t timeout_ms)
+SerialResult TestStandCommHost::request_axis_state(uint8_t *txn_out)
 {
-  printf("Got into get_axis_state\n");
+    Message msg = {
+        .id = MSG_ID_GET_AXIS_STATE,
+        .length = 0,
+        .data = nullptr
+    };
+    return this->request(msg, MSG_ID_AXIS_STATE, txn_out);
+}
 
-    SerialResult res = this->send_basic_msg(MSG_ID_GET_AXIS_STATE);
+SerialResult TestStandCommHost::recv_axis_state(uint8_t txn, AxisStateData *state_out, uint32_t timeout_ms)
+{
+    SerialResult res = this->recv_reply(txn, codec_length<MSG_ID_AXIS_STATE>(), timeout_ms);
     if (res != SERIAL_OK) return res;
 
-    res = this->recv_message(MSG_ID_AXIS_STATE, sizeof(StateMsgData), timeout_ms);
+    return codec_decode<MSG_ID_AXIS_STATE>(this->received_message(), state_out);
+}
+
+SerialResult TestStandCommHost::get_axis_state(AxisStateData *state_out, uint32_t timeout_ms)
+{
+    uint8_t txn;
+    SerialResult res = this->request_axis_state(&txn);
     if (res != SERIAL_OK) return res;
 
-    // Copy message data into output struct
-    //    StateMsgData msg_data;
-    memcpy(status_out, this->received_message().data, sizeof(StateMsgData));
+    return this->recv_axis_state(txn, state_out, timeout_ms);
+}
+
+SerialResult TestStandCommHost::request_snapshot(uint8_t *txn_out)
+{
+    Message msg = {
+        .id = MSG_ID_GET_SNAPSHOT,
+        .length = 0,
+        .data = nullptr
+    };
+    return this->request(msg, MSG_ID_SNAPSHOT, txn_out);
+}
 
-    //    printf("%i %i %i %i %i %i \n",msg_data.x_motion,msg_data.y_motion,msg_data.x_ls_far, msg_data.y_ls_far
-    //	   ,msg_data.x_ls_home, msg_data.y_ls_home);
-    // Fixup byte order and re-scale
-    //    temp_out.x_motion = 
+/**
+ * @brief Waits for the status, position, axis state and temperatures of the device
+ * 
+ * @param txn          The correlation ID returned by request_snapshot()
+ * @param snapshot_out Pointer to a struct where the readings will be stored
+ * @param timeout_ms   Maximum time (in milliseconds) to wait for the reply
+ * 
+ * @return @see recv_reply(uint8_t txn, uint8_t expect_length, uint32_t timeout_ms)
+ */
+SerialResult TestStandCommHost::recv_snapshot(uint8_t txn, Snapshot *snapshot_out, uint32_t timeout_ms)
+{
+    SerialResult res = this->recv_reply(txn, codec_length<MSG_ID_SNAPSHOT>(), timeout_ms);
+    if (res != SERIAL_OK) return res;
 
-    //    temp_out->temp_ambient = (double)ntohl(msg_data.temp_ambient) / temp_data_scaler;
-    //temp_out->temp_motor_x = (double)ntohl(msg_data.temp_motor_x) / temp_data_scaler;
-    //temp_out->temp_motor_y = (double)ntohl(msg_data.temp_motor_y) / temp_data_scaler;
-    //temp_out->temp_mpmt    = (double)ntohl(msg_data.temp_mpmt) / temp_data_scaler;
-    //temp_out->temp_optical = (double)ntohl(msg_data.temp_optical) / temp_data_scaler;
+    return codec_decode<MSG_ID_SNAPSHOT>(this->received_message(), snapshot_out);
+}
 
-    return SERIAL_OK;
+SerialResult TestStandCommHost::get_snapshot(Snapshot *snapshot_out, uint32_t timeout_ms)
+{
+    uint8_t txn;
+    SerialResult res = this->request_snapshot(&txn);
+    if (res != SERIAL_OK) return res;
+
+    return this->recv_snapshot(txn, snapshot_out, timeout_ms);
 }
 
 SerialResult TestStandCommHost::calibrate(CalibrationKey key, void *value)
@@ -132,22 +529,14 @@ SerialResult TestStandCommHost::calibrate(CalibrationKey key, void *value)
         case CAL_GANTRY_ACCEL:
         case CAL_GANTRY_VEL_START:
         case CAL_GANTRY_VEL_HOME:
-        {
-            uint32_t value_conv = htonl(*(uint32_t *)value);
-            value_size = sizeof(value_conv);
-            memcpy(&this->send_buf[1], &value_conv, value_size);
+            value_size = codec_put(&this->send_buf[1], *(uint32_t *)value);
             break;
-        }
         case CAL_TEMP_ALL_C1:
         case CAL_TEMP_ALL_C2:
         case CAL_TEMP_ALL_C3:
         case CAL_TEMP_ALL_RESISTOR:
-        {
-            double value_conv = htond(*(double *)value);
-            value_size = sizeof(value_conv);
-            memcpy(&this->send_buf[1], &value_conv, value_size);
+            value_size = codec_put(&this->send_buf[1], *(double *)value);
             break;
-        }
         default:
             value_size = 0;
     }
@@ -158,5 +547,278 @@ SerialResult TestStandCommHost::calibrate(CalibrationKey key, void *value)
         .data = this->send_buf
     };
 
-    return this->session.send_message(msg);
+    SerialResult res = this->session.send_message(msg);
+    if (res != SERIAL_OK) return res;
+    return this->wait_acked();
+}
+
+SerialResult TestStandCommHost::request_link_stats(uint8_t *txn_out)
+{
+    Message msg = {
+        .id = MSG_ID_GET_LINK_STATS,
+        .length = 0,
+        .data = nullptr
+    };
+    return this->request(msg, MSG_ID_LINK_STATS, txn_out);
+}
+
+/**
+ * @brief Waits for the link health counters of the other end of the link
+ * 
+ * @param txn        The correlation ID returned by request_link_stats()
+ * @param stats_out  Pointer to a struct where the counters will be stored
+ * @param timeout_ms Maximum time (in milliseconds) to wait for the reply
+ * 
+ * @return @see recv_reply(uint8_t txn, uint8_t expect_length, uint32_t timeout_ms)
+ */
+SerialResult TestStandCommHost::recv_link_stats(uint8_t txn, LinkStats *stats_out, uint32_t timeout_ms)
+{
+    SerialResult res = this->recv_reply(txn, sizeof(LinkStats), timeout_ms);
+    if (res != SERIAL_OK) return res;
+
+    // Copy message data into output struct
+    memcpy(stats_out, this->received_message().data, sizeof(LinkStats));
+    // Fixup byte order
+    uint32_t *words = (uint32_t *)stats_out;
+    for (size_t i = 0; i < sizeof(LinkStats) / sizeof(uint32_t); i++) {
+        words[i] = ntohl(words[i]);
+    }
+
+    return SERIAL_OK;
+}
+
+SerialResult TestStandCommHost::get_link_stats(LinkStats *stats_out, uint32_t timeout_ms)
+{
+    uint8_t txn;
+    SerialResult res = this->request_link_stats(&txn);
+    if (res != SERIAL_OK) return res;
+
+    return this->recv_link_stats(txn, stats_out, timeout_ms);
+}
+
+/**
+ * @brief Sets what receives the telemetry samples (nullptr to only count them)
+ */
+void TestStandCommHost::set_telemetry_handler(TelemetryHandler *handler)
+{
+    this->telemetry_handler = handler;
+}
+
+SerialResult TestStandCommHost::request_telemetry(uint16_t rate_hz, uint8_t *txn_out)
+{
+    uint8_t buf[codec_length<MSG_ID_SET_TELEMETRY>()];
+    Message msg = codec_encode<MSG_ID_SET_TELEMETRY>(rate_hz, buf);
+    return this->request(msg, MSG_ID_TELEMETRY_RATE, txn_out);
+}
+
+/**
+ * @brief Waits for the device to confirm the telemetry rate
+ * 
+ * @param txn         The correlation ID returned by request_telemetry()
+ * @param rate_hz_out Where to store the rate the device streams at (0 if it does not)
+ * @param timeout_ms  Maximum time (in milliseconds) to wait for the reply
+ * 
+ * @return @see recv_reply(uint8_t txn, uint8_t expect_length, uint32_t timeout_ms)
+ */
+SerialResult TestStandCommHost::recv_telemetry_rate(uint8_t txn, uint16_t *rate_hz_out, uint32_t timeout_ms)
+{
+    SerialResult res = this->recv_reply(txn, codec_length<MSG_ID_TELEMETRY_RATE>(), timeout_ms);
+    if (res != SERIAL_OK) return res;
+
+    res = codec_decode<MSG_ID_TELEMETRY_RATE>(this->received_message(), rate_hz_out);
+    if (res == SERIAL_OK) this->telemetry_rate_hz = *rate_hz_out;
+    return res;
+}
+
+/**
+ * @brief Asks the device to stream telemetry
+ * 
+ * The device only streams on a windowed link (@see TestStandComm::negotiate) and caps the
+ * rate at TELEMETRY_RATE_MAX. Renegotiating the link or its baud rate unsubscribes.
+ * 
+ * @param rate_hz     Samples per second
+ * @param rate_hz_out Where to store the rate the device streams at
+ * @param timeout_ms  Maximum time (in milliseconds) to wait for the reply
+ * 
+ * @return SERIAL_OK if the device is streaming
+ *         SERIAL_ERR_REJECTED if the device refused to stream
+ *         @see recv_telemetry_rate(uint8_t txn, uint16_t *rate_hz_out, uint32_t timeout_ms)
+ */
+SerialResult TestStandCommHost::subscribe_telemetry(uint16_t rate_hz, uint16_t *rate_hz_out, uint32_t timeout_ms)
+{
+    uint8_t txn;
+    SerialResult res = this->request_telemetry(rate_hz, &txn);
+    if (res != SERIAL_OK) return res;
+
+    res = this->recv_telemetry_rate(txn, rate_hz_out, timeout_ms);
+    if (res != SERIAL_OK) return res;
+    return (rate_hz > 0 && *rate_hz_out == 0) ? SERIAL_ERR_REJECTED : SERIAL_OK;
+}
+
+SerialResult TestStandCommHost::unsubscribe_telemetry(uint32_t timeout_ms)
+{
+    uint16_t rate_hz;
+    return this->subscribe_telemetry(0, &rate_hz, timeout_ms);
+}
+
+/**
+ * @return The rate the device last confirmed it streams telemetry at (0 if not subscribed)
+ */
+uint16_t TestStandCommHost::telemetry_rate()
+{
+    return this->telemetry_rate_hz;
+}
+
+/**
+ * @return The number of telemetry samples received
+ */
+uint32_t TestStandCommHost::telemetry_received()
+{
+    return this->telemetry_count;
+}
+
+/**
+ * @brief Decodes a frame of the position stream and hands its samples to the TelemetryHandler
+ * 
+ * Frames that cannot be decoded (received before the first key frame or malformed) are
+ * counted, the decoder picks up again at the next key frame.
+ */
+void TestStandCommHost::handle_position_stream(Message& msg)
+{
+    PositionSample samples[POSITION_STREAM_BATCH];
+    uint8_t count;
+    if (this->position_decoder.decode(msg.data, msg.length, samples, &count) != SERIAL_OK) {
+        this->position_skipped++;
+        return;
+    }
+
+    this->position_count += count;
+    this->position_bytes += msg.length;
+    if (this->telemetry_handler == nullptr) return;
+    for (uint8_t i = 0; i < count; i++) {
+        this->telemetry_handler->position(samples[i]);
+    }
+}
+
+SerialResult TestStandCommHost::request_position_stream(uint16_t rate_hz, uint8_t *txn_out)
+{
+    uint8_t buf[codec_length<MSG_ID_SET_POSITION_STREAM>()];
+    Message msg = codec_encode<MSG_ID_SET_POSITION_STREAM>(rate_hz, buf);
+    return this->request(msg, MSG_ID_POSITION_STREAM_RATE, txn_out);
+}
+
+/**
+ * @brief Waits for the device to confirm the position stream rate
+ * 
+ * The stream starts over with a key frame, so the decoder waits for one.
+ * 
+ * @return @see recv_telemetry_rate(uint8_t txn, uint16_t *rate_hz_out, uint32_t timeout_ms)
+ */
+SerialResult TestStandCommHost::recv_position_stream_rate(uint8_t txn, uint16_t *rate_hz_out, uint32_t timeout_ms)
+{
+    SerialResult res = this->recv_reply(txn, codec_length<MSG_ID_POSITION_STREAM_RATE>(), timeout_ms);
+    if (res != SERIAL_OK) return res;
+
+    res = codec_decode<MSG_ID_POSITION_STREAM_RATE>(this->received_message(), rate_hz_out);
+    if (res == SERIAL_OK) {
+        this->position_rate_hz = *rate_hz_out;
+        this->position_decoder.reset();
+    }
+    return res;
+}
+
+/**
+ * @brief Asks the device to stream its encoder positions
+ * 
+ * The samples are batched and delta encoded (@see PositionStream.h), so the device can
+ * stream several hundred per second. Like telemetry, the device only streams on a windowed
+ * link, and renegotiating the link or its baud rate unsubscribes. The rate is capped at
+ * POSITION_STREAM_RATE_MAX.
+ * 
+ * @return @see subscribe_telemetry(uint16_t rate_hz, uint16_t *rate_hz_out, uint32_t timeout_ms)
+ */
+SerialResult TestStandCommHost::subscribe_position_stream(uint16_t rate_hz, uint16_t *rate_hz_out, uint32_t timeout_ms)
+{
+    uint8_t txn;
+    SerialResult res = this->request_position_stream(rate_hz, &txn);
+    if (res != SERIAL_OK) return res;
+
+    res = this->recv_position_stream_rate(txn, rate_hz_out, timeout_ms);
+    if (res != SERIAL_OK) return res;
+    return (rate_hz > 0 && *rate_hz_out == 0) ? SERIAL_ERR_REJECTED : SERIAL_OK;
+}
+
+SerialResult TestStandCommHost::unsubscribe_position_stream(uint32_t timeout_ms)
+{
+    uint16_t rate_hz;
+    return this->subscribe_position_stream(0, &rate_hz, timeout_ms);
+}
+
+/**
+ * @return The rate the device last confirmed it streams positions at (0 if not subscribed)
+ */
+uint16_t TestStandCommHost::position_stream_rate()
+{
+    return this->position_rate_hz;
+}
+
+/**
+ * @return The number of position samples received
+ */
+uint32_t TestStandCommHost::positions_received()
+{
+    return this->position_count;
+}
+
+/**
+ * @return The number of bytes of position stream data the samples were decoded from
+ */
+uint32_t TestStandCommHost::position_stream_bytes()
+{
+    return this->position_bytes;
+}
+
+/**
+ * @return The number of position stream frames that could not be decoded
+ */
+uint32_t TestStandCommHost::position_frames_skipped()
+{
+    return this->position_skipped;
+}
+
+/**
+ * @brief Decodes a MSG_ID_LOG frame and hands its entries to the LogHandler
+ * 
+ * Entries before a malformed one are still handed on, the frame is counted as skipped.
+ */
+void TestStandCommHost::handle_log(Message& msg)
+{
+    LogFrameReader reader(msg.data, msg.length);
+    LogEntry entry;
+    while (reader.next(&entry)) {
+        this->log_count++;
+        if (this->log_handler != nullptr) this->log_handler->log(entry);
+    }
+    if (reader.error()) this->log_frames_malformed++;
+}
+
+void TestStandCommHost::set_log_handler(LogHandler *handler)
+{
+    this->log_handler = handler;
+}
+
+/**
+ * @return The number of log entries received
+ */
+uint32_t TestStandCommHost::logs_received()
+{
+    return this->log_count;
+}
+
+/**
+ * @return The number of MSG_ID_LOG frames that were malformed
+ */
+uint32_t TestStandCommHost::log_frames_skipped()
+{
+    return this->log_frames_malformed;
 }
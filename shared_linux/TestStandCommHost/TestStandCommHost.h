@@ -3,6 +3,9 @@
 
 #include "TestStandComm.h"
 #include "TestStandMessages.h"
+#include "TestStandCodec.h"
+#include "PositionStream.h"
+#include "BinaryLog.h"
 
 #include "Gantry.h"
 #include "TemperatureDAQ.h"
@@ -11,24 +14,164 @@
 
 #include "shared_defs.h"
 
+/** Maximum number of requests that can be waiting for a reply at once */
+#define HOST_PENDING_MAX 8
+
+/**
+ * @class TelemetryHandler
+ * 
+ * @brief Receives the telemetry the device streams (@see TestStandCommHost::subscribe_telemetry)
+ */
+class TelemetryHandler
+{
+    public:
+        virtual ~TelemetryHandler() {}
+
+        /**
+         * @brief Called for every sample, from whichever thread is using the TestStandCommHost
+         */
+        virtual void telemetry(const TelemetryMsgData& data) = 0;
+
+        /**
+         * @brief Called for every sample of the position stream (@see
+         *        TestStandCommHost::subscribe_position_stream), in the same way
+         */
+        virtual void position(const PositionSample& sample) {}
+};
+
+/**
+ * @class LogHandler
+ * 
+ * @brief Receives the entries the device logs (@see TestStandCommHost::set_log_handler)
+ */
+class LogHandler
+{
+    public:
+        virtual ~LogHandler() {}
+
+        /**
+         * @brief Called for every entry, in the same way as TelemetryHandler::telemetry
+         * 
+         * @see log_entry_format(const LogEntry& entry, char *buf, size_t size)
+         */
+        virtual void log(const LogEntry& entry) = 0;
+};
+
 /**
  * @class TestStandCommHost
  * 
  * @brief Extension of TestStandComm to implement the host-side application layer
+ * 
+ * Queries can be split into a request_*() call, which sends the request and returns its
+ * correlation ID, and a recv_*() call, which waits for the reply with that ID. Replies to
+ * other outstanding requests that arrive in the meantime are kept in a pending-request
+ * table until they are asked for, so several queries can be in flight at once when the
+ * link is windowed (@see TestStandComm::negotiate). On a stop-and-wait link only one
+ * request can be outstanding.
+ * 
+ * Telemetry and position samples the device streams are handed to the TelemetryHandler as
+ * they are received, whether that is while waiting for a reply or from poll(), and so are
+ * the log entries the device sends to the LogHandler.
  */
 class TestStandCommHost : public TestStandComm
 {
+    private:
+        typedef struct {
+            bool in_use;
+            bool replied;
+            uint8_t txn;
+            uint8_t reply_id;
+            uint8_t id;
+            uint8_t length;
+            uint8_t data[MSG_DATA_LENGTH_MAX];
+        } PendingRequest;
+
+        PendingRequest pending[HOST_PENDING_MAX];
+        uint8_t next_txn;
+
+        SerialBaudRate best_baud_rate;
+
+        TelemetryHandler *telemetry_handler;
+        uint16_t telemetry_rate_hz;
+        uint32_t telemetry_count;
+
+        PositionStreamDecoder position_decoder;
+        uint16_t position_rate_hz;
+        uint32_t position_count;
+        uint32_t position_bytes;
+        uint32_t position_skipped;
+
+        LogHandler *log_handler;
+        uint32_t log_count;
+        uint32_t log_frames_malformed;
+
+        void handle_position_stream(Message& msg);
+        void handle_log(Message& msg);
+
+        PendingRequest *find_pending(uint8_t txn);
+        PendingRequest *match_reply(Message& msg);
+        void hold_reply(PendingRequest *req, Message& msg);
+
+    protected:
+        bool handle_unsolicited(Message& msg);
+
     public:
         TestStandCommHost(SerialDevice& device);
 
+        SerialResult negotiate_baud_rate(SerialBaudRate max_baud_rate, uint32_t timeout_ms);
+        SerialBaudRate get_best_baud_rate();
+        bool set_best_baud_rate(SerialBaudRate baud_rate);
+
+        SerialResult request(Message& msg, uint8_t reply_id, uint8_t *txn_out);
+        SerialResult recv_reply(uint8_t txn, uint8_t expect_length, uint32_t timeout_ms);
+        void cancel(uint8_t txn);
+        SerialResult poll();
+
+        SerialResult request_status(uint8_t *txn_out);
+        SerialResult recv_status(uint8_t txn, Status *status_out, uint32_t timeout_ms);
         SerialResult get_status(Status *status_out, uint32_t timeout_ms);
         SerialResult home();
+        SerialResult request_move(AxisId axis, AxisDirection dir, uint32_t vel_hold, uint32_t dist_counts, uint8_t *txn_out);
+        SerialResult recv_move(uint8_t txn, AxisResult *res_out, uint32_t timeout_ms);
         SerialResult move(AxisId axis, AxisDirection dir, uint32_t vel_hold, uint32_t dist_counts, AxisResult *res_out, uint32_t timeout_ms);
         SerialResult stop();
+        SerialResult request_position(uint8_t *txn_out);
+        SerialResult recv_position(uint8_t txn, PositionMsgData *position_out, uint32_t timeout_ms);
         SerialResult get_position(PositionMsgData *position_out, uint32_t timeout_ms);
+        SerialResult request_temp(uint8_t *txn_out);
+        SerialResult recv_temp(uint8_t txn, TempData *temp_out, uint32_t timeout_ms);
         SerialResult get_temp(TempData *temp_out, uint32_t timeout_ms);
-        SerialResult get_axis_state(StateMsgData *status_out, uint32_t timeout_ms);
+        SerialResult request_axis_state(uint8_t *txn_out);
+        SerialResult recv_axis_state(uint8_t txn, AxisStateData *state_out, uint32_t timeout_ms);
+        SerialResult get_axis_state(AxisStateData *state_out, uint32_t timeout_ms);
+        SerialResult request_snapshot(uint8_t *txn_out);
+        SerialResult recv_snapshot(uint8_t txn, Snapshot *snapshot_out, uint32_t timeout_ms);
+        SerialResult get_snapshot(Snapshot *snapshot_out, uint32_t timeout_ms);
         SerialResult calibrate(CalibrationKey key, void *value);
+        SerialResult request_link_stats(uint8_t *txn_out);
+        SerialResult recv_link_stats(uint8_t txn, LinkStats *stats_out, uint32_t timeout_ms);
+        SerialResult get_link_stats(LinkStats *stats_out, uint32_t timeout_ms);
+
+        void set_telemetry_handler(TelemetryHandler *handler);
+        SerialResult request_telemetry(uint16_t rate_hz, uint8_t *txn_out);
+        SerialResult recv_telemetry_rate(uint8_t txn, uint16_t *rate_hz_out, uint32_t timeout_ms);
+        SerialResult subscribe_telemetry(uint16_t rate_hz, uint16_t *rate_hz_out, uint32_t timeout_ms);
+        SerialResult unsubscribe_telemetry(uint32_t timeout_ms);
+        uint16_t telemetry_rate();
+        uint32_t telemetry_received();
+
+        SerialResult request_position_stream(uint16_t rate_hz, uint8_t *txn_out);
+        SerialResult recv_position_stream_rate(uint8_t txn, uint16_t *rate_hz_out, uint32_t timeout_ms);
+        SerialResult subscribe_position_stream(uint16_t rate_hz, uint16_t *rate_hz_out, uint32_t timeout_ms);
+        SerialResult unsubscribe_position_stream(uint32_t timeout_ms);
+        uint16_t position_stream_rate();
+        uint32_t positions_received();
+        uint32_t position_stream_bytes();
+        uint32_t position_frames_skipped();
+
+        void set_log_handler(LogHandler *handler);
+        uint32_t logs_received();
+        uint32_t log_frames_skipped();
 };
 
 #endif // TEST_STAND_COMM_HOST_H
@@ -0,0 +1,140 @@
+#ifndef LOCK_FREE_QUEUE_H
+#define LOCK_FREE_QUEUE_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+/**
+ * @class SpscQueue
+ *
+ * @brief Bounded lock-free queue with a single producer thread and a single consumer thread
+ *
+ * @tparam T    Element type (copied in and out, so it should be trivially copyable)
+ * @tparam SIZE Number of elements that fit in the queue (must be a power of 2)
+ */
+template <typename T, uint32_t SIZE>
+class SpscQueue
+{
+    static_assert(SIZE > 0 && (SIZE & (SIZE - 1)) == 0, "SpscQueue SIZE must be a power of 2");
+
+    private:
+        T items[SIZE];
+        std::atomic<uint32_t> head; //!< Next element to pop (only written by the consumer)
+        std::atomic<uint32_t> tail; //!< Next element to push (only written by the producer)
+
+    public:
+        SpscQueue() : head(0), tail(0) {}
+
+        /**
+         * @return false if the queue is full
+         */
+        bool push(const T& item)
+        {
+            uint32_t t = this->tail.load(std::memory_order_relaxed);
+            if (t - this->head.load(std::memory_order_acquire) >= SIZE) return false;
+
+            this->items[t & (SIZE - 1)] = item;
+            this->tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @return false if the queue is empty
+         */
+        bool pop(T *out)
+        {
+            uint32_t h = this->head.load(std::memory_order_relaxed);
+            if (h == this->tail.load(std::memory_order_acquire)) return false;
+
+            *out = this->items[h & (SIZE - 1)];
+            this->head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool empty()
+        {
+            return (this->head.load(std::memory_order_acquire) == this->tail.load(std::memory_order_acquire));
+        }
+};
+
+/**
+ * @class MpscQueue
+ *
+ * @brief Bounded lock-free queue with any number of producer threads and a single consumer thread
+ *
+ * Each cell carries a sequence number saying whether it is free to write or ready to read
+ * (D. Vyukov's bounded queue). Producers claim a cell by advancing the tail with a CAS and
+ * publish it by bumping its sequence number, so a producer that is preempted part way
+ * through only holds up the consumer at that one cell.
+ *
+ * @tparam T    Element type (copied in and out, so it should be trivially copyable)
+ * @tparam SIZE Number of elements that fit in the queue (must be a power of 2)
+ */
+template <typename T, uint32_t SIZE>
+class MpscQueue
+{
+    static_assert(SIZE > 0 && (SIZE & (SIZE - 1)) == 0, "MpscQueue SIZE must be a power of 2");
+
+    private:
+        typedef struct {
+            std::atomic<uint32_t> seq;
+            T item;
+        } Cell;
+
+        Cell cells[SIZE];
+        std::atomic<uint32_t> tail; //!< Next cell to claim (written by all producers)
+        uint32_t head;              //!< Next cell to pop (only used by the consumer)
+
+    public:
+        MpscQueue() : tail(0), head(0)
+        {
+            for (uint32_t i = 0; i < SIZE; i++) {
+                this->cells[i].seq.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        /**
+         * @return false if the queue is full
+         */
+        bool push(const T& item)
+        {
+            uint32_t t = this->tail.load(std::memory_order_relaxed);
+            Cell *cell;
+            while (true) {
+                cell = &this->cells[t & (SIZE - 1)];
+                int32_t diff = (int32_t)(cell->seq.load(std::memory_order_acquire) - t);
+                if (diff == 0) {
+                    if (this->tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed)) break;
+                }
+                else if (diff < 0) {
+                    // The consumer has not freed this cell yet
+                    return false;
+                }
+                else {
+                    // Another producer claimed it first
+                    t = this->tail.load(std::memory_order_relaxed);
+                }
+            }
+
+            cell->item = item;
+            cell->seq.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @return false if the queue is empty (or the next element is still being written)
+         */
+        bool pop(T *out)
+        {
+            Cell *cell = &this->cells[this->head & (SIZE - 1)];
+            if (cell->seq.load(std::memory_order_acquire) != this->head + 1) return false;
+
+            *out = cell->item;
+            cell->seq.store(this->head + SIZE, std::memory_order_release);
+            this->head++;
+            return true;
+        }
+};
+
+#endif // LOCK_FREE_QUEUE_H
@@ -0,0 +1,321 @@
+#include "TestStandCommAsync.h"
+
+#include <string.h>
+
+/**
+ * @class CommPromise
+ *
+ * @brief Fulfils a future from the I/O thread and then deletes itself
+ */
+class CommPromise : public CommCompletionHandler
+{
+    public:
+        std::promise<CommResponse> promise;
+
+        void complete(const CommResponse& resp)
+        {
+            this->promise.set_value(resp);
+            delete this;
+        }
+};
+
+/**
+ * @return A command with the given ID and no args
+ */
+static CommCommand make_command(CommCommandId id)
+{
+    CommCommand cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.id = id;
+    return cmd;
+}
+
+/**
+ * @return A response for a command that did not run
+ */
+static CommResponse make_failed_response(const CommCommand& cmd, SerialResult res)
+{
+    CommResponse resp;
+    memset(&resp, 0, sizeof(resp));
+    resp.cmd = cmd;
+    resp.res = res;
+    return resp;
+}
+
+TestStandCommAsync::TestStandCommAsync(TestStandCommThread& thread) : thread(thread), client(thread) {}
+
+std::future<CommResponse> TestStandCommAsync::submit(CommCommand& cmd)
+{
+    CommPromise *handler = new CommPromise();
+    std::future<CommResponse> future = handler->promise.get_future();
+
+    if (this->thread.submit(cmd, handler) == 0) {
+        handler->complete(make_failed_response(cmd, SERIAL_ERR_BUSY));
+    }
+    return future;
+}
+
+bool TestStandCommAsync::submit(CommCommand& cmd, Callback callback)
+{
+    if (this->client.submit(cmd) == 0) return false;
+
+    PendingCallback pending = { .cmd = cmd, .callback = callback };
+    this->callbacks.push_back(pending);
+    return true;
+}
+
+/**
+ * @brief Runs the callbacks of the requests that have completed since the last call
+ *
+ * Must be called from the thread that made the requests. If completions were dropped
+ * (@see TestStandCommClient::dropped()) the callbacks they belonged to are run with
+ * SERIAL_ERR_NO_MSG, so every callback is run exactly once.
+ *
+ * @return The number of callbacks that were run
+ */
+uint32_t TestStandCommAsync::dispatch()
+{
+    uint32_t count = 0;
+    CommResponse resp;
+    while (this->client.poll(&resp)) {
+        // Completions arrive in order, so anything queued before this one is lost
+        while (!this->callbacks.empty() && this->callbacks.front().cmd.ticket != resp.cmd.ticket) {
+            PendingCallback lost = this->callbacks.front();
+            this->callbacks.pop_front();
+            lost.callback(make_failed_response(lost.cmd, SERIAL_ERR_NO_MSG));
+            count++;
+        }
+        if (this->callbacks.empty()) continue;
+
+        PendingCallback pending = this->callbacks.front();
+        this->callbacks.pop_front();
+        pending.callback(resp);
+        count++;
+    }
+    return count;
+}
+
+std::future<CommResponse> TestStandCommAsync::get_status()
+{
+    CommCommand cmd = make_command(COMM_CMD_GET_STATUS);
+    return this->submit(cmd);
+}
+
+bool TestStandCommAsync::get_status(Callback callback)
+{
+    CommCommand cmd = make_command(COMM_CMD_GET_STATUS);
+    return this->submit(cmd, callback);
+}
+
+std::future<CommResponse> TestStandCommAsync::get_position()
+{
+    CommCommand cmd = make_command(COMM_CMD_GET_POSITION);
+    return this->submit(cmd);
+}
+
+bool TestStandCommAsync::get_position(Callback callback)
+{
+    CommCommand cmd = make_command(COMM_CMD_GET_POSITION);
+    return this->submit(cmd, callback);
+}
+
+std::future<CommResponse> TestStandCommAsync::get_temp()
+{
+    CommCommand cmd = make_command(COMM_CMD_GET_TEMP);
+    return this->submit(cmd);
+}
+
+bool TestStandCommAsync::get_temp(Callback callback)
+{
+    CommCommand cmd = make_command(COMM_CMD_GET_TEMP);
+    return this->submit(cmd, callback);
+}
+
+std::future<CommResponse> TestStandCommAsync::get_snapshot()
+{
+    CommCommand cmd = make_command(COMM_CMD_GET_SNAPSHOT);
+    return this->submit(cmd);
+}
+
+bool TestStandCommAsync::get_snapshot(Callback callback)
+{
+    CommCommand cmd = make_command(COMM_CMD_GET_SNAPSHOT);
+    return this->submit(cmd, callback);
+}
+
+/**
+ * @param axis The axis asked about, the reply carries the state of both
+ *             (CommResponse::data.axis_state)
+ */
+std::future<CommResponse> TestStandCommAsync::get_axis_state(AxisId axis)
+{
+    CommCommand cmd = make_command(COMM_CMD_GET_AXIS_STATE);
+    cmd.args.get_axis_state.axis = axis;
+    return this->submit(cmd);
+}
+
+bool TestStandCommAsync::get_axis_state(AxisId axis, Callback callback)
+{
+    CommCommand cmd = make_command(COMM_CMD_GET_AXIS_STATE);
+    cmd.args.get_axis_state.axis = axis;
+    return this->submit(cmd, callback);
+}
+
+std::future<CommResponse> TestStandCommAsync::get_link_stats()
+{
+    CommCommand cmd = make_command(COMM_CMD_GET_LINK_STATS);
+    return this->submit(cmd);
+}
+
+bool TestStandCommAsync::get_link_stats(Callback callback)
+{
+    CommCommand cmd = make_command(COMM_CMD_GET_LINK_STATS);
+    return this->submit(cmd, callback);
+}
+
+/**
+ * @return A COMM_CMD_MOVE command
+ */
+static CommCommand make_move(AxisId axis, AxisDirection dir, uint32_t vel_steps_s, uint32_t dist_counts)
+{
+    CommCommand cmd = make_command(COMM_CMD_MOVE);
+    cmd.args.move.axis = axis;
+    cmd.args.move.dir = dir;
+    cmd.args.move.vel_steps_s = vel_steps_s;
+    cmd.args.move.dist_counts = dist_counts;
+    return cmd;
+}
+
+/**
+ * @brief Moves one axis relative to where it is, @see TestStandCommHost::move
+ *
+ * @param axis        The axis to move
+ * @param dir         The direction to move in
+ * @param vel_steps_s Holding velocity
+ * @param dist_counts Encoder counts to move by
+ */
+std::future<CommResponse> TestStandCommAsync::move(AxisId axis, AxisDirection dir, uint32_t vel_steps_s, uint32_t dist_counts)
+{
+    CommCommand cmd = make_move(axis, dir, vel_steps_s, dist_counts);
+    return this->submit(cmd);
+}
+
+bool TestStandCommAsync::move(AxisId axis, AxisDirection dir, uint32_t vel_steps_s, uint32_t dist_counts, Callback callback)
+{
+    CommCommand cmd = make_move(axis, dir, vel_steps_s, dist_counts);
+    return this->submit(cmd, callback);
+}
+
+/**
+ * @return A COMM_CMD_MOVE_TO command
+ */
+static CommCommand make_move_to(const int32_t *target_counts, const uint32_t *vel_steps_s)
+{
+    CommCommand cmd = make_command(COMM_CMD_MOVE_TO);
+    for (int axis = AXIS_X; axis <= AXIS_Y; axis++) {
+        cmd.args.move_to.target_counts[axis] = target_counts[axis];
+        cmd.args.move_to.vel_steps_s[axis] = vel_steps_s[axis];
+    }
+    return cmd;
+}
+
+/**
+ * @param target_counts Pointer to two absolute encoder positions, indexed by AxisId
+ * @param vel_steps_s   Pointer to two holding velocities, indexed by AxisId
+ */
+std::future<CommResponse> TestStandCommAsync::move_to(const int32_t *target_counts, const uint32_t *vel_steps_s)
+{
+    CommCommand cmd = make_move_to(target_counts, vel_steps_s);
+    return this->submit(cmd);
+}
+
+bool TestStandCommAsync::move_to(const int32_t *target_counts, const uint32_t *vel_steps_s, Callback callback)
+{
+    CommCommand cmd = make_move_to(target_counts, vel_steps_s);
+    return this->submit(cmd, callback);
+}
+
+std::future<CommResponse> TestStandCommAsync::home()
+{
+    CommCommand cmd = make_command(COMM_CMD_HOME);
+    return this->submit(cmd);
+}
+
+bool TestStandCommAsync::home(Callback callback)
+{
+    CommCommand cmd = make_command(COMM_CMD_HOME);
+    return this->submit(cmd, callback);
+}
+
+std::future<CommResponse> TestStandCommAsync::stop()
+{
+    CommCommand cmd = make_command(COMM_CMD_STOP);
+    return this->submit(cmd);
+}
+
+bool TestStandCommAsync::stop(Callback callback)
+{
+    CommCommand cmd = make_command(COMM_CMD_STOP);
+    return this->submit(cmd, callback);
+}
+
+std::future<CommResponse> TestStandCommAsync::calibrate(CalibrationKey key, uint32_t value)
+{
+    CommCommand cmd = make_command(COMM_CMD_CALIBRATE);
+    cmd.args.calibrate.key = key;
+    cmd.args.calibrate.value.u32 = value;
+    return this->submit(cmd);
+}
+
+bool TestStandCommAsync::calibrate(CalibrationKey key, uint32_t value, Callback callback)
+{
+    CommCommand cmd = make_command(COMM_CMD_CALIBRATE);
+    cmd.args.calibrate.key = key;
+    cmd.args.calibrate.value.u32 = value;
+    return this->submit(cmd, callback);
+}
+
+std::future<CommResponse> TestStandCommAsync::calibrate(CalibrationKey key, double value)
+{
+    CommCommand cmd = make_command(COMM_CMD_CALIBRATE);
+    cmd.args.calibrate.key = key;
+    cmd.args.calibrate.value.f64 = value;
+    return this->submit(cmd);
+}
+
+bool TestStandCommAsync::calibrate(CalibrationKey key, double value, Callback callback)
+{
+    CommCommand cmd = make_command(COMM_CMD_CALIBRATE);
+    cmd.args.calibrate.key = key;
+    cmd.args.calibrate.value.f64 = value;
+    return this->submit(cmd, callback);
+}
+
+/**
+ * @brief Asks the device to stream telemetry, @see TestStandCommHost::subscribe_telemetry
+ *
+ * The samples are taken with TestStandCommThread::poll_telemetry().
+ */
+std::future<CommResponse> TestStandCommAsync::subscribe_telemetry(uint16_t rate_hz)
+{
+    CommCommand cmd = make_command(COMM_CMD_SET_TELEMETRY);
+    cmd.args.set_telemetry.rate_hz = rate_hz;
+    return this->submit(cmd);
+}
+
+bool TestStandCommAsync::subscribe_telemetry(uint16_t rate_hz, Callback callback)
+{
+    CommCommand cmd = make_command(COMM_CMD_SET_TELEMETRY);
+    cmd.args.set_telemetry.rate_hz = rate_hz;
+    return this->submit(cmd, callback);
+}
+
+std::future<CommResponse> TestStandCommAsync::unsubscribe_telemetry()
+{
+    return this->subscribe_telemetry(0);
+}
+
+bool TestStandCommAsync::unsubscribe_telemetry(Callback callback)
+{
+    return this->subscribe_telemetry(0, callback);
+}
@@ -0,0 +1,79 @@
+#ifndef TEST_STAND_COMM_ASYNC_H
+#define TEST_STAND_COMM_ASYNC_H
+
+#include "TestStandCommThread.h"
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <future>
+
+/**
+ * @class TestStandCommAsync
+ *
+ * @brief Non-blocking interface to the requests of TestStandCommHost
+ *
+ * Every request is queued for a TestStandCommThread and comes in two forms. One returns a
+ * std::future that the I/O thread fulfils as soon as the request completes, so it can be
+ * waited on from any thread. The other takes a callback, which is run by dispatch() on the
+ * thread that owns this object (e.g. the MIDAS main loop), in the order the requests were
+ * made. Either way the CommResponse carries the SerialResult and the decoded reply.
+ *
+ * If a request cannot be queued its future is fulfilled straight away with SERIAL_ERR_BUSY,
+ * and its callback is not queued (the callback form returns false).
+ */
+class TestStandCommAsync
+{
+    public:
+        typedef std::function<void(const CommResponse& resp)> Callback;
+
+    private:
+        typedef struct {
+            CommCommand cmd;
+            Callback callback;
+        } PendingCallback;
+
+        TestStandCommThread& thread;
+        TestStandCommClient client; //!< Completions of requests that have a callback
+        std::deque<PendingCallback> callbacks;
+
+        std::future<CommResponse> submit(CommCommand& cmd);
+        bool submit(CommCommand& cmd, Callback callback);
+
+    public:
+        TestStandCommAsync(TestStandCommThread& thread);
+
+        uint32_t dispatch();
+
+        std::future<CommResponse> get_status();
+        bool get_status(Callback callback);
+        std::future<CommResponse> get_position();
+        bool get_position(Callback callback);
+        std::future<CommResponse> get_temp();
+        bool get_temp(Callback callback);
+        std::future<CommResponse> get_snapshot();
+        bool get_snapshot(Callback callback);
+        std::future<CommResponse> get_axis_state(AxisId axis);
+        bool get_axis_state(AxisId axis, Callback callback);
+        std::future<CommResponse> get_link_stats();
+        bool get_link_stats(Callback callback);
+        std::future<CommResponse> move(AxisId axis, AxisDirection dir, uint32_t vel_steps_s, uint32_t dist_counts);
+        bool move(AxisId axis, AxisDirection dir, uint32_t vel_steps_s, uint32_t dist_counts, Callback callback);
+        std::future<CommResponse> move_to(const int32_t *target_counts, const uint32_t *vel_steps_s);
+        bool move_to(const int32_t *target_counts, const uint32_t *vel_steps_s, Callback callback);
+        std::future<CommResponse> home();
+        bool home(Callback callback);
+        std::future<CommResponse> stop();
+        bool stop(Callback callback);
+        std::future<CommResponse> calibrate(CalibrationKey key, uint32_t value);
+        bool calibrate(CalibrationKey key, uint32_t value, Callback callback);
+        std::future<CommResponse> calibrate(CalibrationKey key, double value);
+        bool calibrate(CalibrationKey key, double value, Callback callback);
+        std::future<CommResponse> subscribe_telemetry(uint16_t rate_hz);
+        bool subscribe_telemetry(uint16_t rate_hz, Callback callback);
+        std::future<CommResponse> unsubscribe_telemetry();
+        bool unsubscribe_telemetry(Callback callback);
+};
+
+#endif // TEST_STAND_COMM_ASYNC_H
@@ -0,0 +1,448 @@
+#include "TestStandCommThread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+/*****************************************************************************/
+/*                                  CLIENT                                   */
+/*****************************************************************************/
+
+TestStandCommClient::TestStandCommClient(TestStandCommThread& thread) : thread(thread), dropped_count(0) {}
+
+/**
+ * @brief Queues a command for the I/O thread
+ *
+ * @param cmd The command to run (its ticket and handler are filled in)
+ *
+ * @return The command's ticket to pass to wait(), or 0 if the command queue is full
+ */
+uint32_t TestStandCommClient::submit(CommCommand& cmd)
+{
+    return this->thread.submit(cmd, this);
+}
+
+/**
+ * @brief Takes the next completion without waiting
+ *
+ * @return true if there was a completion, it is then stored in resp_out
+ */
+bool TestStandCommClient::poll(CommResponse *resp_out)
+{
+    return this->completed.pop(resp_out);
+}
+
+/**
+ * @brief Waits for a command to complete
+ *
+ * Completions of commands submitted before the one being waited on are discarded, so a
+ * client that wait()s should not also poll().
+ *
+ * @param ticket     The ticket returned by submit()
+ * @param resp_out   Where to store the completion
+ * @param timeout_ms Maximum time (in milliseconds) to wait
+ *
+ * @return true if the command completed, otherwise false
+ */
+bool TestStandCommClient::wait(uint32_t ticket, CommResponse *resp_out, uint32_t timeout_ms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true) {
+        while (this->completed.pop(resp_out)) {
+            if (resp_out->cmd.ticket == ticket) return true;
+        }
+
+        std::unique_lock<std::mutex> lock(this->wait_mutex);
+        if (!this->completed.empty()) continue;
+        if (this->wait_cond.wait_until(lock, deadline) == std::cv_status::timeout
+            && this->completed.empty()) return false;
+    }
+}
+
+/**
+ * @return The number of completions that were dropped because the queue was full
+ */
+uint32_t TestStandCommClient::dropped()
+{
+    return this->dropped_count.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Hands a completion to the client (only called from the I/O thread)
+ */
+void TestStandCommClient::complete(const CommResponse& resp)
+{
+    if (!this->completed.push(resp)) {
+        this->dropped_count.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Taking the lock orders this against a client that is about to sleep
+    { std::lock_guard<std::mutex> lock(this->wait_mutex); }
+    this->wait_cond.notify_one();
+}
+
+/*****************************************************************************/
+/*                                 I/O THREAD                                */
+/*****************************************************************************/
+
+TestStandCommThread::TestStandCommThread(TestStandCommHost& comm)
+    : comm(comm), next_ticket(1), running(false), telemetry_dropped_count(0), log_dropped_count(0) {}
+
+TestStandCommThread::~TestStandCommThread()
+{
+    this->stop();
+}
+
+/**
+ * @brief Starts the I/O thread
+ *
+ * The link should already be connected and negotiated. From now until stop() returns,
+ * the TestStandCommHost must not be used from any other thread.
+ */
+void TestStandCommThread::start()
+{
+    if (this->io_thread.joinable()) return;
+
+    this->comm.set_telemetry_handler(this);
+    this->comm.set_log_handler(this);
+    this->running.store(true, std::memory_order_release);
+    this->io_thread = std::thread(&TestStandCommThread::run, this);
+}
+
+/**
+ * @brief Stops the I/O thread once every command that has been submitted has completed
+ */
+void TestStandCommThread::stop()
+{
+    if (!this->io_thread.joinable()) return;
+
+    this->running.store(false, std::memory_order_release);
+    this->wake();
+    this->io_thread.join();
+    this->comm.set_telemetry_handler(nullptr);
+    this->comm.set_log_handler(nullptr);
+}
+
+/**
+ * @brief Queues a command
+ *
+ * @param cmd     The command to run (its ticket and handler are filled in)
+ * @param handler What to hand the outcome of the command to
+ *
+ * @return The command's ticket, or 0 if the command queue is full
+ */
+uint32_t TestStandCommThread::submit(CommCommand& cmd, CommCompletionHandler *handler)
+{
+    uint32_t ticket;
+    do {
+        ticket = this->next_ticket.fetch_add(1, std::memory_order_relaxed);
+    } while (ticket == 0);
+
+    cmd.ticket = ticket;
+    cmd.handler = handler;
+    if (!this->commands.push(cmd)) return 0;
+
+    this->wake();
+    return ticket;
+}
+
+/**
+ * @brief Takes the oldest telemetry sample that has not been taken yet
+ *
+ * Samples are queued for a single consumer, only one thread may call this.
+ *
+ * @return true if there was a sample, it is then stored in data_out
+ */
+bool TestStandCommThread::poll_telemetry(TelemetryMsgData *data_out)
+{
+    return this->telemetry_samples.pop(data_out);
+}
+
+/**
+ * @return The number of telemetry samples that were dropped because the queue was full
+ */
+uint32_t TestStandCommThread::telemetry_dropped()
+{
+    return this->telemetry_dropped_count.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Queues a telemetry sample (only called from the I/O thread)
+ */
+void TestStandCommThread::telemetry(const TelemetryMsgData& data)
+{
+    if (!this->telemetry_samples.push(data)) {
+        this->telemetry_dropped_count.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Takes the oldest log entry that has not been taken yet
+ *
+ * Like telemetry, entries are queued for a single consumer.
+ *
+ * @return true if there was an entry, it is then stored in entry_out
+ */
+bool TestStandCommThread::poll_log(LogEntry *entry_out)
+{
+    return this->log_entries.pop(entry_out);
+}
+
+/**
+ * @return The number of log entries that were dropped because the queue was full
+ */
+uint32_t TestStandCommThread::log_dropped()
+{
+    return this->log_dropped_count.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Queues a log entry (only called from the I/O thread)
+ */
+void TestStandCommThread::log(const LogEntry& entry)
+{
+    if (!this->log_entries.push(entry)) {
+        this->log_dropped_count.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void TestStandCommThread::wake()
+{
+    // Taking the lock orders this against the I/O thread about to sleep
+    { std::lock_guard<std::mutex> lock(this->wait_mutex); }
+    this->wait_cond.notify_one();
+}
+
+/**
+ * @return The number of entries a command holds in the pending-request table while in flight
+ */
+static uint8_t command_slots(CommCommandId id)
+{
+    switch (id) {
+        case COMM_CMD_GET_STATUS:
+        case COMM_CMD_GET_POSITION:
+        case COMM_CMD_GET_TEMP:
+        case COMM_CMD_GET_SNAPSHOT:
+        case COMM_CMD_GET_AXIS_STATE:
+        case COMM_CMD_GET_LINK_STATS:
+        case COMM_CMD_MOVE:
+        case COMM_CMD_SET_TELEMETRY:
+            return 1;
+        case COMM_CMD_MOVE_TO:
+            return 2;
+        default:
+            // Carried out as soon as they are started
+            return 0;
+    }
+}
+
+/**
+ * @brief Sends a command's requests, or carries out the whole command if nothing comes back
+ */
+void TestStandCommThread::start_command(const CommCommand& cmd, InFlight& op)
+{
+    memset(&op, 0, sizeof(op));
+    op.resp.cmd = cmd;
+
+    SerialResult res = SERIAL_OK;
+    switch (cmd.id) {
+        case COMM_CMD_GET_STATUS:
+            res = this->comm.request_status(&op.txn[0]);
+            op.pending[0] = (res == SERIAL_OK);
+            break;
+        case COMM_CMD_GET_POSITION:
+            res = this->comm.request_position(&op.txn[0]);
+            op.pending[0] = (res == SERIAL_OK);
+            break;
+        case COMM_CMD_GET_TEMP:
+            res = this->comm.request_temp(&op.txn[0]);
+            op.pending[0] = (res == SERIAL_OK);
+            break;
+        case COMM_CMD_GET_SNAPSHOT:
+            res = this->comm.request_snapshot(&op.txn[0]);
+            op.pending[0] = (res == SERIAL_OK);
+            break;
+        case COMM_CMD_GET_AXIS_STATE:
+            res = this->comm.request_axis_state(&op.txn[0]);
+            op.pending[0] = (res == SERIAL_OK);
+            break;
+        case COMM_CMD_GET_LINK_STATS:
+            res = this->comm.request_link_stats(&op.txn[0]);
+            op.pending[0] = (res == SERIAL_OK);
+            break;
+        case COMM_CMD_MOVE:
+            res = this->comm.request_move(cmd.args.move.axis, cmd.args.move.dir, cmd.args.move.vel_steps_s,
+                                          cmd.args.move.dist_counts, &op.txn[0]);
+            op.pending[0] = (res == SERIAL_OK);
+            break;
+        case COMM_CMD_SET_TELEMETRY:
+            res = this->comm.request_telemetry(cmd.args.set_telemetry.rate_hz, &op.txn[0]);
+            op.pending[0] = (res == SERIAL_OK);
+            break;
+        case COMM_CMD_MOVE_TO:
+        {
+            // Moves are relative, so this has to know where the gantry is right now
+            PositionMsgData pos = { 0, 0 };
+            res = this->comm.get_position(&pos, this->comm.reply_timeout());
+            int32_t cur_counts[2] = { pos.x_counts, pos.y_counts };
+
+            for (int axis = AXIS_X; axis <= AXIS_Y; axis++) {
+                op.resp.data.move_to.res[axis] = res;
+                if (res != SERIAL_OK) continue;
+
+                int32_t disp_counts = cmd.args.move_to.target_counts[axis] - cur_counts[axis];
+                AxisDirection dir = (disp_counts < 0 ? AXIS_DIR_NEGATIVE : AXIS_DIR_POSITIVE);
+                SerialResult axis_res = this->comm.request_move((AxisId)axis, dir, cmd.args.move_to.vel_steps_s[axis],
+                                                                abs(disp_counts), &op.txn[axis]);
+                op.resp.data.move_to.res[axis] = axis_res;
+                op.pending[axis] = (axis_res == SERIAL_OK);
+
+                // Only one request can be outstanding on a stop-and-wait link
+                if (op.pending[axis] && this->comm.window_size() == 0) {
+                    op.resp.data.move_to.res[axis] = this->comm.recv_move(op.txn[axis], &op.resp.data.move_to.axis_res[axis],
+                                                                          this->comm.reply_timeout());
+                    op.pending[axis] = false;
+                }
+            }
+            break;
+        }
+        case COMM_CMD_HOME:
+            res = this->comm.home();
+            break;
+        case COMM_CMD_STOP:
+            res = this->comm.stop();
+            break;
+        case COMM_CMD_CALIBRATE:
+            res = this->comm.calibrate(cmd.args.calibrate.key, (void *)&cmd.args.calibrate.value);
+            break;
+    }
+    op.resp.res = res;
+
+    for (int i = 0; i < 2; i++) {
+        if (op.pending[i]) op.slots++;
+    }
+}
+
+/**
+ * @brief Waits for the replies to a command's requests
+ */
+void TestStandCommThread::finish_command(InFlight& op)
+{
+    CommResponse& resp = op.resp;
+    uint32_t timeout_ms = this->comm.reply_timeout();
+
+    switch (resp.cmd.id) {
+        case COMM_CMD_GET_STATUS:
+            if (op.pending[0]) resp.res = this->comm.recv_status(op.txn[0], &resp.data.status, timeout_ms);
+            break;
+        case COMM_CMD_GET_POSITION:
+            if (op.pending[0]) resp.res = this->comm.recv_position(op.txn[0], &resp.data.position, timeout_ms);
+            break;
+        case COMM_CMD_GET_TEMP:
+            if (op.pending[0]) resp.res = this->comm.recv_temp(op.txn[0], &resp.data.temp, timeout_ms);
+            break;
+        case COMM_CMD_GET_SNAPSHOT:
+            if (op.pending[0]) resp.res = this->comm.recv_snapshot(op.txn[0], &resp.data.snapshot, timeout_ms);
+            break;
+        case COMM_CMD_GET_AXIS_STATE:
+            if (op.pending[0]) resp.res = this->comm.recv_axis_state(op.txn[0], &resp.data.axis_state, timeout_ms);
+            break;
+        case COMM_CMD_GET_LINK_STATS:
+            if (op.pending[0]) resp.res = this->comm.recv_link_stats(op.txn[0], &resp.data.link_stats.device, timeout_ms);
+            this->comm.link_stats(&resp.data.link_stats.host);
+            break;
+        case COMM_CMD_SET_TELEMETRY:
+            if (!op.pending[0]) break;
+            resp.res = this->comm.recv_telemetry_rate(op.txn[0], &resp.data.telemetry_rate_hz, timeout_ms);
+            if (resp.res == SERIAL_OK && resp.cmd.args.set_telemetry.rate_hz > 0 && resp.data.telemetry_rate_hz == 0) {
+                resp.res = SERIAL_ERR_REJECTED;
+            }
+            break;
+        case COMM_CMD_MOVE:
+            if (op.pending[0]) resp.res = this->comm.recv_move(op.txn[0], &resp.data.move, timeout_ms);
+            break;
+        case COMM_CMD_MOVE_TO:
+            for (int axis = AXIS_X; axis <= AXIS_Y; axis++) {
+                if (!op.pending[axis]) continue;
+                resp.data.move_to.res[axis] = this->comm.recv_move(op.txn[axis], &resp.data.move_to.axis_res[axis], timeout_ms);
+            }
+            resp.res = resp.data.move_to.res[AXIS_X];
+            if (resp.res == SERIAL_OK) resp.res = resp.data.move_to.res[AXIS_Y];
+            break;
+        default:
+            break;
+    }
+
+    op.pending[0] = false;
+    op.pending[1] = false;
+    op.slots = 0;
+}
+
+/**
+ * @brief Body of the I/O thread
+ *
+ * Starts queued commands until the pending-request table is full, then finishes the oldest
+ * one. Completions are handed back in the order the commands were started. While the device
+ * streams telemetry, the thread wakes up every COMM_TELEMETRY_POLL_MS to take it in, and
+ * otherwise every COMM_LOG_POLL_MS on a windowed link to take in log entries.
+ */
+void TestStandCommThread::run()
+{
+    InFlight in_flight[HOST_PENDING_MAX];
+    uint8_t count = 0; // Commands in in_flight, oldest first
+    uint8_t slots = 0; // Pending-request table entries they hold
+
+    CommCommand next;
+    bool have_next = false;
+
+    while (true) {
+        bool windowed = (this->comm.window_size() > 0);
+
+        while (count < HOST_PENDING_MAX) {
+            if (!have_next) have_next = this->commands.pop(&next);
+            if (!have_next) break;
+
+            // On a stop-and-wait link nothing else can be sent while a reply is outstanding
+            uint8_t need = command_slots(next.id);
+            bool fits = (windowed ? slots + need <= HOST_PENDING_MAX : slots == 0 && need <= 1);
+            if (count > 0 && !fits) break;
+
+            this->start_command(next, in_flight[count]);
+            slots += in_flight[count].slots;
+            count++;
+            have_next = false;
+        }
+
+        if (count == 0) {
+            if (!this->running.load(std::memory_order_acquire)) break;
+
+            // The device only streams telemetry and logs on a windowed link
+            bool streaming = windowed;
+            uint32_t poll_ms = (this->comm.telemetry_rate() > 0 ? COMM_TELEMETRY_POLL_MS : COMM_LOG_POLL_MS);
+            if (streaming) this->comm.poll();
+
+            // Nothing to do, sleep until a command is submitted (or telemetry or logs are due)
+            std::unique_lock<std::mutex> lock(this->wait_mutex);
+            have_next = this->commands.pop(&next);
+            if (!have_next && this->running.load(std::memory_order_acquire)) {
+                if (streaming) {
+                    this->wait_cond.wait_for(lock, std::chrono::milliseconds(poll_ms));
+                }
+                else {
+                    this->wait_cond.wait(lock);
+                }
+            }
+            continue;
+        }
+
+        InFlight& op = in_flight[0];
+        slots -= op.slots;
+        this->finish_command(op);
+        op.resp.cmd.handler->complete(op.resp);
+
+        count--;
+        memmove(&in_flight[0], &in_flight[1], count * sizeof(InFlight));
+    }
+}
@@ -0,0 +1,257 @@
+#ifndef TEST_STAND_COMM_THREAD_H
+#define TEST_STAND_COMM_THREAD_H
+
+#include "TestStandCommHost.h"
+#include "LockFreeQueue.h"
+#include "LinkStats.h"
+
+#include "Gantry.h"
+#include "TemperatureDAQ.h"
+#include "Calibration.h"
+
+#include "shared_defs.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/** Number of commands that can be queued for the I/O thread (must be a power of 2) */
+#ifndef COMM_CMD_QUEUE_SIZE
+#define COMM_CMD_QUEUE_SIZE 64
+#endif // COMM_CMD_QUEUE_SIZE
+
+/** Number of completions that can be waiting for each client (must be a power of 2) */
+#ifndef COMM_CLIENT_QUEUE_SIZE
+#define COMM_CLIENT_QUEUE_SIZE 32
+#endif // COMM_CLIENT_QUEUE_SIZE
+
+/**
+ * Longest a client waits for a completion (milliseconds). The I/O thread times out each
+ * request itself (@see TestStandComm::reply_timeout()), so this only guards against it
+ * being stuck behind a long queue.
+ */
+#ifndef COMM_WAIT_MS
+#define COMM_WAIT_MS 10000
+#endif // COMM_WAIT_MS
+
+/** Number of telemetry samples that can be waiting to be taken (must be a power of 2) */
+#ifndef COMM_TELEMETRY_QUEUE_SIZE
+#define COMM_TELEMETRY_QUEUE_SIZE 256
+#endif // COMM_TELEMETRY_QUEUE_SIZE
+
+/** How often the idle I/O thread takes in telemetry while subscribed (milliseconds) */
+#ifndef COMM_TELEMETRY_POLL_MS
+#define COMM_TELEMETRY_POLL_MS 5
+#endif // COMM_TELEMETRY_POLL_MS
+
+/** Number of log entries that can be waiting to be taken (must be a power of 2) */
+#ifndef COMM_LOG_QUEUE_SIZE
+#define COMM_LOG_QUEUE_SIZE 64
+#endif // COMM_LOG_QUEUE_SIZE
+
+/**
+ * How often the idle I/O thread takes in log entries on a windowed link when it is not
+ * subscribed to telemetry (milliseconds)
+ */
+#ifndef COMM_LOG_POLL_MS
+#define COMM_LOG_POLL_MS 50
+#endif // COMM_LOG_POLL_MS
+
+class CommCompletionHandler;
+
+typedef enum {
+    COMM_CMD_GET_STATUS,
+    COMM_CMD_GET_POSITION,
+    COMM_CMD_GET_TEMP,
+    COMM_CMD_GET_SNAPSHOT,
+    COMM_CMD_GET_AXIS_STATE,
+    COMM_CMD_GET_LINK_STATS,
+    COMM_CMD_MOVE,
+    COMM_CMD_MOVE_TO,
+    COMM_CMD_HOME,
+    COMM_CMD_STOP,
+    COMM_CMD_CALIBRATE,
+    COMM_CMD_SET_TELEMETRY
+} CommCommandId;
+
+/**
+ * @struct CommCommand
+ *
+ * @brief A command for the I/O thread, only the args of the command's ID are used
+ */
+typedef struct {
+    CommCommandId id;
+    uint32_t ticket;                //!< Filled in by TestStandCommThread::submit()
+    CommCompletionHandler *handler; //!< Filled in by TestStandCommThread::submit()
+    union {
+        struct {
+            AxisId axis; //!< The axis asked about (the reply covers both)
+        } get_axis_state;
+        struct {
+            AxisId axis;
+            AxisDirection dir;
+            uint32_t vel_steps_s; //!< Holding velocity
+            uint32_t dist_counts; //!< Encoder counts to move by
+        } move;
+        struct {
+            int32_t target_counts[2]; //!< Absolute encoder position to move to, indexed by AxisId
+            uint32_t vel_steps_s[2];  //!< Holding velocity, indexed by AxisId
+        } move_to;
+        struct {
+            CalibrationKey key;
+            union {
+                uint32_t u32;
+                double f64;
+            } value;
+        } calibrate;
+        struct {
+            uint16_t rate_hz; //!< 0 to unsubscribe
+        } set_telemetry;
+    } args;
+} CommCommand;
+
+/**
+ * @struct CommResponse
+ *
+ * @brief The outcome of a CommCommand, only the data of the command's ID is used (and only
+ *        if res is SERIAL_OK)
+ */
+typedef struct {
+    CommCommand cmd;
+    SerialResult res;
+    union {
+        Status status;
+        PositionMsgData position;
+        TempData temp;
+        Snapshot snapshot;
+        AxisStateData axis_state;
+        uint16_t telemetry_rate_hz; //!< Rate the device streams at (@see TestStandCommHost::subscribe_telemetry)
+        struct {
+            LinkStats device;
+            LinkStats host; //!< Always filled in, even if res is not SERIAL_OK
+        } link_stats;
+        AxisResult move;
+        struct {
+            SerialResult res[2];     //!< Indexed by AxisId
+            AxisResult axis_res[2];  //!< Indexed by AxisId, only valid if res[axis] is SERIAL_OK
+        } move_to;
+    } data;
+} CommResponse;
+
+/**
+ * @class CommCompletionHandler
+ *
+ * @brief Receives the outcome of the commands it was submitted with
+ */
+class CommCompletionHandler
+{
+    public:
+        virtual ~CommCompletionHandler() {}
+
+        /**
+         * @brief Called from the I/O thread when a command completes, so it must not block
+         */
+        virtual void complete(const CommResponse& resp) = 0;
+};
+
+class TestStandCommThread;
+
+/**
+ * @class TestStandCommClient
+ *
+ * @brief A source of commands for a TestStandCommThread with its own queue of completions
+ *
+ * A client belongs to one thread, completions are handed back to it through a lock-free
+ * single-producer / single-consumer queue. Commands from one client complete in the order
+ * they were submitted. Completions that do not fit in the queue are dropped (@see dropped()).
+ */
+class TestStandCommClient : public CommCompletionHandler
+{
+    private:
+        TestStandCommThread& thread;
+        SpscQueue<CommResponse, COMM_CLIENT_QUEUE_SIZE> completed;
+        std::atomic<uint32_t> dropped_count;
+
+        std::mutex wait_mutex;
+        std::condition_variable wait_cond;
+
+    public:
+        TestStandCommClient(TestStandCommThread& thread);
+
+        void complete(const CommResponse& resp);
+
+        uint32_t submit(CommCommand& cmd);
+        bool poll(CommResponse *resp_out);
+        bool wait(uint32_t ticket, CommResponse *resp_out, uint32_t timeout_ms);
+        uint32_t dropped();
+};
+
+/**
+ * @class TestStandCommThread
+ *
+ * @brief Owns a TestStandCommHost and talks to the device from a thread of its own
+ *
+ * Once started, the I/O thread is the only one that touches the serial port. Commands are
+ * submitted through a lock-free multi-producer / single-consumer queue and the I/O thread
+ * starts as many of them as the pending-request table allows (@see HOST_PENDING_MAX), so
+ * commands from different clients are pipelined on a windowed link rather than waiting for
+ * each other. On a stop-and-wait link they are carried out one at a time. The mutexes are
+ * only used to sleep on, never to move commands or completions.
+ *
+ * While the device streams telemetry the I/O thread keeps taking it in between commands,
+ * and the samples are queued for a single consumer (@see poll_telemetry()). The log entries
+ * the device sends on a windowed link are taken in and queued the same way (@see poll_log()).
+ */
+class TestStandCommThread : private TelemetryHandler, private LogHandler
+{
+    private:
+        /** A command that has been started and is waiting to be finished */
+        typedef struct {
+            CommResponse resp;
+            uint8_t txn[2];
+            bool pending[2]; //!< Which txns are still in the pending-request table
+            uint8_t slots;   //!< Entries held in the pending-request table
+        } InFlight;
+
+        TestStandCommHost& comm;
+        MpscQueue<CommCommand, COMM_CMD_QUEUE_SIZE> commands;
+        std::atomic<uint32_t> next_ticket;
+        std::atomic<bool> running;
+        std::thread io_thread;
+
+        std::mutex wait_mutex;
+        std::condition_variable wait_cond;
+
+        SpscQueue<TelemetryMsgData, COMM_TELEMETRY_QUEUE_SIZE> telemetry_samples;
+        std::atomic<uint32_t> telemetry_dropped_count;
+
+        SpscQueue<LogEntry, COMM_LOG_QUEUE_SIZE> log_entries;
+        std::atomic<uint32_t> log_dropped_count;
+
+        void telemetry(const TelemetryMsgData& data);
+        void log(const LogEntry& entry);
+        void run();
+        void start_command(const CommCommand& cmd, InFlight& op);
+        void finish_command(InFlight& op);
+        void wake();
+
+    public:
+        TestStandCommThread(TestStandCommHost& comm);
+        ~TestStandCommThread();
+
+        void start();
+        void stop();
+
+        uint32_t submit(CommCommand& cmd, CommCompletionHandler *handler);
+
+        bool poll_telemetry(TelemetryMsgData *data_out);
+        uint32_t telemetry_dropped();
+
+        bool poll_log(LogEntry *entry_out);
+        uint32_t log_dropped();
+};
+
+#endif // TEST_STAND_COMM_THREAD_H
@@ -0,0 +1,49 @@
+#!/bin/bash
+
+# Exit when any command fails
+set -e
+
+if [ "$#" -lt 1 ]; then
+    echo "usage: $0 [-n <count>] <revision> [revision...]"
+    echo ""
+    echo "    Builds tools/pty_bench/PtyBench against each git revision of the host software"
+    echo "    and runs it over a pseudo-terminal, reporting messages/s, CPU and wall time (us)"
+    echo "    and C library I/O calls per message. For example, to see the effect of a commit:"
+    echo ""
+    echo "        $0 <commit>^ <commit>"
+    echo ""
+    echo "    -n <count> = transactions per test (default 20000)"
+    exit 0
+fi
+
+COUNT=20000
+if [ "$1" == "-n" ]; then
+    COUNT=$2
+    shift 2
+fi
+
+REPO=$(git -C "$(dirname "$0")" rev-parse --show-toplevel)
+BENCH_DIR=$REPO/tools/pty_bench
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 -shared -fPIC -o "$WORK/syscount.so" "$BENCH_DIR/syscount.c" -ldl
+
+for REV in "$@"; do
+    TREE=$WORK/tree
+    rm -rf "$TREE"
+    mkdir -p "$TREE"
+    git -C "$REPO" archive "$REV" shared shared_linux firmware | tar -x -C "$TREE"
+
+    INCS="-I$TREE/shared -I$TREE/shared/TestStandComm -I$TREE/firmware/include"
+    for DIR in "$TREE"/shared_linux/* "$TREE"/firmware/lib/*/include; do
+        INCS="$INCS -I$DIR"
+    done
+    SRCS="$TREE/shared/TestStandComm/*.cxx $TREE/shared_linux/LinuxSerialDevice/LinuxSerialDevice.cxx $TREE/shared_linux/TestStandCommHost/TestStandCommHost.cxx"
+
+    g++ -std=c++11 -O2 -pthread -DPLATFORM_MIDAS $INCS -o "$WORK/PtyBench" "$BENCH_DIR/PtyBench.cxx" $SRCS
+
+    echo "== $(git -C "$REPO" log -1 --format='%h %s' "$REV")"
+    LD_PRELOAD=$WORK/syscount.so "$WORK/PtyBench" "$COUNT"
+    echo ""
+done
@@ -0,0 +1,300 @@
+/**
+ * PtyBench: host side message rate, CPU time and system calls over a pseudo-terminal
+ *
+ * The host end uses LinuxSerialDevice on a pty exactly as on the real port. The stand-in
+ * for the Arduino runs in a child process on a second pty, with a thread copying bytes
+ * between the two, so only the host end is measured (CPU time with getrusage(), calls into
+ * the C library with syscount.so, @see pty_bench.sh). A pty does not pace the data at the
+ * baud rate, so the results show the processing cost per message rather than wire time.
+ *
+ * Only uses the parts of the protocol stack that exist in every revision, so the same
+ * source can be built against older trees to compare them.
+ */
+
+#include "LinuxSerialDevice.h"
+#include "TestStandCommHost.h"
+
+#include "TestStandMessages.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+/*****************************************************************************/
+/*                                  DEFINES                                  */
+/*****************************************************************************/
+
+#define ITEM_COUNT(_a) (sizeof(_a) / sizeof(_a[0]))
+
+/** Time to wait for each reply (ms) */
+#define REPLY_TIMEOUT_MS 1000
+
+/** Transactions per test unless given on the command line */
+#define DEFAULT_COUNT 20000
+
+/*****************************************************************************/
+/*                                  TYPEDEFS                                 */
+/*****************************************************************************/
+
+typedef enum {
+    TEST_STOP,       //!< STOP, ACK back
+    TEST_GET_STATUS, //!< GET_STATUS, ACK and STATUS back, ACK
+    TEST_ECHO,       //!< ECHO of 16 bytes, ACK and ECHOED back, ACK
+    TEST_LINK_CHECK, //!< ECHO of 255 bytes, ACK and ECHOED back, ACK
+    TEST_ACK         //!< ACK frames one way only (nothing comes back)
+} TestType;
+
+/**
+ * @class BenchController
+ *
+ * @brief Stand-in for the Arduino that answers ECHO and GET_STATUS
+ */
+class BenchController : public TestStandComm
+{
+    public:
+        BenchController(SerialDevice& device) : TestStandComm(device) {}
+
+        SerialResult reply_status()
+        {
+            // Copied so any reply fields a revision has (such as the correlation ID) match
+            uint8_t status = 0;
+            Message msg = this->received_message();
+            msg.id = MSG_ID_STATUS;
+            msg.length = sizeof(status);
+            msg.data = &status;
+            return this->session.send_message(msg);
+        }
+};
+
+/*****************************************************************************/
+/*                                  GLOBALS                                  */
+/*****************************************************************************/
+
+/** Filled in by syscount.so when it is preloaded */
+extern "C" void syscount_snapshot(uint64_t *counts, uint32_t count) __attribute__((weak));
+extern "C" const char *syscount_name(uint32_t index) __attribute__((weak));
+
+#define SYSCOUNT_MAX 16
+
+/*****************************************************************************/
+/*                                  HELPERS                                  */
+/*****************************************************************************/
+
+/**
+ * @brief Opens a pty master and returns it (or -1), with the path of its slave in slave_path
+ */
+int open_pty(string& slave_path)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) return -1;
+    slave_path = ptsname(master);
+    return master;
+}
+
+/**
+ * @brief Copies bytes both ways between two pty masters until the process is killed
+ *
+ * Writes do not block, so data nobody reads (replies to the one-way ACK test) is dropped
+ * rather than stalling the other direction. Every write towards the controller is signalled
+ * on wake_fd so the controller can sleep while the link is idle.
+ */
+void bridge(int host_master, int controller_master, int wake_fd)
+{
+    fcntl(host_master, F_SETFL, O_NONBLOCK);
+    fcntl(controller_master, F_SETFL, O_NONBLOCK);
+
+    struct pollfd fds[2] = {
+        { .fd = host_master,       .events = POLLIN, .revents = 0 },
+        { .fd = controller_master, .events = POLLIN, .revents = 0 }
+    };
+    uint8_t buf[4096];
+    while (true) {
+        if (poll(fds, 2, -1) < 0) continue;
+        if (fds[0].revents & POLLIN) {
+            ssize_t n = read(host_master, buf, sizeof(buf));
+            if (n > 0 && write(controller_master, buf, n) > 0) {
+                uint64_t one = 1;
+                if (write(wake_fd, &one, sizeof(one)) < 0) {}
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            ssize_t n = read(controller_master, buf, sizeof(buf));
+            if (n > 0 && write(host_master, buf, n) < 0) {}
+        }
+    }
+}
+
+/**
+ * @brief Runs the stand-in for the Arduino on its own pty (never returns)
+ */
+void run_controller(int host_master)
+{
+    string path;
+    int controller_master = open_pty(path);
+    int wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (controller_master < 0 || wake_fd < 0) exit(1);
+
+    LinuxSerialDevice device;
+    device.set_device_file(path.c_str());
+    if (!device.ser_connect(BAUD_115200)) exit(1);
+    BenchController comm(device);
+
+    thread bridge_thread(bridge, host_master, controller_master, wake_fd);
+    bridge_thread.detach();
+
+    while (true) {
+        if (comm.check_for_message() != SERIAL_OK) {
+            // Sleep until the bridge has passed on more data (a wakeup is never lost, as the
+            // event counter stays set until it is read)
+            struct pollfd fd = { .fd = wake_fd, .events = POLLIN, .revents = 0 };
+            if (poll(&fd, 1, 1) > 0) {
+                uint64_t value;
+                if (read(wake_fd, &value, sizeof(value)) < 0) {}
+            }
+            continue;
+        }
+
+        switch (comm.received_message().id) {
+            case MSG_ID_ECHO:       comm.recv_echo();    break;
+            case MSG_ID_GET_STATUS: comm.reply_status(); break;
+            default:                                     break;
+        }
+    }
+}
+
+const char *test_name(TestType type)
+{
+    switch (type) {
+        case TEST_STOP:       return "stop";
+        case TEST_GET_STATUS: return "get_status";
+        case TEST_ECHO:       return "echo_16";
+        case TEST_LINK_CHECK: return "link_check";
+        default:              return "ack";
+    }
+}
+
+double cpu_seconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+void snapshot(uint64_t *counts)
+{
+    memset(counts, 0, SYSCOUNT_MAX * sizeof(uint64_t));
+    if (syscount_snapshot != nullptr) syscount_snapshot(counts, SYSCOUNT_MAX);
+}
+
+/*****************************************************************************/
+/*                                 BENCHMARKS                                */
+/*****************************************************************************/
+
+bool run_once(TestType type, TestStandCommHost& comm, SerialTransport& transport)
+{
+    static uint8_t data[MSG_DATA_LENGTH_MAX];
+    Status status;
+
+    switch (type) {
+        case TEST_STOP:
+            return (comm.stop() == SERIAL_OK);
+        case TEST_GET_STATUS:
+            return (comm.get_status(&status, REPLY_TIMEOUT_MS) == SERIAL_OK);
+        case TEST_ECHO:
+            if (comm.echo(data, 16) != SERIAL_OK) return false;
+            return (comm.recv_message(MSG_ID_ECHOED, 16, REPLY_TIMEOUT_MS) == SERIAL_OK);
+        case TEST_LINK_CHECK:
+            return (comm.link_check(REPLY_TIMEOUT_MS) == SERIAL_OK);
+        default: {
+            Message ack = { .id = MSG_ID_ACK, .length = 0, .data = nullptr };
+            return transport.send_message(ack);
+        }
+    }
+}
+
+void bench(TestType type, TestStandCommHost& comm, SerialTransport& transport, uint32_t count)
+{
+    uint64_t calls_start[SYSCOUNT_MAX], calls_end[SYSCOUNT_MAX];
+    uint32_t fails = 0;
+
+    snapshot(calls_start);
+    double cpu_start = cpu_seconds();
+    auto start = chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; i++) {
+        if (!run_once(type, comm, transport)) fails++;
+    }
+    double elapsed_s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double cpu_s = cpu_seconds() - cpu_start;
+    snapshot(calls_end);
+
+    printf("%-10s %7u %5u %10.0f %8.2f %8.2f", test_name(type), count, fails,
+           count / elapsed_s, cpu_s * 1e6 / count, elapsed_s * 1e6 / count);
+    if (syscount_snapshot != nullptr) {
+        for (uint32_t i = 0; i < SYSCOUNT_MAX && syscount_name(i) != nullptr; i++) {
+            printf(" %7.2f", (double)(calls_end[i] - calls_start[i]) / count);
+        }
+    }
+    printf("\n");
+}
+
+/*****************************************************************************/
+/*                                    MAIN                                   */
+/*****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+    uint32_t count = (argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 0) : DEFAULT_COUNT);
+    if (count == 0) {
+        printf("\nusage: %s [count]\n\n", argv[0]);
+        return 0;
+    }
+
+    string host_path;
+    int host_master = open_pty(host_path);
+    if (host_master < 0) {
+        fprintf(stderr, "Could not open a pty\n");
+        return 1;
+    }
+
+    pid_t controller = fork();
+    if (controller == 0) run_controller(host_master);
+    close(host_master);
+
+    LinuxSerialDevice device;
+    device.set_device_file(host_path.c_str());
+    if (!device.ser_connect(BAUD_115200)) return 1;
+    TestStandCommHost comm(device);
+    SerialTransport transport(device);
+    this_thread::sleep_for(chrono::milliseconds(200));
+
+    printf("%-10s %7s %5s %10s %8s %8s", "test", "count", "fail", "msgs/s", "cpu us", "wall us");
+    if (syscount_snapshot != nullptr) {
+        for (uint32_t i = 0; i < SYSCOUNT_MAX && syscount_name(i) != nullptr; i++) {
+            printf(" %7s", syscount_name(i));
+        }
+    }
+    printf("\n");
+
+    const TestType tests[] = { TEST_STOP, TEST_GET_STATUS, TEST_ECHO, TEST_LINK_CHECK, TEST_ACK };
+    for (uint32_t t = 0; t < ITEM_COUNT(tests); t++) {
+        bench(tests[t], comm, transport, count);
+    }
+
+    kill(controller, SIGKILL);
+    waitpid(controller, nullptr, 0);
+    return 0;
+}
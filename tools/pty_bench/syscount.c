@@ -0,0 +1,130 @@
+/**
+ * syscount.so: counts the calls a process makes into the C library's serial I/O functions
+ *
+ * Preloaded into PtyBench (LD_PRELOAD), where strace is not available. Every call counted
+ * here enters the kernel, so the counts match what `strace -c` reports for the same calls.
+ * PtyBench reads them with syscount_snapshot().
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/select.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef enum {
+    CALL_READ,       /* reads that returned data */
+    CALL_READ_EMPTY, /* reads that returned nothing (polling an idle port) */
+    CALL_WRITE,
+    CALL_WRITEV,
+    CALL_IOCTL,
+    CALL_POLL,  /* poll, ppoll and select */
+    CALL_SLEEP, /* usleep, nanosleep and clock_nanosleep */
+    CALL_TOTAL,
+    CALL_COUNT
+} CallType;
+
+static const char *call_names[CALL_COUNT] = {
+    "read", "read0", "write", "writev", "ioctl", "poll", "sleep", "total"
+};
+
+static uint64_t counts[CALL_COUNT];
+
+static void count(CallType type)
+{
+    __atomic_add_fetch(&counts[type], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counts[CALL_TOTAL], 1, __ATOMIC_RELAXED);
+}
+
+#define REAL(_name) static __typeof__(&_name) real; if (!real) real = (__typeof__(&_name))dlsym(RTLD_NEXT, #_name)
+
+void syscount_snapshot(uint64_t *out, uint32_t length)
+{
+    for (uint32_t i = 0; i < length && i < CALL_COUNT; i++) {
+        out[i] = __atomic_load_n(&counts[i], __ATOMIC_RELAXED);
+    }
+}
+
+const char *syscount_name(uint32_t index)
+{
+    return (index < CALL_COUNT) ? call_names[index] : 0;
+}
+
+ssize_t read(int fd, void *buf, size_t length)
+{
+    REAL(read);
+    ssize_t result = real(fd, buf, length);
+    count((result > 0) ? CALL_READ : CALL_READ_EMPTY);
+    return result;
+}
+
+ssize_t write(int fd, const void *buf, size_t length)
+{
+    REAL(write);
+    count(CALL_WRITE);
+    return real(fd, buf, length);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    REAL(writev);
+    count(CALL_WRITEV);
+    return real(fd, iov, iovcnt);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    REAL(ioctl);
+    va_list args;
+    va_start(args, request);
+    void *arg = va_arg(args, void *);
+    va_end(args);
+    count(CALL_IOCTL);
+    return real(fd, request, arg);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    REAL(poll);
+    count(CALL_POLL);
+    return real(fds, nfds, timeout);
+}
+
+int ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *timeout, const sigset_t *sigmask)
+{
+    REAL(ppoll);
+    count(CALL_POLL);
+    return real(fds, nfds, timeout, sigmask);
+}
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
+{
+    REAL(select);
+    count(CALL_POLL);
+    return real(nfds, readfds, writefds, exceptfds, timeout);
+}
+
+int usleep(useconds_t usec)
+{
+    REAL(usleep);
+    count(CALL_SLEEP);
+    return real(usec);
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem)
+{
+    REAL(nanosleep);
+    count(CALL_SLEEP);
+    return real(req, rem);
+}
+
+int clock_nanosleep(clockid_t clock, int flags, const struct timespec *req, struct timespec *rem)
+{
+    REAL(clock_nanosleep);
+    count(CALL_SLEEP);
+    return real(clock, flags, req, rem);
+}